@@ -0,0 +1,117 @@
+#include "camera.h"
+
+#include <math.h>
+
+// Rounds towards negative infinity, so cells left of and above the map stay negative.
+static S32 _floor_div(S32 a, S32 b) {
+    S32 result = a / b;
+    if ((a % b != 0) && ((a < 0) != (b < 0))) {
+        result--;
+    }
+    return result;
+}
+
+// Lays one axis of the map out in the window, returning where cell 0 starts. Maps smaller than the
+// window are centered, bigger ones are scrolled to center as near as they can without leaving a gap
+// at either end.
+static S32 _camera_axis_offset(float center, S32 map_cells, S32 cell_size, S32 window_size) {
+    S32 map_size = map_cells * cell_size;
+    if (map_size <= window_size) {
+        return (window_size - map_size) / 2;
+    }
+
+    S32 offset = (S32)(floorf((float)(window_size) / 2.0f - (center + 0.5f) * (float)(cell_size) + 0.5f));
+    if (offset > 0) {
+        offset = 0;
+    }
+    if (offset < window_size - map_size) {
+        offset = window_size - map_size;
+    }
+    return offset;
+}
+
+S32 camera_fit_zoom(S32 map_width,
+                    S32 map_height,
+                    S32 cell_pixel_size,
+                    S32 window_width,
+                    S32 window_height) {
+    if (map_width <= 0 || map_height <= 0) {
+        return 1;
+    }
+
+    S32 scale_x = window_width / (map_width * cell_pixel_size);
+    S32 scale_y = window_height / (map_height * cell_pixel_size);
+    S32 scale = (scale_x < scale_y) ? scale_x : scale_y;
+    if (scale < 1) {
+        return 1;
+    }
+    if (scale > CAMERA_MAX_ZOOM) {
+        return CAMERA_MAX_ZOOM;
+    }
+    return scale;
+}
+
+void camera_zoom(Camera* camera, S32 steps) {
+    camera->zoom += steps;
+    if (camera->zoom < 0) {
+        camera->zoom = 0;
+    }
+    if (camera->zoom > CAMERA_MAX_ZOOM) {
+        camera->zoom = CAMERA_MAX_ZOOM;
+    }
+}
+
+CameraView camera_get_view(const Camera* camera,
+                           S32 map_width,
+                           S32 map_height,
+                           S32 cell_pixel_size,
+                           S32 window_width,
+                           S32 window_height) {
+    CameraView view = {
+        .cells = { 0, 0, -1, -1 },
+        .cell_size = cell_pixel_size,
+    };
+    if (map_width <= 0 || map_height <= 0) {
+        return view;
+    }
+
+    if (camera->zoom > 0) {
+        view.cell_size = cell_pixel_size * camera->zoom;
+    } else {
+        // The whole map at a whole number scale if it fits, otherwise shrunk down to fit.
+        S32 scale = camera_fit_zoom(map_width, map_height, cell_pixel_size, window_width, window_height);
+        view.cell_size = cell_pixel_size * scale;
+        if (map_width * view.cell_size > window_width || map_height * view.cell_size > window_height) {
+            S32 size_x = window_width / map_width;
+            S32 size_y = window_height / map_height;
+            view.cell_size = (size_x < size_y) ? size_x : size_y;
+            if (view.cell_size < 1) {
+                view.cell_size = 1;
+            }
+        }
+    }
+
+    view.offset_x = _camera_axis_offset(camera->center_x, map_width, view.cell_size, window_width);
+    view.offset_y = _camera_axis_offset(camera->center_y, map_height, view.cell_size, window_height);
+
+    camera_view_cell_at(&view, 0, 0, &view.cells.min_x, &view.cells.min_y);
+    camera_view_cell_at(&view, window_width - 1, window_height - 1, &view.cells.max_x, &view.cells.max_y);
+    if (view.cells.min_x < 0) {
+        view.cells.min_x = 0;
+    }
+    if (view.cells.min_y < 0) {
+        view.cells.min_y = 0;
+    }
+    if (view.cells.max_x >= map_width) {
+        view.cells.max_x = map_width - 1;
+    }
+    if (view.cells.max_y >= map_height) {
+        view.cells.max_y = map_height - 1;
+    }
+    return view;
+}
+
+void camera_view_cell_at(const CameraView* view, S32 window_x, S32 window_y, S32* cell_x, S32* cell_y) {
+    *cell_x = _floor_div(window_x - view->offset_x, view->cell_size);
+    *cell_y = _floor_div(window_y - view->offset_y, view->cell_size);
+}
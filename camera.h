@@ -0,0 +1,44 @@
+#ifndef camera_h
+#define camera_h
+
+#include "ints.h"
+#include "spatial.h"
+
+#define CAMERA_MAX_ZOOM 8
+
+// Where the game is looked at from. At zoom 0 the whole map is fit to the window. Otherwise each
+// sprite sheet pixel covers zoom window pixels and the view is centered on center_x, center_y, as
+// far as it can be without showing past the edge of the map.
+typedef struct {
+    S32 zoom;
+    float center_x; // In cells.
+    float center_y;
+} Camera;
+
+// What a camera sees of the map in a window, worked out every frame.
+typedef struct {
+    SpatialRect cells; // Cells at least partly on screen, inclusive. Empty when there is no map.
+    S32 cell_size;     // In window pixels.
+    S32 offset_x;      // Where the top left corner of the map is in the window, can be off screen.
+    S32 offset_y;
+} CameraView;
+
+// The zoom that fits the whole map at a whole number scale, or 1 when it is too big for that.
+S32 camera_fit_zoom(S32 map_width,
+                    S32 map_height,
+                    S32 cell_pixel_size,
+                    S32 window_width,
+                    S32 window_height);
+void camera_zoom(Camera* camera, S32 steps);
+
+CameraView camera_get_view(const Camera* camera,
+                           S32 map_width,
+                           S32 map_height,
+                           S32 cell_pixel_size,
+                           S32 window_width,
+                           S32 window_height);
+
+// The cell under a point in the window, which may be outside the map.
+void camera_view_cell_at(const CameraView* view, S32 window_x, S32 window_y, S32* cell_x, S32* cell_y);
+
+#endif /* camera_h */
@@ -6,11 +6,62 @@ bool dev_mode_should_step(const DevMode *dev_mode) {
     return dev_mode->should_step;
 }
 
-void dev_mode_draw(DevMode* dev_mode, Game* game, PF_Font* font, S32 window_width, S32 cell_size) {
+static void _dev_mode_draw_profiler_row(PF_Font* font,
+                                        S32 y,
+                                        const char* name,
+                                        const TickProfileHistogram* histogram) {
+    U64 average_ns = (histogram->tick_count > 0) ? histogram->total_ns / histogram->tick_count : 0;
+    PF_RenderString(font,
+                    2,
+                    y,
+                    "%-14s %8llu %8llu %8llu %8llu %6u",
+                    name,
+                    (unsigned long long)(average_ns / 1000),
+                    (unsigned long long)(tick_profile_percentile_ns(histogram, 0.5f) / 1000),
+                    (unsigned long long)(tick_profile_percentile_ns(histogram, 0.99f) / 1000),
+                    (unsigned long long)(tick_profile_max_ns(histogram) / 1000),
+                    histogram->total_calls);
+}
+
+static void _dev_mode_draw_profiler(DevMode* dev_mode, PF_Font* font) {
+    PF_FontState font_state = PF_GetState(font);
+    S32 line_height = (S32)((font_state.char_height + 2) * font_state.scale);
+    S32 y = 2 + line_height * 2;
+
+    // Percentiles are the upper bound of the histogram bucket they land in, so only accurate to
+    // within a factor of 2.
+    PF_SetForeground(font, 255, 255, 0, 255);
+    PF_RenderString(font,
+                    2,
+                    y,
+                    "%-14s %8s %8s %8s %8s %6s",
+                    "phase (us)", "avg", "p50", "p99", "max", "calls");
+    y += line_height;
+
+    for (S32 p = 0; p < GAME_PHASE_COUNT; p++) {
+        _dev_mode_draw_profiler_row(font,
+                                    y,
+                                    game_phase_string((GamePhase)(p)),
+                                    dev_mode->tick_profile.histograms + p);
+        y += line_height;
+    }
+    _dev_mode_draw_profiler_row(font,
+                                y,
+                                "tick",
+                                dev_mode->tick_profile.histograms + TICK_PROFILE_TOTAL);
+}
+
+void dev_mode_draw(DevMode* dev_mode,
+                   Game* game,
+                   PF_Font* font,
+                   S32 window_width,
+                   const CameraView* view) {
     if (!dev_mode->enabled) {
         return;
     }
 
+    // One draw for all of it, the segment numbers especially.
+    PF_BeginBatch(font);
     PF_SetForeground(font, 255, 255, 0, 255);
     if (dev_mode->step_mode ) {
         PF_RenderString(font, 2, 2, "Dev Step Mode!");
@@ -22,23 +73,32 @@ void dev_mode_draw(DevMode* dev_mode, Game* game, PF_Font* font, S32 window_widt
         PF_RenderString(font, window_width / 3, 2, "Selected Snake %d", dev_mode->snake_selection_index);
     }
 
+    if (dev_mode->show_profiler) {
+        _dev_mode_draw_profiler(dev_mode, font);
+    }
+
     PF_SetForeground(font, 0, 0, 0, 255);
     PF_FontState font_state = PF_GetState(font);
+    S32 cell_size = view->cell_size;
     for (S32 i = 0; i < MAX_SNAKE_COUNT; i++) {
         Snake *snake = game->snakes + i;
         for (S32 j = 1; j < snake->length; j++) {
             SnakeSegment *segment = snake->segments + j;
+            if (!spatial_rect_contains(view->cells, segment->x, segment->y)) {
+                continue;
+            }
             PF_RenderChar(font,
-                          (S16)((segment->x * cell_size) + (cell_size - (font_state.char_width * font_state.scale)) / 2),
-                          (S16)((segment->y * cell_size) + (cell_size - (font_state.char_height * font_state.scale)) / 2),
+                          (S16)(view->offset_x + (segment->x * cell_size) + (cell_size - (font_state.char_width * font_state.scale)) / 2),
+                          (S16)(view->offset_y + (segment->y * cell_size) + (cell_size - (font_state.char_height * font_state.scale)) / 2),
                           (char)('1' + j));
         }
     }
+    PF_EndBatch(font);
 }
 
 void dev_mode_handle_keystate(DevMode* dev_mode,
                               Game* game,
-                              S32 cell_size,
+                              const CameraView* view,
                               const bool* keyboard_state,
                               UIMouseState* ui_mouse_state) {
     DevModeKeyState current_dev_key_state = {0};
@@ -46,6 +106,7 @@ void dev_mode_handle_keystate(DevMode* dev_mode,
     current_dev_key_state.toggle_step_mode = keyboard_state[SDL_SCANCODE_TAB];
     current_dev_key_state.step_forward = keyboard_state[SDL_SCANCODE_RETURN];
     current_dev_key_state.place_taco = keyboard_state[SDL_SCANCODE_T];
+    current_dev_key_state.toggle_profiler = keyboard_state[SDL_SCANCODE_P];
 
     if (!dev_mode->prev_key_state.toggle_enabled &&
         current_dev_key_state.toggle_enabled) {
@@ -61,6 +122,13 @@ void dev_mode_handle_keystate(DevMode* dev_mode,
             dev_mode->step_mode = !dev_mode->step_mode;
         }
 
+        if (!dev_mode->prev_key_state.toggle_profiler &&
+            current_dev_key_state.toggle_profiler) {
+            dev_mode->show_profiler = !dev_mode->show_profiler;
+            // Start from an empty window rather than whatever was left from last time it was open.
+            dev_mode->tick_profile = (TickProfile){0};
+        }
+
         if (!dev_mode->prev_key_state.step_forward &&
             current_dev_key_state.step_forward) {
             if (dev_mode->step_mode) {
@@ -70,8 +138,9 @@ void dev_mode_handle_keystate(DevMode* dev_mode,
 
         if (!dev_mode->prev_key_state.place_taco &&
             current_dev_key_state.place_taco) {
-            S32 cell_x = (S32)(ui_mouse_state->x) / cell_size;
-            S32 cell_y = (S32)(ui_mouse_state->y) / cell_size;
+            S32 cell_x = 0;
+            S32 cell_y = 0;
+            camera_view_cell_at(view, (S32)(ui_mouse_state->x), (S32)(ui_mouse_state->y), &cell_x, &cell_y);
             if (game_empty_at(game, cell_x, cell_y)) {
                 items_set_cell(&game->items, cell_x, cell_y, ITEM_TYPE_TACO);
             }
@@ -84,14 +153,15 @@ void dev_mode_handle_keystate(DevMode* dev_mode,
 void dev_mode_handle_mouse(DevMode* dev_mode,
                            Game* game,
                            UIMouseState* ui_mouse_state,
-                           S32 cell_size) {
+                           const CameraView* view) {
     if (!dev_mode->enabled) {
         return;
     }
 
     if (ui_mouse_state->left_clicked) {
-        S32 cell_x = (S32)(ui_mouse_state->x) / cell_size;
-        S32 cell_y = (S32)(ui_mouse_state->y) / cell_size;
+        S32 cell_x = 0;
+        S32 cell_y = 0;
+        camera_view_cell_at(view, (S32)(ui_mouse_state->x), (S32)(ui_mouse_state->y), &cell_x, &cell_y);
 
         switch (dev_mode->snake_selection_state) {
         case SNAKE_SELECTION_STATE_NONE: {
@@ -1,8 +1,10 @@
 #ifndef dev_mode_h
 #define dev_mode_h
 
+#include "camera.h"
 #include "game.h"
 #include "pixelfont.h"
+#include "tick_profile.h"
 #include "ui.h"
 
 #include <stdbool.h>
@@ -18,6 +20,7 @@ typedef struct {
     bool toggle_step_mode;
     bool step_forward;
     bool place_taco;
+    bool toggle_profiler;
 } DevModeKeyState;
 
 typedef struct {
@@ -27,18 +30,24 @@ typedef struct {
     DevModeSnakeSelectionState snake_selection_state;
     S32 snake_selection_index;
     DevModeKeyState prev_key_state;
+    bool show_profiler;
+    TickProfile tick_profile;
 } DevMode;
 
 bool dev_mode_should_step(const DevMode *dev_mode);
-void dev_mode_draw(DevMode* dev_mode, Game* game, PF_Font* font, S32 window_width, S32 cell_size);
+void dev_mode_draw(DevMode* dev_mode,
+                   Game* game,
+                   PF_Font* font,
+                   S32 window_width,
+                   const CameraView* view);
 void dev_mode_handle_keystate(DevMode* dev_mode,
                               Game* game,
-                              S32 cell_size,
+                              const CameraView* view,
                               const bool* keyboard_state,
                               UIMouseState* ui_mouse_state);
 void dev_mode_handle_mouse(DevMode* dev_mode,
                            Game* game,
                            UIMouseState* ui_mouse_state,
-                           S32 cell_size);
+                           const CameraView* view);
 
 #endif
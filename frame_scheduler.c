@@ -0,0 +1,55 @@
+#include "frame_scheduler.h"
+
+#include <SDL3/SDL.h>
+
+#define _NS_PER_MS 1000000ull
+
+void frame_scheduler_init(FrameScheduler* scheduler, S32 target_fps) {
+    *scheduler = (FrameScheduler){0};
+    if (target_fps > 0) {
+        scheduler->frame_interval_ns = 1000000000ull / (U64)(target_fps);
+    }
+
+    // Nothing has been drawn yet.
+    scheduler->redraw = true;
+}
+
+void frame_scheduler_invalidate(FrameScheduler* scheduler) {
+    scheduler->redraw = true;
+}
+
+bool frame_scheduler_begin_frame(FrameScheduler* scheduler, U64 now_ns) {
+    if (!scheduler->redraw || now_ns < scheduler->next_frame_ns) {
+        scheduler->skipped_count++;
+        return false;
+    }
+
+    scheduler->redraw = false;
+    scheduler->drawn_count++;
+
+    // Keep to the frame interval on average, unless we fell a whole frame or more behind.
+    scheduler->next_frame_ns += scheduler->frame_interval_ns;
+    if (scheduler->next_frame_ns < now_ns) {
+        scheduler->next_frame_ns = now_ns;
+    }
+    return true;
+}
+
+U64 frame_scheduler_sleep_ns(const FrameScheduler* scheduler, U64 now_ns, U64 next_event_ns) {
+    U64 wake_ns = next_event_ns;
+    if (scheduler->redraw && scheduler->next_frame_ns < wake_ns) {
+        wake_ns = scheduler->next_frame_ns;
+    }
+    return (wake_ns > now_ns) ? wake_ns - now_ns : 0;
+}
+
+void frame_scheduler_wait(const FrameScheduler* scheduler, U64 now_ns, U64 next_event_ns) {
+    U64 sleep_ns = frame_scheduler_sleep_ns(scheduler, now_ns, next_event_ns);
+    if (sleep_ns >= _NS_PER_MS) {
+        // Event waits only go to the millisecond, the rest is slept off next time around.
+        U64 sleep_ms = sleep_ns / _NS_PER_MS;
+        SDL_WaitEventTimeout(NULL, (Sint32)((sleep_ms < SDL_MAX_SINT32) ? sleep_ms : SDL_MAX_SINT32));
+    } else if (sleep_ns > 0) {
+        SDL_DelayPrecise(sleep_ns);
+    }
+}
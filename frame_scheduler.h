@@ -0,0 +1,37 @@
+#ifndef frame_scheduler_h
+#define frame_scheduler_h
+
+#include "ints.h"
+
+#include <stdbool.h>
+
+// Used when vsync isn't available and no frame rate was asked for.
+#define FRAME_SCHEDULER_DEFAULT_FPS 60
+
+// Decides when the main loop draws and how long it can sleep in between. Frames are only drawn when
+// something has called frame_scheduler_invalidate since the last one, and no more often than the
+// target frame rate, or as often as presenting allows with vsync.
+typedef struct {
+    U64 frame_interval_ns; // 0 when presenting waits for vsync instead.
+    U64 next_frame_ns;     // The earliest the next frame can be drawn.
+    bool redraw;           // Something on screen changed since the last frame was drawn.
+    U64 drawn_count;
+    U64 skipped_count;
+} FrameScheduler;
+
+// A target_fps of 0 leaves pacing to vsync.
+void frame_scheduler_init(FrameScheduler* scheduler, S32 target_fps);
+void frame_scheduler_invalidate(FrameScheduler* scheduler);
+
+// Returns whether to draw this time around the loop. If so the redraw is considered done, and the
+// next one won't be allowed until a frame interval from now.
+bool frame_scheduler_begin_frame(FrameScheduler* scheduler, U64 now_ns);
+
+// How long the loop can sleep for: until the next frame if a redraw is waiting for one, otherwise
+// until next_event_ns.
+U64 frame_scheduler_sleep_ns(const FrameScheduler* scheduler, U64 now_ns, U64 next_event_ns);
+
+// Sleeps for frame_scheduler_sleep_ns, waking early for any input or window event.
+void frame_scheduler_wait(const FrameScheduler* scheduler, U64 now_ns, U64 next_event_ns);
+
+#endif /* frame_scheduler_h */
@@ -6,6 +6,7 @@
 //
 
 #include "game.h"
+#include "zone.h"
 
 #include <assert.h>
 #include <stdio.h> // TODO: remove
@@ -227,6 +228,11 @@ void _snake_move(Snake* snake, Game* game) {
                   &new_snake_x,
                   &new_snake_y);
 
+    // Off the edge of the map counts as a wall.
+    if (!IsValidPosition(&game->map, new_snake_x, new_snake_y)) {
+        return;
+    }
+
     ItemType item_type = items_get_cell(&game->items, new_snake_x, new_snake_y);
 
     // TODO: Duplication with _snake_chomp() to figure out.
@@ -284,6 +290,10 @@ bool game_init(Game* game, const char* map_filepath) {
         return false;
     }
 
+    return game_init_loaded_map(game);
+}
+
+bool game_init_loaded_map(Game* game) {
     if (!items_init(&game->items, game->map.width, game->map.height)) {
         return false;
     }
@@ -296,9 +306,25 @@ bool game_init(Game* game, const char* map_filepath) {
     }
 
     game->state = GAME_STATE_WAITING;
+    game->tick = 0;
+    game_seed_random(game, 1);
     return true;
 }
 
+void game_seed_random(Game* game, U32 seed) {
+    // xorshift gets stuck at zero.
+    game->random_state = seed ? seed : 1;
+}
+
+static U32 _game_random(Game* game) {
+    U32 x = game->random_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    game->random_state = x;
+    return x;
+}
+
 void game_clone(Game* input, Game* output) {
     if (input->items.width != output->items.width ||
         input->items.height != output->items.height) {
@@ -333,6 +359,8 @@ void game_clone(Game* input, Game* output) {
 
     output->state = input->state;
     output->settings = input->settings;
+    output->tick = input->tick;
+    output->random_state = input->random_state;
 }
 
 void _snake_turn(Game* game, SnakeAction snake_action, S32 snake_index) {
@@ -452,6 +480,12 @@ MoveResult game_empty_push_result(Game* game, S32 x, S32 y) {
 }
 
 MoveResult _game_object_push_impl(Game* game, PushState* push_state, S32 x, S32 y, Direction direction) {
+    // The edge of the map is as good as a wall, and there's no push state to check past it. Stacked
+    // snake segments have no direction to push in.
+    if (!IsValidPosition(&game->map, x, y) || direction >= DIRECTION_COUNT) {
+        return MOVE_OBJECT_FAIL;
+    }
+
     if (has_been_pushed(push_state, game, x, y, direction)) {
         return MOVE_OBJECT_FAIL;
     }
@@ -1060,8 +1094,11 @@ MoveResult snake_segment_constrict(Game* game, S32 snake_index, S32 segment_inde
     Direction current_direction_to_head = snake_segment_direction_to_head(snake, segment_index);
     Direction next_direction_to_head = snake_segment_direction_to_head(snake, segment_to_move_index);
 
-    assert(current_direction_to_head < DIRECTION_COUNT);
-    assert(next_direction_to_head < DIRECTION_COUNT);
+    // Segments that haven't unfurled since spawning or growing are stacked on top of each other,
+    // and have nowhere to rotate.
+    if (current_direction_to_head >= DIRECTION_COUNT || next_direction_to_head >= DIRECTION_COUNT) {
+        return MOVE_OBJECT_FAIL;
+    }
 
     Direction rotation_direction = (left) ?
         rotate_counter_clockwise(next_direction_to_head) :
@@ -1411,6 +1448,11 @@ bool _kill_checks_has_adjacent_empty(Game* game,
         S32 adjacent_y = y;
         adjacent_cell(d, &adjacent_x, &adjacent_y);
 
+        // Off the edge of the map counts as a wall.
+        if (!IsValidPosition(&game->map, adjacent_x, adjacent_y)) {
+            continue;
+        }
+
         SnakeKillCheck* adjacent_entry = kill_check_entry(game, kill_checks, adjacent_x, adjacent_y);
         if (*current_entry == SNAKE_KILL_CHECK_CELL && *adjacent_entry == SNAKE_KILL_CHECK_CELL) {
             return true;
@@ -1442,7 +1484,24 @@ bool _kill_checks_has_adjacent_empty(Game* game,
     return false;
 }
 
+static U64 _game_start_phase(Game* game) {
+    return game->phase_times != NULL ? SDL_GetTicksNS() : 0;
+}
+
+// Adds the time since phase_start_ns to the phase, and starts timing whatever comes next.
+static void _game_end_phase(Game* game, GamePhase phase, U64* phase_start_ns) {
+    if (game->phase_times == NULL) {
+        return;
+    }
+
+    U64 now_ns = SDL_GetTicksNS();
+    game->phase_times->ns[phase] += now_ns - *phase_start_ns;
+    game->phase_times->calls[phase]++;
+    *phase_start_ns = now_ns;
+}
+
 void snake_constrict(Game* game, S32 snake_index) {
+    ZONE_BEGIN("snake_constrict");
     Snake* snake = game->snakes + snake_index;
     assert(snake->constrict_state != SNAKE_CONSTRICT_STATE_NONE);
 
@@ -1490,6 +1549,7 @@ void snake_constrict(Game* game, S32 snake_index) {
 
         {
             // Check for a kill !
+            U64 phase_start_ns = _game_start_phase(game);
 
             // Reset the board.
             for (S32 i = 0; i < cell_count; i++) {
@@ -1511,6 +1571,7 @@ void snake_constrict(Game* game, S32 snake_index) {
             Direction direction_to_tail = snake_segment_direction_to_tail(snake, original_segment_index);
 
             if (opposite_direction(direction_to_head) != direction_to_tail) {
+                _game_end_phase(game, GAME_PHASE_FLOOD_FILL, &phase_start_ns);
                 continue;
             }
 
@@ -1527,6 +1588,7 @@ void snake_constrict(Game* game, S32 snake_index) {
 
             // Flood fill inside the snake's constriction.
             _flood_fill_kill_checks(game, kill_checks, snake_index, cell_to_fill_x, cell_to_fill_y);
+            _game_end_phase(game, GAME_PHASE_FLOOD_FILL, &phase_start_ns);
 
             // Debug printing.
             // printf("\n");
@@ -1628,16 +1690,23 @@ void snake_constrict(Game* game, S32 snake_index) {
                     snake_should_attempt_to_kill = false;
                 }
             }
+            _game_end_phase(game, GAME_PHASE_KILL_SCAN, &phase_start_ns);
         }
     }
 
     free(adjacent_checks);
     free(kill_checks);
+    ZONE_END();
 }
 
 QueriedObject game_query(Game* game, S32 x, S32 y) {
     QueriedObject result = {0};
 
+    if (!IsValidPosition(&game->map, x, y)) {
+        result.type = QUERIED_OBJECT_TYPE_WALL;
+        return result;
+    }
+
     GID tile_gid = GetMapTile(&game->map, x, y, MAP_SOLID_LAYER);
     if (tile_gid != 0) {
         result.type = QUERIED_OBJECT_TYPE_WALL;
@@ -1667,6 +1736,9 @@ QueriedObject game_query(Game* game, S32 x, S32 y) {
 }
 
 void game_update(Game* game, SnakeAction* snake_actions) {
+    ZONE_BEGIN("game_update");
+    U64 phase_start_ns = _game_start_phase(game);
+
     S32 snakes_alive = 0;
     for (S32 s = 0; s < MAX_SNAKE_COUNT; s++) {
         Snake* snake = game->snakes + s;
@@ -1675,21 +1747,33 @@ void game_update(Game* game, SnakeAction* snake_actions) {
         }
     }
 
+    // Dead snakes keep their old head and direction but nothing they do can matter, and replay
+    // keyframes only store the segments a snake still has.
+    ZONE_BEGIN("turn");
     for (S32 s = 0; s < MAX_SNAKE_COUNT; s++) {
+        if (game->snakes[s].length == 0) {
+            continue;
+        }
         SnakeAction snake_action = snake_actions[s];
         _snake_turn(game, snake_action, s);
     }
+    _game_end_phase(game, GAME_PHASE_TURN, &phase_start_ns);
+    ZONE_END();
 
+    ZONE_BEGIN("chomp");
     for (S32 s = 0; s < MAX_SNAKE_COUNT; s++) {
         if (game->snakes[s].chomp_cooldown > 0) {
             game->snakes[s].chomp_cooldown--;
         }
         SnakeAction snake_action = snake_actions[s];
-        if (snake_action & SNAKE_ACTION_CHOMP) {
+        if ((snake_action & SNAKE_ACTION_CHOMP) && game->snakes[s].length > 0) {
             _snake_chomp(game->snakes + s, game);
         }
     }
+    _game_end_phase(game, GAME_PHASE_CHOMP, &phase_start_ns);
+    ZONE_END();
 
+    ZONE_BEGIN("constrict");
     for (S32 s = 0; s < MAX_SNAKE_COUNT; s++) {
         Snake* snake = game->snakes + s;
         snake->constrict_state = SNAKE_CONSTRICT_STATE_NONE;
@@ -1717,7 +1801,10 @@ void game_update(Game* game, SnakeAction* snake_actions) {
             snake_constrict(game, s);
         }
     }
+    _game_end_phase(game, GAME_PHASE_CONSTRICT, &phase_start_ns);
+    ZONE_END();
 
+    ZONE_BEGIN("move");
     for (S32 s = 0; s < MAX_SNAKE_COUNT; s++) {
         Snake* snake = game->snakes + s;
         // Only allow movement if we aren't constricting.
@@ -1725,17 +1812,25 @@ void game_update(Game* game, SnakeAction* snake_actions) {
             _snake_move(game->snakes + s, game);
         }
     }
+    _game_end_phase(game, GAME_PHASE_MOVE, &phase_start_ns);
+    ZONE_END();
 
+    ZONE_BEGIN("tacos");
     S32 taco_count = game_count_tacos(game);
     if ((game->settings.zero_tacos_respawn && taco_count == 0) || !game->settings.zero_tacos_respawn) {
         for (size_t i = taco_count; i < (size_t)game->settings.taco_count; i++) {
             game_spawn_taco(game);
         }
     }
+    _game_end_phase(game, GAME_PHASE_TACOS, &phase_start_ns);
+    ZONE_END();
 
     if (snakes_alive == 1) {
         game->state = GAME_STATE_GAME_OVER;
     }
+
+    game->tick++;
+    ZONE_END();
 }
 
 void game_destroy(Game* game) {
@@ -1745,12 +1840,34 @@ void game_destroy(Game* game) {
     }
 }
 
+const char* game_phase_string(GamePhase phase) {
+    switch (phase) {
+    case GAME_PHASE_TURN:
+        return "turn";
+    case GAME_PHASE_CHOMP:
+        return "chomp";
+    case GAME_PHASE_CONSTRICT:
+        return "constrict";
+    case GAME_PHASE_MOVE:
+        return "move";
+    case GAME_PHASE_TACOS:
+        return "tacos";
+    case GAME_PHASE_FLOOD_FILL:
+        return "flood_fill";
+    case GAME_PHASE_KILL_SCAN:
+        return "kill_scan";
+    default:
+        break;
+    }
+    return "unknown";
+}
+
 void game_spawn_taco(Game* game) {
     // If there are no tacos on the map, generate one in an empty cell.
     int32_t attempts = 0;
     while (attempts < 10) {
-        int taco_x = (int)(rand() % game->map.width);
-        int taco_y = (int)(rand() % game->map.height);
+        int taco_x = (int)(_game_random(game) % game->map.width);
+        int taco_y = (int)(_game_random(game) % game->map.height);
 
         ItemType item_type = items_get_cell(&game->items, taco_x, taco_y);
         if (item_type == ITEM_TYPE_TACO) {
@@ -1803,11 +1920,54 @@ S32 game_count_tacos(Game* game) {
     return taco_count;
 }
 
+static U64 _hash_bytes(U64 hash, const void* data, size_t size) {
+    // FNV-1a
+    const U8* bytes = data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+U64 game_hash(const Game* game) {
+    U64 hash = 0xcbf29ce484222325ULL;
+    hash = _hash_bytes(hash, &game->tick, sizeof(game->tick));
+    hash = _hash_bytes(hash, &game->state, sizeof(game->state));
+    hash = _hash_bytes(hash, &game->random_state, sizeof(game->random_state));
+    hash = _hash_bytes(hash,
+                       game->items.cells,
+                       game->items.width * game->items.height * sizeof(*game->items.cells));
+
+    for (S32 s = 0; s < MAX_SNAKE_COUNT; s++) {
+        const Snake* snake = game->snakes + s;
+        hash = _hash_bytes(hash, &snake->length, sizeof(snake->length));
+        hash = _hash_bytes(hash, &snake->direction, sizeof(snake->direction));
+        hash = _hash_bytes(hash, &snake->chomp_cooldown, sizeof(snake->chomp_cooldown));
+        hash = _hash_bytes(hash, &snake->kill_damage_cooldown, sizeof(snake->kill_damage_cooldown));
+        hash = _hash_bytes(hash, &snake->life_state, sizeof(snake->life_state));
+        hash = _hash_bytes(hash, &snake->constrict_state, sizeof(snake->constrict_state));
+        // Field by field, the padding in SnakeSegment isn't necessarily the same.
+        for (S32 e = 0; e < snake->length; e++) {
+            hash = _hash_bytes(hash, &snake->segments[e].x, sizeof(snake->segments[e].x));
+            hash = _hash_bytes(hash, &snake->segments[e].y, sizeof(snake->segments[e].y));
+            hash = _hash_bytes(hash, &snake->segments[e].health, sizeof(snake->segments[e].health));
+        }
+    }
+
+    return hash;
+}
+
 size_t game_serialize(const Game* game, void* buffer, size_t buffer_size)
 {
     U8 * byte_buffer = buffer;
 
-    size_t msg_size = sizeof(game->state);
+    // The tick goes first so it can be read without deserializing the rest of the state.
+    size_t msg_size = sizeof(game->tick);
+    memcpy(byte_buffer, &game->tick, msg_size);
+    byte_buffer += msg_size;
+
+    msg_size = sizeof(game->state);
     memcpy(byte_buffer, &game->state, msg_size);
     byte_buffer += msg_size;
 
@@ -1835,7 +1995,11 @@ size_t game_deserialize(void * buffer, size_t size, Game * out)
 {
     U8 * byte_buffer = buffer;
 
-    size_t msg_size = sizeof(out->state);
+    size_t msg_size = sizeof(out->tick);
+    memcpy(&out->tick, byte_buffer, msg_size);
+    byte_buffer += msg_size;
+
+    msg_size = sizeof(out->state);
     memcpy(&out->state, byte_buffer, msg_size);
     byte_buffer += msg_size;
 
@@ -1859,3 +2023,256 @@ size_t game_deserialize(void * buffer, size_t size, Game * out)
 
     return byte_buffer - (U8*)buffer;
 }
+
+static bool _snake_overlaps_rect(const Snake* snake, SpatialRect rect) {
+    for (S32 i = 0; i < snake->length; i++) {
+        if (spatial_rect_contains(rect, snake->segments[i].x, snake->segments[i].y)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Returns NULL if the tacos don't all fit before end.
+static U8* _serialize_tacos(const SpatialGrid* tacos, SpatialRect rect, bool inside, U8* ptr, U8* end) {
+    if ((size_t)(end - ptr) < sizeof(S32)) {
+        return NULL;
+    }
+
+    S32 max_count = (S32)((end - ptr - sizeof(S32)) / sizeof(SpatialPoint));
+    SpatialPoint* points = (SpatialPoint*)(ptr + sizeof(S32));
+
+    S32 count = inside ? spatial_grid_query_rect(tacos, rect, points, max_count) :
+                         spatial_grid_query_outside_rect(tacos, rect, points, max_count);
+    if (count > max_count) {
+        return NULL;
+    }
+
+    memcpy(ptr, &count, sizeof(count));
+    return ptr + sizeof(count) + count * sizeof(SpatialPoint);
+}
+
+static bool _read_interest(U8** ptr, const U8* end, void* out, size_t size) {
+    if ((size_t)(end - *ptr) < size) {
+        return false;
+    }
+    memcpy(out, *ptr, size);
+    *ptr += size;
+    return true;
+}
+
+// Empties the cells of the tacos inside or outside rect. Points are walked from the back of each
+// bucket, and buckets from the back of the occupied list, since removing one swaps the last into
+// its place.
+static void _clear_tacos(Items* items, SpatialRect rect, bool inside) {
+    SpatialGrid* tacos = &items->tacos;
+    if (inside) {
+        SpatialRect buckets = spatial_grid_bucket_rect(tacos, rect);
+        for (S32 by = buckets.min_y; by <= buckets.max_y; by++) {
+            for (S32 bx = buckets.min_x; bx <= buckets.max_x; bx++) {
+                SpatialBucket* bucket = tacos->buckets + (by * tacos->width + bx);
+                for (S32 p = bucket->count - 1; p >= 0; p--) {
+                    SpatialPoint point = bucket->points[p];
+                    if (spatial_rect_contains(rect, point.x, point.y)) {
+                        items_set_cell(items, point.x, point.y, ITEM_TYPE_EMPTY);
+                    }
+                }
+            }
+        }
+        return;
+    }
+
+    for (S32 o = tacos->occupied_count - 1; o >= 0; o--) {
+        SpatialBucket* bucket = tacos->buckets + tacos->occupied[o];
+        for (S32 p = bucket->count - 1; p >= 0; p--) {
+            SpatialPoint point = bucket->points[p];
+            if (!spatial_rect_contains(rect, point.x, point.y)) {
+                items_set_cell(items, point.x, point.y, ITEM_TYPE_EMPTY);
+            }
+        }
+    }
+}
+
+// Replaces the tacos inside or outside rect with the serialized ones, if they were sent. Returns
+// false if the count doesn't fit in what's left of the buffer or the level.
+static bool _deserialize_tacos(Items* items, SpatialRect rect, bool inside, U8** ptr, const U8* end) {
+    S32 count = 0;
+    if (!_read_interest(ptr, end, &count, sizeof(count))) {
+        return false;
+    }
+
+    if (count < 0) {
+        return true;
+    }
+
+    if ((size_t)count > (size_t)(end - *ptr) / sizeof(SpatialPoint) ||
+        count > items->width * items->height) {
+        return false;
+    }
+
+    _clear_tacos(items, rect, inside);
+
+    for (S32 i = 0; i < count; i++) {
+        SpatialPoint point = {0};
+        _read_interest(ptr, end, &point, sizeof(point));
+        items_set_cell(items, point.x, point.y, ITEM_TYPE_TACO);
+    }
+
+    return true;
+}
+
+size_t game_serialize_interest(const Game* game,
+                               S32 snake_index,
+                               S32 radius,
+                               void* buffer,
+                               size_t buffer_size)
+{
+    U8* byte_buffer = buffer;
+    U8* end = byte_buffer + buffer_size;
+
+    size_t header_size = sizeof(game->tick) +
+                         sizeof(game->state) +
+                         sizeof(game->settings.wait_to_start_ms) +
+                         sizeof(game->items.width) +
+                         sizeof(game->items.height) +
+                         sizeof(SpatialRect);
+    if (buffer_size < header_size) {
+        return 0;
+    }
+
+    // Same leading fields as game_serialize.
+    memcpy(byte_buffer, &game->tick, sizeof(game->tick));
+    byte_buffer += sizeof(game->tick);
+
+    memcpy(byte_buffer, &game->state, sizeof(game->state));
+    byte_buffer += sizeof(game->state);
+
+    memcpy(byte_buffer, &game->settings.wait_to_start_ms, sizeof(game->settings.wait_to_start_ms));
+    byte_buffer += sizeof(game->settings.wait_to_start_ms);
+
+    memcpy(byte_buffer, &game->items.width, sizeof(game->items.width));
+    byte_buffer += sizeof(game->items.width);
+
+    memcpy(byte_buffer, &game->items.height, sizeof(game->items.height));
+    byte_buffer += sizeof(game->items.height);
+
+    const Snake* snake = game->snakes + snake_index;
+    assert(snake->length > 0 && "interest needs a live snake!");
+
+    SpatialRect view = {
+        .min_x = snake->segments[0].x - radius,
+        .min_y = snake->segments[0].y - radius,
+        .max_x = snake->segments[0].x + radius,
+        .max_y = snake->segments[0].y + radius,
+    };
+
+    memcpy(byte_buffer, &view, sizeof(view));
+    byte_buffer += sizeof(view);
+
+    byte_buffer = _serialize_tacos(&game->items.tacos, view, true, byte_buffer, end);
+    if (byte_buffer == NULL) {
+        return 0;
+    }
+
+    // The distant tacos are left out on most ticks, marked by a count of -1.
+    bool far = (game->tick % INTEREST_FAR_INTERVAL_TICKS) == 0;
+    if (far) {
+        byte_buffer = _serialize_tacos(&game->items.tacos, view, false, byte_buffer, end);
+        if (byte_buffer == NULL) {
+            return 0;
+        }
+    } else {
+        S32 no_tacos = -1;
+        if ((size_t)(end - byte_buffer) < sizeof(no_tacos)) {
+            return 0;
+        }
+        memcpy(byte_buffer, &no_tacos, sizeof(no_tacos));
+        byte_buffer += sizeof(no_tacos);
+    }
+
+    for (S32 s = 0; s < MAX_SNAKE_COUNT; s++) {
+        const Snake* other = game->snakes + s;
+        U8 included = far || s == snake_index || _snake_overlaps_rect(other, view);
+        size_t snake_size = included ? snake_serialized_size(other->length) : 0;
+        if ((size_t)(end - byte_buffer) < sizeof(included) + snake_size) {
+            return 0;
+        }
+
+        *byte_buffer = included;
+        byte_buffer += sizeof(included);
+
+        if (included) {
+            byte_buffer += snake_serialize(other, byte_buffer, end - byte_buffer);
+        }
+    }
+
+    return byte_buffer - (U8*)buffer;
+}
+
+size_t game_deserialize_interest(void* buffer, size_t size, Game* out)
+{
+    U8* byte_buffer = buffer;
+    const U8* end = byte_buffer + size;
+
+    U32 tick = 0;
+    GameState state = GAME_STATE_WAITING;
+    S32 wait_to_start_ms = 0;
+    S32 width = 0;
+    S32 height = 0;
+    SpatialRect view = {0};
+    bool valid = _read_interest(&byte_buffer, end, &tick, sizeof(tick)) &&
+                 _read_interest(&byte_buffer, end, &state, sizeof(state)) &&
+                 _read_interest(&byte_buffer, end, &wait_to_start_ms, sizeof(wait_to_start_ms)) &&
+                 _read_interest(&byte_buffer, end, &width, sizeof(width)) &&
+                 _read_interest(&byte_buffer, end, &height, sizeof(height)) &&
+                 _read_interest(&byte_buffer, end, &view, sizeof(view));
+    // Cells are addressed with S16s.
+    if (!valid || width <= 0 || height <= 0 || width > INT16_MAX || height > INT16_MAX) {
+        return 0;
+    }
+
+    out->tick = tick;
+    out->state = state;
+    out->settings.wait_to_start_ms = wait_to_start_ms;
+
+    if (out->items.width != width || out->items.height != height) {
+        items_destroy(&out->items);
+        if (!items_init(&out->items, width, height)) {
+            return 0;
+        }
+    }
+
+    // Tacos eaten in the part of the last view that is now outside this one are only cleared by the
+    // next far update, at most INTEREST_FAR_INTERVAL_TICKS ticks later, like any other far taco.
+    if (!_deserialize_tacos(&out->items, view, true, &byte_buffer, end) ||
+        !_deserialize_tacos(&out->items, view, false, &byte_buffer, end)) {
+        return 0;
+    }
+
+    // Snakes that weren't included stay where they were last seen.
+    for (S32 s = 0; s < MAX_SNAKE_COUNT; s++) {
+        U8 included = 0;
+        if (!_read_interest(&byte_buffer, end, &included, sizeof(included))) {
+            return 0;
+        }
+
+        if (included) {
+            S32 length = 0;
+            if ((size_t)(end - byte_buffer) < sizeof(length)) {
+                return 0;
+            }
+            memcpy(&length, byte_buffer, sizeof(length));
+            if (length < 0 ||
+                length > width * height ||
+                (size_t)(end - byte_buffer) < snake_serialized_size(length)) {
+                return 0;
+            }
+
+            byte_buffer += snake_deserialize(byte_buffer,
+                                             end - byte_buffer,
+                                             &out->snakes[s]);
+        }
+    }
+
+    return byte_buffer - (U8*)buffer;
+}
@@ -21,6 +21,10 @@
 #define MAP_SOLID_LAYER 1
 #define MAX_SNAKE_COUNT 4
 
+// With area of interest filtering, tacos and snakes away from a client's snake are only sent on
+// every nth tick.
+#define INTEREST_FAR_INTERVAL_TICKS 4
+
 typedef enum {
     GAME_STATE_WAITING,
     GAME_STATE_PLAYING,
@@ -65,12 +69,33 @@ typedef struct {
     S32 wait_to_start_ms;
 } GameSettings;
 
+// The parts of game_update, in the order they run. The flood fill and kill scan are timed within
+// GAME_PHASE_CONSTRICT, rather than running after it.
+typedef enum {
+    GAME_PHASE_TURN,
+    GAME_PHASE_CHOMP,
+    GAME_PHASE_CONSTRICT,
+    GAME_PHASE_MOVE,
+    GAME_PHASE_TACOS,
+    GAME_PHASE_FLOOD_FILL,
+    GAME_PHASE_KILL_SCAN,
+    GAME_PHASE_COUNT,
+} GamePhase;
+
+typedef struct {
+    U64 ns[GAME_PHASE_COUNT];
+    U32 calls[GAME_PHASE_COUNT];
+} GamePhaseTimes;
+
 typedef struct {
     Map map;
     Items items;
     Snake snakes[MAX_SNAKE_COUNT];
     GameState state;
     GameSettings settings;
+    U32 tick; // Number of updates simulated since the game started.
+    U32 random_state; // Everything random in game_update comes from here, so replays match.
+    GamePhaseTimes* phase_times; // When set, game_update adds up the time and calls of each phase.
 } Game;
 
 typedef enum {
@@ -81,6 +106,9 @@ typedef enum {
 } MoveResult;
 
 bool game_init(Game* game, const char* map_filepath);
+// Same as game_init for a map that has already been loaded into game->map.
+bool game_init_loaded_map(Game* game);
+void game_seed_random(Game* game, U32 seed);
 void game_clone(Game* input, Game* output);
 void game_apply_snake_action(Game* game, SnakeAction snake_action, S32 snake_index);
 QueriedObject game_query(Game* game, S32 x, S32 y);
@@ -89,12 +117,28 @@ S32 game_query_for_snake_at(Game* game, S32 x, S32 y);
 void game_update(Game* game, SnakeAction* snake_actions);
 void game_destroy(Game* game);
 
+const char* game_phase_string(GamePhase phase);
+
 void game_spawn_taco(Game* game);
 S32 game_count_tacos(Game* game);
 
+// Hash of everything game_update depends on, to check two simulations ended up the same.
+U64 game_hash(const Game* game);
+
 size_t game_serialize(const Game* game, void* buffer, size_t buffer_size);
 size_t game_deserialize(void * buffer, size_t size, Game * out);
 
+// Serializes the cells within radius of the snake's head in full, and everything else only every
+// INTEREST_FAR_INTERVAL_TICKS ticks. The snake must be alive. Returns 0 if it doesn't fit in the
+// buffer. Deserializing applies the update on top of the last state received, so out must already
+// hold it, and returns 0 if the buffer is cut off or corrupt.
+size_t game_serialize_interest(const Game* game,
+                               S32 snake_index,
+                               S32 radius,
+                               void* buffer,
+                               size_t buffer_size);
+size_t game_deserialize_interest(void* buffer, size_t size, Game* out);
+
 void snake_constrict(Game* game, S32 snake_index);
 
 MoveResult snake_segment_push(Game* game, PushState* push_state, S32 snake_index, S32 segment_index, Direction direction);
@@ -23,16 +23,30 @@ bool items_init(Items* items, int32_t width, int32_t height) {
     items->width = width;
     items->height = height;
 
-    return true;
+    return spatial_grid_init(&items->tacos, width, height);
 }
 
 void items_destroy(Items* items) {
     if (items->cells != NULL) {
         free(items->cells);
+        spatial_grid_destroy(&items->tacos);
         memset(items, 0, sizeof(*items));
     }
 }
 
+static void _items_rebuild_taco_index(Items* items) {
+    spatial_grid_destroy(&items->tacos);
+    spatial_grid_init(&items->tacos, items->width, items->height);
+
+    for (S32 y = 0; y < items->height; y++) {
+        for (S32 x = 0; x < items->width; x++) {
+            if (items->cells[y * items->width + x] == ITEM_TYPE_TACO) {
+                spatial_grid_insert(&items->tacos, x, y);
+            }
+        }
+    }
+}
+
 int32_t items_get_cell_index(Items* items, S32 x, S32 y) {
     return y * items->width + x;
 }
@@ -47,6 +61,12 @@ bool items_set_cell(Items* items, S32 x, S32 y, ItemType value) {
     }
 
     int32_t index = items_get_cell_index(items, x, y);
+    if (items->cells[index] == ITEM_TYPE_TACO && value != ITEM_TYPE_TACO) {
+        spatial_grid_remove(&items->tacos, x, y);
+    } else if (items->cells[index] != ITEM_TYPE_TACO && value == ITEM_TYPE_TACO) {
+        spatial_grid_insert(&items->tacos, x, y);
+    }
+
     items->cells[index] = value;
     return true;
 }
@@ -118,5 +138,7 @@ size_t items_deserialize(void * buffer, size_t size, Items * out) {
     ptr += cells_size;
     size -= cells_size;
 
+    _items_rebuild_taco_index(out);
+
     return ptr - (U8 *)buffer;
 }
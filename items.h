@@ -12,6 +12,7 @@
 #include <stdbool.h>
 
 #include "ints.h"
+#include "spatial.h"
 
 typedef S8 ItemType;
 enum {
@@ -24,6 +25,7 @@ typedef struct {
     ItemType* cells;
     S32 width;
     S32 height;
+    SpatialGrid tacos; // Where every taco is, kept up to date by items_set_cell.
 } Items;
 
 bool items_init(Items* items, S32 width, S32 height);
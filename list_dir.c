@@ -4,10 +4,20 @@
     #include <fileapi.h>
     #include <handleapi.h>
 #define WINDOWS_MAP_SUFFIX_MATCHER "*.temap"
+#else
+    #include <dirent.h>
+#define _strdup strdup
 #endif
 
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
+
+static U32 _list_dir_last_generation = 0;
+
+void list_dir_changed(ListDir* list_dir) {
+    list_dir->generation = ++_list_dir_last_generation;
+}
 
 bool list_dir_insert(ListDir* list_dir, const char* file_name) {
     S32 new_count = list_dir->file_count + 1;
@@ -20,6 +30,7 @@ bool list_dir_insert(ListDir* list_dir, const char* file_name) {
     list_dir->file_names = reallocation;
     list_dir->file_names[list_dir->file_count] = _strdup(file_name);
     list_dir->file_count = new_count;
+    list_dir_changed(list_dir);
     return true;
 }
 
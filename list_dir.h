@@ -12,9 +12,12 @@
 typedef struct {
     char** file_names;
     S32 file_count;
+    U32 generation; // Changes whenever file_names does, never goes back to an earlier value.
 } ListDir;
 
 bool list_dir_insert(ListDir* list_dir, const char* file_name);
+// Gives list_dir a new generation, for when its file names were changed from outside.
+void list_dir_changed(ListDir* list_dir);
 void list_dir_destroy(ListDir* list_dir);
 
 #if defined(PLATFORM_WINDOWS)
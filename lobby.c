@@ -93,9 +93,37 @@ size_t lobby_state_serialize(AppStateLobby* lobby_state,
     bytes_written += sizeof(lobby_state->selected_map);
     buffer_ptr += sizeof(lobby_state->selected_map);
 
+    memcpy(buffer_ptr, &lobby_state->map_hash, sizeof(lobby_state->map_hash));
+    bytes_written += sizeof(lobby_state->map_hash);
+    buffer_ptr += sizeof(lobby_state->map_hash);
+
+    memcpy(buffer_ptr, &lobby_state->map_size, sizeof(lobby_state->map_size));
+    bytes_written += sizeof(lobby_state->map_size);
+    buffer_ptr += sizeof(lobby_state->map_size);
+
     return bytes_written;
 }
 
+// Whether the file_count serialized file names at buffer are the ones already in map_list.
+static bool _lobby_map_list_matches(const ListDir* map_list, const U8* buffer, S32 file_count) {
+    if (file_count != map_list->file_count) {
+        return false;
+    }
+
+    for (S32 i = 0; i < file_count; i++) {
+        S32 file_name_len = 0;
+        memcpy(&file_name_len, buffer, sizeof(file_name_len));
+        buffer += sizeof(file_name_len);
+
+        if ((S32)(strlen(map_list->file_names[i])) != file_name_len ||
+            memcmp(map_list->file_names[i], buffer, file_name_len) != 0) {
+            return false;
+        }
+        buffer += file_name_len;
+    }
+    return true;
+}
+
 size_t lobby_state_deserialize(void* buffer,
                                size_t buffer_size,
                                AppStateLobby* lobby_state,
@@ -123,39 +151,58 @@ size_t lobby_state_deserialize(void* buffer,
     bytes_read += sizeof(*game_settings);
     buffer_ptr += sizeof(*game_settings);
 
-    if (lobby_state->map_list.file_count > 0) {
-        for (S32 i = 0; i < lobby_state->map_list.file_count; i++) {
-            free(lobby_state->map_list.file_names[i]);
-        }
-        free(lobby_state->map_list.file_names);
-    }
-
     S32 file_count = 0;
     memcpy(&file_count, buffer_ptr, sizeof(file_count));
     bytes_read += sizeof(file_count);
     buffer_ptr += sizeof(file_count);
 
-    lobby_state->map_list.file_count = file_count;
-    lobby_state->map_list.file_names = malloc(file_count * sizeof(char*));
+    // The list rarely changes, so keep the one we have (and its generation) when it's the same.
+    if (_lobby_map_list_matches(&lobby_state->map_list, buffer_ptr, file_count)) {
+        for (S32 i = 0; i < file_count; i++) {
+            S32 file_name_len = 0;
+            memcpy(&file_name_len, buffer_ptr, sizeof(file_name_len));
+            bytes_read += sizeof(file_name_len) + file_name_len;
+            buffer_ptr += sizeof(file_name_len) + file_name_len;
+        }
+    } else {
+        if (lobby_state->map_list.file_count > 0) {
+            for (S32 i = 0; i < lobby_state->map_list.file_count; i++) {
+                free(lobby_state->map_list.file_names[i]);
+            }
+            free(lobby_state->map_list.file_names);
+        }
 
-    for (S32 i = 0; i < lobby_state->map_list.file_count; i++) {
-        S32 file_name_len = 0;
-        memcpy(&file_name_len, buffer_ptr, sizeof(file_name_len));
-        bytes_read += sizeof(file_name_len);
-        buffer_ptr += sizeof(file_name_len);
+        lobby_state->map_list.file_count = file_count;
+        lobby_state->map_list.file_names = malloc(file_count * sizeof(char*));
+        list_dir_changed(&lobby_state->map_list);
 
-        lobby_state->map_list.file_names[i] = malloc(file_name_len + 1);
+        for (S32 i = 0; i < lobby_state->map_list.file_count; i++) {
+            S32 file_name_len = 0;
+            memcpy(&file_name_len, buffer_ptr, sizeof(file_name_len));
+            bytes_read += sizeof(file_name_len);
+            buffer_ptr += sizeof(file_name_len);
 
-        memcpy(lobby_state->map_list.file_names[i], buffer_ptr, file_name_len);
-        lobby_state->map_list.file_names[i][file_name_len] = 0;
-        bytes_read += file_name_len;
-        buffer_ptr += file_name_len;
+            lobby_state->map_list.file_names[i] = malloc(file_name_len + 1);
+
+            memcpy(lobby_state->map_list.file_names[i], buffer_ptr, file_name_len);
+            lobby_state->map_list.file_names[i][file_name_len] = 0;
+            bytes_read += file_name_len;
+            buffer_ptr += file_name_len;
+        }
     }
 
     memcpy(&lobby_state->selected_map, buffer_ptr, sizeof(lobby_state->selected_map));
     bytes_read += sizeof(lobby_state->selected_map);
     buffer_ptr += sizeof(lobby_state->selected_map);
 
+    memcpy(&lobby_state->map_hash, buffer_ptr, sizeof(lobby_state->map_hash));
+    bytes_read += sizeof(lobby_state->map_hash);
+    buffer_ptr += sizeof(lobby_state->map_hash);
+
+    memcpy(&lobby_state->map_size, buffer_ptr, sizeof(lobby_state->map_size));
+    bytes_read += sizeof(lobby_state->map_size);
+    buffer_ptr += sizeof(lobby_state->map_size);
+
     return bytes_read;
 }
 
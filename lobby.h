@@ -44,6 +44,8 @@ typedef struct {
     LobbyAction actions[MAX_SNAKE_COUNT];
     ListDir map_list;
     S32 selected_map;
+    U64 map_hash; // Content hash of the selected map file, so clients can tell if theirs matches.
+    U32 map_size;
 } AppStateLobby;
 
 bool app_lobby_update(AppStateLobby* lobby_state);
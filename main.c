@@ -10,18 +10,38 @@
 
 #include <SDL3/SDL.h>
 
+#include "camera.h"
 #include "dev_mode.h"
+#include "frame_scheduler.h"
 #include "lobby.h"
 #include "map.h"
+#include "map_cache.h"
+#include "minimap.h"
 #include "network.h"
 #include "packet.h"
 #include "pixelfont.h"
+#include "replay.h"
+#include "snapshot.h"
+#include "spectator.h"
+#include "sprite_batch.h"
 #include "ui.h"
+#include "zone.h"
 
 #define MS_TO_US(ms) ((ms) * 1000)
 #define SERVER_ACCEPT_QUEUE_LIMIT 5
 #define MAX_GAME_CONTROLLERS 4
 
+// How far ahead of its estimate of the server tick a client stamps its inputs, to cover the time it
+// takes the input to reach the server.
+#define CLIENT_INPUT_LEAD_MS 50
+
+// Sockets can't wake the main loop the way input does, so while connected it checks them at least
+// this often.
+#define NET_POLL_INTERVAL_MS 2
+
+// The same for when nothing is waiting on the network, in the lobby or a client in the background.
+#define NET_IDLE_POLL_INTERVAL_MS 50
+
 // Minus one due to the server itself not needing a client socket.
 #define MAX_SERVER_CLIENT_COUNT (MAX_SNAKE_COUNT - 1)
 
@@ -33,7 +53,8 @@ typedef enum {
 typedef enum {
     SESSION_TYPE_SINGLE_PLAYER,
     SESSION_TYPE_SERVER,
-    SESSION_TYPE_CLIENT
+    SESSION_TYPE_CLIENT,
+    SESSION_TYPE_REPLAY,
 } SessionType;
 
 typedef struct {
@@ -41,13 +62,18 @@ typedef struct {
     SnakeActionKeyState prev_snake_actions_key_states[MAX_SNAKE_COUNT];
     SnakeAction snake_actions[MAX_SNAKE_COUNT];
     ActionBuffer action_buffers[MAX_SNAKE_COUNT];
+    InputTimeline input_timelines[MAX_SNAKE_COUNT]; // Tick stamped input from network players.
     DevMode dev_mode;
+    bool record_replays;
+    ReplayRecorder replay_recorder;
 } AppStateGameServer;
 
 typedef struct {
     Game game;
     SnakeActionKeyState prev_action_key_state;
     SnakeAction snake_actions;
+    S64 time_since_state_us; // Time since the last game state was received from the server.
+    SnapshotBuffer snapshots;
 } AppStateGameClient;
 
 static int __tick;
@@ -202,90 +228,136 @@ void reset_game(Game* game,
                     (S8)(game->settings.segment_health));
         game->snakes[3].color = lobby_state->players[3].snake_color;
     }
+
+    game_seed_random(game, (U32)(rand()));
+}
+
+// Where a snake's head is drawn, sliding from prev_game the same way snake_draw does. Leaves x and y
+// alone if the snake isn't alive.
+void snake_head_draw_position(Game* game,
+                              Game* prev_game,
+                              float interpolation,
+                              S32 snake_index,
+                              float* x,
+                              float* y) {
+    Snake* snake = game->snakes + snake_index;
+    if (snake->life_state != SNAKE_LIFE_STATE_ALIVE || snake->length <= 0) {
+        return;
+    }
+
+    *x = (float)(snake->segments[0].x);
+    *y = (float)(snake->segments[0].y);
+
+    if (prev_game != NULL && interpolation < 1.0f) {
+        Snake* prev_snake = prev_game->snakes + snake_index;
+        if (prev_snake->length > 0) {
+            S32 dx = snake->segments[0].x - prev_snake->segments[0].x;
+            S32 dy = snake->segments[0].y - prev_snake->segments[0].y;
+            if ((dx == 0 || dy == 0) && abs(dx + dy) <= 1) {
+                *x = (float)(prev_snake->segments[0].x) + (float)(dx) * interpolation;
+                *y = (float)(prev_snake->segments[0].y) + (float)(dy) * interpolation;
+            }
+        }
+    }
 }
 
+// prev_game is the previous state to interpolate snakes from, or NULL to draw game as is. Only what
+// is in visible_cells is drawn.
 bool draw_game(Game* game,
+               Game* prev_game,
+               float interpolation,
                SDL_Renderer* renderer,
                SDL_Texture* snake_texture,
                SDL_Texture* tileset_texture,
+               MapTexture* map_texture,
+               SpriteBatch* sprite_batch,
+               SnakeSpriteCache* snake_sprite_caches,
                S32 cell_size,
                S32 camera_offset_x,
-               S32 camera_offset_y) {
-
-    // Draw level
-    for (Uint8 l = 0; l < game->map.num_layers; l++) {
-        for (Uint16 y = 0; y < game->map.height; y++) {
-            for (Uint16 x = 0; x < game->map.width; x++) {
-                GID gid = GetMapTile(&game->map, x, y, l);
-                if (gid == 0) {
-                    continue;
-                }
-
-                SDL_FRect dest_rect = {
-                    (float)(camera_offset_x + x * cell_size),
-                    (float)(camera_offset_y + y * cell_size),
-                    (float)(cell_size),
-                    (float)(cell_size)
-                };
-
-                RenderTile2(renderer, gid, tileset_texture, 16, &dest_rect);
-            }
-        }
+               S32 camera_offset_y,
+               SpatialRect visible_cells) {
+    ZONE_BEGIN("draw_game");
+
+    // Draw level, which is only rendered tile by tile when the map or cell size changes.
+    ZONE_BEGIN("draw level");
+    if (!UpdateMapTexture(map_texture, renderer, &game->map, tileset_texture, 16, cell_size)) {
+        ZONE_END();
+        ZONE_END();
+        return false;
     }
+    SDL_Rect map_cells = {
+        .x = visible_cells.min_x,
+        .y = visible_cells.min_y,
+        .w = visible_cells.max_x - visible_cells.min_x + 1,
+        .h = visible_cells.max_y - visible_cells.min_y + 1
+    };
+    RenderMapTexture(renderer, map_texture, (float)(camera_offset_x), (float)(camera_offset_y), &map_cells);
+    ZONE_END();
 
-    // draw items
-    for(S32 y = 0; y < game->items.height; y++) {
-        for(S32 x = 0; x < game->items.width; x++) {
-            // TODO: Asserts
-            ItemType item_type = items_get_cell(&game->items, x, y);
+    // Tacos and snakes all come from the same sprite sheet, so they go out in one batch.
+    sprite_batch_begin(sprite_batch, snake_texture);
 
-            switch (item_type) {
-                case ITEM_TYPE_EMPTY: {
-                    break;
+    // draw items
+    ZONE_BEGIN("draw items");
+    const SpatialGrid* tacos = &game->items.tacos;
+    SpatialRect taco_buckets = spatial_grid_bucket_rect(tacos, visible_cells);
+    for (S32 by = taco_buckets.min_y; by <= taco_buckets.max_y; by++) {
+        for (S32 bx = taco_buckets.min_x; bx <= taco_buckets.max_x; bx++) {
+            const SpatialBucket* bucket = tacos->buckets + (by * tacos->width + bx);
+            for (S32 p = 0; p < bucket->count; p++) {
+                if (!spatial_rect_contains(visible_cells, bucket->points[p].x, bucket->points[p].y)) {
+                    continue;
                 }
-                case ITEM_TYPE_TACO: {
-                    SDL_FRect source_rect = {64.0f, 0.0f, 16.0f, 16.0f};
-
-                    SDL_FRect cell_rect = {
-                        .x = (float)(camera_offset_x + x * cell_size),
-                        .y = (float)(camera_offset_y + y * cell_size),
-                        .w = (float)(cell_size),
-                        .h = (float)(cell_size)
-                    };
 
-                    bool result = SDL_RenderTexture(renderer,
-                                                    snake_texture,
-                                                    &source_rect,
-                                                    &cell_rect);
-                    if (!result) {
-                        fprintf(stderr, "Tom F was wrong: %s\n", SDL_GetError());
-                        return false;
-                    }
-                    break;
-                }
-                default:
-                    break;
+                SDL_FRect source_rect = {64.0f, 0.0f, 16.0f, 16.0f};
+
+                SDL_FRect cell_rect = {
+                    .x = (float)(camera_offset_x + bucket->points[p].x * cell_size),
+                    .y = (float)(camera_offset_y + bucket->points[p].y * cell_size),
+                    .w = (float)(cell_size),
+                    .h = (float)(cell_size)
+                };
+
+                sprite_batch_add(sprite_batch, &source_rect, &cell_rect, 0, (SDL_FColor){1.0f, 1.0f, 1.0f, 1.0f});
             }
         }
     }
-
-    // draw snakes
+    ZONE_END();
+
+    // draw snakes, and a cell past each edge of the view, since segments there can be partly on
+    // screen while they slide between cells.
+    ZONE_BEGIN("draw snakes");
+    SpatialRect snake_cells = {
+        visible_cells.min_x - 1,
+        visible_cells.min_y - 1,
+        visible_cells.max_x + 1,
+        visible_cells.max_y + 1
+    };
     for (S32 s = 0; s < MAX_SNAKE_COUNT; s++) {
-        snake_draw(renderer,
-                   snake_texture,
+        snake_draw(sprite_batch,
                    game->snakes + s,
+                   prev_game ? prev_game->snakes + s : NULL,
+                   interpolation,
                    cell_size,
                    camera_offset_x,
                    camera_offset_y,
-                   game->settings.segment_health);
+                   &snake_cells,
+                   game->settings.segment_health,
+                   snake_sprite_caches + s);
     }
+    ZONE_END();
 
-    return true;
+    ZONE_BEGIN("draw sprites");
+    bool result = sprite_batch_draw(sprite_batch, renderer);
+    ZONE_END();
+
+    ZONE_END();
+    return result;
 }
 
 bool app_game_server_handle_keystate(AppStateGameServer* app_game_server,
                                      const bool* keyboard_state,
-                                     S32 cell_size,
+                                     const CameraView* camera_view,
                                      bool use_keyboard_for_snake_actions,
                                      UIMouseState* ui_mouse_state) {
     switch (app_game_server->game.state) {
@@ -298,7 +370,7 @@ bool app_game_server_handle_keystate(AppStateGameServer* app_game_server,
 
         dev_mode_handle_keystate(&app_game_server->dev_mode,
                                  &app_game_server->game,
-                                 cell_size,
+                                 camera_view,
                                  keyboard_state,
                                  ui_mouse_state);
         break;
@@ -317,9 +389,12 @@ bool app_game_server_handle_keystate(AppStateGameServer* app_game_server,
 }
 
 // returns whether or not a tick occurred.
+// hold_start keeps the game waiting to start once the countdown is up, e.g. while clients are still
+// being sent the map.
 void app_game_server_update(AppStateGameServer* app_game_server,
                             bool should_tick,
-                            S64 time_since_update_us) {
+                            S64 time_since_update_us,
+                            bool hold_start) {
     for (S32 i = 0; i < MAX_SNAKE_COUNT; i++) {
         if (app_game_server->snake_actions[i] != SNAKE_ACTION_NONE) {
             action_buffer_add(app_game_server->action_buffers + i, app_game_server->snake_actions[i]);
@@ -328,7 +403,7 @@ void app_game_server_update(AppStateGameServer* app_game_server,
 
     if (app_game_server->game.state == GAME_STATE_WAITING) {
         app_game_server->game.settings.wait_to_start_ms -= (S32)(time_since_update_us / 1000);
-        if (app_game_server->game.settings.wait_to_start_ms <= 0) {
+        if (app_game_server->game.settings.wait_to_start_ms <= 0 && !hold_start) {
             app_game_server->game.state = GAME_STATE_PLAYING;
         }
     }
@@ -336,7 +411,10 @@ void app_game_server_update(AppStateGameServer* app_game_server,
     if (should_tick) {
         SnakeAction snake_actions[MAX_SNAKE_COUNT];
         for (S32 i = 0; i < MAX_SNAKE_COUNT; i++) {
+            // A snake is either driven locally or over the network, so only one of these will
+            // have an action, but the timeline always has to advance.
             snake_actions[i] = action_buffer_remove(&app_game_server->action_buffers[i]);
+            snake_actions[i] |= input_timeline_remove(&app_game_server->input_timelines[i]);
             if (!app_game_server->game.settings.enable_chomping) {
                 snake_actions[i] &= ~SNAKE_ACTION_CHOMP;
             }
@@ -344,8 +422,46 @@ void app_game_server_update(AppStateGameServer* app_game_server,
                 snake_actions[i] &= ~(SNAKE_ACTION_CONSTRICT_LEFT | SNAKE_ACTION_CONSTRICT_RIGHT);
             }
         }
-        game_update(&app_game_server->game, snake_actions);
+        replay_recorder_add_tick(&app_game_server->replay_recorder,
+                                 &app_game_server->game,
+                                 snake_actions);
+
+        DevMode* dev_mode = &app_game_server->dev_mode;
+        if (dev_mode->enabled && dev_mode->show_profiler) {
+            GamePhaseTimes phase_times = {0};
+            app_game_server->game.phase_times = &phase_times;
+            U64 tick_start_ns = SDL_GetTicksNS();
+            game_update(&app_game_server->game, snake_actions);
+            U64 tick_ns = SDL_GetTicksNS() - tick_start_ns;
+            app_game_server->game.phase_times = NULL;
+            tick_profile_add(&dev_mode->tick_profile, &phase_times, tick_ns);
+        } else {
+            game_update(&app_game_server->game, snake_actions);
+        }
+
+        if (app_game_server->game.state == GAME_STATE_GAME_OVER) {
+            replay_recorder_end(&app_game_server->replay_recorder, &app_game_server->game);
+
+            for (S32 i = 0; i < MAX_SNAKE_COUNT; i++) {
+                InputTimelineStats* stats = &app_game_server->input_timelines[i].stats;
+                if (stats->on_time_count + stats->late_count + stats->early_count == 0) {
+                    continue;
+                }
+                net_log("player %d inputs: %d on time, %d late, %d early\n",
+                        i, stats->on_time_count, stats->late_count, stats->early_count);
+            }
+        }
+    }
+}
+
+// The tick the server is expected to be simulating by the time an input sent now arrives.
+U32 app_game_client_input_target_tick(AppStateGameClient* app_game_client) {
+    S64 tick_us = MS_TO_US((S64)app_game_client->game.settings.tick_ms);
+    if (tick_us <= 0) {
+        return app_game_client->game.tick;
     }
+    S64 lead_us = app_game_client->time_since_state_us + MS_TO_US(CLIENT_INPUT_LEAD_MS);
+    return app_game_client->game.tick + (U32)(lead_us / tick_us);
 }
 
 void app_game_client_handle_keystate(AppStateGameClient* app_game_client, const bool* keyboard_state) {
@@ -361,19 +477,67 @@ void app_server_update(AppState* app_state,
                        AppStateGameServer* server_game_state,
                        bool should_tick,
                        S64 time_since_last_frame_us,
-                       const char* map_file_name) {
+                       const char* map_file_name,
+                       bool hold_start) {
     if (*app_state == APP_STATE_LOBBY) {
         if (app_lobby_update(lobby_state)) {
             *app_state = APP_STATE_GAME;
             server_game_state->game.settings.wait_to_start_ms = 3000;
+            // Finish off the last game's replay if it was left before it was over.
+            replay_recorder_end(&server_game_state->replay_recorder, &server_game_state->game);
             reset_game(&server_game_state->game,
                        lobby_state,
                        map_file_name);
+            if (server_game_state->record_replays) {
+                replay_recorder_begin(&server_game_state->replay_recorder,
+                                      &server_game_state->game,
+                                      map_file_name);
+            }
+            for (S32 i = 0; i < MAX_SNAKE_COUNT; i++) {
+                input_timeline_reset(server_game_state->input_timelines + i,
+                                     server_game_state->game.tick);
+            }
         }
     } else if (*app_state == APP_STATE_GAME) {
         app_game_server_update(server_game_state,
                                should_tick,
-                               time_since_last_frame_us);
+                               time_since_last_frame_us,
+                               hold_start);
+    }
+}
+
+// Readies up the server's player once enough clients have joined and goes back to the lobby after
+// each game, so load tests can run game after game with nobody at the server.
+void server_auto_start(AppState* app_state,
+                       AppStateLobby* lobby_state,
+                       AppStateGameServer* server_game_state,
+                       S32 client_count) {
+    if (*app_state == APP_STATE_LOBBY) {
+        S32 network_player_count = 0;
+        for (S32 p = 0; p < MAX_SNAKE_COUNT; p++) {
+            if (lobby_state->players[p].state != LOBBY_PLAYER_STATE_NONE &&
+                lobby_state->players[p].type == LOBBY_PLAYER_TYPE_NETWORK) {
+                network_player_count++;
+            }
+        }
+
+        if (network_player_count >= client_count &&
+            lobby_state->players[0].state == LOBBY_PLAYER_STATE_NOT_READY) {
+            lobby_state->actions[0] |= LOBBY_ACTION_TOGGLE_READY;
+        }
+    } else if (*app_state == APP_STATE_GAME &&
+               server_game_state->game.state == GAME_STATE_GAME_OVER) {
+        printf("game over at tick %u, server cpu time so far: %.2f s\n",
+               server_game_state->game.tick,
+               (double)clock() / CLOCKS_PER_SEC);
+
+        server_game_state->game.state = GAME_STATE_WAITING;
+        for (S32 p = 0; p < MAX_SNAKE_COUNT; p++) {
+            if (lobby_state->players[p].state == LOBBY_PLAYER_STATE_READY) {
+                lobby_state->players[p].state = LOBBY_PLAYER_STATE_NOT_READY;
+            }
+        }
+        *app_state = APP_STATE_LOBBY;
     }
 }
 
@@ -566,20 +730,6 @@ void controller_handle_input(AppState app_state,
     }
 }
 
-void net_action_log(const char* timestamp_str,
-                    const char* type,
-                    size_t bytes_to_send,
-                    size_t bytes_sent,
-                    int seq,
-                    const char* desc) {
-    net_log("%s [tk %5d] %s: %4zu of %4zu bytes | ", timestamp_str, __tick, type, bytes_to_send, bytes_sent);
-    if ( seq != -1 ) {
-        net_log(" seq %3d (%s)\n", seq, desc);
-    } else {
-        net_log("         (%s)\n", desc);
-    }
-}
-
 void handle_client_disconnect(NetSocket** server_client_sockets,
                               AppStateLobby* lobby_state,
                               S32 socket_index) {
@@ -592,11 +742,103 @@ void handle_client_disconnect(NetSocket** server_client_sockets,
     server_client_sockets[socket_index] = NULL;
 }
 
+// Sends what each client's socket will take, disconnecting clients whose socket has failed.
+void flush_client_send_queues(NetSocket** server_client_sockets,
+                              PacketSendQueue* send_queues,
+                              AppStateLobby* lobby_state) {
+    for (S32 i = 0; i < MAX_SERVER_CLIENT_COUNT; i++) {
+        if (server_client_sockets[i] == NULL) {
+            continue;
+        }
+
+        if (!packet_send_queue_flush(send_queues + i, server_client_sockets[i])) {
+            fputs(net_get_error(), stderr);
+            packet_send_queue_clear(send_queues + i);
+            handle_client_disconnect(server_client_sockets, lobby_state, i);
+        }
+    }
+}
+
+// Serializes the lobby or level state to share between clients, NULL if it failed.
+PacketBuffer* server_create_state_buffer(AppState app_state,
+                                         AppStateLobby* lobby_state,
+                                         Game* game,
+                                         void* buffer,
+                                         size_t buffer_size,
+                                         U16* sequence) {
+    Packet state_packet = {
+        .header = {
+            .type = app_state == APP_STATE_GAME ? PACKET_TYPE_LEVEL_STATE : PACKET_TYPE_LOBBY_STATE,
+            .sequence = (*sequence)++
+        },
+        .payload = (U8*)buffer
+    };
+    if (app_state == APP_STATE_GAME) {
+        state_packet.size = (U32)(game_serialize(game, buffer, buffer_size));
+    } else {
+        state_packet.size = (U32)(lobby_state_serialize(lobby_state,
+                                                        &game->settings,
+                                                        buffer,
+                                                        buffer_size));
+    }
+
+    PacketBuffer* state_buffer = packet_buffer_create(&state_packet);
+    if (state_buffer == NULL) {
+        printf("failed to serialize state for tick: %d\n", __tick);
+    }
+    return state_buffer;
+}
+
+// Queues the part of the level around the client's snake, returns false if the client has no live
+// snake to center it on or it doesn't fit in the buffer, to send the whole state instead.
+bool server_queue_interest_state(PacketSendQueue* send_queue,
+                                 AppStateLobby* lobby_state,
+                                 Game* game,
+                                 S32 client_index,
+                                 S32 radius,
+                                 void* buffer,
+                                 size_t buffer_size,
+                                 U16* sequence) {
+    S32 snake_index = lobby_find_network_player(lobby_state, client_index);
+    if (snake_index < 0 ||
+        game->snakes[snake_index].life_state != SNAKE_LIFE_STATE_ALIVE ||
+        game->snakes[snake_index].length <= 0) {
+        return false;
+    }
+
+    size_t size = game_serialize_interest(game, snake_index, radius, buffer, buffer_size);
+    if (size == 0) {
+        return false;
+    }
+
+    Packet packet = {
+        .header = {
+            .type = PACKET_TYPE_INTEREST_STATE,
+            .sequence = (*sequence)++
+        },
+        .size = (U32)(size),
+        .payload = (U8*)buffer
+    };
+
+    if (!packet_send_queue_push(send_queue, &packet, true)) {
+        printf("failed to queue interest state for tick: %d\n", __tick);
+    }
+    return true;
+}
+
 int main(S32 argc, char** argv) {
     const char* port = NULL;
     const char* ip = NULL;
     const char* window_title = NULL;
     const char* player_name = NULL;
+    S32 auto_start_client_count = 0;
+    S32 interest_radius = 0; // Only send each player the level within this many cells of its snake.
+    bool record_replays = false;
+    const char* replay_path = NULL;
+    const char* verify_replay_path = NULL;
+    bool spectate = false;
+    bool record_zones = false;
+    S32 target_fps = 0; // Left to vsync when 0.
 
     SessionType session_type = SESSION_TYPE_SINGLE_PLAYER;
     for (S32 i = 1; i < argc; i++) {
@@ -629,12 +871,65 @@ int main(S32 argc, char** argv) {
 
             player_name = argv[i + 1];
             i++;
+        } else if (strcmp(argv[i], "-w") == 0) {
+            spectate = true;
+        } else if (strcmp(argv[i], "-i") == 0) {
+            if (argc <= (i + 1)) {
+                puts("Expected radius argument for area of interest filtering");
+                return EXIT_FAILURE;
+            }
+
+            interest_radius = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-r") == 0) {
+            record_replays = true;
+        } else if (strcmp(argv[i], "-t") == 0) {
+            record_zones = true;
+        } else if (strcmp(argv[i], "-f") == 0) {
+            if (argc <= (i + 1)) {
+                puts("Expected frames per second argument");
+                return EXIT_FAILURE;
+            }
+
+            target_fps = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-p") == 0) {
+            session_type = SESSION_TYPE_REPLAY;
+
+            if (argc <= (i + 1)) {
+                puts("Expected replay file argument for playback");
+                return EXIT_FAILURE;
+            }
+
+            replay_path = argv[i + 1];
+            i++;
+        } else if (strcmp(argv[i], "-v") == 0) {
+            if (argc <= (i + 1)) {
+                puts("Expected replay file argument to verify");
+                return EXIT_FAILURE;
+            }
+
+            verify_replay_path = argv[i + 1];
+            i++;
+        } else if (strcmp(argv[i], "-a") == 0) {
+            if (argc <= (i + 1)) {
+                puts("Expected client count argument for auto start");
+                return EXIT_FAILURE;
+            }
+
+            auto_start_client_count = atoi(argv[i + 1]);
+            i++;
         } else {
             puts("Unexpected argument passed");
             return EXIT_FAILURE;
         }
     }
 
+    // Re-simulates a replay without opening a window, to check it still plays out the same.
+    if (verify_replay_path != NULL) {
+        return replay_verify(verify_replay_path) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
     //
     // Init game and level
     //
@@ -647,17 +942,53 @@ int main(S32 argc, char** argv) {
     NetSocket* client_socket = NULL; // Used by client to send and receive.
 
     NetSocket* server_client_sockets[MAX_SERVER_CLIENT_COUNT] = { 0 };
+    MapFile server_map_file = { .map_index = -1 };
+    MapUpload server_map_uploads[MAX_SERVER_CLIENT_COUNT] = { 0 };
+    PacketSendQueue server_send_queues[MAX_SERVER_CLIENT_COUNT] = { 0 };
+    PacketSendQueue client_send_queue = { 0 }; // Everything the client sends, flushed each frame.
+    // The player index each client was last told it controls, so it's only sent again on a change.
+    S32 server_sent_player_indices[MAX_SERVER_CLIENT_COUNT];
+    for (S32 i = 0; i < MAX_SERVER_CLIENT_COUNT; i++) {
+        server_sent_player_indices[i] = -1;
+    }
+    S32 client_player_index = -1; // The lobby player the server says we control, -1 until it does.
+    SpectatorList spectators = { 0 };
+    MapDownload client_map_download = { 0 };
+    U64 client_game_map_hash = 0; // Hash of the map currently loaded into the client game.
     U16 server_sequence = 0;
     U16 client_sequence = 0;
-
-    // TODO: Only do this when doing networking
-    const char* net_log_file_name = session_type == SESSION_TYPE_SERVER ?
-        "net_server.log" : "net_client.log";
-    if (!net_init(net_log_file_name)) {
+    Replay replay = { 0 };
+    S32 replay_speed = 1; // Multiple of the recorded tick rate to play back at.
+    S64 replay_time_us = 0;
+    bool replay_finished = false;
+
+    // Packet sends and receives go to the binary trace, decode it with tools/net_trace_decode.
+    const char* net_log_file_name = NULL;
+    const char* net_trace_file_name = NULL;
+    if (session_type == SESSION_TYPE_SERVER) {
+        net_log_file_name = "net_server.log";
+        net_trace_file_name = "net_server.trace";
+    } else if (session_type == SESSION_TYPE_CLIENT) {
+        net_log_file_name = "net_client.log";
+        net_trace_file_name = "net_client.trace";
+    }
+    if (!net_init(net_log_file_name, net_trace_file_name)) {
         fprintf(stderr, "%s\n", net_get_error());
         return EXIT_FAILURE;
     }
 
+    // Zones go to a Chrome trace on exit, or when pressing F9 for the frames leading up to now.
+    const char* zone_file_prefix = "zones";
+    if (session_type == SESSION_TYPE_SERVER) {
+        zone_file_prefix = "zones_server";
+    } else if (session_type == SESSION_TYPE_CLIENT) {
+        zone_file_prefix = "zones_client";
+    }
+    S32 zone_snapshot_count = 0;
+    if (record_zones) {
+        zone_init();
+    }
+
     Game* game = NULL;
 
     switch(session_type) {
@@ -684,19 +1015,31 @@ int main(S32 argc, char** argv) {
         printf("Connected to %s:%s\n", ip, port);
         game = &client_game_state.game;
 
-        if (player_name) {
+        if (spectate) {
+            Packet packet = {
+                .header = {
+                    .type = PACKET_TYPE_SPECTATE,
+                    .sequence = client_sequence++
+                }
+            };
+
+            puts("joining as a spectator");
+            if (!packet_send_queue_push(&client_send_queue, &packet, false)) {
+                fprintf(stderr, "failed to queue spectate request\n");
+            }
+        } else if (player_name) {
             Packet packet = {
                 .header = {
                     .type = PACKET_TYPE_CLIENT_NAME,
-                    .payload_size = (U16)(strnlen(player_name, MAX_LOBBY_PLAYER_NAME_LEN)),
                     .sequence = client_sequence++
                 },
+                .size = (U32)(strnlen(player_name, MAX_LOBBY_PLAYER_NAME_LEN)),
                 .payload = (U8*)player_name
             };
 
             printf("sending player name: %s\n", player_name);
-            if (!packet_send(client_socket, &packet)) {
-                fprintf(stderr, "failed to send entire header for snake action\n");
+            if (!packet_send_queue_push(&client_send_queue, &packet, false)) {
+                fprintf(stderr, "failed to queue player name\n");
             }
         }
         break;
@@ -717,6 +1060,13 @@ int main(S32 argc, char** argv) {
         game = &server_game_state.game;
         break;
     }
+    case SESSION_TYPE_REPLAY:
+        printf("Playing back replay: %s\n", replay_path);
+
+        window_title = "Taco Quest (Replay)";
+
+        game = &server_game_state.game;
+        break;
     }
 
     game->settings.enable_chomping = true;
@@ -742,6 +1092,14 @@ int main(S32 argc, char** argv) {
         }
     }
 
+    server_game_state.record_replays = record_replays;
+    if (session_type == SESSION_TYPE_REPLAY) {
+        if (!replay_load(&replay, replay_path) || !replay_start_game(&replay, game)) {
+            return EXIT_FAILURE;
+        }
+        app_state = APP_STATE_GAME;
+    }
+
     int rc = SDL_Init(SDL_INIT_VIDEO | SDL_INIT_GAMEPAD);
     if (rc < 0) {
         printf("SDL_Init failed %s\n", SDL_GetError());
@@ -791,6 +1149,16 @@ int main(S32 argc, char** argv) {
         return 1;
     }
 
+    // Frames are paced by vsync unless a frame rate was asked for.
+    if (target_fps <= 0 && !SDL_SetRenderVSync(renderer, 1)) {
+        fprintf(stderr, "Failed to enable vsync, capping at %d fps: %s\n",
+                FRAME_SCHEDULER_DEFAULT_FPS,
+                SDL_GetError());
+        target_fps = FRAME_SCHEDULER_DEFAULT_FPS;
+    }
+    FrameScheduler frame_scheduler = {0};
+    frame_scheduler_init(&frame_scheduler, target_fps);
+
     PF_Config font_config = {
         .renderer = renderer,
         .bmp_file = "assets/arcade.bmp",
@@ -848,6 +1216,19 @@ int main(S32 argc, char** argv) {
     }
     SDL_DestroySurface(tileset_surface);
 
+    MapTexture map_texture = {0};
+    SpriteBatch sprite_batch = {0};
+    SDL_Texture* game_target = NULL; // The game at 1 texel per sprite sheet pixel.
+    // The game target can't be bigger than this on either side, or 0 when the renderer doesn't say.
+    S32 max_texture_size = (S32)SDL_GetNumberProperty(SDL_GetRendererProperties(renderer),
+                                                      SDL_PROP_RENDERER_MAX_TEXTURE_SIZE_NUMBER,
+                                                      0);
+    // The size of the last game target that couldn't be created, so it isn't tried every frame.
+    S32 failed_target_width = 0;
+    S32 failed_target_height = 0;
+    SnakeSpriteCache snake_sprite_caches[MAX_SNAKE_COUNT] = {0};
+    Minimap minimap = {0};
+
     SDL_Gamepad* game_pads[MAX_GAME_CONTROLLERS];
     memset(game_pads, 0, sizeof(game_pads[0]) * MAX_GAME_CONTROLLERS);
 
@@ -856,10 +1237,10 @@ int main(S32 argc, char** argv) {
 
     UIMouseState ui_mouse_state = {0};
 
-    UICheckBox ui_enable_chomping_checkbox = {15, 35};
-    UICheckBox ui_enable_constricting_checkbox = {15, 60};
-    UICheckBox ui_head_invincible_checkbox = {15, 85};
-    UICheckBox ui_zero_tacos_respawn_checkbox = {15, 110};
+    UICheckBox ui_enable_chomping_checkbox = {.x = 15, .y = 35};
+    UICheckBox ui_enable_constricting_checkbox = {.x = 15, .y = 60};
+    UICheckBox ui_head_invincible_checkbox = {.x = 15, .y = 85};
+    UICheckBox ui_zero_tacos_respawn_checkbox = {.x = 15, .y = 110};
     UISlider ui_segment_health_slider = {
         .x = 260,
         .y = 60,
@@ -916,9 +1297,14 @@ int main(S32 argc, char** argv) {
         printf("%s\n", lobby_state.map_list.file_names[i]);
     }
 
-    S32 cell_size = cell_pixel_size;
+    // The camera follows the local player's snake. What it sees is worked out while rendering and
+    // used by the next frame's input as well.
+    Camera camera = {0};
+    CameraView camera_view = { .cells = { 0, 0, -1, -1 }, .cell_size = cell_pixel_size };
+    Uint32 camera_map_revision = 0;
 
     int64_t time_since_tick_us = 0;
+    int64_t app_time_us = 0;
 
     size_t net_msg_buffer_size = 1024 * 1024;
     char* net_msg_buffer = (char*)malloc(net_msg_buffer_size);
@@ -931,11 +1317,21 @@ int main(S32 argc, char** argv) {
     bool quit = false;
 
     while (!quit) {
+        ZONE_BEGIN("frame");
+        U64 frame_start_ns = SDL_GetTicksNS();
+        AppState frame_start_app_state = app_state;
+        S32 frame_start_selected_map = lobby_state.selected_map;
+        S32 frame_start_spectator_count = spectators.count;
+        LobbyPlayer frame_start_players[MAX_SNAKE_COUNT];
+        memcpy(frame_start_players, lobby_state.players, sizeof(frame_start_players));
+
         // Calculate how much time has elapsed (in microseconds).
         struct timespec current_frame_timestamp = {0};
         timespec_get(&current_frame_timestamp, TIME_UTC);
         int64_t time_since_last_frame_us = microseconds_between_timestamps(&last_frame_timestamp, &current_frame_timestamp);
         time_since_tick_us += time_since_last_frame_us;
+        app_time_us += time_since_last_frame_us;
+        client_game_state.time_since_state_us += time_since_last_frame_us;
         last_frame_timestamp = current_frame_timestamp;
 
         ui_mouse_state.prev_left_clicked = ui_mouse_state.left_clicked;
@@ -951,8 +1347,12 @@ int main(S32 argc, char** argv) {
         client_game_state.snake_actions = 0;
 
         // Handle events, such as input or window changes.
+        ZONE_BEGIN("events");
         SDL_Event event;
         while (SDL_PollEvent(&event)) {
+            // Anything from input to the window being uncovered can change what should be shown.
+            frame_scheduler_invalidate(&frame_scheduler);
+
             switch (event.type) {
             case SDL_EVENT_QUIT:
                 quit = true;
@@ -974,6 +1374,72 @@ int main(S32 argc, char** argv) {
                                                session_type);
                 }
                 break;
+            case SDL_EVENT_KEY_DOWN:
+                if (zone_enabled && event.key.scancode == SDL_SCANCODE_F9 && !event.key.repeat) {
+                    char zone_file_name[64];
+                    snprintf(zone_file_name,
+                             sizeof(zone_file_name),
+                             "%s_%d.json",
+                             zone_file_prefix,
+                             ++zone_snapshot_count);
+                    if (zone_write(zone_file_name)) {
+                        printf("Wrote zones to %s\n", zone_file_name);
+                    }
+                }
+
+                // Plus and minus zoom the camera in and out, zoomed all the way out shows the whole
+                // map.
+                if (app_state == APP_STATE_GAME) {
+                    if (event.key.scancode == SDL_SCANCODE_EQUALS || event.key.scancode == SDL_SCANCODE_KP_PLUS) {
+                        camera_zoom(&camera, 1);
+                    } else if (event.key.scancode == SDL_SCANCODE_MINUS ||
+                               event.key.scancode == SDL_SCANCODE_KP_MINUS) {
+                        camera_zoom(&camera, -1);
+                    }
+                }
+
+                // Up and down change the replay speed between 1x and 64x, left and right jump
+                // back and forward 10 seconds.
+                if (session_type == SESSION_TYPE_REPLAY && !event.key.repeat) {
+                    if (event.key.scancode == SDL_SCANCODE_UP && replay_speed < 64) {
+                        replay_speed *= 2;
+                    } else if (event.key.scancode == SDL_SCANCODE_DOWN && replay_speed > 1) {
+                        replay_speed /= 2;
+                    } else if ((event.key.scancode == SDL_SCANCODE_LEFT ||
+                                event.key.scancode == SDL_SCANCODE_RIGHT) &&
+                               game->settings.tick_ms > 0) {
+                        U32 jump_ticks = 10000 / game->settings.tick_ms;
+                        U32 tick = replay.ticks_played;
+                        if (event.key.scancode == SDL_SCANCODE_RIGHT) {
+                            tick += jump_ticks;
+                        } else {
+                            tick = tick > jump_ticks ? tick - jump_ticks : 0;
+                        }
+                        if (replay_seek(&replay, game, tick)) {
+                            replay_time_us = 0;
+                            replay_finished = false;
+                        }
+                    }
+                }
+                break;
+            case SDL_EVENT_RENDER_TARGETS_RESET:
+            case SDL_EVENT_RENDER_DEVICE_RESET:
+                // The baked map was lost along with every other render target, and on a device
+                // reset everything else too.
+                DestroyMapTexture(&map_texture);
+                if (event.type == SDL_EVENT_RENDER_DEVICE_RESET) {
+                    minimap_destroy_texture(&minimap);
+                }
+                break;
+            case SDL_EVENT_MOUSE_WHEEL:
+                if (app_state == APP_STATE_GAME) {
+                    if (event.wheel.y > 0.0f) {
+                        camera_zoom(&camera, 1);
+                    } else if (event.wheel.y < 0.0f) {
+                        camera_zoom(&camera, -1);
+                    }
+                }
+                break;
             case SDL_EVENT_MOUSE_MOTION:
                 ui_mouse_state.x = event.button.x;
                 ui_mouse_state.y = event.button.y;
@@ -1006,8 +1472,10 @@ int main(S32 argc, char** argv) {
                 break;
             }
         }
+        ZONE_END();
 
         // Handle snake action keys separately.
+        ZONE_BEGIN("input");
         {
             const bool* keyboard_state = SDL_GetKeyboardState(NULL);
 
@@ -1026,7 +1494,7 @@ int main(S32 argc, char** argv) {
                 case SESSION_TYPE_SINGLE_PLAYER: {
                     if (app_game_server_handle_keystate(&server_game_state,
                                                         keyboard_state,
-                                                        cell_size,
+                                                        &camera_view,
                                                         lobby_state.players[0].type == LOBBY_PLAYER_TYPE_LOCAL_KEYBOARD,
                                                         &ui_mouse_state)) {
                         for (S32 p = 0; p < MAX_SNAKE_COUNT; p++) {
@@ -1039,9 +1507,15 @@ int main(S32 argc, char** argv) {
                     dev_mode_handle_mouse(&server_game_state.dev_mode,
                                           &server_game_state.game,
                                           &ui_mouse_state,
-                                          cell_size);
+                                          &camera_view);
+                    // Dev mode can place tacos and snakes between ticks.
+                    if (server_game_state.dev_mode.enabled) {
+                        minimap_invalidate(&minimap);
+                    }
                     break;
                 }
+                case SESSION_TYPE_REPLAY:
+                    break;
                 }
             }
         }
@@ -1052,6 +1526,7 @@ int main(S32 argc, char** argv) {
                                 &lobby_state,
                                 &server_game_state,
                                 &client_game_state);
+        ZONE_END();
 
         // The server/single player mode should only update the game state if a tick has passed.
         bool should_tick = false;
@@ -1059,90 +1534,204 @@ int main(S32 argc, char** argv) {
         if (time_since_tick_us >= MS_TO_US(game->settings.tick_ms)) {
             time_since_tick_us -= MS_TO_US(game->settings.tick_ms);
             should_send_state = true;
+            if (app_state == APP_STATE_GAME) {
+                frame_scheduler_invalidate(&frame_scheduler);
+            }
             if (server_game_state.game.state == GAME_STATE_PLAYING &&
                 dev_mode_should_step(&server_game_state.dev_mode)) {
                 server_game_state.dev_mode.should_step = false;
                 __tick++;
+                net_trace_set_tick(__tick);
                 should_tick = true;
             }
         }
 
+        ZONE_BEGIN("update");
         switch (session_type) {
         case SESSION_TYPE_CLIENT: {
             // TODO: Check if our socket is still alive, otherwise we have to press a key after
             // the server disconnects.
+            if (client_socket == NULL) {
+                break;
+            }
 
             // Send our lobby or snake action to the server if there is one.
+            // Spectators just watch, the server ignores anything else they send.
+            if (spectate) {
+                lobby_state.actions[0] = LOBBY_ACTION_NONE;
+                client_game_state.snake_actions = SNAKE_ACTION_NONE;
+            }
+
             if (lobby_state.actions[0] != LOBBY_ACTION_NONE) {
                 Packet packet = {
                     .header = {
                         .type = PACKET_TYPE_LOBBY_ACTION,
-                        .payload_size = sizeof(lobby_state.actions[0]),
                         .sequence = client_sequence++
                     },
+                    .size = sizeof(lobby_state.actions[0]),
                     .payload = (U8*)lobby_state.actions
                 };
 
-                if (!packet_send(client_socket, &packet)) {
-                    fprintf(stderr, "failed to send entire header for snake action\n");
+                if (!packet_send_queue_push(&client_send_queue, &packet, false)) {
+                    fprintf(stderr, "failed to queue lobby action\n");
                 }
 
                 lobby_state.actions[0] = LOBBY_ACTION_NONE;
             }
 
             if (client_game_state.snake_actions != SNAKE_ACTION_NONE) {
+                TickedSnakeAction ticked_action = {
+                    .tick = app_game_client_input_target_tick(&client_game_state),
+                    .action = client_game_state.snake_actions
+                };
+                U8 ticked_action_buffer[sizeof(TickedSnakeAction)];
+                size_t msg_size = ticked_snake_action_serialize(&ticked_action,
+                                                                ticked_action_buffer,
+                                                                sizeof(ticked_action_buffer));
+
                 Packet packet = {
                     .header = {
                         .type = PACKET_TYPE_SNAKE_ACTION,
-                        .payload_size = sizeof(client_game_state.snake_actions),
                         .sequence = client_sequence++
                     },
-                    .payload = (U8*)&client_game_state.snake_actions
+                    .size = (U32)(msg_size),
+                    .payload = ticked_action_buffer
                 };
 
-                if (!packet_send(client_socket, &packet)) {
-                    fprintf(stderr, "failed to send entire header for snake action\n");
+                if (!packet_send_queue_push(&client_send_queue, &packet, false)) {
+                    fprintf(stderr, "failed to queue snake action\n");
                 }
             }
 
+            // Sockets are non-blocking, whatever doesn't fit goes out on a later frame.
+            if (!packet_send_queue_flush(&client_send_queue, client_socket)) {
+                fputs(net_get_error(), stderr);
+                packet_send_queue_clear(&client_send_queue);
+                net_destroy_socket(client_socket);
+                client_socket = NULL;
+                break;
+            }
+
             packet_receive(client_socket,
                            &client_receive_packet,
                            &recv_game_state_state);
 
             if ( recv_game_state_state.stage == PACKET_PROGRESS_STAGE_COMPLETE ) {
+                // The server sends the lobby and game states whether or not they changed, so only
+                // redraw for what they change. The players, map and app state are checked at the
+                // end of the frame.
                 if (client_receive_packet.header.type == PACKET_TYPE_LOBBY_STATE) {
                     if (app_state == APP_STATE_GAME) {
                         app_state = APP_STATE_LOBBY;
                     }
+                    GameSettings previous_settings = game->settings;
+                    U64 previous_map_hash = lobby_state.map_hash;
                     lobby_state_deserialize(client_receive_packet.payload,
-                                            client_receive_packet.header.payload_size,
+                                            client_receive_packet.size,
                                             &lobby_state,
                                             &game->settings);
+                    if (memcmp(&previous_settings, &game->settings, sizeof(previous_settings)) != 0 ||
+                        previous_map_hash != lobby_state.map_hash) {
+                        frame_scheduler_invalidate(&frame_scheduler);
+                    }
 
-                } else if (client_receive_packet.header.type == PACKET_TYPE_LEVEL_STATE) {
-                    if (app_state == APP_STATE_LOBBY) {
+                    // Make sure we have the selected map well before the game starts, asking the
+                    // server for it if it isn't cached.
+                    const char* map_file_name = NULL;
+                    if (lobby_state.selected_map >= 0 &&
+                        lobby_state.selected_map < lobby_state.map_list.file_count) {
+                        map_file_name = lobby_state.map_list.file_names[lobby_state.selected_map];
+                    }
+                    if (map_download_begin(&client_map_download,
+                                           lobby_state.map_hash,
+                                           lobby_state.map_size,
+                                           map_file_name)) {
+                        Packet packet = {
+                            .header = {
+                                .type = PACKET_TYPE_MAP_REQUEST,
+                                .sequence = client_sequence++
+                            },
+                            .size = sizeof(lobby_state.map_hash),
+                            .payload = (U8*)&lobby_state.map_hash
+                        };
+
+                        if (!packet_send_queue_push(&client_send_queue, &packet, false)) {
+                            fprintf(stderr, "failed to queue map request\n");
+                        }
+                    }
+                } else if (client_receive_packet.header.type == PACKET_TYPE_PLAYER_INDEX &&
+                           client_receive_packet.size == sizeof(client_player_index)) {
+                    memcpy(&client_player_index, client_receive_packet.payload, sizeof(client_player_index));
+                    frame_scheduler_invalidate(&frame_scheduler);
+                } else if (client_receive_packet.header.type == PACKET_TYPE_MAP_CHUNK) {
+                    // The download progress is shown in the lobby.
+                    frame_scheduler_invalidate(&frame_scheduler);
+                    MapChunk chunk = {0};
+                    if (map_chunk_deserialize(client_receive_packet.payload,
+                                              client_receive_packet.size,
+                                              &chunk) > 0 &&
+                        map_download_add_chunk(&client_map_download, &chunk)) {
+                        printf("received map %016llx\n", (unsigned long long)client_map_download.hash);
+                    }
+
+                } else if (client_receive_packet.header.type == PACKET_TYPE_LEVEL_STATE ||
+                           client_receive_packet.header.type == PACKET_TYPE_INTEREST_STATE) {
+                    // A hash of 0 is no map selected, there's nothing to play on.
+                    bool map_ready = lobby_state.map_hash != 0 &&
+                                     client_map_download.ready &&
+                                     client_map_download.hash == lobby_state.map_hash;
+                    if (app_state == APP_STATE_LOBBY && map_ready) {
                         app_state = APP_STATE_GAME;
-                        const char* map_file_name =
-                            lobby_state.map_list.file_names[lobby_state.selected_map];
-                        char map_path[128];
-                        snprintf(map_path, 128, "assets/%s", map_file_name);
-                        if (!LoadMap(&game->map, map_path)) {
-                            printf("failed to load server selected map %s\n", map_file_name);
-                            return EXIT_FAILURE;
+                        // The buffered states share the map tiles that are about to be freed.
+                        snapshot_buffer_clear(&client_game_state.snapshots);
+                        // The map was loaded while in the lobby, hand it over to the game.
+                        if (client_game_map_hash != client_map_download.hash) {
+                            FreeMap(&game->map);
+                            game->map = client_map_download.map;
+                            memset(&client_map_download.map, 0, sizeof(client_map_download.map));
+                            client_game_map_hash = client_map_download.hash;
                         }
                     }
-                    game_deserialize(client_receive_packet.payload,
-                                     client_receive_packet.header.payload_size,
-                                     game);
+
+                    // States are dropped until the map has arrived, the server holds the start of
+                    // the game until it has finished sending it.
+                    U32 previous_tick = game->tick;
+                    GameState previous_game_state = game->state;
+                    S32 previous_wait_to_start_ms = game->settings.wait_to_start_ms;
+                    bool received_state = app_state == APP_STATE_GAME;
+                    if (received_state && client_receive_packet.header.type == PACKET_TYPE_INTEREST_STATE) {
+                        received_state = game_deserialize_interest(client_receive_packet.payload,
+                                                                   client_receive_packet.size,
+                                                                   game) > 0;
+                        if (!received_state) {
+                            fprintf(stderr, "Dropped a corrupt interest state\n");
+                        }
+                    } else if (received_state) {
+                        game_deserialize(client_receive_packet.payload,
+                                         client_receive_packet.size,
+                                         game);
+                    }
+
+                    if (received_state &&
+                        (game->tick != previous_tick ||
+                         game->state != previous_game_state ||
+                         game->settings.wait_to_start_ms != previous_wait_to_start_ms)) {
+                        frame_scheduler_invalidate(&frame_scheduler);
+                    }
+
+                    if (received_state) {
+                        net_trace_set_tick(game->tick);
+                        client_game_state.time_since_state_us = 0;
+                        snapshot_buffer_push(&client_game_state.snapshots,
+                                             game,
+                                             MS_TO_US((S64)game->settings.tick_ms),
+                                             app_time_us);
+                    }
                 }
 
-                memset(&recv_game_state_state, 0, sizeof(recv_game_state_state));
-                free(client_receive_packet.payload);
+                packet_transmission_state_reset(&recv_game_state_state);
                 memset(&client_receive_packet, 0, sizeof(client_receive_packet));
             } else if ( recv_game_state_state.stage == PACKET_PROGRESS_STAGE_ERROR ) {
-                if ( client_receive_packet.payload != NULL ) {
-                    free(client_receive_packet.payload);
-                }
                 memset(&client_receive_packet, 0, sizeof(client_receive_packet));
                 fputs(net_get_error(), stderr);
                 net_destroy_socket(client_socket);
@@ -1151,6 +1740,17 @@ int main(S32 argc, char** argv) {
             break;
         }
         case SESSION_TYPE_SERVER: {
+            // Keep the selected map's file and hash around to tell clients about and send to them.
+            if (server_map_file.map_index != lobby_state.selected_map &&
+                lobby_state.selected_map >= 0 &&
+                lobby_state.selected_map < lobby_state.map_list.file_count) {
+                char map_path[128];
+                snprintf(map_path, 128, "assets/%s", lobby_state.map_list.file_names[lobby_state.selected_map]);
+                map_file_load(&server_map_file, map_path, lobby_state.selected_map);
+                lobby_state.map_hash = server_map_file.hash;
+                lobby_state.map_size = server_map_file.size;
+            }
+
             // Server recEive input from client, update, then send game state to client
             // TODO: receive multiple snake actions, handle the last one.
             for (S32 i = 0; i < MAX_SERVER_CLIENT_COUNT; i++) {
@@ -1162,6 +1762,8 @@ int main(S32 argc, char** argv) {
                                &server_receive_packets[i],
                                &recv_snake_action_states[i]);
 
+                // What clients send shows up through the lobby players and the game ticking, which
+                // are checked for redraws on their own.
                 if (recv_snake_action_states[i].stage == PACKET_PROGRESS_STAGE_COMPLETE) {
                     if (server_receive_packets[i].header.type == PACKET_TYPE_LOBBY_ACTION &&
                         app_state == APP_STATE_LOBBY) {
@@ -1174,22 +1776,61 @@ int main(S32 argc, char** argv) {
                         }
                     } else if (server_receive_packets[i].header.type == PACKET_TYPE_SNAKE_ACTION &&
                                app_state == APP_STATE_GAME) {
-                        SnakeAction client_snake_action = *(SnakeAction*)server_receive_packets[i].payload;
-                        for (S32 p = 0; p < MAX_SNAKE_COUNT; p++) {
+                        TickedSnakeAction ticked_action = {0};
+                        size_t msg_size = ticked_snake_action_deserialize(server_receive_packets[i].payload,
+                                                                          server_receive_packets[i].size,
+                                                                          &ticked_action);
+                        for (S32 p = 0; p < MAX_SNAKE_COUNT && msg_size > 0; p++) {
                             if (lobby_state.players[p].type == LOBBY_PLAYER_TYPE_NETWORK &&
                                 lobby_state.players[p].input_index == i) {
-                                action_buffer_add(server_game_state.action_buffers + p, client_snake_action);
+                                InputTimeline* timeline = server_game_state.input_timelines + p;
+                                InputArrival arrival = input_timeline_add(timeline,
+                                                                          ticked_action.tick,
+                                                                          ticked_action.action);
+                                if (arrival != INPUT_ARRIVAL_ON_TIME) {
+                                    net_log("%s [tk %5d] client %d input for tick %u arrived %s (%d ticks)\n",
+                                            get_timestamp(),
+                                            __tick,
+                                            i,
+                                            ticked_action.tick,
+                                            arrival == INPUT_ARRIVAL_LATE ? "late" : "early",
+                                            timeline->stats.last_lead_ticks);
+                                }
                                 break;
                             }
                         }
+                    } else if (server_receive_packets[i].header.type == PACKET_TYPE_MAP_REQUEST) {
+                        U64 requested_hash = 0;
+                        if (server_receive_packets[i].size >= sizeof(requested_hash)) {
+                            memcpy(&requested_hash, server_receive_packets[i].payload, sizeof(requested_hash));
+                        }
+                        if (requested_hash != 0 && requested_hash == server_map_file.hash) {
+                            printf("sending map to client %d\n", i);
+                            server_map_uploads[i].active = true;
+                            server_map_uploads[i].hash = requested_hash;
+                            server_map_uploads[i].offset = 0;
+                        }
+                    } else if (server_receive_packets[i].header.type == PACKET_TYPE_SPECTATE) {
+                        // Give up the player slot, keeping the socket and anything part sent on it.
+                        if (spectator_list_add(&spectators, server_client_sockets[i], &server_send_queues[i])) {
+                            printf("client %d is now spectating\n", i);
+                            S32 lobby_player_index = lobby_find_network_player(&lobby_state, i);
+                            if (lobby_player_index >= 0) {
+                                lobby_remove_player(&lobby_state, lobby_player_index);
+                            }
+                            server_client_sockets[i] = NULL;
+                            server_map_uploads[i].active = false;
+                        } else {
+                            printf("no room for client %d to spectate\n", i);
+                        }
                     } else if (server_receive_packets[i].header.type == PACKET_TYPE_CLIENT_NAME) {
                         printf("received client name: %.*s\n",
-                               server_receive_packets[i].header.payload_size,
+                               server_receive_packets[i].size,
                                server_receive_packets[i].payload);
                         for (S32 p = 0; p < MAX_SNAKE_COUNT; p++) {
                             if (lobby_state.players[p].type == LOBBY_PLAYER_TYPE_NETWORK &&
                                 lobby_state.players[p].input_index == i) {
-                                size_t name_len = server_receive_packets[i].header.payload_size;
+                                size_t name_len = server_receive_packets[i].size;
                                 if (name_len >= MAX_LOBBY_PLAYER_NAME_LEN) {
                                     name_len = MAX_LOBBY_PLAYER_NAME_LEN - 1;
                                 }
@@ -1203,38 +1844,101 @@ int main(S32 argc, char** argv) {
                     }
 
                     // Resent packet state
-                    memset(&recv_snake_action_states[i], 0, sizeof(recv_snake_action_states[i]));
-                    free(server_receive_packets[i].payload);
+                    packet_transmission_state_reset(&recv_snake_action_states[i]);
                     memset(&server_receive_packets[i], 0, sizeof(server_receive_packets[i]));
                 } else if ( recv_snake_action_states[i].stage == PACKET_PROGRESS_STAGE_ERROR ) {
-                    if ( server_receive_packets[i].payload != NULL ) {
-                        free(server_receive_packets[i].payload);
-                    }
                     memset(&server_receive_packets[i], 0, sizeof(server_receive_packets[i]));
-                    memset(&recv_snake_action_states[i], 0, sizeof(recv_snake_action_states[i]));
+                    packet_transmission_state_reset(&recv_snake_action_states[i]);
                     fputs(net_get_error(), stderr);
                     handle_client_disconnect(server_client_sockets, &lobby_state, i);
                 }
             }
 
+            // Stream the map to clients that don't have it a few chunks at a time, so it goes out
+            // in the background while in the lobby or counting down.
+            bool map_uploads_pending = false;
+            for (S32 i = 0; i < MAX_SERVER_CLIENT_COUNT; i++) {
+                if (server_client_sockets[i] == NULL) {
+                    server_map_uploads[i].active = false;
+                    continue;
+                }
+
+                // Only top up the queue once the last few chunks have gone out, so the map doesn't
+                // crowd out game states for a slow client.
+                MapChunk chunk = {0};
+                for (S32 c = 0; c < MAP_CHUNKS_PER_FRAME; c++) {
+                    if (server_send_queues[i].queued_bytes >= MAP_CHUNKS_PER_FRAME * MAP_CHUNK_SIZE) {
+                        break;
+                    }
+                    if (!map_upload_next_chunk(&server_map_uploads[i], &server_map_file, &chunk)) {
+                        break;
+                    }
+
+                    size_t msg_size = map_chunk_serialize(&chunk, net_msg_buffer, net_msg_buffer_size);
+                    Packet packet = {
+                        .header = {
+                            .type = PACKET_TYPE_MAP_CHUNK,
+                            .sequence = server_sequence++
+                        },
+                        .size = (U32)(msg_size),
+                        .payload = (U8*)net_msg_buffer
+                    };
+
+                    if (!packet_send_queue_push(&server_send_queues[i], &packet, false)) {
+                        printf("failed to queue map chunk for client %d\n", i);
+                        break;
+                    }
+                }
+
+                if (server_map_uploads[i].active) {
+                    map_uploads_pending = true;
+                }
+            }
+
+            flush_client_send_queues(server_client_sockets, server_send_queues, &lobby_state);
+            spectator_list_update(&spectators,
+                                  &server_map_file,
+                                  net_msg_buffer,
+                                  net_msg_buffer_size,
+                                  &server_sequence);
+
+            if (auto_start_client_count > 0) {
+                server_auto_start(&app_state, &lobby_state, &server_game_state, auto_start_client_count);
+            }
+
             // TODO: Consolidate with SINGLE code path
             const char* map_filename = lobby_state.map_list.file_names[lobby_state.selected_map];
+            ZONE_BEGIN("app_server_update");
             app_server_update(&app_state,
                               &lobby_state,
                               &server_game_state,
                               should_tick,
                               time_since_last_frame_us,
-                              map_filename);
+                              map_filename,
+                              map_uploads_pending);
+            ZONE_END();
             if (!should_send_state) {
                 break;
             }
 
+            bool player_slot_free = false;
+            for (S32 i = 0; i < MAX_SERVER_CLIENT_COUNT; i++) {
+                player_slot_free |= server_client_sockets[i] == NULL;
+            }
+
+            // Serialize the full state at most once and share it between every send queue that
+            // needs it. With area of interest filtering, players get their own smaller state instead.
+            PacketBuffer* state_buffer = NULL;
+
             // Listen for client connections
             for (S32 i = 0; i < MAX_SERVER_CLIENT_COUNT; i++) {
                 if (server_client_sockets[i] == NULL) {
                     bool result = net_accept(server_socket, &server_client_sockets[i]);
                     if (result) {
                         if (server_client_sockets[i] != NULL) {
+                            memset(&server_map_uploads[i], 0, sizeof(server_map_uploads[i]));
+                            packet_send_queue_clear(&server_send_queues[i]);
+                            server_sent_player_indices[i] = -1;
                             for (S32 p = 0; p < MAX_SNAKE_COUNT; p++) {
                                 if (lobby_state.players[p].state == LOBBY_PLAYER_STATE_NONE) {
                                     lobby_state.players[p].state = LOBBY_PLAYER_STATE_NOT_READY;
@@ -1252,263 +1956,614 @@ int main(S32 argc, char** argv) {
                     } else {
                         fprintf(stderr, "%s\n", net_get_error());
                     }
-                } else if (app_state == APP_STATE_LOBBY) {
-                    // Serialize game state
-                    size_t msg_size = lobby_state_serialize(&lobby_state,
-                                                            &game->settings,
-                                                            net_msg_buffer,
-                                                            net_msg_buffer_size);
-
-                    // Send packet header
-                    Packet packet = {
-                        .header = {
-                            .type = PACKET_TYPE_LOBBY_STATE,
-                            .payload_size = (U16)(msg_size),
-                            .sequence = server_sequence++
-                        },
-                        .payload = (U8*)net_msg_buffer
-                    };
+                } else {
+                    // Players can move to a lower slot when someone before them leaves, so tell
+                    // the client whenever its slot changes.
+                    S32 player_index = lobby_find_network_player(&lobby_state, i);
+                    if (player_index != server_sent_player_indices[i]) {
+                        Packet packet = {
+                            .header = {
+                                .type = PACKET_TYPE_PLAYER_INDEX,
+                                .sequence = server_sequence++
+                            },
+                            .size = sizeof(player_index),
+                            .payload = (U8*)&player_index
+                        };
+                        if (packet_send_queue_push(&server_send_queues[i], &packet, false)) {
+                            server_sent_player_indices[i] = player_index;
+                        } else {
+                            printf("failed to queue player index for client %d\n", i);
+                        }
+                    }
 
-                    if (!packet_send(server_client_sockets[i], &packet)) {
-                        printf("failed to send lobby state for tick: %d\n", __tick);
-                        handle_client_disconnect(server_client_sockets, &lobby_state, i);
+                    bool queued_interest_state = interest_radius > 0 &&
+                                                 app_state == APP_STATE_GAME &&
+                                                 server_queue_interest_state(&server_send_queues[i],
+                                                                             &lobby_state,
+                                                                             game,
+                                                                             i,
+                                                                             interest_radius,
+                                                                             net_msg_buffer,
+                                                                             net_msg_buffer_size,
+                                                                             &server_sequence);
+                    if (queued_interest_state) {
+                        continue;
                     }
-                } else if (app_state == APP_STATE_GAME) {
-                    // Serialize game state
-                    size_t msg_size = game_serialize(game,
-                                                     net_msg_buffer,
-                                                     net_msg_buffer_size);
 
-                    // Send packet header
-                    Packet packet = {
-                        .header = {
-                            .type = PACKET_TYPE_LEVEL_STATE,
-                            .payload_size = (U16)(msg_size),
-                            .sequence = server_sequence++
-                        },
-                        .payload = (U8*)net_msg_buffer
-                    };
+                    if (state_buffer == NULL) {
+                        state_buffer = server_create_state_buffer(app_state,
+                                                                  &lobby_state,
+                                                                  game,
+                                                                  net_msg_buffer,
+                                                                  net_msg_buffer_size,
+                                                                  &server_sequence);
+                    }
+                    if (state_buffer != NULL &&
+                        !packet_send_queue_push_buffer(&server_send_queues[i], state_buffer, true)) {
+                        printf("failed to queue state for tick: %d\n", __tick);
+                    }
+                }
+            }
+
+            if (state_buffer == NULL && spectators.count > 0) {
+                state_buffer = server_create_state_buffer(app_state,
+                                                          &lobby_state,
+                                                          game,
+                                                          net_msg_buffer,
+                                                          net_msg_buffer_size,
+                                                          &server_sequence);
+            }
 
-                    if (!packet_send(server_client_sockets[i], &packet)) {
-                        printf("failed to send game state for tick: %d\n", __tick);
-                        handle_client_disconnect(server_client_sockets, &lobby_state, i);
+            // Once every player slot is taken, anyone else who connects watches.
+            if (!player_slot_free) {
+                NetSocket* spectator_socket = NULL;
+                if (!net_accept(server_socket, &spectator_socket)) {
+                    fprintf(stderr, "%s\n", net_get_error());
+                } else if (spectator_socket != NULL) {
+                    if (spectator_list_add(&spectators, spectator_socket, NULL)) {
+                        puts("game full, new connection is spectating");
+                    } else {
+                        net_destroy_socket(spectator_socket);
                     }
                 }
             }
 
+            // Spectators joining a game in progress need the lobby state for the map and settings
+            // before their first game state.
+            PacketBuffer* join_buffer = NULL;
+            if (state_buffer != NULL && app_state == APP_STATE_GAME &&
+                spectator_list_needs_keyframe(&spectators)) {
+                Packet lobby_packet = {
+                    .header = {
+                        .type = PACKET_TYPE_LOBBY_STATE,
+                        .sequence = server_sequence++
+                    },
+                    .size = (U32)(lobby_state_serialize(&lobby_state,
+                                                        &game->settings,
+                                                        net_msg_buffer,
+                                                        net_msg_buffer_size)),
+                    .payload = (U8*)net_msg_buffer
+                };
+                join_buffer = packet_buffer_create(&lobby_packet);
+            }
+
+            spectator_list_send_state(&spectators, join_buffer, state_buffer);
+            packet_buffer_release(join_buffer);
+            packet_buffer_release(state_buffer);
+            flush_client_send_queues(server_client_sockets, server_send_queues, &lobby_state);
+            spectator_list_update(&spectators,
+                                  &server_map_file,
+                                  net_msg_buffer,
+                                  net_msg_buffer_size,
+                                  &server_sequence);
             break;
         }
         case SESSION_TYPE_SINGLE_PLAYER: {
             const char* map_filename = lobby_state.map_list.file_names[lobby_state.selected_map];
+            ZONE_BEGIN("app_server_update");
             app_server_update(&app_state,
                               &lobby_state,
                               &server_game_state,
                               should_tick,
                               time_since_last_frame_us,
-                              map_filename);
+                              map_filename,
+                              false);
+            ZONE_END();
             break;
         }
+        case SESSION_TYPE_REPLAY: {
+            // Runs as many ticks as are due at the current speed, which at high speeds can be
+            // several a frame.
+            S64 tick_us = MS_TO_US((S64)game->settings.tick_ms);
+            replay_time_us += time_since_last_frame_us * replay_speed;
+            while (!replay_finished && tick_us > 0 && replay_time_us >= tick_us) {
+                replay_time_us -= tick_us;
+
+                SnakeAction snake_actions[MAX_SNAKE_COUNT];
+                if (!replay_next_tick(&replay, snake_actions)) {
+                    replay_finished = true;
+                    frame_scheduler_invalidate(&frame_scheduler);
+                    break;
+                }
+                game_update(game, snake_actions);
+                frame_scheduler_invalidate(&frame_scheduler);
+            }
+            break;
+        }
+        }
+        ZONE_END();
+
+        // Redraw if anything shown has changed since the last frame, and it is time for one.
+        if (app_state != frame_start_app_state ||
+            lobby_state.selected_map != frame_start_selected_map ||
+            spectators.count != frame_start_spectator_count ||
+            memcmp(lobby_state.players, frame_start_players, sizeof(frame_start_players)) != 0) {
+            frame_scheduler_invalidate(&frame_scheduler);
+        }
+
+        // Clients slide the snakes between states, which changes every frame.
+        if (app_state == APP_STATE_GAME &&
+            session_type == SESSION_TYPE_CLIENT &&
+            game->state == GAME_STATE_PLAYING) {
+            frame_scheduler_invalidate(&frame_scheduler);
         }
 
         //
         // Render game
         //
+        if (frame_scheduler_begin_frame(&frame_scheduler, SDL_GetTicksNS())) {
+            ZONE_BEGIN("render");
 
-        // Clear window
-        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0xFF);
-        SDL_RenderClear(renderer);
+            // Clear window
+            SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0xFF);
+            SDL_RenderClear(renderer);
 
-        float font_scale = (float)(40 / 16); // 16 is the sprite sheet tile size.
+            float font_scale = (float)(40 / 16); // 16 is the sprite sheet tile size.
 
-        // Draw level
-        if (app_state == APP_STATE_LOBBY) {
-            PF_SetForeground(font, 255, 255, 255, 255);
-            PF_SetScale(font, font_scale);
-
-            PF_FontState font_state = PF_GetState(font);
-
-            PF_RenderString(font, 3, 6, "Settings");
-            PF_RenderString(font, 42, 38, "Chomping");
-            PF_RenderString(font, 42, 64, "Constricting");
-            PF_RenderString(font, 42, 90, "Head Invincible");
-            PF_RenderString(font, 42, 116, "Zero Tacos Respawn");
-            PF_RenderString(font, 240, 38, "Segment HP: %d", game->settings.segment_health);
-            PF_RenderString(font, 480, 38, "Start Len: %d", game->settings.starting_length);
-            PF_RenderString(font, 720, 38, "Tacos: %d", game->settings.taco_count);
-            PF_RenderString(font, 480, 90, "Tick MS: %d", game->settings.tick_ms);
-            PF_RenderString(font, 720, 90, "Chomp CD ticks: %d", game->settings.chomp_cooldown_ticks);
-            PF_RenderString(font, 500, 148, "Map");
-
-            {
-                UIMouseState* mouse_state = &ui_mouse_state;
-                UIMouseState empty = {0};
-
-                // The client cannot modify the lobby ui, its readonly, so just always pass in an
-                // empty state.
-                if (session_type == SESSION_TYPE_CLIENT) {
-                    mouse_state = &empty;
+            // Draw level
+            if (app_state == APP_STATE_LOBBY) {
+                ZONE_BEGIN("lobby ui");
+                PF_SetForeground(font, 255, 255, 255, 255);
+                PF_SetScale(font, font_scale);
+
+                PF_FontState font_state = PF_GetState(font);
+
+                // The labels go down in one draw, before the widgets so an open drop down still covers them.
+                PF_BeginBatch(font);
+                PF_RenderString(font, 3, 6, "Settings");
+                PF_RenderString(font, 42, 38, "Chomping");
+                PF_RenderString(font, 42, 64, "Constricting");
+                PF_RenderString(font, 42, 90, "Head Invincible");
+                PF_RenderString(font, 42, 116, "Zero Tacos Respawn");
+                PF_RenderString(font, 240, 38, "Segment HP: %d", game->settings.segment_health);
+                PF_RenderString(font, 480, 38, "Start Len: %d", game->settings.starting_length);
+                PF_RenderString(font, 720, 38, "Tacos: %d", game->settings.taco_count);
+                PF_RenderString(font, 480, 90, "Tick MS: %d", game->settings.tick_ms);
+                PF_RenderString(font, 720, 90, "Chomp CD ticks: %d", game->settings.chomp_cooldown_ticks);
+                PF_RenderString(font, 500, 148, "Map");
+                if (session_type == SESSION_TYPE_CLIENT && lobby_state.map_hash == 0) {
+                    PF_RenderString(font, 720, 148, "No map selected");
+                } else if (session_type == SESSION_TYPE_CLIENT && client_map_download.requested) {
+                    PF_RenderString(font, 720, 148, "Downloading: %d%%",
+                                    (S32)((100.0 * client_map_download.received_bytes) /
+                                          (client_map_download.size ? client_map_download.size : 1)));
                 }
+                PF_EndBatch(font);
 
-                ui_checkbox(&ui,
-                            renderer,
-                            mouse_state,
-                            &ui_enable_chomping_checkbox,
-                            &game->settings.enable_chomping);
-                ui_checkbox(&ui,
-                            renderer,
-                            mouse_state,
-                            &ui_enable_constricting_checkbox,
-                            &game->settings.enable_constricting);
-                ui_checkbox(&ui,
-                            renderer,
-                            mouse_state,
-                            &ui_head_invincible_checkbox,
-                            &game->settings.head_invincible);
-                ui_checkbox(&ui,
-                            renderer,
-                            mouse_state,
-                            &ui_zero_tacos_respawn_checkbox,
-                            &game->settings.zero_tacos_respawn);
-                ui_slider(&ui,
-                          renderer,
-                          mouse_state,
-                          &ui_segment_health_slider,
-                          &game->settings.segment_health);
-                ui_slider(&ui,
-                          renderer,
-                          mouse_state,
-                          &ui_snake_length_slider,
-                          &game->settings.starting_length);
-                ui_slider(&ui,
-                          renderer,
-                          mouse_state,
-                          &ui_taco_count_slider,
-                          &game->settings.taco_count);
-                ui_slider(&ui,
-                          renderer,
-                          mouse_state,
-                          &ui_tick_ms_slider,
-                          &game->settings.tick_ms);
-
-                ui_slider(&ui,
-                          renderer,
-                          mouse_state,
-                          &ui_chomp_cooldown_ticks_slider,
-                          &game->settings.chomp_cooldown_ticks);
-
-                ui_dropdown(&ui,
-                            renderer,
-                            mouse_state,
-                            &ui_maps_drop_down,
-                            lobby_state.map_list.file_names,
-                            lobby_state.map_list.file_count,
-                            &lobby_state.selected_map);
-            }
+                {
+                    UIMouseState* mouse_state = &ui_mouse_state;
+                    UIMouseState empty = {0};
 
-            S32 lobby_cell_size = 40;
-            S32 players_start_y = 148;
-            S32 players_offset = 30;
+                    // The client cannot modify the lobby ui, its readonly, so just always pass in an
+                    // empty state.
+                    if (session_type == SESSION_TYPE_CLIENT) {
+                        mouse_state = &empty;
+                    }
 
-            PF_RenderString(font, 3, players_start_y, "Players");
-            for (S32 i = 0; i < MAX_SNAKE_COUNT; i++) {
-                if (lobby_state.players[i].state != LOBBY_PLAYER_STATE_NONE) {
-                    PF_SetForeground(font, 255, 255, 255, 255);
-                    S32 name_len = (S32)(strnlen(lobby_state.players[i].name, MAX_LOBBY_PLAYER_NAME_LEN));
-                    S32 name_pixel_width = (S32)(((name_len * font_state.char_width) + ((name_len - 1) * font_state.letter_spacing)) * font_state.scale);
-                    PF_RenderString(font,
-                                    130 - (name_pixel_width / 2),
-                                    players_start_y + players_offset + lobby_cell_size * 2 * i,
-                                    "%s",
-                                    lobby_state.players[i].name);
+                    ui_checkbox(&ui,
+                                renderer,
+                                mouse_state,
+                                &ui_enable_chomping_checkbox,
+                                &game->settings.enable_chomping);
+                    ui_checkbox(&ui,
+                                renderer,
+                                mouse_state,
+                                &ui_enable_constricting_checkbox,
+                                &game->settings.enable_constricting);
+                    ui_checkbox(&ui,
+                                renderer,
+                                mouse_state,
+                                &ui_head_invincible_checkbox,
+                                &game->settings.head_invincible);
+                    ui_checkbox(&ui,
+                                renderer,
+                                mouse_state,
+                                &ui_zero_tacos_respawn_checkbox,
+                                &game->settings.zero_tacos_respawn);
+                    ui_slider(&ui,
+                              renderer,
+                              mouse_state,
+                              &ui_segment_health_slider,
+                              &game->settings.segment_health);
+                    ui_slider(&ui,
+                              renderer,
+                              mouse_state,
+                              &ui_snake_length_slider,
+                              &game->settings.starting_length);
+                    ui_slider(&ui,
+                              renderer,
+                              mouse_state,
+                              &ui_taco_count_slider,
+                              &game->settings.taco_count);
+                    ui_slider(&ui,
+                              renderer,
+                              mouse_state,
+                              &ui_tick_ms_slider,
+                              &game->settings.tick_ms);
+
+                    ui_slider(&ui,
+                              renderer,
+                              mouse_state,
+                              &ui_chomp_cooldown_ticks_slider,
+                              &game->settings.chomp_cooldown_ticks);
+
+                    ui_dropdown(&ui,
+                                renderer,
+                                mouse_state,
+                                &ui_maps_drop_down,
+                                lobby_state.map_list.file_names,
+                                lobby_state.map_list.file_count,
+                                lobby_state.map_list.generation,
+                                &lobby_state.selected_map);
+                }
 
-                    if (lobby_state.players[i].state == LOBBY_PLAYER_STATE_READY) {
-                        PF_SetForeground(font, 0, 255, 0, 255);
+                S32 lobby_cell_size = 40;
+                S32 players_start_y = 148;
+                S32 players_offset = 30;
+
+                PF_BeginBatch(font);
+                PF_RenderString(font, 3, players_start_y, "Players");
+                sprite_batch_begin(&sprite_batch, snake_texture);
+                for (S32 i = 0; i < MAX_SNAKE_COUNT; i++) {
+                    if (lobby_state.players[i].state != LOBBY_PLAYER_STATE_NONE) {
+                        PF_SetForeground(font, 255, 255, 255, 255);
+                        S32 name_len = (S32)(strnlen(lobby_state.players[i].name, MAX_LOBBY_PLAYER_NAME_LEN));
+                        S32 name_pixel_width = (S32)(((name_len * font_state.char_width) + ((name_len - 1) * font_state.letter_spacing)) * font_state.scale);
                         PF_RenderString(font,
-                                        260,
-                                        players_start_y + players_offset + (lobby_cell_size * 2 * i) + lobby_cell_size - 5,
-                                        "Ready");
+                                        130 - (name_pixel_width / 2),
+                                        players_start_y + players_offset + lobby_cell_size * 2 * i,
+                                        "%s",
+                                        lobby_state.players[i].name);
+
+                        if (lobby_state.players[i].state == LOBBY_PLAYER_STATE_READY) {
+                            PF_SetForeground(font, 0, 255, 0, 255);
+                            PF_RenderString(font,
+                                            260,
+                                            players_start_y + players_offset + (lobby_cell_size * 2 * i) + lobby_cell_size - 5,
+                                            "Ready");
+                        } else {
+                            PF_SetForeground(font, 255, 0, 0, 255);
+                            PF_RenderString(font,
+                                            260,
+                                            players_start_y + players_offset + (lobby_cell_size * 2 * i) + lobby_cell_size - 5,
+                                            "Not Ready");
+                        }
+
+                        Snake snake = {0};
+                        snake_init(&snake, 5);
+                        snake.length = 4;
+                        snake.direction = DIRECTION_EAST;
+                        snake.color = lobby_state.players[i].snake_color;
+                        for (S32 e = 0; e < 4; e++) {
+                            snake.segments[e].x = (S16)(4 - e);
+                            snake.segments[e].y = (S16)(5 + (i * 2));
+                            snake.segments[e].health = 3;
+                        }
+                        snake_draw(&sprite_batch, &snake, NULL, 1.0f, lobby_cell_size, 0, 0, NULL, 3, NULL);
+                        snake_destroy(&snake);
+                    }
+                }
+                sprite_batch_draw(&sprite_batch, renderer);
+                PF_EndBatch(font);
+                ZONE_END();
+            } else if (app_state == APP_STATE_GAME) {
+                ZONE_BEGIN("game ui");
+
+                // Clients render slightly behind the server, between the buffered states.
+                Game* render_game = game;
+                Game* prev_render_game = NULL;
+                float interpolation = 1.0f;
+                if (session_type == SESSION_TYPE_CLIENT) {
+                    if (!snapshot_buffer_sample(&client_game_state.snapshots,
+                                                app_time_us,
+                                                &prev_render_game,
+                                                &render_game,
+                                                &interpolation)) {
+                        render_game = game;
+                    }
+                }
+
+                // A new map starts zoomed in as far as it can while still fitting the window, or at 1x
+                // when it's too big for that.
+                if (game->map.revision != camera_map_revision) {
+                    camera_map_revision = game->map.revision;
+                    camera.zoom = camera_fit_zoom(game->map.width,
+                                                  game->map.height,
+                                                  cell_pixel_size,
+                                                  window_width,
+                                                  window_height);
+                }
+
+                // Follow the local player, which on a client is the one the server told us we control.
+                S32 camera_snake_index = 0;
+                if (session_type == SESSION_TYPE_CLIENT &&
+                    client_player_index >= 0 && client_player_index < MAX_SNAKE_COUNT) {
+                    camera_snake_index = client_player_index;
+                }
+                snake_head_draw_position(render_game,
+                                         prev_render_game,
+                                         interpolation,
+                                         camera_snake_index,
+                                         &camera.center_x,
+                                         &camera.center_y);
+
+                // Anything drawn over the game in window pixels must use camera_view's offset and
+                // cell_size.
+                camera_view = camera_get_view(&camera,
+                                              game->map.width,
+                                              game->map.height,
+                                              cell_pixel_size,
+                                              window_width,
+                                              window_height);
+
+                // The visible part of the game is drawn at the sprite sheet's own size into game_target,
+                // then scaled up to the window by a whole number so every texel covers the same number
+                // of pixels. Zoomed out too far for that, it is drawn at the window's size instead.
+                S32 target_cell_size = (camera_view.cell_size < cell_pixel_size) ? camera_view.cell_size : cell_pixel_size;
+                S32 target_scale = camera_view.cell_size / target_cell_size;
+
+                // Big enough for the most cells that can be partly on screen at once, so scrolling
+                // doesn't resize it.
+                S32 target_columns = window_width / camera_view.cell_size + 2;
+                S32 target_rows = window_height / camera_view.cell_size + 2;
+                if (target_columns > game->map.width) {
+                    target_columns = game->map.width;
+                }
+                if (target_rows > game->map.height) {
+                    target_rows = game->map.height;
+                }
+
+                S32 target_width = target_columns * target_cell_size;
+                S32 target_height = target_rows * target_cell_size;
+
+                // When the target is too big for the renderer or can't be created, the game is drawn
+                // straight to the window instead.
+                bool use_target = target_width > 0 && target_height > 0 &&
+                                  (max_texture_size <= 0 ||
+                                   (target_width <= max_texture_size && target_height <= max_texture_size)) &&
+                                  (target_width != failed_target_width || target_height != failed_target_height);
+                if (use_target &&
+                    (game_target == NULL || game_target->w != target_width || game_target->h != target_height)) {
+                    SDL_DestroyTexture(game_target);
+                    game_target = SDL_CreateTexture(renderer,
+                                                    SDL_PIXELFORMAT_RGBA8888,
+                                                    SDL_TEXTUREACCESS_TARGET,
+                                                    target_width,
+                                                    target_height);
+                    if (game_target == NULL) {
+                        fprintf(stderr, "Failed to create %dx%d game target, drawing to the window: %s\n",
+                                target_width,
+                                target_height,
+                                SDL_GetError());
+                        failed_target_width = target_width;
+                        failed_target_height = target_height;
+                        use_target = false;
                     } else {
-                        PF_SetForeground(font, 255, 0, 0, 255);
-                        PF_RenderString(font,
-                                        260,
-                                        players_start_y + players_offset + (lobby_cell_size * 2 * i) + lobby_cell_size - 5,
-                                        "Not Ready");
+                        SDL_SetTextureScaleMode(game_target, SDL_SCALEMODE_NEAREST);
+                    }
+                }
+
+                if (use_target && camera_view.cells.max_x >= camera_view.cells.min_x) {
+                    SpatialRect visible_cells = camera_view.cells;
+                    S32 visible_width = (visible_cells.max_x - visible_cells.min_x + 1) * target_cell_size;
+                    S32 visible_height = (visible_cells.max_y - visible_cells.min_y + 1) * target_cell_size;
+
+                    SDL_SetRenderTarget(renderer, game_target);
+                    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0xFF);
+                    SDL_RenderClear(renderer);
+
+                    // The top left visible cell goes in the top left corner of the target.
+                    bool drew_game = draw_game(render_game,
+                                               prev_render_game,
+                                               interpolation,
+                                               renderer,
+                                               snake_texture,
+                                               tileset_texture,
+                                               &map_texture,
+                                               &sprite_batch,
+                                               snake_sprite_caches,
+                                               target_cell_size,
+                                               -visible_cells.min_x * target_cell_size,
+                                               -visible_cells.min_y * target_cell_size,
+                                               visible_cells);
+                    SDL_SetRenderTarget(renderer, NULL);
+                    if (!drew_game) {
+                        return EXIT_FAILURE;
+                    }
+
+                    SDL_FRect source_rect = {
+                        .w = (float)(visible_width),
+                        .h = (float)(visible_height)
+                    };
+                    SDL_FRect game_rect = {
+                        .x = (float)(camera_view.offset_x + visible_cells.min_x * camera_view.cell_size),
+                        .y = (float)(camera_view.offset_y + visible_cells.min_y * camera_view.cell_size),
+                        .w = (float)(visible_width * target_scale),
+                        .h = (float)(visible_height * target_scale)
+                    };
+                    SDL_RenderTexture(renderer, game_target, &source_rect, &game_rect);
+                } else if (camera_view.cells.max_x >= camera_view.cells.min_x) {
+                    bool drew_game = draw_game(render_game,
+                                               prev_render_game,
+                                               interpolation,
+                                               renderer,
+                                               snake_texture,
+                                               tileset_texture,
+                                               &map_texture,
+                                               &sprite_batch,
+                                               snake_sprite_caches,
+                                               camera_view.cell_size,
+                                               camera_view.offset_x,
+                                               camera_view.offset_y,
+                                               camera_view.cells);
+                    if (!drew_game) {
+                        return EXIT_FAILURE;
+                    }
+                }
+
+                // When the map doesn't all fit on screen, show where the view is on a minimap in the
+                // top right corner, no more than a quarter of the window across.
+                S32 map_width = game->map.width;
+                S32 map_height = game->map.height;
+                if (camera_view.cells.max_x >= camera_view.cells.min_x &&
+                    (camera_view.cells.max_x - camera_view.cells.min_x + 1 < map_width ||
+                     camera_view.cells.max_y - camera_view.cells.min_y + 1 < map_height)) {
+                    ZONE_BEGIN("minimap");
+                    if (!minimap_update(&minimap, renderer, render_game)) {
+                        return EXIT_FAILURE;
                     }
 
-                    Snake snake = {0};
-                    snake_init(&snake, 5);
-                    snake.length = 4;
-                    snake.direction = DIRECTION_EAST;
-                    snake.color = lobby_state.players[i].snake_color;
-                    for (S32 e = 0; e < 4; e++) {
-                        snake.segments[e].x = (S16)(4 - e);
-                        snake.segments[e].y = (S16)(5 + (i * 2));
-                        snake.segments[e].health = 3;
+                    float minimap_max_size = (float)(window_width / 4);
+                    float minimap_scale = SDL_min(minimap_max_size / (float)(map_width),
+                                                  minimap_max_size / (float)(map_height));
+                    if (minimap_scale >= 1.0f) {
+                        minimap_scale = (float)((S32)(minimap_scale));
                     }
-                    snake_draw(renderer, snake_texture, &snake, lobby_cell_size, 0, 0, 3);
-                    snake_destroy(&snake);
+
+                    SDL_FRect minimap_rect = {
+                        .w = (float)(map_width) * minimap_scale,
+                        .h = (float)(map_height) * minimap_scale
+                    };
+                    minimap_rect.x = (float)(window_width) - minimap_rect.w - 4.0f;
+                    minimap_rect.y = 4.0f;
+                    minimap_draw(&minimap, renderer, &minimap_rect);
+
+                    SDL_FRect view_rect = {
+                        .x = minimap_rect.x + (float)(camera_view.cells.min_x) * minimap_scale,
+                        .y = minimap_rect.y + (float)(camera_view.cells.min_y) * minimap_scale,
+                        .w = (float)(camera_view.cells.max_x - camera_view.cells.min_x + 1) * minimap_scale,
+                        .h = (float)(camera_view.cells.max_y - camera_view.cells.min_y + 1) * minimap_scale
+                    };
+                    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+                    SDL_RenderRect(renderer, &view_rect);
+                    SDL_RenderRect(renderer, &minimap_rect);
+                    ZONE_END();
                 }
-            }
-        } else if (app_state == APP_STATE_GAME) {
-            // Adjust cell size based on map dimensions and window dimensions.
-            if (game->map.width != 0 && game->map.height != 0) {
-                S32 max_map_dimension =
-                    (game->map.height > game->map.width) ? game->map.height : game->map.width;
-                cell_size = (min_display_dimension / max_map_dimension);
-                // This commented out logic ensures there are no visual artifacts by making sure the pixels are divisible.
-                // cell_size -= (cell_size % cell_pixel_size);
-            }
 
-            // Calculate offset so that map will be centered, all objects must use this offset.
-            S32 camera_offset_x = (window_width - (cell_size * game->map.width)) / 2;
-            S32 camera_offset_y = (window_height - (cell_size * game->map.height)) / 2;
-
-            if (!draw_game(game,
-                           renderer,
-                           snake_texture,
-                           tileset_texture,
-                           cell_size,
-                           camera_offset_x,
-                           camera_offset_y)) {
-                return EXIT_FAILURE;
-            }
+                // All the text over the game goes down in one draw.
+                PF_BeginBatch(font);
+                if (session_type == SESSION_TYPE_SERVER || session_type == SESSION_TYPE_SINGLE_PLAYER) {
+                    PF_SetScale(font, font_scale);
+                    dev_mode_draw(&server_game_state.dev_mode, game, font, window_width, &camera_view);
+                }
 
-            SDL_SetTextureColorMod(snake_texture, 255, 255, 255);
+                // Show how far behind each client's connection is.
+                if (session_type == SESSION_TYPE_SERVER && server_game_state.dev_mode.enabled) {
+                    PF_SetForeground(font, 255, 255, 0, 255);
+                    PF_FontState font_state = PF_GetState(font);
+                    S32 line_height = (S32)((font_state.char_height + 2) * font_state.scale);
+                    for (S32 i = 0; i < MAX_SERVER_CLIENT_COUNT; i++) {
+                        if (server_client_sockets[i] == NULL) {
+                            continue;
+                        }
+                        PF_RenderString(font,
+                                        2,
+                                        window_height - line_height * (MAX_SERVER_CLIENT_COUNT - i),
+                                        "client %d: %d queued (%zu bytes), %u dropped",
+                                        i,
+                                        server_send_queues[i].count,
+                                        server_send_queues[i].queued_bytes,
+                                        server_send_queues[i].dropped_count);
+                    }
+                    PF_RenderString(font,
+                                    2,
+                                    window_height - line_height * (MAX_SERVER_CLIENT_COUNT + 1),
+                                    "spectators: %d",
+                                    spectators.count);
+                }
 
-            if (session_type == SESSION_TYPE_SERVER || session_type == SESSION_TYPE_SINGLE_PLAYER) {
-                PF_SetScale(font, font_scale);
-                dev_mode_draw(&server_game_state.dev_mode, game, font, window_width, cell_size);
+                PF_SetScale(font, font_scale * 2.0f);
+                PF_SetForeground(font, 255, 255, 255, 255);
+
+                switch(session_type) {
+                case SESSION_TYPE_CLIENT:
+                    if (game->state == GAME_STATE_WAITING) {
+                        PF_RenderString(font, 0, 0, "Game Starting in %d seconds",
+                                        (S32)(ceil(client_game_state.game.settings.wait_to_start_ms / 1000.0)));
+                    } else if (game->state == GAME_STATE_GAME_OVER) {
+                        PF_RenderString(font, 0, 0, "Game Over!");
+                    }
+                    break;
+                case SESSION_TYPE_SERVER:
+                case SESSION_TYPE_SINGLE_PLAYER:
+                    if (game->state == GAME_STATE_WAITING) {
+                        PF_RenderString(font, 0, 0, "Game Starting in %d seconds",
+                                        (S32)(ceil(server_game_state.game.settings.wait_to_start_ms / 1000.0)));
+                    } else if (game->state == GAME_STATE_GAME_OVER) {
+                        PF_RenderString(font, 0, 0, "Game Over!");
+                    }
+                    break;
+                case SESSION_TYPE_REPLAY:
+                    PF_RenderString(font, 0, 0, "Replay %dx, tick %u%s",
+                                    replay_speed,
+                                    game->tick,
+                                    replay_finished ? " (finished)" : "");
+                    break;
+                }
+                PF_EndBatch(font);
+                ZONE_END();
             }
 
-            PF_SetScale(font, font_scale * 2.0f);
-            PF_SetForeground(font, 255, 255, 255, 255);
+            // Render updates
+            ZONE_BEGIN("present");
+            SDL_RenderPresent(renderer);
+            ZONE_END();
+            ZONE_END(); // render
+        }
 
-            switch(session_type) {
-            case SESSION_TYPE_CLIENT:
-                if (game->state == GAME_STATE_WAITING) {
-                    PF_RenderString(font, 0, 0, "Game Starting in %d seconds",
-                                    (S32)(ceil(client_game_state.game.settings.wait_to_start_ms / 1000.0)));
-                } else if (game->state == GAME_STATE_GAME_OVER) {
-                    PF_RenderString(font, 0, 0, "Game Over!");
+        // Sleep until the next tick is due, or the next frame if there is something to draw, waking
+        // early for input.
+        ZONE_BEGIN("sleep");
+        {
+            U64 now_ns = SDL_GetTicksNS();
+            S64 frame_us = (S64)((now_ns - frame_start_ns) / 1000);
+            S64 wait_us = MS_TO_US((S64)game->settings.tick_ms) - time_since_tick_us - frame_us;
+            if (session_type == SESSION_TYPE_REPLAY && !replay_finished) {
+                S64 tick_us = MS_TO_US((S64)game->settings.tick_ms);
+                wait_us = (tick_us - replay_time_us) / replay_speed - frame_us;
+            }
+            if (session_type == SESSION_TYPE_CLIENT || session_type == SESSION_TYPE_SERVER) {
+                bool map_transfer = client_map_download.requested && !client_map_download.ready;
+                for (S32 i = 0; i < MAX_SERVER_CLIENT_COUNT; i++) {
+                    map_transfer = map_transfer || server_map_uploads[i].active;
                 }
-                break;
-            case SESSION_TYPE_SERVER:
-            case SESSION_TYPE_SINGLE_PLAYER:
-                if (game->state == GAME_STATE_WAITING) {
-                    PF_RenderString(font, 0, 0, "Game Starting in %d seconds",
-                                    (S32)(ceil(server_game_state.game.settings.wait_to_start_ms / 1000.0)));
-                } else if (game->state == GAME_STATE_GAME_OVER) {
-                    PF_RenderString(font, 0, 0, "Game Over!");
+                bool focused = (SDL_GetWindowFlags(window) & SDL_WINDOW_INPUT_FOCUS) != 0;
+                bool idle = !map_transfer &&
+                            (app_state == APP_STATE_LOBBY ||
+                             (session_type == SESSION_TYPE_CLIENT && !focused));
+                S64 poll_us = MS_TO_US(idle ? NET_IDLE_POLL_INTERVAL_MS : NET_POLL_INTERVAL_MS);
+                if (wait_us > poll_us) {
+                    wait_us = poll_us;
                 }
-                break;
             }
+            if (wait_us < 0) {
+                wait_us = 0;
+            }
+            frame_scheduler_wait(&frame_scheduler, now_ns, now_ns + (U64)(wait_us) * 1000);
         }
+        ZONE_END();
 
-        // Render updates
-        SDL_RenderPresent(renderer);
-
-        // Allow process to go to sleep so we don't use 100% of CPU
-        SDL_Delay(1);
+        ZONE_END(); // frame
     }
 
     switch(session_type) {
@@ -1526,6 +2581,7 @@ int main(S32 argc, char** argv) {
         }
         break;
     case SESSION_TYPE_SINGLE_PLAYER:
+    case SESSION_TYPE_REPLAY:
         break;
     }
 
@@ -1537,11 +2593,40 @@ int main(S32 argc, char** argv) {
     }
 
     list_dir_destroy(&lobby_state.map_list);
+    map_file_destroy(&server_map_file);
+    for (S32 i = 0; i < MAX_SERVER_CLIENT_COUNT; i++) {
+        packet_send_queue_destroy(&server_send_queues[i]);
+    }
+    packet_send_queue_destroy(&client_send_queue);
+    spectator_list_destroy(&spectators);
+    map_download_destroy(&client_map_download);
+    packet_transmission_state_destroy(&recv_game_state_state);
+    for (S32 i = 0; i < MAX_SERVER_CLIENT_COUNT; i++) {
+        packet_transmission_state_destroy(&recv_snake_action_states[i]);
+    }
+    snapshot_buffer_destroy(&client_game_state.snapshots);
+    replay_recorder_end(&server_game_state.replay_recorder, &server_game_state.game);
+    replay_destroy(&replay);
     net_shutdown();
+    if (zone_enabled) {
+        char zone_file_name[64];
+        snprintf(zone_file_name, sizeof(zone_file_name), "%s.json", zone_file_prefix);
+        if (zone_write(zone_file_name)) {
+            printf("Wrote zones to %s\n", zone_file_name);
+        }
+        zone_shutdown();
+    }
     free(net_msg_buffer);
     PF_DestroyFont(font);
     game_destroy(game);
     SDL_DestroyTexture(snake_texture);
+    DestroyMapTexture(&map_texture);
+    sprite_batch_destroy(&sprite_batch);
+    SDL_DestroyTexture(game_target);
+    for (S32 i = 0; i < MAX_SNAKE_COUNT; i++) {
+        snake_sprite_cache_destroy(snake_sprite_caches + i);
+    }
+    minimap_destroy(&minimap);
     SDL_DestroyTexture(tileset_texture);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
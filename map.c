@@ -78,37 +78,65 @@ Compress(Uint16 * data, size_t data_size, size_t * compressed_size)
     return buffer;
 }
 
-static Uint16 *
-Decompress(Uint16 * data, size_t size, size_t * uncompressed_size)
+/// Decompresses a layer into a newly allocated `*out`.
+/// - returns: The number of tiles written, which is less than the header says
+///   if the data was cut short. `*out` is `NULL` if it couldn't be decompressed.
+static size_t
+Decompress(Uint16 * data, size_t size, Uint16 ** out)
 {
     size_t header_size = sizeof(Uint64);
-    *uncompressed_size = *(Uint64 *)data;
+    size_t uncompressed_size = *(Uint64 *)data;
     data += header_size / sizeof(Uint16); // Move past the header.
 
-    Uint16 * buffer = malloc(*uncompressed_size);
+    *out = NULL;
+    Uint16 * buffer = malloc(uncompressed_size);
     if ( buffer == NULL ) {
-        return NULL;
+        return 0;
     }
 
     Uint16 * source = data;
     Uint16 * source_end = data + (size - header_size) / sizeof(Uint16);
     Uint16 * dest = buffer;
+    Uint16 * dest_end = buffer + uncompressed_size / sizeof(Uint16);
 
     while ( source < source_end ) {
         Uint16 count = 1;
         Uint16 value = *source++;
 
         if ( value == (Uint16)RLE_TAG ) {
+            if ( source + 2 > source_end ) {
+                break;
+            }
             count = *source++;
             value = *source++;
         }
 
+        // Map data can come over the network, don't trust it to fit.
+        if ( count > dest_end - dest ) {
+            free(buffer);
+            return 0;
+        }
+
         for ( Uint16 i = 0; i < count; i++ ) {
             *dest++ = value;
         }
     }
 
-    return buffer;
+    *out = buffer;
+    return (size_t)(dest - buffer);
+}
+
+static Uint32
+NextMapRevision(void)
+{
+    static Uint32 revision;
+
+    // Skip 0, which means no map.
+    if ( ++revision == 0 ) {
+        revision++;
+    }
+
+    return revision;
 }
 
 void FreeMap(Map * map)
@@ -171,7 +199,54 @@ bool SaveMap(Map * map, const char * path)
     return true;
 }
 
-bool LoadMap(Map * map, const char * path)
+Uint64 HashMapData(const Uint8 * data, size_t size)
+{
+    // 64-bit FNV-1a
+    Uint64 hash = 0xcbf29ce484222325ULL;
+    for ( size_t i = 0; i < size; i++ ) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+Uint8 * ReadMapFile(const char * path, size_t * size)
+{
+    FILE * file = fopen(path, "rb");
+    if ( file == NULL ) {
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long file_size = ftell(file);
+    rewind(file);
+
+    if ( file_size <= 0 ) {
+        fclose(file);
+        return NULL;
+    }
+
+    Uint8 * data = malloc((size_t)file_size);
+    if ( data == NULL ) {
+        fprintf(stderr, "%s: malloc failed: %s\n", __func__, strerror(errno));
+        fclose(file);
+        return NULL;
+    }
+
+    if ( fread(data, (size_t)file_size, 1, file) != 1 ) {
+        fprintf(stderr, "%s: failed to read '%s'\n", __func__, path);
+        free(data);
+        fclose(file);
+        return NULL;
+    }
+
+    fclose(file);
+    *size = (size_t)file_size;
+    return data;
+}
+
+bool LoadMapFromMemory(Map * map, const Uint8 * data, size_t size)
 {
     if ( map == NULL ) {
         // TODO: assert
@@ -182,15 +257,19 @@ bool LoadMap(Map * map, const char * path)
     // Free previously loaded map.
     FreeMap(map);
 
-    FILE * file = fopen(path, "rb");
-    if ( file == NULL ) {
-        // TODO: error
+    if ( size < sizeof(MapHeader) ) {
+        fprintf(stderr, "%s: map data too small\n", __func__);
         return false;
     }
 
     MapHeader header;
-    fread(&header, sizeof(header), 1, file);
-    // TODO: error
+    memcpy(&header, data, sizeof(header));
+
+    if ( header.num_layers > MAX_LAYERS
+        || sizeof(header) + sizeof(LayerInfo) * header.num_layers > size ) {
+        fprintf(stderr, "%s: bad layer count (%d)\n", __func__, header.num_layers);
+        return false;
+    }
 
     map->num_layers = header.num_layers;
     map->width = header.width;
@@ -199,42 +278,78 @@ bool LoadMap(Map * map, const char * path)
     map->bg_color.g = header.bg_color[1];
     map->bg_color.b = header.bg_color[2];
     map->bg_color.a = 255;
+    map->revision = NextMapRevision();
 
     printf("Loading %d x %d map with %d layers\n",
            map->width, map->height, map->num_layers);
 
     // Read layer info table.
     LayerInfo layer_info[MAX_LAYERS];
-    fread(layer_info, sizeof(layer_info[0]), map->num_layers, file);
+    memcpy(layer_info, data + sizeof(header), sizeof(layer_info[0]) * map->num_layers);
 
-    // Using the layer info table, Read layer data and decompress.
+    // Using the layer info table, decompress layer data.
+    size_t expected_size = map->width * map->height * sizeof(GID);
     for ( int i = 0; i < map->num_layers; i++ ) {
         size_t data_size = layer_info[i].size;
-        fseek(file, layer_info[i].offset, SEEK_SET);
-        Uint16 * data = malloc(data_size);
-        // TODO: error
-
-        fread(data, data_size, 1, file);
-        // TODO: error
+        if ( data_size < sizeof(Uint64)
+            || layer_info[i].offset > size
+            || data_size > size - layer_info[i].offset ) {
+            fprintf(stderr, "%s: layer %d is out of bounds\n", __func__, i);
+            FreeMap(map);
+            return false;
+        }
 
-        size_t decompressed_size = 0;
-        map->tiles[i] = Decompress(data, data_size, &decompressed_size);
-        if ( map->tiles[i] == NULL ) {
-            // TODO: error
+        // Decompress reads in place, so copy the layer out to keep it aligned.
+        Uint16 * layer = malloc(data_size);
+        if ( layer == NULL ) {
+            fprintf(stderr, "%s: malloc failed: %s\n", __func__, strerror(errno));
+            FreeMap(map);
+            return false;
         }
+        memcpy(layer, data + layer_info[i].offset, data_size);
 
-        size_t expected_size = map->width * map->height * sizeof(GID);
-        if ( decompressed_size != expected_size ) {
+        if ( *(Uint64 *)layer != expected_size ) {
             fprintf(stderr, "map size mismatch\n");
+            free(layer);
+            FreeMap(map);
             return false;
         }
 
-        free(data);
+        size_t tile_count = Decompress(layer, data_size, &map->tiles[i]);
+        free(layer);
+
+        if ( map->tiles[i] == NULL ) {
+            fprintf(stderr, "%s: failed to decompress layer %d\n", __func__, i);
+            FreeMap(map);
+            return false;
+        }
+
+        // A cut off layer would leave the rest of the tiles uninitialized.
+        if ( tile_count != (size_t)map->width * map->height ) {
+            fprintf(stderr, "%s: layer %d has %zu of %d tiles\n",
+                    __func__, i, tile_count, map->width * map->height);
+            FreeMap(map);
+            return false;
+        }
     }
 
     return true;
 }
 
+bool LoadMap(Map * map, const char * path)
+{
+    size_t size = 0;
+    Uint8 * data = ReadMapFile(path, &size);
+    if ( data == NULL ) {
+        // TODO: error
+        return false;
+    }
+
+    bool result = LoadMapFromMemory(map, data, size);
+    free(data);
+    return result;
+}
+
 bool CreateMap(const char * path, Uint16 w, Uint16 h, Uint8 num_layers)
 {
     FILE * file = fopen(path, "rb");
@@ -295,6 +410,7 @@ void SetMapTile(Map * map, int x, int y, int layer, GID gid)
     }
 
     map->tiles[layer][y * map->width + x] = gid;
+    map->revision = NextMapRevision();
 }
 
 void GetTilesetPath(const char * id, char * out, size_t len)
@@ -447,3 +563,186 @@ void RenderTile2(SDL_Renderer * renderer,
 
     SDL_RenderTexture(renderer, tileset, &source, dest);
 }
+
+void DestroyMapTexture(MapTexture * map_texture)
+{
+    int chunk_count = map_texture->chunk_columns * map_texture->chunk_rows;
+    for ( int i = 0; i < chunk_count; i++ ) {
+        SDL_DestroyTexture(map_texture->chunks[i]);
+    }
+
+    free(map_texture->chunks);
+    memset(map_texture, 0, sizeof(MapTexture));
+}
+
+static bool
+BakeMapChunk(SDL_Renderer * renderer,
+             const MapTexture * map_texture,
+             SDL_Texture * chunk,
+             int chunk_x,
+             int chunk_y,
+             const Map * map,
+             SDL_Texture * tileset,
+             int tile_size)
+{
+    if ( !SDL_SetRenderTarget(renderer, chunk) ) {
+        fprintf(stderr, "%s: %s\n", __func__, SDL_GetError());
+        return false;
+    }
+
+    // Clear to transparent, so cells without tiles show whatever is behind the
+    // map.
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+    SDL_RenderClear(renderer);
+
+    int first_x = chunk_x * map_texture->chunk_cells;
+    int first_y = chunk_y * map_texture->chunk_cells;
+    int last_x = SDL_min(first_x + map_texture->chunk_cells, map->width);
+    int last_y = SDL_min(first_y + map_texture->chunk_cells, map->height);
+
+    for ( int l = 0; l < map->num_layers; l++ ) {
+        for ( int y = first_y; y < last_y; y++ ) {
+            for ( int x = first_x; x < last_x; x++ ) {
+                GID gid = map->tiles[l][y * map->width + x];
+                if ( gid == 0 ) {
+                    continue;
+                }
+
+                SDL_FRect dest = {
+                    (float)((x - first_x) * map_texture->cell_size),
+                    (float)((y - first_y) * map_texture->cell_size),
+                    (float)(map_texture->cell_size),
+                    (float)(map_texture->cell_size)
+                };
+
+                RenderTile2(renderer, gid, tileset, tile_size, &dest);
+            }
+        }
+    }
+
+    return true;
+}
+
+bool UpdateMapTexture(MapTexture * map_texture,
+                      SDL_Renderer * renderer,
+                      const Map * map,
+                      SDL_Texture * tileset,
+                      int tile_size,
+                      int cell_size)
+{
+    if ( map_texture->chunks != NULL
+        && map_texture->map_revision == map->revision
+        && map_texture->cell_size == cell_size ) {
+        return true;
+    }
+
+    DestroyMapTexture(map_texture);
+    if ( map->revision == 0 || cell_size <= 0 ) {
+        return true;
+    }
+
+    // Cells larger than a chunk get a chunk each.
+    int chunk_cells = SDL_max(MAP_TEXTURE_CHUNK_SIZE / cell_size, 1);
+    int chunk_columns = (map->width + chunk_cells - 1) / chunk_cells;
+    int chunk_rows = (map->height + chunk_cells - 1) / chunk_cells;
+
+    map_texture->chunks = calloc((size_t)(chunk_columns * chunk_rows),
+                                 sizeof(*map_texture->chunks));
+    if ( map_texture->chunks == NULL ) {
+        fprintf(stderr, "%s: calloc failed: %s\n", __func__, strerror(errno));
+        return false;
+    }
+
+    map_texture->chunk_columns = chunk_columns;
+    map_texture->chunk_rows = chunk_rows;
+    map_texture->chunk_cells = chunk_cells;
+    map_texture->cell_size = cell_size;
+    map_texture->map_revision = map->revision;
+
+    SDL_Texture * previous_target = SDL_GetRenderTarget(renderer);
+    Uint8 r, g, b, a;
+    SDL_GetRenderDrawColor(renderer, &r, &g, &b, &a);
+
+    bool result = true;
+    for ( int cy = 0; cy < chunk_rows && result; cy++ ) {
+        for ( int cx = 0; cx < chunk_columns && result; cx++ ) {
+            // Chunks along the right and bottom edges only cover what's left of
+            // the map.
+            int w = SDL_min(chunk_cells, map->width - cx * chunk_cells) * cell_size;
+            int h = SDL_min(chunk_cells, map->height - cy * chunk_cells) * cell_size;
+
+            SDL_Texture * chunk = SDL_CreateTexture(renderer,
+                                                    SDL_PIXELFORMAT_RGBA8888,
+                                                    SDL_TEXTUREACCESS_TARGET,
+                                                    w,
+                                                    h);
+            if ( chunk == NULL ) {
+                fprintf(stderr, "%s: %s\n", __func__, SDL_GetError());
+                result = false;
+                break;
+            }
+
+            map_texture->chunks[cy * chunk_columns + cx] = chunk;
+            SDL_SetTextureBlendMode(chunk, SDL_BLENDMODE_BLEND);
+            SDL_SetTextureScaleMode(chunk, SDL_SCALEMODE_NEAREST);
+            result = BakeMapChunk(renderer,
+                                  map_texture,
+                                  chunk,
+                                  cx,
+                                  cy,
+                                  map,
+                                  tileset,
+                                  tile_size);
+        }
+    }
+
+    SDL_SetRenderTarget(renderer, previous_target);
+    SDL_SetRenderDrawColor(renderer, r, g, b, a);
+
+    if ( !result ) {
+        DestroyMapTexture(map_texture);
+    }
+
+    return result;
+}
+
+void RenderMapTexture(SDL_Renderer * renderer,
+                      const MapTexture * map_texture,
+                      float x,
+                      float y,
+                      const SDL_Rect * cells)
+{
+    float chunk_size = (float)(map_texture->chunk_cells * map_texture->cell_size);
+
+    int first_cx = 0;
+    int first_cy = 0;
+    int last_cx = map_texture->chunk_columns - 1;
+    int last_cy = map_texture->chunk_rows - 1;
+
+    // Skip the chunks that are entirely outside the visible cells.
+    if ( cells != NULL ) {
+        if ( cells->w <= 0 || cells->h <= 0 ) {
+            return;
+        }
+
+        first_cx = SDL_max(cells->x / map_texture->chunk_cells, first_cx);
+        first_cy = SDL_max(cells->y / map_texture->chunk_cells, first_cy);
+        last_cx = SDL_min((cells->x + cells->w - 1) / map_texture->chunk_cells, last_cx);
+        last_cy = SDL_min((cells->y + cells->h - 1) / map_texture->chunk_cells, last_cy);
+    }
+
+    for ( int cy = first_cy; cy <= last_cy; cy++ ) {
+        for ( int cx = first_cx; cx <= last_cx; cx++ ) {
+            SDL_Texture * chunk = map_texture->chunks[cy * map_texture->chunk_columns + cx];
+
+            SDL_FRect dest = {
+                x + (float)cx * chunk_size,
+                y + (float)cy * chunk_size,
+                (float)(chunk->w),
+                (float)(chunk->h)
+            };
+
+            SDL_RenderTexture(renderer, chunk, NULL, &dest);
+        }
+    }
+}
@@ -52,10 +52,36 @@ typedef struct {
     Uint16 height;
     Uint8 num_layers;
     SDL_Color bg_color;
+    Uint32 revision; // Changes whenever the tiles do, 0 when no map is loaded.
 } Map;
 
+/// Width and height in pixels of each chunk of a map texture, kept well under
+/// the texture size limit of any renderer.
+#define MAP_TEXTURE_CHUNK_SIZE 1024
+
+/// A map's layers rendered ahead of time, so drawing the map is one texture
+/// per chunk rather than one per tile. Most maps fit in a single chunk.
+typedef struct {
+    SDL_Texture ** chunks;
+    int chunk_columns;
+    int chunk_rows;
+    int chunk_cells; // Width and height of a chunk in cells.
+    int cell_size;
+    Uint32 map_revision;
+} MapTexture;
+
 bool SaveMap(Map * map, const char * path);
 bool LoadMap(Map * map, const char * path);
+void FreeMap(Map * map);
+
+/// Load a map from the contents of a map file, as read by `ReadMapFile`.
+bool LoadMapFromMemory(Map * map, const Uint8 * data, size_t size);
+
+/// Read a whole map file without decompressing it. The caller frees the result.
+Uint8 * ReadMapFile(const char * path, size_t * size);
+
+/// Content hash of map file data, used to tell whether two map files match.
+Uint64 HashMapData(const Uint8 * data, size_t size);
 bool CreateMap(const char * path, Uint16 w, Uint16 h, Uint8 num_layers);
 
 bool IsValidPosition(const Map * map, int x, int y);
@@ -83,6 +109,34 @@ Tileset * LoadTilesets(SDL_Renderer * renderer,
                        int tile_size,
                        TilesetTextureLoader texture_loader);
 
+///
+/// Bake the map into `map_texture` if it hasn't been yet at this cell size, or
+/// the map has changed since.
+///
+/// - returns: false if the textures could not be created.
+///
+bool UpdateMapTexture(MapTexture * map_texture,
+                      SDL_Renderer * renderer,
+                      const Map * map,
+                      SDL_Texture * tileset,
+                      int tile_size,
+                      int cell_size);
+
+/// Draw a map texture with its top left corner at `x`, `y`.
+///
+/// - parameter cells: The cells that can be seen, in map coordinates. Only
+///   the chunks overlapping them are drawn. Pass NULL to draw every chunk.
+///
+void RenderMapTexture(SDL_Renderer * renderer,
+                      const MapTexture * map_texture,
+                      float x,
+                      float y,
+                      const SDL_Rect * cells);
+
+/// Drop the baked textures, e.g. after the renderer lost its render targets,
+/// so the next update bakes them again.
+void DestroyMapTexture(MapTexture * map_texture);
+
 void RenderTile(SDL_Renderer * renderer,
                 GID gid,
                 Tileset * tilesets,
@@ -0,0 +1,240 @@
+#include "map_cache.h"
+
+#if defined(PLATFORM_WINDOWS)
+    #include <direct.h>
+#else
+    #include <sys/stat.h>
+#endif
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void _map_cache_path(U64 hash, char* out, size_t len) {
+    snprintf(out, len, MAP_CACHE_DIRECTORY "/%016" PRIx64 ".temap", hash);
+}
+
+static bool _load_map_if_hash_matches(const char* path, U64 hash, Map* out) {
+    size_t size = 0;
+    U8* data = ReadMapFile(path, &size);
+    if (data == NULL) {
+        return false;
+    }
+
+    bool result = false;
+    if (HashMapData(data, size) == hash) {
+        result = LoadMapFromMemory(out, data, size);
+    }
+
+    free(data);
+    return result;
+}
+
+bool map_file_load(MapFile* map_file, const char* path, S32 map_index) {
+    map_file_destroy(map_file);
+    map_file->map_index = map_index;
+
+    size_t size = 0;
+    map_file->data = ReadMapFile(path, &size);
+    if (map_file->data == NULL) {
+        fprintf(stderr, "Failed to read map file %s\n", path);
+        return false;
+    }
+
+    map_file->size = (U32)size;
+    map_file->hash = HashMapData(map_file->data, size);
+    return true;
+}
+
+void map_file_destroy(MapFile* map_file) {
+    free(map_file->data);
+    memset(map_file, 0, sizeof(*map_file));
+    map_file->map_index = -1;
+}
+
+bool map_cache_find(U64 hash, const char* map_file_name, Map* out) {
+    char path[128];
+    _map_cache_path(hash, path, sizeof(path));
+    if (_load_map_if_hash_matches(path, hash, out)) {
+        return true;
+    }
+
+    // The bundled map is fine as long as it's the same file the server has.
+    if (map_file_name != NULL) {
+        snprintf(path, sizeof(path), "assets/%s", map_file_name);
+        if (_load_map_if_hash_matches(path, hash, out)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool map_cache_store(U64 hash, const U8* data, U32 size) {
+#if defined(PLATFORM_WINDOWS)
+    _mkdir(MAP_CACHE_DIRECTORY);
+#else
+    mkdir(MAP_CACHE_DIRECTORY, 0755);
+#endif
+
+    char path[128];
+    _map_cache_path(hash, path, sizeof(path));
+
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "Failed to create map cache file %s\n", path);
+        return false;
+    }
+
+    bool result = fwrite(data, size, 1, file) == 1;
+    fclose(file);
+
+    if (!result) {
+        fprintf(stderr, "Failed to write map cache file %s\n", path);
+        remove(path);
+    }
+
+    return result;
+}
+
+size_t map_chunk_serialize(const MapChunk* chunk, void* buffer, size_t buffer_size) {
+    size_t total_size = sizeof(chunk->hash) +
+                        sizeof(chunk->total_size) +
+                        sizeof(chunk->offset) +
+                        chunk->size;
+    assert(total_size <= buffer_size && "buffer too small!");
+
+    U8* ptr = buffer;
+
+    memcpy(ptr, &chunk->hash, sizeof(chunk->hash));
+    ptr += sizeof(chunk->hash);
+
+    memcpy(ptr, &chunk->total_size, sizeof(chunk->total_size));
+    ptr += sizeof(chunk->total_size);
+
+    memcpy(ptr, &chunk->offset, sizeof(chunk->offset));
+    ptr += sizeof(chunk->offset);
+
+    memcpy(ptr, chunk->data, chunk->size);
+    ptr += chunk->size;
+
+    return total_size;
+}
+
+size_t map_chunk_deserialize(void* buffer, size_t size, MapChunk* out) {
+    size_t header_size = sizeof(out->hash) + sizeof(out->total_size) + sizeof(out->offset);
+    if (size < header_size) {
+        return 0;
+    }
+
+    U8* ptr = buffer;
+
+    memcpy(&out->hash, ptr, sizeof(out->hash));
+    ptr += sizeof(out->hash);
+
+    memcpy(&out->total_size, ptr, sizeof(out->total_size));
+    ptr += sizeof(out->total_size);
+
+    memcpy(&out->offset, ptr, sizeof(out->offset));
+    ptr += sizeof(out->offset);
+
+    // The chunk data is left in the buffer.
+    out->size = (U32)(size - header_size);
+    out->data = ptr;
+
+    return size;
+}
+
+bool map_download_begin(MapDownload* download, U64 hash, U32 size, const char* map_file_name) {
+    if (download->hash == hash && (download->ready || download->requested)) {
+        return false;
+    }
+
+    download->hash = hash;
+    download->size = size;
+    download->ready = false;
+    download->requested = false;
+    download->received_bytes = 0;
+
+    // The server hasn't got a map selected, or couldn't read it, so there's nothing to get yet.
+    if (hash == 0) {
+        return false;
+    }
+
+    if (map_cache_find(hash, map_file_name, &download->map)) {
+        download->ready = true;
+        return false;
+    }
+
+    U8* data = realloc(download->data, size);
+    if (data == NULL) {
+        fprintf(stderr, "Failed to allocate %u bytes for map download\n", size);
+        return false;
+    }
+
+    download->data = data;
+    download->requested = true;
+    return true;
+}
+
+bool map_download_add_chunk(MapDownload* download, const MapChunk* chunk) {
+    if (!download->requested ||
+        chunk->hash != download->hash ||
+        chunk->total_size != download->size ||
+        chunk->offset != download->received_bytes ||
+        chunk->size > download->size - download->received_bytes) {
+        return false;
+    }
+
+    memcpy(download->data + chunk->offset, chunk->data, chunk->size);
+    download->received_bytes += chunk->size;
+
+    if (download->received_bytes < download->size) {
+        return false;
+    }
+
+    download->requested = false;
+
+    if (HashMapData(download->data, download->size) != download->hash) {
+        fprintf(stderr, "Downloaded map does not match its hash\n");
+        download->hash = 0;
+        return false;
+    }
+
+    map_cache_store(download->hash, download->data, download->size);
+
+    if (!LoadMapFromMemory(&download->map, download->data, download->size)) {
+        download->hash = 0;
+        return false;
+    }
+
+    download->ready = true;
+    return true;
+}
+
+void map_download_destroy(MapDownload* download) {
+    free(download->data);
+    FreeMap(&download->map);
+    memset(download, 0, sizeof(*download));
+}
+
+bool map_upload_next_chunk(MapUpload* upload, const MapFile* map_file, MapChunk* chunk) {
+    if (!upload->active || upload->hash != map_file->hash || upload->offset >= map_file->size) {
+        upload->active = false;
+        return false;
+    }
+
+    chunk->hash = map_file->hash;
+    chunk->total_size = map_file->size;
+    chunk->offset = upload->offset;
+    chunk->size = map_file->size - upload->offset;
+    if (chunk->size > MAP_CHUNK_SIZE) {
+        chunk->size = MAP_CHUNK_SIZE;
+    }
+    chunk->data = map_file->data + upload->offset;
+
+    upload->offset += chunk->size;
+    return true;
+}
@@ -0,0 +1,69 @@
+#ifndef map_cache_h
+#define map_cache_h
+
+#include "ints.h"
+#include "map.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define MAP_CACHE_DIRECTORY "cache"
+#define MAP_CHUNK_SIZE (16 * 1024)
+#define MAP_CHUNKS_PER_FRAME 4
+
+// The selected map's file as the server has it, sent as is to clients that don't have a copy.
+typedef struct {
+    U64 hash;
+    U8* data;
+    U32 size;
+    S32 map_index; // Index into the lobby map list this was loaded for, -1 if none.
+} MapFile;
+
+// Server side progress sending a map file to one client.
+typedef struct {
+    bool active;
+    U64 hash;
+    U32 offset;
+} MapUpload;
+
+// Client side state for getting hold of the map the server has selected, from the cache or
+// downloaded from the server.
+typedef struct {
+    U64 hash;
+    U32 size;
+    bool ready;     // map holds the map with this hash, unless it was handed over to the game.
+    bool requested; // Waiting on the server to send it.
+    U8* data;
+    U32 received_bytes;
+    Map map;
+} MapDownload;
+
+typedef struct {
+    U64 hash;
+    U32 total_size;
+    U32 offset;
+    U32 size;
+    U8* data;
+} MapChunk;
+
+bool map_file_load(MapFile* map_file, const char* path, S32 map_index);
+void map_file_destroy(MapFile* map_file);
+
+// Looks in the cache, then in assets for a map file with the same name and hash.
+bool map_cache_find(U64 hash, const char* map_file_name, Map* out);
+bool map_cache_store(U64 hash, const U8* data, U32 size);
+
+size_t map_chunk_serialize(const MapChunk* chunk, void* buffer, size_t buffer_size);
+size_t map_chunk_deserialize(void* buffer, size_t size, MapChunk* out);
+
+// Returns true if the map wasn't found locally and has to be requested from the server. A hash of 0
+// means no map is selected, which is never ready.
+bool map_download_begin(MapDownload* download, U64 hash, U32 size, const char* map_file_name);
+// Returns true once the last chunk has arrived and the map is ready.
+bool map_download_add_chunk(MapDownload* download, const MapChunk* chunk);
+void map_download_destroy(MapDownload* download);
+
+// Fills in the next chunk of the upload, returns false once everything has been sent.
+bool map_upload_next_chunk(MapUpload* upload, const MapFile* map_file, MapChunk* chunk);
+
+#endif /* map_cache_h */
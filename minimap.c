@@ -0,0 +1,294 @@
+#include "minimap.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// What a cell of the minimap shows, snakes are _MINIMAP_CELL_SNAKE plus their color.
+enum {
+    _MINIMAP_CELL_MAP,
+    _MINIMAP_CELL_TACO,
+    _MINIMAP_CELL_SNAKE,
+    _MINIMAP_CELL_UNTOUCHED = 0xFF, // Only used in next.
+};
+
+#define _MINIMAP_EMPTY_COLOR 0xFF000000
+#define _MINIMAP_GROUND_COLOR 0xFF203020
+#define _MINIMAP_WALL_COLOR 0xFF808080
+#define _MINIMAP_TACO_COLOR 0xFFFFB020
+
+// The same colors snake_draw tints the snakes.
+static const Uint32 _snake_colors[SNAKE_COLOR_COUNT] = {
+    0xFFFF0000, // SNAKE_COLOR_RED
+    0xFFFFFF00, // SNAKE_COLOR_YELLOW
+    0xFF00FF00, // SNAKE_COLOR_GREEN
+    0xFF00FFFF, // SNAKE_COLOR_CYAN
+    0xFF0000FF, // SNAKE_COLOR_BLUE
+    0xFFFF00FF, // SNAKE_COLOR_PURPLE
+};
+
+static bool _minimap_push_point(SpatialPoint** points, S32* count, S32* capacity, S32 x, S32 y) {
+    if (*count >= *capacity) {
+        S32 new_capacity = (*capacity > 0) ? *capacity * 2 : 256;
+        SpatialPoint* new_points = realloc(*points, (size_t)(new_capacity) * sizeof(*new_points));
+        if (new_points == NULL) {
+            fprintf(stderr, "minimap: failed to allocate %d points\n", new_capacity);
+            return false;
+        }
+        *points = new_points;
+        *capacity = new_capacity;
+    }
+
+    (*points)[(*count)++] = (SpatialPoint){ (S16)(x), (S16)(y) };
+    return true;
+}
+
+static void _minimap_mark_dirty(Minimap* minimap, S32 x, S32 y) {
+    S32 block = (y / MINIMAP_BLOCK_SIZE) * minimap->block_columns + (x / MINIMAP_BLOCK_SIZE);
+    if (!minimap->block_dirty[block]) {
+        minimap->block_dirty[block] = true;
+        minimap->dirty_blocks[minimap->dirty_block_count++] = block;
+    }
+}
+
+static void _minimap_free(Minimap* minimap) {
+    free(minimap->base_pixels);
+    free(minimap->pixels);
+    free(minimap->shown);
+    free(minimap->next);
+    free(minimap->covered);
+    free(minimap->touched);
+    free(minimap->block_dirty);
+    free(minimap->dirty_blocks);
+}
+
+// Draws the map layers from scratch, with nothing on top.
+static bool _minimap_rebuild(Minimap* minimap, const Map* map) {
+    SDL_Texture* texture = minimap->texture;
+    if (texture != NULL && (texture->w != map->width || texture->h != map->height)) {
+        SDL_DestroyTexture(texture);
+        texture = NULL;
+    }
+    _minimap_free(minimap);
+    *minimap = (Minimap){ .texture = texture };
+
+    size_t cell_count = (size_t)(map->width) * (size_t)(map->height);
+    S32 block_columns = (map->width + MINIMAP_BLOCK_SIZE - 1) / MINIMAP_BLOCK_SIZE;
+    S32 block_rows = (map->height + MINIMAP_BLOCK_SIZE - 1) / MINIMAP_BLOCK_SIZE;
+    size_t block_count = (size_t)(block_columns) * (size_t)(block_rows);
+
+    minimap->base_pixels = malloc(cell_count * sizeof(*minimap->base_pixels));
+    minimap->pixels = malloc(cell_count * sizeof(*minimap->pixels));
+    minimap->shown = calloc(cell_count, sizeof(*minimap->shown));
+    minimap->next = malloc(cell_count * sizeof(*minimap->next));
+    minimap->block_dirty = calloc(block_count, sizeof(*minimap->block_dirty));
+    minimap->dirty_blocks = malloc(block_count * sizeof(*minimap->dirty_blocks));
+    if (minimap->base_pixels == NULL || minimap->pixels == NULL || minimap->shown == NULL ||
+        minimap->next == NULL || minimap->block_dirty == NULL || minimap->dirty_blocks == NULL) {
+        fprintf(stderr, "minimap: failed to allocate %dx%d map\n", map->width, map->height);
+        _minimap_free(minimap);
+        *minimap = (Minimap){ .texture = texture };
+        return false;
+    }
+
+    minimap->width = map->width;
+    minimap->height = map->height;
+    minimap->map_revision = map->revision;
+    minimap->block_columns = block_columns;
+    minimap->block_rows = block_rows;
+    memset(minimap->next, _MINIMAP_CELL_UNTOUCHED, cell_count);
+
+    for (S32 y = 0; y < map->height; y++) {
+        for (S32 x = 0; x < map->width; x++) {
+            Uint32 color = _MINIMAP_EMPTY_COLOR;
+            if (map->num_layers > MAP_SOLID_LAYER && GetMapTile(map, x, y, MAP_SOLID_LAYER) != 0) {
+                color = _MINIMAP_WALL_COLOR;
+            } else if (map->num_layers > MAP_GROUND_LAYER && GetMapTile(map, x, y, MAP_GROUND_LAYER) != 0) {
+                color = _MINIMAP_GROUND_COLOR;
+            }
+            minimap->base_pixels[y * map->width + x] = color;
+        }
+    }
+    memcpy(minimap->pixels, minimap->base_pixels, cell_count * sizeof(*minimap->pixels));
+
+    for (S32 b = 0; b < (S32)(block_count); b++) {
+        minimap->block_dirty[b] = true;
+        minimap->dirty_blocks[b] = b;
+    }
+    minimap->dirty_block_count = (S32)(block_count);
+    return true;
+}
+
+// Says what a cell should show after this update. Later calls win, so snakes go over tacos.
+static bool _minimap_touch(Minimap* minimap, S32 x, S32 y, U8 value) {
+    if (x < 0 || y < 0 || x >= minimap->width || y >= minimap->height) {
+        return true;
+    }
+
+    S32 index = y * minimap->width + x;
+    if (minimap->next[index] == _MINIMAP_CELL_UNTOUCHED &&
+        !_minimap_push_point(&minimap->touched, &minimap->touched_count, &minimap->touched_capacity, x, y)) {
+        return false;
+    }
+    minimap->next[index] = value;
+    return true;
+}
+
+static bool _minimap_upload(Minimap* minimap) {
+    bool result = true;
+    for (S32 i = 0; i < minimap->dirty_block_count; i++) {
+        S32 block = minimap->dirty_blocks[i];
+        minimap->block_dirty[block] = false;
+
+        SDL_Rect rect = {
+            .x = (block % minimap->block_columns) * MINIMAP_BLOCK_SIZE,
+            .y = (block / minimap->block_columns) * MINIMAP_BLOCK_SIZE,
+            .w = MINIMAP_BLOCK_SIZE,
+            .h = MINIMAP_BLOCK_SIZE
+        };
+        // Blocks along the right and bottom edges only cover what's left of the map.
+        rect.w = SDL_min(rect.w, minimap->width - rect.x);
+        rect.h = SDL_min(rect.h, minimap->height - rect.y);
+
+        const Uint32* pixels = minimap->pixels + (rect.y * minimap->width + rect.x);
+        if (!SDL_UpdateTexture(minimap->texture, &rect, pixels, minimap->width * (int)(sizeof(*pixels)))) {
+            fprintf(stderr, "minimap: failed to update texture: %s\n", SDL_GetError());
+            result = false;
+        }
+    }
+    minimap->dirty_block_count = 0;
+    return result;
+}
+
+bool minimap_update(Minimap* minimap, SDL_Renderer* renderer, Game* game) {
+    const Map* map = &game->map;
+    if (map->revision == 0 || map->width <= 0 || map->height <= 0) {
+        return true;
+    }
+
+    if (minimap->pixels == NULL ||
+        minimap->map_revision != map->revision ||
+        minimap->width != map->width ||
+        minimap->height != map->height) {
+        if (!_minimap_rebuild(minimap, map)) {
+            return false;
+        }
+    }
+
+    if (minimap->up_to_date &&
+        minimap->texture != NULL &&
+        minimap->tick == game->tick &&
+        minimap->game_state == game->state) {
+        return true;
+    }
+
+    if (minimap->texture == NULL) {
+        minimap->texture = SDL_CreateTexture(renderer,
+                                             SDL_PIXELFORMAT_ARGB8888,
+                                             SDL_TEXTUREACCESS_STREAMING,
+                                             minimap->width,
+                                             minimap->height);
+        if (minimap->texture == NULL) {
+            fprintf(stderr, "minimap: failed to create %dx%d texture: %s\n",
+                    minimap->width,
+                    minimap->height,
+                    SDL_GetError());
+            return false;
+        }
+        SDL_SetTextureScaleMode(minimap->texture, SDL_SCALEMODE_NEAREST);
+
+        // A new texture starts out with nothing in it.
+        minimap->dirty_block_count = 0;
+        for (S32 b = 0; b < minimap->block_columns * minimap->block_rows; b++) {
+            minimap->block_dirty[b] = true;
+            minimap->dirty_blocks[minimap->dirty_block_count++] = b;
+        }
+    }
+
+    // Whatever was covered last time goes back to the map unless something is still there.
+    minimap->touched_count = 0;
+    bool touched_all = true;
+    for (S32 i = 0; i < minimap->covered_count; i++) {
+        touched_all &= _minimap_touch(minimap, minimap->covered[i].x, minimap->covered[i].y, _MINIMAP_CELL_MAP);
+    }
+
+    const SpatialGrid* tacos = &game->items.tacos;
+    for (S32 o = 0; o < tacos->occupied_count; o++) {
+        const SpatialBucket* bucket = tacos->buckets + tacos->occupied[o];
+        for (S32 p = 0; p < bucket->count; p++) {
+            touched_all &= _minimap_touch(minimap, bucket->points[p].x, bucket->points[p].y, _MINIMAP_CELL_TACO);
+        }
+    }
+
+    for (S32 s = 0; s < MAX_SNAKE_COUNT; s++) {
+        const Snake* snake = game->snakes + s;
+        U8 value = (U8)(_MINIMAP_CELL_SNAKE + ((U8)(snake->color) % SNAKE_COLOR_COUNT));
+        for (S32 i = 0; i < snake->length; i++) {
+            touched_all &= _minimap_touch(minimap, snake->segments[i].x, snake->segments[i].y, value);
+        }
+    }
+
+    // Only the touched cells that now show something else need their pixel and block updated.
+    minimap->covered_count = 0;
+    for (S32 i = 0; i < minimap->touched_count; i++) {
+        SpatialPoint point = minimap->touched[i];
+        S32 index = point.y * minimap->width + point.x;
+        U8 value = minimap->next[index];
+        minimap->next[index] = _MINIMAP_CELL_UNTOUCHED;
+
+        if (value != _MINIMAP_CELL_MAP) {
+            touched_all &= _minimap_push_point(&minimap->covered,
+                                               &minimap->covered_count,
+                                               &minimap->covered_capacity,
+                                               point.x,
+                                               point.y);
+        }
+
+        if (value == minimap->shown[index]) {
+            continue;
+        }
+
+        minimap->shown[index] = value;
+        if (value == _MINIMAP_CELL_MAP) {
+            minimap->pixels[index] = minimap->base_pixels[index];
+        } else if (value == _MINIMAP_CELL_TACO) {
+            minimap->pixels[index] = _MINIMAP_TACO_COLOR;
+        } else {
+            minimap->pixels[index] = _snake_colors[value - _MINIMAP_CELL_SNAKE];
+        }
+        _minimap_mark_dirty(minimap, point.x, point.y);
+    }
+
+    // Anything we lost track of is drawn again from scratch next time.
+    if (!touched_all) {
+        minimap->map_revision = 0;
+    }
+
+    bool uploaded = _minimap_upload(minimap);
+    minimap->tick = game->tick;
+    minimap->game_state = game->state;
+    minimap->up_to_date = touched_all && uploaded;
+    return uploaded;
+}
+
+void minimap_invalidate(Minimap* minimap) {
+    minimap->up_to_date = false;
+}
+
+void minimap_draw(Minimap* minimap, SDL_Renderer* renderer, const SDL_FRect* dest) {
+    if (minimap->texture == NULL) {
+        return;
+    }
+    SDL_RenderTexture(renderer, minimap->texture, NULL, dest);
+}
+
+void minimap_destroy_texture(Minimap* minimap) {
+    SDL_DestroyTexture(minimap->texture);
+    minimap->texture = NULL;
+}
+
+void minimap_destroy(Minimap* minimap) {
+    minimap_destroy_texture(minimap);
+    _minimap_free(minimap);
+    *minimap = (Minimap){0};
+}
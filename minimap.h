@@ -0,0 +1,58 @@
+#ifndef minimap_h
+#define minimap_h
+
+#include "game.h"
+
+#include <SDL3/SDL_render.h>
+#include <stdbool.h>
+
+// Width and height in cells of the blocks the minimap is uploaded in.
+#define MINIMAP_BLOCK_SIZE 16
+
+// The map at one pixel per cell with the tacos and snakes on top. It is only drawn in full when the
+// map changes, after that each update looks at the cells tacos and snakes were in last time and are
+// in now, and only uploads the blocks where a pixel actually changed.
+typedef struct {
+    SDL_Texture* texture;
+    Uint32* base_pixels; // Just the map layers.
+    Uint32* pixels;      // What the texture holds.
+    U8* shown;           // What is drawn in each cell of pixels: the map, a taco or a snake.
+    U8* next;            // Scratch space for what each touched cell should become.
+    S32 width;
+    S32 height;
+    Uint32 map_revision;
+
+    // Cells a taco or snake was in at the last update.
+    SpatialPoint* covered;
+    S32 covered_count;
+    S32 covered_capacity;
+
+    // Cells that may have changed this update.
+    SpatialPoint* touched;
+    S32 touched_count;
+    S32 touched_capacity;
+
+    bool* block_dirty;
+    S32* dirty_blocks;
+    S32 dirty_block_count;
+    S32 block_columns;
+    S32 block_rows;
+
+    // Tacos and snakes only move when the game ticks or changes state, so an update with the same
+    // tick and state as the last one has nothing to do.
+    U32 tick;
+    GameState game_state;
+    bool up_to_date;
+} Minimap;
+
+// Brings the minimap up to date with game, creating the texture the first time or after it was
+// destroyed.
+bool minimap_update(Minimap* minimap, SDL_Renderer* renderer, Game* game);
+// Makes the next update look at the tacos and snakes again, for changes made outside of a tick.
+void minimap_invalidate(Minimap* minimap);
+void minimap_draw(Minimap* minimap, SDL_Renderer* renderer, const SDL_FRect* dest);
+// Drops the texture, e.g. after the renderer lost it, so the next update uploads it all again.
+void minimap_destroy_texture(Minimap* minimap);
+void minimap_destroy(Minimap* minimap);
+
+#endif /* minimap_h */
@@ -9,9 +9,38 @@
 #define NET_ERROR_MESSAGE_LEN 128
 #define SERVER_ACCEPT_QUEUE_LIMIT 5
 
+#define NET_TRACE_MAGIC "TQNT"
+#define NET_TRACE_VERSION 1
+
 typedef struct net_socket NetSocket;
 
-bool        net_init(const char* log_name);
+typedef enum {
+    NET_TRACE_SEND,
+    NET_TRACE_RECV,
+    NET_TRACE_DROP, // A queued packet was thrown away before being sent.
+} NetTraceDirection;
+
+// Written at the start of a trace file, followed by NetTraceRecords until the end of the file.
+typedef struct {
+    char magic[4];
+    U32 version;
+    U64 start_time_us; // Wall clock time tracing started, in microseconds since the unix epoch.
+} NetTraceFileHeader;
+
+// Fixed size so the hot path is a copy into the ring buffer, formatting is left to the decoder.
+typedef struct {
+    U64 time_us; // Monotonic microseconds since tracing started.
+    U32 tick;
+    U32 bytes_expected;
+    U32 bytes_transferred;
+    S32 sequence; // -1 until the whole packet has been transferred.
+    U8 direction; // NetTraceDirection
+    U8 packet_type;
+    U8 padding[6];
+} NetTraceRecord;
+
+// Either file name can be NULL to skip opening it, e.g. in single player.
+bool        net_init(const char* log_name, const char* trace_name);
 NetSocket*  net_create_client(const char* ip, const char* port);
 NetSocket*  net_create_server(const char* port);
 bool        net_accept(NetSocket* server, NetSocket** out);
@@ -21,5 +50,12 @@ void        net_destroy_socket(NetSocket* socket);
 const char* net_get_error(void);
 void        net_shutdown(void);
 void        net_log(const char* format, ...);
+// Only call these from the thread doing the networking.
+void        net_trace_set_tick(U32 tick);
+void        net_trace(NetTraceDirection direction,
+                      U32 bytes_expected,
+                      U32 bytes_transferred,
+                      S32 sequence,
+                      U8 packet_type);
 
 #endif /* network_h */
@@ -1,9 +1,9 @@
 #include "packet.h"
+#include "zone.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <assert.h>
 
 const char* packet_type_description(PacketType type) {
     switch (type) {
@@ -17,113 +17,458 @@ const char* packet_type_description(PacketType type) {
             return "snake";
         case PACKET_TYPE_ACKNOWLEDGE:
             return "acknowledge";
+        case PACKET_TYPE_FRAGMENT:
+            return "fragment";
+        case PACKET_TYPE_MAP_REQUEST:
+            return "map request";
+        case PACKET_TYPE_MAP_CHUNK:
+            return "map chunk";
+        case PACKET_TYPE_SPECTATE:
+            return "spectate";
+        case PACKET_TYPE_INTEREST_STATE:
+            return "interest state";
+        case PACKET_TYPE_PLAYER_INDEX:
+            return "player index";
         default:
             return "unknown";
     }
 }
 
-// TODO: temp or put these in a header.
-char* get_timestamp(void);
-void net_action_log(const char* timestamp_str,
-                    const char* type,
-                    size_t bytes_to_send,
-                    size_t bytes_sent,
-                    int seq,
-                    const char* desc);
+static U32 _next_message_id;
 
-void _execute_receive_stage(NetSocket* socket,
-                            Packet* packet,
+static void _fragment_header_serialize(const PacketFragmentHeader* fragment, U8* buffer) {
+    memcpy(buffer, &fragment->message_id, sizeof(fragment->message_id));
+    buffer += sizeof(fragment->message_id);
+    memcpy(buffer, &fragment->total_size, sizeof(fragment->total_size));
+    buffer += sizeof(fragment->total_size);
+    memcpy(buffer, &fragment->offset, sizeof(fragment->offset));
+    buffer += sizeof(fragment->offset);
+    *buffer = fragment->type;
+}
+
+static void _fragment_header_deserialize(const U8* buffer, PacketFragmentHeader* out) {
+    memcpy(&out->message_id, buffer, sizeof(out->message_id));
+    buffer += sizeof(out->message_id);
+    memcpy(&out->total_size, buffer, sizeof(out->total_size));
+    buffer += sizeof(out->total_size);
+    memcpy(&out->offset, buffer, sizeof(out->offset));
+    buffer += sizeof(out->offset);
+    out->type = *buffer;
+}
+
+static bool _reserve_buffer(PacketTransmissionState* packet_transmission_state, U32 size) {
+    if (size <= packet_transmission_state->buffer_capacity) {
+        return true;
+    }
+
+    U8* buffer = realloc(packet_transmission_state->buffer, size);
+    if (buffer == NULL) {
+        fprintf(stderr, "packet_receive: failed to allocate %u byte message\n", size);
+        return false;
+    }
+
+    packet_transmission_state->buffer = buffer;
+    packet_transmission_state->buffer_capacity = size;
+    return true;
+}
+
+// Returns true once all size bytes have been received.
+bool _execute_receive_stage(NetSocket* socket,
                             PacketTransmissionState* packet_transmission_state,
                             U8* bytes,
-                            int size,
-                            PacketProgressStage next_stage) {
-    const char* timestamp_str = get_timestamp();
+                            int size) {
     int bytes_received = net_receive(socket,
                                      bytes + packet_transmission_state->progress_bytes,
                                      size - packet_transmission_state->progress_bytes);
 
     if (bytes_received == -1) {
         packet_transmission_state->stage = PACKET_PROGRESS_STAGE_ERROR;
-        return;
+        return false;
     }
 
     if (bytes_received == 0) {
-        return;
+        return false;
     }
 
     packet_transmission_state->progress_bytes += bytes_received;
     if (packet_transmission_state->progress_bytes == size) {
-        packet_transmission_state->stage = next_stage;
         packet_transmission_state->progress_bytes = 0;
-        net_action_log(timestamp_str,
-                       "RECV",
-                       size,
-                       bytes_received,
-                       packet->header.sequence,
-                       packet_type_description(packet->header.type));
-    } else {
-        net_action_log(timestamp_str,
-                       "RECV",
-                       size,
-                       bytes_received,
-                       -1,
-                       packet_type_description(packet->header.type));
+        net_trace(NET_TRACE_RECV,
+                  (U32)(size),
+                  (U32)(bytes_received),
+                  packet_transmission_state->header.sequence,
+                  packet_transmission_state->header.type);
+        return true;
+    }
+
+    net_trace(NET_TRACE_RECV,
+              (U32)(size),
+              (U32)(bytes_received),
+              -1,
+              packet_transmission_state->header.type);
+    return false;
+}
+
+// Checks a fragment continues the message being reassembled, or starts a new one.
+static bool _begin_fragment(PacketTransmissionState* state) {
+    PacketFragmentHeader fragment = {0};
+    _fragment_header_deserialize(state->fragment_header_bytes, &fragment);
+
+    U32 chunk_size = state->header.payload_size - PACKET_FRAGMENT_HEADER_SIZE;
+
+    if (fragment.offset == 0) {
+        if (fragment.total_size > PACKET_MAX_MESSAGE_SIZE) {
+            fprintf(stderr, "packet_receive: message %u is %u bytes, over the %u byte limit\n",
+                    fragment.message_id,
+                    fragment.total_size,
+                    (U32)(PACKET_MAX_MESSAGE_SIZE));
+            return false;
+        }
+        if (!_reserve_buffer(state, fragment.total_size)) {
+            return false;
+        }
+        state->message_size = fragment.total_size;
+        state->message_received_bytes = 0;
+        state->message_type = fragment.type;
+    } else if (fragment.message_id != state->fragment.message_id ||
+               fragment.offset != state->message_received_bytes) {
+        fprintf(stderr, "packet_receive: fragment of message %u at offset %u is out of order\n",
+                fragment.message_id,
+                fragment.offset);
+        return false;
+    }
+
+    if (fragment.total_size != state->message_size ||
+        fragment.offset + chunk_size > state->message_size) {
+        fprintf(stderr, "packet_receive: fragment of message %u overruns the message\n",
+                fragment.message_id);
+        return false;
+    }
+
+    state->fragment = fragment;
+    return true;
+}
+
+static void _packet_receive(NetSocket* socket,
+                            Packet* packet,
+                            PacketTransmissionState* packet_transmission_state) {
+    PacketTransmissionState* state = packet_transmission_state;
+
+    // Keep going while data is available, a message may be made up of many fragment packets.
+    for (;;) {
+        switch (state->stage) {
+        case PACKET_PROGRESS_STAGE_PACKET_HEADER: {
+            if (!_execute_receive_stage(socket,
+                                        state,
+                                        (U8*)(&state->header),
+                                        sizeof(state->header))) {
+                return;
+            }
+
+            if (state->header.type == PACKET_TYPE_FRAGMENT) {
+                if (state->header.payload_size <= PACKET_FRAGMENT_HEADER_SIZE) {
+                    fprintf(stderr, "packet_receive: fragment packet too small\n");
+                    state->stage = PACKET_PROGRESS_STAGE_ERROR;
+                    return;
+                }
+                state->stage = PACKET_PROGRESS_STAGE_FRAGMENT_HEADER;
+            } else {
+                if (!_reserve_buffer(state, state->header.payload_size)) {
+                    state->stage = PACKET_PROGRESS_STAGE_ERROR;
+                    return;
+                }
+                state->message_size = state->header.payload_size;
+                state->message_received_bytes = 0;
+                state->message_type = state->header.type;
+                state->stage = PACKET_PROGRESS_STAGE_PAYLOAD;
+            }
+            break;
+        }
+        case PACKET_PROGRESS_STAGE_FRAGMENT_HEADER: {
+            if (!_execute_receive_stage(socket,
+                                        state,
+                                        state->fragment_header_bytes,
+                                        PACKET_FRAGMENT_HEADER_SIZE)) {
+                return;
+            }
+
+            if (!_begin_fragment(state)) {
+                state->stage = PACKET_PROGRESS_STAGE_ERROR;
+                return;
+            }
+            state->stage = PACKET_PROGRESS_STAGE_PAYLOAD;
+            break;
+        }
+        case PACKET_PROGRESS_STAGE_PAYLOAD: {
+            // Fragment chunks are received straight into place in the message.
+            U32 chunk_size = state->header.payload_size;
+            if (state->header.type == PACKET_TYPE_FRAGMENT) {
+                chunk_size -= PACKET_FRAGMENT_HEADER_SIZE;
+            }
+
+            if (chunk_size > 0 &&
+                !_execute_receive_stage(socket,
+                                        state,
+                                        state->buffer + state->message_received_bytes,
+                                        (int)chunk_size)) {
+                return;
+            }
+
+            state->message_received_bytes += chunk_size;
+            if (state->message_received_bytes < state->message_size) {
+                state->stage = PACKET_PROGRESS_STAGE_PACKET_HEADER;
+                break;
+            }
+
+            packet->header.payload_size = state->header.payload_size;
+            packet->header.sequence = state->header.sequence;
+            packet->header.type = state->message_type;
+            packet->size = state->message_size;
+            packet->payload = state->buffer;
+            state->stage = PACKET_PROGRESS_STAGE_COMPLETE;
+            return;
+        }
+        default:
+            return;
+        }
     }
 }
 
 void packet_receive(NetSocket* socket,
                     Packet* packet,
                     PacketTransmissionState* packet_transmission_state) {
-    if (packet_transmission_state->stage == PACKET_PROGRESS_STAGE_PACKET_HEADER) {
-        _execute_receive_stage(socket,
-                               packet,
-                               packet_transmission_state,
-                               (U8*)(&packet->header),
-                               sizeof(packet->header),
-                               PACKET_PROGRESS_STAGE_PAYLOAD);
-        if (packet_transmission_state->stage == PACKET_PROGRESS_STAGE_PAYLOAD) {
-            packet->payload = malloc(packet->header.payload_size);
+    ZONE_BEGIN("packet_receive");
+    _packet_receive(socket, packet, packet_transmission_state);
+    ZONE_END();
+}
+
+void packet_transmission_state_reset(PacketTransmissionState* packet_transmission_state) {
+    packet_transmission_state->stage = PACKET_PROGRESS_STAGE_PACKET_HEADER;
+    packet_transmission_state->progress_bytes = 0;
+    packet_transmission_state->message_size = 0;
+    packet_transmission_state->message_received_bytes = 0;
+}
+
+void packet_transmission_state_destroy(PacketTransmissionState* packet_transmission_state) {
+    free(packet_transmission_state->buffer);
+    memset(packet_transmission_state, 0, sizeof(*packet_transmission_state));
+}
+
+size_t packet_wire_size(U32 payload_size) {
+    if (payload_size <= PACKET_MAX_PAYLOAD_SIZE) {
+        return sizeof(PacketHeader) + payload_size;
+    }
+
+    size_t fragment_count = (payload_size + PACKET_FRAGMENT_CHUNK_SIZE - 1) / PACKET_FRAGMENT_CHUNK_SIZE;
+    return fragment_count * (sizeof(PacketHeader) + PACKET_FRAGMENT_HEADER_SIZE) + payload_size;
+}
+
+size_t packet_write(const Packet* packet, U8* buffer, size_t buffer_size) {
+    if (packet->size > PACKET_MAX_MESSAGE_SIZE) {
+        fprintf(stderr, "packet_write: %u byte message is over the %u byte limit\n",
+                packet->size,
+                (U32)(PACKET_MAX_MESSAGE_SIZE));
+        return 0;
+    }
+
+    if (packet_wire_size(packet->size) > buffer_size) {
+        return 0;
+    }
+
+    U8* ptr = buffer;
+
+    if (packet->size <= PACKET_MAX_PAYLOAD_SIZE) {
+        PacketHeader header = packet->header;
+        header.payload_size = (U16)(packet->size);
+        memcpy(ptr, &header, sizeof(header));
+        ptr += sizeof(header);
+        if (packet->size > 0) {
+            memcpy(ptr, packet->payload, packet->size);
+            ptr += packet->size;
         }
+        return ptr - buffer;
     }
 
-    if (packet_transmission_state->stage == PACKET_PROGRESS_STAGE_PAYLOAD) {
-        _execute_receive_stage(socket,
-                               packet,
-                               packet_transmission_state,
-                               packet->payload,
-                               packet->header.payload_size,
-                               PACKET_PROGRESS_STAGE_COMPLETE);
+    // Every fragment carries the same sequence, the message id ties them together.
+    PacketFragmentHeader fragment = {
+        .message_id = _next_message_id++,
+        .total_size = packet->size,
+        .offset = 0,
+        .type = packet->header.type
+    };
+
+    while (fragment.offset < packet->size) {
+        U32 chunk_size = packet->size - fragment.offset;
+        if (chunk_size > PACKET_FRAGMENT_CHUNK_SIZE) {
+            chunk_size = PACKET_FRAGMENT_CHUNK_SIZE;
+        }
+
+        PacketHeader header = {
+            .payload_size = (U16)(PACKET_FRAGMENT_HEADER_SIZE + chunk_size),
+            .sequence = packet->header.sequence,
+            .type = PACKET_TYPE_FRAGMENT
+        };
+        memcpy(ptr, &header, sizeof(header));
+        ptr += sizeof(header);
+
+        _fragment_header_serialize(&fragment, ptr);
+        ptr += PACKET_FRAGMENT_HEADER_SIZE;
+
+        memcpy(ptr, packet->payload + fragment.offset, chunk_size);
+        ptr += chunk_size;
+
+        fragment.offset += chunk_size;
     }
+
+    return ptr - buffer;
 }
 
-bool packet_send(NetSocket* socket, const Packet* packet) {
-    int buf_size = sizeof(packet->header) + packet->header.payload_size;
-    U8* buf = malloc(buf_size);
+PacketBuffer* packet_buffer_create(const Packet* packet) {
+    size_t wire_size = packet_wire_size(packet->size);
 
-    if (buf == NULL) {
-        fprintf(stderr, "packet_send: malloc failed. \n");
+    // One allocation for the header and the data that follows it.
+    PacketBuffer* buffer = malloc(sizeof(*buffer) + wire_size);
+    if (buffer == NULL) {
+        fprintf(stderr, "packet_buffer_create: malloc failed\n");
+        return NULL;
     }
 
-    memcpy(buf, &packet->header, sizeof(packet->header));
-    memcpy(buf + sizeof(packet->header), packet->payload, packet->header.payload_size);
+    buffer->data = (U8*)(buffer + 1);
+    buffer->size = (U32)(wire_size);
+    buffer->ref_count = 1;
+    buffer->sequence = packet->header.sequence;
+    buffer->type = packet->header.type;
 
-    const char* timestamp_str = get_timestamp();
-    int bytes_sent = net_send(socket, buf, buf_size);
+    if (packet_write(packet, buffer->data, wire_size) == 0) {
+        free(buffer);
+        return NULL;
+    }
+    return buffer;
+}
+
+void packet_buffer_retain(PacketBuffer* buffer) {
+    buffer->ref_count++;
+}
 
-    if (bytes_sent > 0) {
-        net_action_log(timestamp_str,
-                       "SEND",
-                       buf_size,
-                       bytes_sent,
-                       packet->header.sequence,
-                       packet_type_description(packet->header.type));
-    } else if (bytes_sent == -1) {
-        free(buf);
+void packet_buffer_release(PacketBuffer* buffer) {
+    if (buffer == NULL) {
+        return;
+    }
+
+    buffer->ref_count--;
+    if (buffer->ref_count == 0) {
+        free(buffer);
+    }
+}
+
+static void _packet_send_queue_remove(PacketSendQueue* queue, S32 index) {
+    PacketSendQueueEntry* entry = queue->entries + index;
+    queue->queued_bytes -= entry->buffer->size - entry->sent_bytes;
+    packet_buffer_release(entry->buffer);
+
+    memmove(queue->entries + index,
+            queue->entries + index + 1,
+            (queue->count - index - 1) * sizeof(*queue->entries));
+    queue->count--;
+}
+
+bool packet_send_queue_push(PacketSendQueue* queue, const Packet* packet, bool droppable) {
+    PacketBuffer* buffer = packet_buffer_create(packet);
+    if (buffer == NULL) {
         return false;
     }
 
-    assert(bytes_sent == buf_size);
+    bool result = packet_send_queue_push_buffer(queue, buffer, droppable);
+    packet_buffer_release(buffer);
+    return result;
+}
+
+bool packet_send_queue_push_buffer(PacketSendQueue* queue, PacketBuffer* buffer, bool droppable) {
+    size_t byte_limit = queue->byte_limit ? queue->byte_limit : PACKET_SEND_QUEUE_BYTE_LIMIT;
+
+    if (droppable && queue->queued_bytes + buffer->size > byte_limit) {
+        // Anything already partly on the wire has to finish, otherwise the receiver gets a torn
+        // packet.
+        for (S32 i = queue->count - 1; i >= 0; i--) {
+            PacketSendQueueEntry* entry = queue->entries + i;
+            if (entry->droppable && entry->sent_bytes == 0) {
+                net_trace(NET_TRACE_DROP,
+                          entry->buffer->size,
+                          0,
+                          entry->buffer->sequence,
+                          entry->buffer->type);
+                _packet_send_queue_remove(queue, i);
+                queue->dropped_count++;
+            }
+        }
+    }
+
+    if (queue->count == queue->capacity) {
+        S32 capacity = queue->capacity ? queue->capacity * 2 : 8;
+        PacketSendQueueEntry* entries = realloc(queue->entries, capacity * sizeof(*entries));
+        if (entries == NULL) {
+            fprintf(stderr, "packet_send_queue_push: realloc failed\n");
+            return false;
+        }
+        queue->entries = entries;
+        queue->capacity = capacity;
+    }
 
-    free(buf);
+    packet_buffer_retain(buffer);
+    queue->entries[queue->count++] = (PacketSendQueueEntry){
+        .buffer = buffer,
+        .sent_bytes = 0,
+        .droppable = droppable
+    };
+    queue->queued_bytes += buffer->size;
     return true;
 }
+
+bool packet_send_queue_flush(PacketSendQueue* queue, NetSocket* socket) {
+    ZONE_BEGIN("packet_send_queue_flush");
+    while (queue->count > 0) {
+        PacketSendQueueEntry* entry = queue->entries;
+        PacketBuffer* buffer = entry->buffer;
+
+        int bytes_sent = net_send(socket,
+                                  buffer->data + entry->sent_bytes,
+                                  (int)(buffer->size - entry->sent_bytes));
+
+        if (bytes_sent == -1) {
+            ZONE_END();
+            return false;
+        }
+
+        if (bytes_sent == 0) {
+            break; // The socket is full, try again next time.
+        }
+
+        net_trace(NET_TRACE_SEND, buffer->size, (U32)(bytes_sent), buffer->sequence, buffer->type);
+
+        entry->sent_bytes += bytes_sent;
+        queue->queued_bytes -= bytes_sent;
+
+        if (entry->sent_bytes < buffer->size) {
+            break;
+        }
+
+        _packet_send_queue_remove(queue, 0);
+    }
+
+    ZONE_END();
+    return true;
+}
+
+void packet_send_queue_clear(PacketSendQueue* queue) {
+    while (queue->count > 0) {
+        _packet_send_queue_remove(queue, queue->count - 1);
+    }
+    queue->queued_bytes = 0;
+    queue->dropped_count = 0;
+}
+
+void packet_send_queue_destroy(PacketSendQueue* queue) {
+    packet_send_queue_clear(queue);
+    free(queue->entries);
+    memset(queue, 0, sizeof(*queue));
+}
@@ -14,11 +14,32 @@ enum {
     PACKET_TYPE_LOBBY_STATE,
     PACKET_TYPE_LOBBY_ACTION,
     PACKET_TYPE_CLIENT_NAME,
+    PACKET_TYPE_FRAGMENT, // Part of a message too large for a single packet.
+    PACKET_TYPE_MAP_REQUEST,
+    PACKET_TYPE_MAP_CHUNK,
+    PACKET_TYPE_SPECTATE, // Sent by a client that only wants to watch.
+    PACKET_TYPE_INTEREST_STATE, // The level state around one client's snake.
+    PACKET_TYPE_PLAYER_INDEX, // The lobby player, and so the snake, the receiving client controls.
 };
 
+// Payloads up to this size are sent as a single packet, anything larger is split into fragments.
+#define PACKET_MAX_PAYLOAD_SIZE 0xFFFF
+
+// Serialized size of PacketFragmentHeader, which starts the payload of every fragment packet.
+#define PACKET_FRAGMENT_HEADER_SIZE 13
+#define PACKET_FRAGMENT_CHUNK_SIZE (PACKET_MAX_PAYLOAD_SIZE - PACKET_FRAGMENT_HEADER_SIZE)
+
+// The largest message that will be sent or reassembled. States are serialized into a 1 MB buffer,
+// this leaves plenty of room over that while stopping a peer from making us allocate gigabytes.
+#define PACKET_MAX_MESSAGE_SIZE (16 * 1024 * 1024)
+
+// Once this much is waiting to go out to a client, older queued states are skipped for the newest.
+#define PACKET_SEND_QUEUE_BYTE_LIMIT (256 * 1024)
+
 typedef U8 PacketProgressStage;
 enum {
     PACKET_PROGRESS_STAGE_PACKET_HEADER,
+    PACKET_PROGRESS_STAGE_FRAGMENT_HEADER,
     PACKET_PROGRESS_STAGE_PAYLOAD,
     PACKET_PROGRESS_STAGE_COMPLETE,
     PACKET_PROGRESS_STAGE_ERROR,
@@ -30,24 +51,102 @@ typedef struct {
     PacketType type;
 } PacketHeader;
 
+typedef struct {
+    U32 message_id;
+    U32 total_size; // Size of the whole message being reassembled.
+    U32 offset;     // Where this fragment's chunk goes in the message.
+    PacketType type;
+} PacketFragmentHeader;
+
 typedef struct {
     PacketProgressStage stage;
     int progress_bytes;
+
+    // Message payloads are received into this buffer, which is reused between messages and only
+    // grows, so receiving doesn't allocate once it is big enough.
+    U8* buffer;
+    U32 buffer_capacity;
+
+    PacketHeader header; // Header of the packet on the wire, which may be a fragment.
+    U8 fragment_header_bytes[PACKET_FRAGMENT_HEADER_SIZE];
+    PacketFragmentHeader fragment;
+    U32 message_size;
+    U32 message_received_bytes;
+    PacketType message_type;
 } PacketTransmissionState;
 
 typedef struct {
+    // When sending, header.payload_size is filled in for each packet put on the wire, the size of
+    // the whole payload is given by size.
     PacketHeader header;
+    U32 size;
     U8* payload;
 } Packet;
 
 // TODO: Should we consider combining Packet and PacketTransmissionState.
 const char* packet_type_description(PacketType type);
 
-// Function allocates packet payload. Caller should free it.
+// Once the stage is complete, the packet payload points into the transmission state's buffer, so it
+// is only valid until the state is reset. Fragmented messages are reassembled before completing.
 void packet_receive(NetSocket* socket,
                     Packet* packet,
                     PacketTransmissionState* packet_transmission_state);
 
-bool packet_send(NetSocket* socket, const Packet* packet);
+// Gets ready to receive the next packet, keeping the receive buffer.
+void packet_transmission_state_reset(PacketTransmissionState* packet_transmission_state);
+void packet_transmission_state_destroy(PacketTransmissionState* packet_transmission_state);
+
+// Size of a packet with the given payload size once written out, including any fragments.
+size_t packet_wire_size(U32 payload_size);
+
+// Writes the packet as it goes on the wire, splitting it into fragments if needed. Returns the
+// number of bytes written, or 0 if the buffer is too small or the packet is over
+// PACKET_MAX_MESSAGE_SIZE.
+size_t packet_write(const Packet* packet, U8* buffer, size_t buffer_size);
+
+// A packet written out once and shared by every queue sending it, so a state broadcast to many
+// clients is only serialized and copied once. Freed when the last reference is released.
+typedef struct {
+    U8* data; // The packet as written to the wire.
+    U32 size;
+    S32 ref_count;
+    U16 sequence;
+    PacketType type;
+} PacketBuffer;
+
+// Returns a buffer with one reference held by the caller, or NULL on failure.
+PacketBuffer* packet_buffer_create(const Packet* packet);
+void packet_buffer_retain(PacketBuffer* buffer);
+void packet_buffer_release(PacketBuffer* buffer);
+
+typedef struct {
+    PacketBuffer* buffer;
+    U32 sent_bytes;
+    bool droppable; // A full state that a newer state makes redundant.
+} PacketSendQueueEntry;
+
+// Outgoing packets for one socket. Sockets are non-blocking, so packets go out as fast as the socket
+// takes them, picking up partial writes where they left off.
+typedef struct {
+    PacketSendQueueEntry* entries;
+    S32 count;
+    S32 capacity;
+    size_t queued_bytes;
+    size_t byte_limit; // PACKET_SEND_QUEUE_BYTE_LIMIT if 0.
+    U32 dropped_count; // States skipped because the socket couldn't keep up.
+} PacketSendQueue;
+
+// Droppable packets replace any droppable packets that haven't started sending if the queue is over
+// its byte limit, so a slow receiver only ever gets the newest state.
+bool packet_send_queue_push(PacketSendQueue* queue, const Packet* packet, bool droppable);
+// Same as packet_send_queue_push(), but shares an already written buffer. The queue holds its own
+// reference until the packet is sent or dropped.
+bool packet_send_queue_push_buffer(PacketSendQueue* queue, PacketBuffer* buffer, bool droppable);
+
+// Sends as much as the socket will take. Returns false if the socket failed.
+bool packet_send_queue_flush(PacketSendQueue* queue, NetSocket* socket);
+
+void packet_send_queue_clear(PacketSendQueue* queue);
+void packet_send_queue_destroy(PacketSendQueue* queue);
 
 #endif /* packet_h */
@@ -2,13 +2,39 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 #define PF_BUFFER_SIZE 255
+#define PF_RUN_CACHE_SIZE 128 // Must be a power of 2.
 #define PF_SET_ERROR(fmt, ...) \
 snprintf(pf_error, PF_BUFFER_SIZE, fmt, ##__VA_ARGS__)
 
 static char pf_error[PF_BUFFER_SIZE + 1];
 
+/** A growable list of quads, 4 vertices each. */
+typedef struct {
+    SDL_Vertex * vertices;
+    int count;
+    int capacity;
+} QuadList;
+
+/** A string laid out at some scale and colors, with its vertices relative to
+ *  its top left so it can be copied anywhere. */
+typedef struct {
+    Uint32 hash;
+    char text[PF_BUFFER_SIZE + 1];
+    int length;
+    float scale;
+    int letter_spacing;
+    SDL_Color foreground;
+    SDL_Color background;
+
+    QuadList glyphs;
+    QuadList background_quad; // Empty if the background is transparent.
+    Uint32 width;
+} TextRun;
+
 struct PF_PixelFont {
     SDL_Renderer * renderer;
     SDL_Texture * texture;
@@ -18,22 +44,18 @@ struct PF_PixelFont {
     char first_char;
     Uint16 cols;
 
-    // TODO: line_spacing and handle new line option?
-};
+    // Quads waiting to be drawn. Backgrounds are drawn untextured, so they go
+    // in their own list, and both share the same indices.
+    QuadList glyphs;
+    QuadList backgrounds;
+    int * indices;
+    int index_capacity; // In quads.
+    int batch_depth;
 
-static inline SDL_Color
-GetRenderColor(SDL_Renderer * renderer)
-{
-    SDL_Color color;
-    SDL_GetRenderDrawColor(renderer, &color.r, &color.g, &color.b, &color.a);
-    return color;
-}
+    TextRun runs[PF_RUN_CACHE_SIZE];
 
-static inline void
-SetRenderColor(SDL_Renderer * renderer, SDL_Color color)
-{
-    SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, color.a);
-}
+    // TODO: line_spacing and handle new line option?
+};
 
 static inline void
 SetColor(SDL_Color * color, Uint8 r, Uint8 g, Uint8 b, Uint8 a)
@@ -51,55 +73,317 @@ SetColor(SDL_Color * color, Uint8 r, Uint8 g, Uint8 b, Uint8 a)
 //    if ( a ) *a = color->a;
 //}
 
+static inline SDL_FColor
+ToFColor(SDL_Color color)
+{
+    return (SDL_FColor){
+        color.r / 255.0f,
+        color.g / 255.0f,
+        color.b / 255.0f,
+        color.a / 255.0f
+    };
+}
+
+static bool
+GrowIndices(PF_Font * font, int quads)
+{
+    if ( quads <= font->index_capacity ) {
+        return true;
+    }
+
+    int capacity = font->index_capacity > 0 ? font->index_capacity : 256;
+    while ( capacity < quads ) {
+        capacity *= 2;
+    }
+
+    int * indices = realloc(font->indices, (size_t)capacity * 6 * sizeof(*indices));
+    if ( indices == NULL ) {
+        PF_SET_ERROR("could not allocate indices for %d characters\n", capacity);
+        return false;
+    }
+
+    // Every quad is two triangles over its own 4 vertices.
+    for ( int i = font->index_capacity; i < capacity; i++ ) {
+        indices[i * 6 + 0] = i * 4;
+        indices[i * 6 + 1] = i * 4 + 1;
+        indices[i * 6 + 2] = i * 4 + 2;
+        indices[i * 6 + 3] = i * 4;
+        indices[i * 6 + 4] = i * 4 + 2;
+        indices[i * 6 + 5] = i * 4 + 3;
+    }
+
+    font->indices = indices;
+    font->index_capacity = capacity;
+    return true;
+}
+
+/** Makes room for `quads` more quads, returning the first of them. */
+static SDL_Vertex *
+ReserveQuads(QuadList * list, int quads)
+{
+    if ( list->count + quads > list->capacity ) {
+        int capacity = list->capacity > 0 ? list->capacity : 64;
+        while ( capacity < list->count + quads ) {
+            capacity *= 2;
+        }
+
+        SDL_Vertex * vertices = realloc(list->vertices,
+                                        (size_t)capacity * 4 * sizeof(*vertices));
+        if ( vertices == NULL ) {
+            PF_SET_ERROR("could not allocate vertices for %d characters\n", capacity);
+            return NULL;
+        }
+
+        list->vertices = vertices;
+        list->capacity = capacity;
+    }
+
+    SDL_Vertex * first = list->vertices + list->count * 4;
+    list->count += quads;
+    return first;
+}
+
 static void
-RenderChar(PF_Font * font, int x, int y, char ch)
+SetQuad(SDL_Vertex * vertices,
+        const SDL_FRect * dst,
+        const SDL_FRect * uv,
+        SDL_FColor color)
 {
+    float x0 = dst->x;
+    float y0 = dst->y;
+    float x1 = dst->x + dst->w;
+    float y1 = dst->y + dst->h;
+
+    float u0 = uv ? uv->x : 0;
+    float v0 = uv ? uv->y : 0;
+    float u1 = uv ? uv->x + uv->w : 0;
+    float v1 = uv ? uv->y + uv->h : 0;
+
+    vertices[0] = (SDL_Vertex){ { x0, y0 }, color, { u0, v0 } };
+    vertices[1] = (SDL_Vertex){ { x1, y0 }, color, { u1, v0 } };
+    vertices[2] = (SDL_Vertex){ { x1, y1 }, color, { u1, v1 } };
+    vertices[3] = (SDL_Vertex){ { x0, y1 }, color, { u0, v1 } };
+}
+
+/** Adds a character quad at `x`, `y` to `list` in the current foreground color. */
+static bool
+AddChar(PF_Font * font, QuadList * list, float x, float y, char ch)
+{
+    SDL_Vertex * vertices = ReserveQuads(list, 1);
+    if ( vertices == NULL ) {
+        return false;
+    }
+
     ch -= font->first_char;
 
     const uint8_t char_w = (uint8_t)(font->state.char_width);
     const uint8_t char_h = (uint8_t)(font->state.char_height);
-
-    SDL_FRect src = {
-        .x = (float)((ch % font->cols) * char_w),
-        .y = (float)((ch / font->cols) * char_h),
-        .w = (float)(char_w),
-        .h = (float)(char_h)
+    const float texture_w = (float)(font->texture->w);
+    const float texture_h = (float)(font->texture->h);
+
+    SDL_FRect uv = {
+        .x = (float)((ch % font->cols) * char_w) / texture_w,
+        .y = (float)((ch / font->cols) * char_h) / texture_h,
+        .w = (float)(char_w) / texture_w,
+        .h = (float)(char_h) / texture_h
     };
 
     SDL_FRect dst = {
-        .x = (float)(x),
-        .y = (float)(y),
+        .x = x,
+        .y = y,
         .w = (float)(char_w * font->state.scale),
         .h = (float)(char_h * font->state.scale)
     };
 
-    SDL_SetTextureColorMod(font->texture,
-                           font->state.foreground.r,
-                           font->state.foreground.g,
-                           font->state.foreground.b);
-    SDL_SetTextureAlphaMod(font->texture, font->state.foreground.a);
-    SDL_RenderTexture(font->renderer, font->texture, &src, &dst);
+    SetQuad(vertices, &dst, &uv, ToFColor(font->state.foreground));
+    return true;
 }
 
-/** `width` is in characters */
-static inline void
-RenderBackground(PF_Font * font, int x, int y, int width)
+/** Adds a background quad `width` characters wide at `x`, `y` to `list`. */
+static bool
+AddBackground(PF_Font * font, QuadList * list, float x, float y, int width)
 {
-    if ( font->state.background.a == 0 ) {
-        return;
+    if ( font->state.background.a == 0 || width == 0 ) {
+        return true;
+    }
+
+    SDL_Vertex * vertices = ReserveQuads(list, 1);
+    if ( vertices == NULL ) {
+        return false;
     }
 
     SDL_FRect dst = {
-        .x = (float)(x),
-        .y = (float)(y),
-        .w = (float)(width * font->state.char_width),
-        .h = (float)(font->state.char_height)
+        .x = x,
+        .y = y,
+        .w = (float)(width * font->state.char_width * font->state.scale),
+        .h = (float)(font->state.char_height * font->state.scale)
+    };
+
+    SetQuad(vertices, &dst, NULL, ToFColor(font->state.background));
+    return true;
+}
+
+static bool
+DrawQuads(PF_Font * font, SDL_Texture * texture, const QuadList * list)
+{
+    if ( list->count == 0 ) {
+        return true;
+    }
+
+    if ( !GrowIndices(font, list->count) ) {
+        return false;
+    }
+
+    if ( !SDL_RenderGeometry(font->renderer,
+                             texture,
+                             list->vertices,
+                             list->count * 4,
+                             font->indices,
+                             list->count * 6) ) {
+        PF_SET_ERROR("failed to draw %d characters: %s\n", list->count, SDL_GetError());
+        return false;
+    }
+
+    return true;
+}
+
+/** Draws everything added since the last flush, backgrounds first. */
+static bool
+Flush(PF_Font * font)
+{
+    bool result = DrawQuads(font, NULL, &font->backgrounds);
+    result &= DrawQuads(font, font->texture, &font->glyphs);
+
+    font->backgrounds.count = 0;
+    font->glyphs.count = 0;
+    return result;
+}
+
+static Uint32
+HashRun(const PF_Font * font, const char * text, int length)
+{
+    // FNV-1a
+    Uint32 hash = 2166136261u;
+    for ( int i = 0; i < length; i++ ) {
+        hash = (hash ^ (Uint8)text[i]) * 16777619u;
+    }
+
+    Uint32 scale_bits;
+    memcpy(&scale_bits, &font->state.scale, sizeof(scale_bits));
+    const SDL_Color fg = font->state.foreground;
+    const SDL_Color bg = font->state.background;
+    Uint32 extra[] = {
+        scale_bits,
+        (Uint32)font->state.letter_spacing,
+        (Uint32)(fg.r | fg.g << 8 | fg.b << 16 | (Uint32)fg.a << 24),
+        (Uint32)(bg.r | bg.g << 8 | bg.b << 16 | (Uint32)bg.a << 24),
     };
 
-    SDL_Color saved = GetRenderColor(font->renderer);
-    SetRenderColor(font->renderer, font->state.background);
-    SDL_RenderFillRect(font->renderer, &dst);
-    SetRenderColor(font->renderer, saved); // Set it back!
+    for ( size_t i = 0; i < sizeof(extra) / sizeof(extra[0]); i++ ) {
+        hash = (hash ^ extra[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+static bool
+SameColor(SDL_Color a, SDL_Color b)
+{
+    return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+}
+
+static bool
+RunMatches(const PF_Font * font,
+           const TextRun * run,
+           Uint32 hash,
+           const char * text,
+           int length)
+{
+    return run->hash == hash
+        && run->length == length
+        && run->scale == font->state.scale
+        && run->letter_spacing == font->state.letter_spacing
+        && SameColor(run->foreground, font->state.foreground)
+        && SameColor(run->background, font->state.background)
+        && memcmp(run->text, text, (size_t)length) == 0;
+}
+
+/**
+ *  Get the cached run for `text` in the font's current state, laying it out
+ *  first if it's not in the cache. Runs that land in the same slot replace each
+ *  other.
+ */
+static TextRun *
+GetRun(PF_Font * font, const char * text, int length)
+{
+    Uint32 hash = HashRun(font, text, length);
+    TextRun * run = &font->runs[hash & (PF_RUN_CACHE_SIZE - 1)];
+
+    if ( run->glyphs.vertices && RunMatches(font, run, hash, text, length) ) {
+        return run;
+    }
+
+    run->hash = 0;
+    run->length = 0;
+    run->glyphs.count = 0;
+    run->background_quad.count = 0;
+
+    if ( !AddBackground(font, &run->background_quad, 0, 0, length) ) {
+        return NULL;
+    }
+
+    // Make sure an empty string still counts as laid out.
+    if ( ReserveQuads(&run->glyphs, length) == NULL ) {
+        return NULL;
+    }
+    run->glyphs.count = 0;
+
+    Uint32 x = 0;
+    for ( int i = 0; i < length; i++ ) {
+        AddChar(font, &run->glyphs, (float)x, 0, text[i]);
+        x += (Uint32)((font->state.char_width + font->state.letter_spacing) * font->state.scale);
+    }
+
+    memcpy(run->text, text, (size_t)length);
+    run->text[length] = '\0';
+    run->length = length;
+    run->scale = font->state.scale;
+    run->letter_spacing = font->state.letter_spacing;
+    run->foreground = font->state.foreground;
+    run->background = font->state.background;
+    run->width = x;
+    run->hash = hash;
+
+    return run;
+}
+
+/** Copies `source` into `list`, moved by `x`, `y`. */
+static bool
+AddMovedQuads(QuadList * list, const QuadList * source, float x, float y)
+{
+    if ( source->count == 0 ) {
+        return true;
+    }
+
+    SDL_Vertex * vertices = ReserveQuads(list, source->count);
+    if ( vertices == NULL ) {
+        return false;
+    }
+
+    for ( int i = 0; i < source->count * 4; i++ ) {
+        vertices[i] = source->vertices[i];
+        vertices[i].position.x += x;
+        vertices[i].position.y += y;
+    }
+
+    return true;
+}
+
+static void
+FreeQuads(QuadList * list)
+{
+    free(list->vertices);
+    *list = (QuadList){ 0 };
 }
 
 // PUBLIC:
@@ -201,7 +485,16 @@ PF_GetError(void)
 void
 PF_DestroyFont(PF_Font * font)
 {
+    for ( int i = 0; i < PF_RUN_CACHE_SIZE; i++ ) {
+        FreeQuads(&font->runs[i].glyphs);
+        FreeQuads(&font->runs[i].background_quad);
+    }
+
+    FreeQuads(&font->glyphs);
+    FreeQuads(&font->backgrounds);
+    free(font->indices);
     SDL_DestroyTexture(font->texture);
+    free(font);
 }
 
 void
@@ -239,29 +532,59 @@ PF_FontState PF_GetState(PF_Font * font)
     return font->state;
 }
 
+void
+PF_BeginBatch(PF_Font * font)
+{
+    font->batch_depth++;
+}
+
+bool
+PF_EndBatch(PF_Font * font)
+{
+    if ( font->batch_depth > 0 ) {
+        font->batch_depth--;
+    }
+
+    if ( font->batch_depth > 0 ) {
+        return true;
+    }
+
+    return Flush(font);
+}
+
 void
 PF_RenderChar(PF_Font * font, int x, int y, char ch)
 {
-    RenderBackground(font, x, y, 1);
-    RenderChar(font, x, y, ch);
+    AddBackground(font, &font->backgrounds, (float)x, (float)y, 1);
+    AddChar(font, &font->glyphs, (float)x, (float)y, ch);
+
+    if ( font->batch_depth == 0 ) {
+        Flush(font);
+    }
 }
 
 Uint32
 PF_RenderString(PF_Font * font, int x, int y, const char * format, ...)
 {
     char buffer[PF_BUFFER_SIZE + 1]; // TODO: (Maybe) grow this exponentially.
+    const char * text = buffer;
+
+    // Plain labels don't need formatting.
+    if ( strchr(format, '%') == NULL ) {
+        text = format;
+    } else {
+        va_list args;
+        va_start(args, format);
+        vsnprintf(buffer, PF_BUFFER_SIZE, format, args);
+        va_end(args);
+    }
 
-    va_list args;
-    va_start(args, format);
-    vsnprintf(buffer, PF_BUFFER_SIZE, format, args);
-    va_end(args);
-
-    int len = (int)strlen(buffer);
+    int len = (int)strnlen(text, PF_BUFFER_SIZE - 1);
 
     if ( len >= PF_BUFFER_SIZE ) {
         PF_SET_ERROR("Warning: string '%s' has length greater than %d "
                      "and will be truncated.",
-                     buffer, PF_BUFFER_SIZE);
+                     text, PF_BUFFER_SIZE);
     }
 
     Uint32 text_w = (Uint32)(len * font->state.char_width * font->state.scale);
@@ -289,15 +612,17 @@ PF_RenderString(PF_Font * font, int x, int y, const char * format, ...)
     x &= 0xFFFF;
     y &= 0xFFFF;
 
-    RenderBackground(font, x, y, len);
+    TextRun * run = GetRun(font, text, len);
+    if ( run == NULL ) {
+        return 0;
+    }
+
+    AddMovedQuads(&font->backgrounds, &run->background_quad, (float)x, (float)y);
+    AddMovedQuads(&font->glyphs, &run->glyphs, (float)x, (float)y);
 
-    const char * ch = buffer;
-    Uint32 x1 = x;
-    while ( *ch ) {
-        RenderChar(font, x1, y, *ch);
-        x1 += (Uint32)((font->state.char_width + font->state.letter_spacing) * font->state.scale);
-        ch++;
+    if ( font->batch_depth == 0 ) {
+        Flush(font);
     }
 
-    return x1 - x;
+    return run->width;
 }
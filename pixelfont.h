@@ -93,6 +93,23 @@ void PF_SetBackground(PF_Font * font, Uint8 r, Uint8 g, Uint8 b, Uint8 a);
 /** Set the current rendering scale. */
 void PF_SetScale(PF_Font * font, float scale);
 
+/**
+ *  Start collecting rendered text instead of drawing it straight away, so that
+ *  everything rendered until the matching `PF_EndBatch` is drawn with one
+ *  `SDL_RenderGeometry` call (two if any of it has a background).
+ *  - note: Batches can be nested, only the outermost `PF_EndBatch` draws.
+ *      Anything else drawn to the renderer in the meantime ends up underneath
+ *      the batched text, and all backgrounds are drawn before all characters.
+ */
+void PF_BeginBatch(PF_Font * font);
+
+/**
+ *  Draw the text rendered since `PF_BeginBatch`.
+ *  - returns: `false` if drawing failed. Use `PF_GetError` to get a string
+ *             description of the error.
+ */
+bool PF_EndBatch(PF_Font * font);
+
 /**
  *  Render character at pixel coordinate with the font's current rendering color.
  */
@@ -105,6 +122,9 @@ void PF_RenderChar(PF_Font * font, int x, int y, char character);
  *      To justify text, `x` may be bitwise OR'd with `PF_CENTER` or `PF_RIGHT`
  *      and `y` may be OR'd with `PF_CENTER` or `PF_BOTTOM`.
  *  - returns: Returns the width of the rendered string in pixels.
+ *  - note: Strings are laid out once per scale, letter spacing and colors, and
+ *      reused from a cache while they stay the same, so static labels only cost
+ *      copying their vertices.
  */
 Uint32 PF_RenderString(PF_Font * font, int x, int y, const char * format, ...);
 
@@ -9,16 +9,33 @@
 #include <string.h>
 
 #include <netdb.h>
+#include <pthread.h>
 #include <sys/select.h>
 #include <sys/socket.h>
+#include <time.h>
 #include <unistd.h>
 
+#define NET_TRACE_RING_CAPACITY 4096 // Must be a power of two.
+#define NET_TRACE_FLUSH_INTERVAL_MS 10
+
 struct net_socket {
     int fd;
 };
 
 static FILE* log_file;
 
+// Single producer, single consumer ring: the networking thread appends records and the flush
+// thread writes them out. Each index is only ever written by one side and they wrap around.
+static FILE* trace_file;
+static pthread_t trace_thread;
+static NetTraceRecord trace_ring[NET_TRACE_RING_CAPACITY];
+static U32 trace_write_index;
+static U32 trace_read_index;
+static bool trace_stop;
+static U32 trace_tick;
+static U32 trace_dropped_count;
+static U64 trace_start_us;
+
 // TODO: use __thread or similar if we go multithreaded!
 static char err_str[NET_ERROR_MESSAGE_LEN] = "No error";
 
@@ -31,11 +48,107 @@ static void set_err(const char* format, ...) {
 
 // TODO: make error messages more generic, don't mention fcntl etc?
 
-bool net_init(const char* log_name) {
-    log_file = fopen(log_name, "w");
+static U64 monotonic_us(void) {
+    struct timespec ts = {0};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (U64)ts.tv_sec * 1000000 + (U64)ts.tv_nsec / 1000;
+}
 
-    if (log_file == NULL) {
-        set_err("Failed to open net.log\n"); // TODO: update
+static void* trace_flush_thread(void* arg) {
+    (void)arg;
+
+    struct timespec interval = { 0, NET_TRACE_FLUSH_INTERVAL_MS * 1000000L };
+
+    while (true) {
+        // Check for stop first, so everything traced before net_shutdown() gets written.
+        bool stopping = __atomic_load_n(&trace_stop, __ATOMIC_ACQUIRE);
+        U32 write_index = __atomic_load_n(&trace_write_index, __ATOMIC_ACQUIRE);
+        U32 read_index = trace_read_index;
+
+        if (read_index != write_index) {
+            while (read_index != write_index) {
+                U32 start = read_index % NET_TRACE_RING_CAPACITY;
+                U32 count = write_index - read_index;
+                if (count > NET_TRACE_RING_CAPACITY - start) {
+                    count = NET_TRACE_RING_CAPACITY - start;
+                }
+                fwrite(trace_ring + start, sizeof(*trace_ring), count, trace_file);
+                read_index += count;
+            }
+            __atomic_store_n(&trace_read_index, read_index, __ATOMIC_RELEASE);
+            fflush(trace_file);
+        }
+
+        if (stopping) {
+            break;
+        }
+
+        nanosleep(&interval, NULL);
+    }
+
+    return NULL;
+}
+
+static bool trace_start(const char* trace_name) {
+    trace_file = fopen(trace_name, "wb");
+    if (trace_file == NULL) {
+        set_err("Failed to open %s\n", trace_name);
+        return false;
+    }
+
+    struct timespec now = {0};
+    timespec_get(&now, TIME_UTC);
+    trace_start_us = monotonic_us();
+
+    NetTraceFileHeader header = {
+        .magic = NET_TRACE_MAGIC,
+        .version = NET_TRACE_VERSION,
+        .start_time_us = (U64)now.tv_sec * 1000000 + (U64)now.tv_nsec / 1000
+    };
+    fwrite(&header, sizeof(header), 1, trace_file);
+
+    trace_write_index = 0;
+    trace_read_index = 0;
+    trace_stop = false;
+    trace_dropped_count = 0;
+
+    int rc = pthread_create(&trace_thread, NULL, trace_flush_thread, NULL);
+    if (rc != 0) {
+        set_err("pthread_create() failed: %s\n", strerror(rc));
+        fclose(trace_file);
+        trace_file = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+static void trace_finish(void) {
+    if (trace_file == NULL) {
+        return;
+    }
+
+    __atomic_store_n(&trace_stop, true, __ATOMIC_RELEASE);
+    pthread_join(trace_thread, NULL);
+    fclose(trace_file);
+    trace_file = NULL;
+
+    if (trace_dropped_count > 0) {
+        net_log("trace ring buffer was full, dropped %u records\n", trace_dropped_count);
+    }
+}
+
+bool net_init(const char* log_name, const char* trace_name) {
+    if (log_name != NULL) {
+        log_file = fopen(log_name, "w");
+
+        if (log_file == NULL) {
+            set_err("Failed to open %s\n", log_name);
+            return false;
+        }
+    }
+
+    if (trace_name != NULL && !trace_start(trace_name)) {
         return false;
     }
 
@@ -205,6 +318,14 @@ bool net_accept(NetSocket* server, NetSocket** out) {
         return false;
     }
 
+    // Linux doesn't pass the listening socket's O_NONBLOCK on to accepted sockets like macOS does.
+    int flags = fcntl(fd, F_GETFL);
+    if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0) {
+        set_err("fcntl() failed on accepted socket: %s\n", strerror(errno));
+        close(fd);
+        return false;
+    }
+
     // there was a connection.
     *out = malloc(sizeof(**out));
     if ( *out == NULL ) {
@@ -265,12 +386,54 @@ const char* net_get_error(void) {
 }
 
 void net_shutdown(void) {
-    fclose(log_file);
+    trace_finish();
+
+    if (log_file != NULL) {
+        fclose(log_file);
+        log_file = NULL;
+    }
 }
 
 void net_log(const char* format, ...) {
+    if (log_file == NULL) {
+        return;
+    }
+
     va_list args;
     va_start(args, format);
     vfprintf(log_file, format, args);
     va_end(args);
 }
+
+void net_trace_set_tick(U32 tick) {
+    trace_tick = tick;
+}
+
+void net_trace(NetTraceDirection direction,
+               U32 bytes_expected,
+               U32 bytes_transferred,
+               S32 sequence,
+               U8 packet_type) {
+    if (trace_file == NULL) {
+        return;
+    }
+
+    U32 write_index = trace_write_index;
+    U32 read_index = __atomic_load_n(&trace_read_index, __ATOMIC_ACQUIRE);
+    if (write_index - read_index == NET_TRACE_RING_CAPACITY) {
+        // Never wait on the disk, lose the record instead.
+        trace_dropped_count++;
+        return;
+    }
+
+    trace_ring[write_index % NET_TRACE_RING_CAPACITY] = (NetTraceRecord){
+        .time_us = monotonic_us() - trace_start_us,
+        .tick = trace_tick,
+        .bytes_expected = bytes_expected,
+        .bytes_transferred = bytes_transferred,
+        .sequence = sequence,
+        .direction = (U8)(direction),
+        .packet_type = packet_type
+    };
+    __atomic_store_n(&trace_write_index, write_index + 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,431 @@
+#include "network_memory.h"
+
+#include <assert.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NET_MEMORY_MAX_LISTENERS 8
+#define NET_MEMORY_PORT_LEN 16
+
+// One net_send() worth of bytes, in flight until the clock reaches deliver_at_us.
+typedef struct NetMemorySegment {
+    struct NetMemorySegment* next;
+    U64 deliver_at_us;
+    U32 size;
+    U32 read_bytes;
+    U8* data;
+} NetMemorySegment;
+
+// One direction of a connection, shared by the sending and receiving socket.
+typedef struct {
+    NetMemorySegment* first;
+    NetMemorySegment* last;
+    U32 in_flight_bytes;
+    U64 link_free_at_us; // When the link has finished putting the previous segment on the wire.
+    bool closed;         // One of the sockets using it has been destroyed.
+    S32 ref_count;
+    NetMemoryLinkSettings settings;
+} NetMemoryPipe;
+
+struct net_socket {
+    NetMemoryPipe* receive_pipe;
+    NetMemoryPipe* send_pipe;
+
+    // Server sockets only.
+    bool listening;
+    char port[NET_MEMORY_PORT_LEN];
+    NetSocket* pending[SERVER_ACCEPT_QUEUE_LIMIT];
+    S32 pending_count;
+};
+
+static FILE* log_file;
+static FILE* trace_file;
+static U32 trace_tick;
+
+static char err_str[NET_ERROR_MESSAGE_LEN] = "No error";
+
+static NetSocket* listeners[NET_MEMORY_MAX_LISTENERS];
+static NetMemoryLinkSettings link_settings;
+static U64 now_us;
+static U32 random_state = 1;
+
+static void set_err(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    vsnprintf(err_str, NET_ERROR_MESSAGE_LEN, format, args);
+    va_end(args);
+}
+
+static U32 random_next(void) {
+    // xorshift32, so runs with the same seed deliver at exactly the same times.
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+static NetMemoryPipe* pipe_create(void) {
+    NetMemoryPipe* pipe = calloc(1, sizeof(*pipe));
+    if (pipe == NULL) {
+        set_err("malloc failed\n");
+        return NULL;
+    }
+
+    pipe->ref_count = 2;
+    pipe->settings = link_settings;
+    if (pipe->settings.buffer_size == 0) {
+        pipe->settings.buffer_size = NET_MEMORY_DEFAULT_BUFFER_SIZE;
+    }
+    return pipe;
+}
+
+static void pipe_release(NetMemoryPipe* pipe) {
+    if (pipe == NULL) {
+        return;
+    }
+
+    pipe->closed = true;
+    pipe->ref_count--;
+    if (pipe->ref_count > 0) {
+        return;
+    }
+
+    NetMemorySegment* segment = pipe->first;
+    while (segment != NULL) {
+        NetMemorySegment* next = segment->next;
+        free(segment);
+        segment = next;
+    }
+    free(pipe);
+}
+
+void net_memory_set_link_settings(const NetMemoryLinkSettings* settings) {
+    link_settings = *settings;
+}
+
+void net_memory_seed(U32 seed) {
+    random_state = seed ? seed : 1;
+}
+
+void net_memory_advance_time(U64 us) {
+    now_us += us;
+}
+
+U64 net_memory_time_us(void) {
+    return now_us;
+}
+
+bool net_init(const char* log_name, const char* trace_name) {
+    if (log_name != NULL) {
+        log_file = fopen(log_name, "w");
+        if (log_file == NULL) {
+            set_err("Failed to open %s\n", log_name);
+            return false;
+        }
+    }
+
+    if (trace_name != NULL) {
+        trace_file = fopen(trace_name, "wb");
+        if (trace_file == NULL) {
+            set_err("Failed to open %s\n", trace_name);
+            return false;
+        }
+
+        // Records are stamped with the virtual clock, starting from when tracing started.
+        struct timespec now = {0};
+        timespec_get(&now, TIME_UTC);
+
+        NetTraceFileHeader header = {
+            .magic = NET_TRACE_MAGIC,
+            .version = NET_TRACE_VERSION,
+            .start_time_us = (U64)now.tv_sec * 1000000 + (U64)now.tv_nsec / 1000 - now_us
+        };
+        fwrite(&header, sizeof(header), 1, trace_file);
+    }
+
+    return true;
+}
+
+NetSocket* net_create_client(const char* ip, const char* port) {
+    assert(port != NULL);
+    assert(ip != NULL);
+
+    // Every address is this process, only the port matters.
+    NetSocket* server = NULL;
+    for (S32 i = 0; i < NET_MEMORY_MAX_LISTENERS; i++) {
+        if (listeners[i] != NULL && strcmp(listeners[i]->port, port) == 0) {
+            server = listeners[i];
+            break;
+        }
+    }
+
+    if (server == NULL) {
+        set_err("connect error: nothing listening on port %s\n", port);
+        return NULL;
+    }
+
+    if (server->pending_count == SERVER_ACCEPT_QUEUE_LIMIT) {
+        set_err("connect error: accept queue for port %s is full\n", port);
+        return NULL;
+    }
+
+    NetSocket* client = calloc(1, sizeof(*client));
+    NetSocket* accepted = calloc(1, sizeof(*accepted));
+    NetMemoryPipe* to_server = pipe_create();
+    NetMemoryPipe* to_client = pipe_create();
+    if (client == NULL || accepted == NULL || to_server == NULL || to_client == NULL) {
+        set_err("malloc failed\n");
+        free(client);
+        free(accepted);
+        free(to_server);
+        free(to_client);
+        return NULL;
+    }
+
+    client->send_pipe = to_server;
+    client->receive_pipe = to_client;
+    accepted->send_pipe = to_client;
+    accepted->receive_pipe = to_server;
+
+    server->pending[server->pending_count++] = accepted;
+    return client;
+}
+
+NetSocket* net_create_server(const char* port) {
+    assert(port != NULL);
+
+    S32 free_index = -1;
+    for (S32 i = 0; i < NET_MEMORY_MAX_LISTENERS; i++) {
+        if (listeners[i] == NULL) {
+            if (free_index < 0) {
+                free_index = i;
+            }
+        } else if (strcmp(listeners[i]->port, port) == 0) {
+            set_err("bind() failed: port %s is in use\n", port);
+            return NULL;
+        }
+    }
+
+    if (free_index < 0) {
+        set_err("bind() failed: too many servers\n");
+        return NULL;
+    }
+
+    NetSocket* sock = calloc(1, sizeof(*sock));
+    if (sock == NULL) {
+        set_err("malloc failed\n");
+        return NULL;
+    }
+
+    sock->listening = true;
+    snprintf(sock->port, sizeof(sock->port), "%s", port);
+    listeners[free_index] = sock;
+    return sock;
+}
+
+bool net_accept(NetSocket* server, NetSocket** out) {
+    assert(server != NULL);
+    assert(out != NULL);
+
+    if (!server->listening) {
+        set_err("accept() failed: not a server socket\n");
+        return false;
+    }
+
+    if (server->pending_count == 0) {
+        *out = NULL;
+        return true;
+    }
+
+    *out = server->pending[0];
+    server->pending_count--;
+    memmove(server->pending, server->pending + 1, server->pending_count * sizeof(*server->pending));
+    return true;
+}
+
+int net_send(NetSocket* socket, void* buf, int size) {
+    assert(socket != NULL);
+    assert(buf != NULL);
+    assert(size > 0);
+
+    NetMemoryPipe* pipe = socket->send_pipe;
+    if (pipe == NULL || pipe->closed) {
+        set_err("Failed to send data: connection closed\n");
+        return -1;
+    }
+
+    const NetMemoryLinkSettings* settings = &pipe->settings;
+    if (pipe->in_flight_bytes >= settings->buffer_size) {
+        return 0;
+    }
+
+    U32 accepted = (U32)size;
+    if (accepted > settings->buffer_size - pipe->in_flight_bytes) {
+        accepted = settings->buffer_size - pipe->in_flight_bytes;
+    }
+    if (settings->max_send_size > 0 && accepted > settings->max_send_size) {
+        accepted = settings->max_send_size;
+    }
+
+    NetMemorySegment* segment = malloc(sizeof(*segment) + accepted);
+    if (segment == NULL) {
+        set_err("Failed to send data: malloc failed\n");
+        return -1;
+    }
+
+    segment->next = NULL;
+    segment->size = accepted;
+    segment->read_bytes = 0;
+    segment->data = (U8*)(segment + 1);
+    memcpy(segment->data, buf, accepted);
+
+    // The link puts one segment on the wire after another, then it takes latency to arrive.
+    U64 start_us = pipe->link_free_at_us > now_us ? pipe->link_free_at_us : now_us;
+    if (settings->bytes_per_second > 0) {
+        start_us += ((U64)accepted * 1000000) / settings->bytes_per_second;
+    }
+    pipe->link_free_at_us = start_us;
+
+    segment->deliver_at_us = start_us + settings->latency_us;
+    if (settings->jitter_us > 0) {
+        segment->deliver_at_us += random_next() % (settings->jitter_us + 1);
+    }
+
+    // The stream stays in order, a segment can't overtake the one in front of it.
+    if (pipe->last != NULL && segment->deliver_at_us < pipe->last->deliver_at_us) {
+        segment->deliver_at_us = pipe->last->deliver_at_us;
+    }
+
+    if (pipe->last != NULL) {
+        pipe->last->next = segment;
+    } else {
+        pipe->first = segment;
+    }
+    pipe->last = segment;
+    pipe->in_flight_bytes += accepted;
+
+    return (int)accepted;
+}
+
+int net_receive(NetSocket* socket, void* buf, int size) {
+    assert(socket != NULL);
+    assert(buf != NULL);
+    assert(size > 0);
+
+    NetMemoryPipe* pipe = socket->receive_pipe;
+    if (pipe == NULL) {
+        set_err("Error receiving data: not connected\n");
+        return -1;
+    }
+
+    U32 limit = (U32)size;
+    if (pipe->settings.max_receive_size > 0 && limit > pipe->settings.max_receive_size) {
+        limit = pipe->settings.max_receive_size;
+    }
+
+    U8* out = buf;
+    U32 received = 0;
+    while (received < limit && pipe->first != NULL && pipe->first->deliver_at_us <= now_us) {
+        NetMemorySegment* segment = pipe->first;
+        U32 count = segment->size - segment->read_bytes;
+        if (count > limit - received) {
+            count = limit - received;
+        }
+
+        memcpy(out + received, segment->data + segment->read_bytes, count);
+        segment->read_bytes += count;
+        received += count;
+
+        if (segment->read_bytes == segment->size) {
+            pipe->first = segment->next;
+            if (pipe->first == NULL) {
+                pipe->last = NULL;
+            }
+            free(segment);
+        }
+    }
+    pipe->in_flight_bytes -= received;
+
+    // Like a real socket, whatever was sent before the other end went away still arrives.
+    if (received == 0 && pipe->closed && pipe->first == NULL) {
+        set_err("Error receiving data: connection closed\n");
+        return -1;
+    }
+
+    return (int)received;
+}
+
+void net_destroy_socket(NetSocket* socket) {
+    assert(socket != NULL);
+
+    if (socket->listening) {
+        for (S32 i = 0; i < NET_MEMORY_MAX_LISTENERS; i++) {
+            if (listeners[i] == socket) {
+                listeners[i] = NULL;
+            }
+        }
+        for (S32 i = 0; i < socket->pending_count; i++) {
+            net_destroy_socket(socket->pending[i]);
+        }
+    }
+
+    pipe_release(socket->send_pipe);
+    pipe_release(socket->receive_pipe);
+    free(socket);
+}
+
+const char* net_get_error(void) {
+    return err_str;
+}
+
+void net_shutdown(void) {
+    if (trace_file != NULL) {
+        fclose(trace_file);
+        trace_file = NULL;
+    }
+
+    if (log_file != NULL) {
+        fclose(log_file);
+        log_file = NULL;
+    }
+}
+
+void net_log(const char* format, ...) {
+    if (log_file == NULL) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, format);
+    vfprintf(log_file, format, args);
+    va_end(args);
+}
+
+void net_trace_set_tick(U32 tick) {
+    trace_tick = tick;
+}
+
+void net_trace(NetTraceDirection direction,
+               U32 bytes_expected,
+               U32 bytes_transferred,
+               S32 sequence,
+               U8 packet_type) {
+    if (trace_file == NULL) {
+        return;
+    }
+
+    // Everything runs on one thread against the virtual clock, so write straight to the file.
+    NetTraceRecord record = {
+        .time_us = now_us,
+        .tick = trace_tick,
+        .bytes_expected = bytes_expected,
+        .bytes_transferred = bytes_transferred,
+        .sequence = sequence,
+        .direction = (U8)(direction),
+        .packet_type = packet_type
+    };
+    fwrite(&record, sizeof(record), 1, trace_file);
+}
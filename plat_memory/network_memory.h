@@ -0,0 +1,27 @@
+#ifndef network_memory_h
+#define network_memory_h
+
+#include "../network.h"
+
+// network_memory.c implements network.h with in-process pipes instead of sockets. Link it in place
+// of plat_mac/ or plat_win/ to run servers and clients in one process against a virtual clock.
+// Nothing arrives until net_memory_advance_time() moves the clock past its delivery time.
+
+#define NET_MEMORY_DEFAULT_BUFFER_SIZE (256 * 1024)
+
+typedef struct {
+    U64 latency_us;
+    U64 jitter_us;         // Up to this much extra random delay. Bytes still arrive in order.
+    U64 bytes_per_second;  // 0 for unlimited.
+    U32 max_receive_size;  // Largest read net_receive returns, 0 for unlimited.
+    U32 max_send_size;     // Largest write net_send accepts, 0 for unlimited.
+    U32 buffer_size;       // Bytes in flight before net_send accepts nothing, 0 for the default.
+} NetMemoryLinkSettings;
+
+// Applies to connections made after the call. Both directions use the same settings.
+void net_memory_set_link_settings(const NetMemoryLinkSettings* settings);
+void net_memory_seed(U32 seed);
+void net_memory_advance_time(U64 us);
+U64  net_memory_time_us(void);
+
+#endif /* network_memory_h */
@@ -2,15 +2,32 @@
 
 #include <assert.h>
 #include <stdio.h>
+#include <time.h>
 #include <ws2tcpip.h>
 #include <winsock2.h>
 
+#define NET_TRACE_RING_CAPACITY 4096 // Must be a power of two.
+#define NET_TRACE_FLUSH_INTERVAL_MS 10
+
 struct net_socket {
     SOCKET socket;
 };
 
 static FILE* log_file;
 
+// Single producer, single consumer ring: the networking thread appends records and the flush
+// thread writes them out. Each index is only ever written by one side and they wrap around.
+static FILE* trace_file;
+static HANDLE trace_thread;
+static NetTraceRecord trace_ring[NET_TRACE_RING_CAPACITY];
+static volatile LONG trace_write_index;
+static volatile LONG trace_read_index;
+static volatile LONG trace_stop;
+static U32 trace_tick;
+static U32 trace_dropped_count;
+static LARGE_INTEGER trace_start_counter;
+static LARGE_INTEGER trace_counter_frequency;
+
 // TODO: use __thread or similar if we go multithreaded!
 static char err_str[NET_ERROR_MESSAGE_LEN] = "No error";
 static char windows_error_str[NET_ERROR_MESSAGE_LEN];
@@ -38,7 +55,91 @@ const char* net_get_error(void) {
     return err_str;
 }
 
-bool net_init(const char* log_name) {
+static DWORD WINAPI trace_flush_thread(LPVOID arg) {
+    (void)arg;
+
+    while (true) {
+        // Check for stop first, so everything traced before net_shutdown() gets written.
+        bool stopping = InterlockedCompareExchange(&trace_stop, 0, 0) != 0;
+        U32 write_index = (U32)InterlockedCompareExchange(&trace_write_index, 0, 0);
+        U32 read_index = (U32)trace_read_index;
+
+        if (read_index != write_index) {
+            while (read_index != write_index) {
+                U32 start = read_index % NET_TRACE_RING_CAPACITY;
+                U32 count = write_index - read_index;
+                if (count > NET_TRACE_RING_CAPACITY - start) {
+                    count = NET_TRACE_RING_CAPACITY - start;
+                }
+                fwrite(trace_ring + start, sizeof(*trace_ring), count, trace_file);
+                read_index += count;
+            }
+            InterlockedExchange(&trace_read_index, (LONG)read_index);
+            fflush(trace_file);
+        }
+
+        if (stopping) {
+            break;
+        }
+
+        Sleep(NET_TRACE_FLUSH_INTERVAL_MS);
+    }
+
+    return 0;
+}
+
+static bool trace_start(const char* trace_name) {
+    trace_file = fopen(trace_name, "wb");
+    if (trace_file == NULL) {
+        set_err("Failed to open %s\n", trace_name);
+        return false;
+    }
+
+    struct timespec now = {0};
+    timespec_get(&now, TIME_UTC);
+    QueryPerformanceFrequency(&trace_counter_frequency);
+    QueryPerformanceCounter(&trace_start_counter);
+
+    NetTraceFileHeader header = {
+        .magic = NET_TRACE_MAGIC,
+        .version = NET_TRACE_VERSION,
+        .start_time_us = (U64)now.tv_sec * 1000000 + (U64)now.tv_nsec / 1000
+    };
+    fwrite(&header, sizeof(header), 1, trace_file);
+
+    trace_write_index = 0;
+    trace_read_index = 0;
+    trace_stop = 0;
+    trace_dropped_count = 0;
+
+    trace_thread = CreateThread(NULL, 0, trace_flush_thread, NULL, 0, NULL);
+    if (trace_thread == NULL) {
+        set_err("CreateThread() failed with %s\n", get_windows_network_error(GetLastError()));
+        fclose(trace_file);
+        trace_file = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+static void trace_finish(void) {
+    if (trace_file == NULL) {
+        return;
+    }
+
+    InterlockedExchange(&trace_stop, 1);
+    WaitForSingleObject(trace_thread, INFINITE);
+    CloseHandle(trace_thread);
+    fclose(trace_file);
+    trace_file = NULL;
+
+    if (trace_dropped_count > 0) {
+        net_log("trace ring buffer was full, dropped %u records\n", trace_dropped_count);
+    }
+}
+
+bool net_init(const char* log_name, const char* trace_name) {
     WORD wsa_version_requested = MAKEWORD(2, 2);
     WSADATA wsa_data = {0};
     int rc = WSAStartup(wsa_version_requested, &wsa_data);
@@ -48,9 +149,15 @@ bool net_init(const char* log_name) {
         return false;
     }
 
-    log_file = fopen(log_name, "w");
-    if (log_file == NULL) {
-        set_err("Failed to open net.log\n");
+    if (log_name != NULL) {
+        log_file = fopen(log_name, "w");
+        if (log_file == NULL) {
+            set_err("Failed to open %s\n", log_name);
+            return false;
+        }
+    }
+
+    if (trace_name != NULL && !trace_start(trace_name)) {
         return false;
     }
 
@@ -276,10 +383,19 @@ void net_destroy_socket(NetSocket* socket) {
 }
 
 void net_shutdown(void) {
-    fclose(log_file);
+    trace_finish();
+
+    if (log_file != NULL) {
+        fclose(log_file);
+        log_file = NULL;
+    }
 }
 
 void net_log(const char* format, ...) {
+    if (log_file == NULL) {
+        return;
+    }
+
     va_list args;
     va_start(args, format);
     vfprintf(log_file, format, args);
@@ -287,3 +403,41 @@ void net_log(const char* format, ...) {
     // TODO: Remote this, just added for testing.
     fflush(log_file);
 }
+
+void net_trace_set_tick(U32 tick) {
+    trace_tick = tick;
+}
+
+void net_trace(NetTraceDirection direction,
+               U32 bytes_expected,
+               U32 bytes_transferred,
+               S32 sequence,
+               U8 packet_type) {
+    if (trace_file == NULL) {
+        return;
+    }
+
+    U32 write_index = (U32)trace_write_index;
+    U32 read_index = (U32)InterlockedCompareExchange(&trace_read_index, 0, 0);
+    if (write_index - read_index == NET_TRACE_RING_CAPACITY) {
+        // Never wait on the disk, lose the record instead.
+        trace_dropped_count++;
+        return;
+    }
+
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    U64 elapsed = (U64)(counter.QuadPart - trace_start_counter.QuadPart);
+    U64 frequency = (U64)trace_counter_frequency.QuadPart;
+
+    trace_ring[write_index % NET_TRACE_RING_CAPACITY] = (NetTraceRecord){
+        .time_us = (elapsed / frequency) * 1000000 + ((elapsed % frequency) * 1000000) / frequency,
+        .tick = trace_tick,
+        .bytes_expected = bytes_expected,
+        .bytes_transferred = bytes_transferred,
+        .sequence = sequence,
+        .direction = (U8)(direction),
+        .packet_type = packet_type
+    };
+    InterlockedExchange(&trace_write_index, (LONG)(write_index + 1));
+}
@@ -0,0 +1,815 @@
+#include "replay.h"
+
+#include "map_cache.h"
+
+#if defined(PLATFORM_WINDOWS)
+    #include <direct.h>
+#else
+    #include <sys/stat.h>
+#endif
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static S32 _replay_file_count;
+
+static bool _read(const U8** ptr, const U8* end, void* out, size_t size) {
+    if ((size_t)(end - *ptr) < size) {
+        return false;
+    }
+    memcpy(out, *ptr, size);
+    *ptr += size;
+    return true;
+}
+
+static bool _write_header(FILE* file, const ReplayHeader* header) {
+    U32 version = REPLAY_VERSION;
+    bool result = fwrite(REPLAY_MAGIC, 4, 1, file) == 1;
+    result &= fwrite(&version, sizeof(version), 1, file) == 1;
+    result &= fwrite(&header->map_hash, sizeof(header->map_hash), 1, file) == 1;
+    result &= fwrite(header->map_file_name, sizeof(header->map_file_name), 1, file) == 1;
+    result &= fwrite(&header->settings, sizeof(header->settings), 1, file) == 1;
+    result &= fwrite(&header->seed, sizeof(header->seed), 1, file) == 1;
+    for (S32 s = 0; s < MAX_SNAKE_COUNT; s++) {
+        const ReplaySnakeSpawn* spawn = header->spawns + s;
+        result &= fwrite(&spawn->x, sizeof(spawn->x), 1, file) == 1;
+        result &= fwrite(&spawn->y, sizeof(spawn->y), 1, file) == 1;
+        result &= fwrite(&spawn->direction, sizeof(spawn->direction), 1, file) == 1;
+        result &= fwrite(&spawn->color, sizeof(spawn->color), 1, file) == 1;
+        result &= fwrite(&spawn->alive, sizeof(spawn->alive), 1, file) == 1;
+    }
+    return result;
+}
+
+static bool _read_header(const U8** ptr, const U8* end, ReplayHeader* header) {
+    char magic[4];
+    U32 version = 0;
+    if (!_read(ptr, end, magic, sizeof(magic)) ||
+        memcmp(magic, REPLAY_MAGIC, sizeof(magic)) != 0 ||
+        !_read(ptr, end, &version, sizeof(version))) {
+        fprintf(stderr, "Not a replay file\n");
+        return false;
+    }
+    if (version != REPLAY_VERSION) {
+        fprintf(stderr, "Unsupported replay version %u\n", version);
+        return false;
+    }
+
+    bool result = _read(ptr, end, &header->map_hash, sizeof(header->map_hash));
+    result = result && _read(ptr, end, header->map_file_name, sizeof(header->map_file_name));
+    result = result && _read(ptr, end, &header->settings, sizeof(header->settings));
+    result = result && _read(ptr, end, &header->seed, sizeof(header->seed));
+    for (S32 s = 0; s < MAX_SNAKE_COUNT && result; s++) {
+        ReplaySnakeSpawn* spawn = header->spawns + s;
+        result = result && _read(ptr, end, &spawn->x, sizeof(spawn->x));
+        result = result && _read(ptr, end, &spawn->y, sizeof(spawn->y));
+        result = result && _read(ptr, end, &spawn->direction, sizeof(spawn->direction));
+        result = result && _read(ptr, end, &spawn->color, sizeof(spawn->color));
+        result = result && _read(ptr, end, &spawn->alive, sizeof(spawn->alive));
+    }
+
+    if (!result) {
+        fprintf(stderr, "Replay header is cut off\n");
+        return false;
+    }
+
+    header->map_file_name[REPLAY_MAP_FILE_NAME_LEN - 1] = 0;
+    return true;
+}
+
+static bool _reserve(U8** buffer, size_t* capacity, size_t size) {
+    if (size <= *capacity) {
+        return true;
+    }
+
+    U8* new_buffer = realloc(*buffer, size);
+    if (new_buffer == NULL) {
+        fprintf(stderr, "Failed to allocate %zu bytes for a replay keyframe\n", size);
+        return false;
+    }
+
+    // Anything past the state in a keyframe buffer is treated as zeros.
+    memset(new_buffer + *capacity, 0, size - *capacity);
+    *buffer = new_buffer;
+    *capacity = size;
+    return true;
+}
+
+// The state written to keyframes is everything game_update reads that isn't in the header. The
+// items come first so that they line up between keyframes whatever length the snakes are.
+static size_t _snake_state_size(const Snake* snake) {
+    size_t segment_size = sizeof(snake->segments[0].x) +
+                          sizeof(snake->segments[0].y) +
+                          sizeof(snake->segments[0].health);
+    return sizeof(snake->length) + 6 * sizeof(U8) + snake->length * segment_size;
+}
+
+static size_t _game_state_size(const Game* game) {
+    size_t size = sizeof(game->tick) + sizeof(game->state) + sizeof(game->random_state);
+    size += sizeof(game->items.width) + sizeof(game->items.height);
+    size += game->items.width * game->items.height * sizeof(*game->items.cells);
+    for (S32 s = 0; s < MAX_SNAKE_COUNT; s++) {
+        size += _snake_state_size(game->snakes + s);
+    }
+    return size;
+}
+
+static size_t _game_state_write(const Game* game, U8* out, size_t size) {
+    U8* ptr = out;
+
+    memcpy(ptr, &game->tick, sizeof(game->tick));
+    ptr += sizeof(game->tick);
+    memcpy(ptr, &game->state, sizeof(game->state));
+    ptr += sizeof(game->state);
+    memcpy(ptr, &game->random_state, sizeof(game->random_state));
+    ptr += sizeof(game->random_state);
+
+    ptr += items_serialize(&game->items, ptr, size - (ptr - out));
+
+    for (S32 s = 0; s < MAX_SNAKE_COUNT; s++) {
+        const Snake* snake = game->snakes + s;
+        memcpy(ptr, &snake->length, sizeof(snake->length));
+        ptr += sizeof(snake->length);
+        *ptr++ = (U8)snake->direction;
+        *ptr++ = (U8)snake->chomp_cooldown;
+        *ptr++ = (U8)snake->kill_damage_cooldown;
+        *ptr++ = (U8)snake->life_state;
+        *ptr++ = (U8)snake->constrict_state;
+        *ptr++ = (U8)snake->color;
+        for (S32 e = 0; e < snake->length; e++) {
+            memcpy(ptr, &snake->segments[e].x, sizeof(snake->segments[e].x));
+            ptr += sizeof(snake->segments[e].x);
+            memcpy(ptr, &snake->segments[e].y, sizeof(snake->segments[e].y));
+            ptr += sizeof(snake->segments[e].y);
+            memcpy(ptr, &snake->segments[e].health, sizeof(snake->segments[e].health));
+            ptr += sizeof(snake->segments[e].health);
+        }
+    }
+
+    return ptr - out;
+}
+
+static bool _game_state_read(U8* data, size_t size, Game* game) {
+    const U8* ptr = data;
+    const U8* end = data + size;
+
+    bool result = _read(&ptr, end, &game->tick, sizeof(game->tick));
+    result = result && _read(&ptr, end, &game->state, sizeof(game->state));
+    result = result && _read(&ptr, end, &game->random_state, sizeof(game->random_state));
+    size_t items_size = sizeof(game->items.width) + sizeof(game->items.height) +
+                        game->items.width * game->items.height * sizeof(*game->items.cells);
+    if (!result || items_size > (size_t)(end - ptr)) {
+        return false;
+    }
+
+    ptr += items_deserialize((U8*)ptr, end - ptr, &game->items);
+
+    for (S32 s = 0; s < MAX_SNAKE_COUNT && result; s++) {
+        Snake* snake = game->snakes + s;
+        S32 length = 0;
+        U8 fields[6];
+        result = _read(&ptr, end, &length, sizeof(length)) &&
+                 _read(&ptr, end, fields, sizeof(fields)) &&
+                 length >= 0 && length <= snake->capacity;
+        if (!result) {
+            break;
+        }
+
+        snake->length = length;
+        snake->direction = fields[0];
+        snake->chomp_cooldown = (S8)fields[1];
+        snake->kill_damage_cooldown = (S8)fields[2];
+        snake->life_state = fields[3];
+        snake->constrict_state = fields[4];
+        snake->color = fields[5];
+        for (S32 e = 0; e < length && result; e++) {
+            result = _read(&ptr, end, &snake->segments[e].x, sizeof(snake->segments[e].x)) &&
+                     _read(&ptr, end, &snake->segments[e].y, sizeof(snake->segments[e].y)) &&
+                     _read(&ptr, end, &snake->segments[e].health, sizeof(snake->segments[e].health));
+        }
+    }
+
+    return result;
+}
+
+// Keyframes are mostly the same as the one before, so the XOR is mostly zeros.
+size_t replay_delta_encode(const U8* state, const U8* previous, size_t size, U8* out) {
+    U8* ptr = out;
+    size_t i = 0;
+    while (i < size) {
+        U16 zero_count = 0;
+        while (i < size && zero_count < 0xFFFF && (state[i] ^ previous[i]) == 0) {
+            zero_count++;
+            i++;
+        }
+
+        U8* literal_count_ptr = ptr + sizeof(zero_count);
+        U16 literal_count = 0;
+        ptr += sizeof(zero_count) + sizeof(literal_count);
+        while (i < size && literal_count < 0xFFFF && (state[i] ^ previous[i]) != 0) {
+            *ptr++ = state[i] ^ previous[i];
+            literal_count++;
+            i++;
+        }
+
+        memcpy(literal_count_ptr - sizeof(zero_count), &zero_count, sizeof(zero_count));
+        memcpy(literal_count_ptr, &literal_count, sizeof(literal_count));
+    }
+    return ptr - out;
+}
+
+// Worst case is alternating zero and non-zero bytes.
+size_t replay_delta_encode_bound(size_t size) {
+    return (size / 2 + 1) * (2 * sizeof(U16) + 1) + 2 * sizeof(U16);
+}
+
+bool replay_delta_decode(const U8* encoded, size_t encoded_size, U8* state, size_t size) {
+    const U8* ptr = encoded;
+    const U8* end = encoded + encoded_size;
+    size_t i = 0;
+    while (ptr < end) {
+        U16 zero_count = 0;
+        U16 literal_count = 0;
+        if (!_read(&ptr, end, &zero_count, sizeof(zero_count)) ||
+            !_read(&ptr, end, &literal_count, sizeof(literal_count)) ||
+            i + zero_count + literal_count > size ||
+            (size_t)(end - ptr) < literal_count) {
+            return false;
+        }
+
+        i += zero_count;
+        for (U16 l = 0; l < literal_count; l++) {
+            state[i++] ^= *ptr++;
+        }
+    }
+
+    // The encoder always covers the whole state, so anything short of it was cut off.
+    return i == size;
+}
+
+static void _recorder_write(ReplayRecorder* recorder, const void* data, size_t size) {
+    fwrite(data, size, 1, recorder->file);
+    recorder->file_offset += (U32)size;
+}
+
+static void _recorder_write_keyframe(ReplayRecorder* recorder, const Game* game) {
+    size_t state_size = _game_state_size(game);
+    if (!_reserve(&recorder->keyframe_state, &recorder->keyframe_state_capacity, state_size) ||
+        !_reserve(&recorder->scratch,
+                  &recorder->scratch_capacity,
+                  state_size + replay_delta_encode_bound(state_size))) {
+        return;
+    }
+
+    if (recorder->keyframe_count == recorder->keyframe_capacity) {
+        U32 capacity = recorder->keyframe_capacity ? recorder->keyframe_capacity * 2 : 16;
+        ReplayKeyframeEntry* keyframes = realloc(recorder->keyframes, capacity * sizeof(*keyframes));
+        if (keyframes == NULL) {
+            fprintf(stderr, "Failed to grow the replay keyframe index\n");
+            return;
+        }
+        recorder->keyframes = keyframes;
+        recorder->keyframe_capacity = capacity;
+    }
+
+    // Full keyframes are encoded against nothing.
+    if (recorder->keyframe_count % REPLAY_KEYFRAMES_PER_FULL == 0) {
+        memset(recorder->keyframe_state, 0, recorder->keyframe_state_capacity);
+    }
+
+    U8* state = recorder->scratch;
+    U8* encoded = recorder->scratch + state_size;
+    _game_state_write(game, state, state_size);
+    U32 encoded_size = (U32)replay_delta_encode(state, recorder->keyframe_state, state_size, encoded);
+
+    // Keep the state for next time, zeroing whatever a longer previous state left past the end.
+    memcpy(recorder->keyframe_state, state, state_size);
+    if (recorder->keyframe_state_size > state_size) {
+        memset(recorder->keyframe_state + state_size, 0, recorder->keyframe_state_size - state_size);
+    }
+    recorder->keyframe_state_size = state_size;
+
+    recorder->keyframes[recorder->keyframe_count++] = (ReplayKeyframeEntry){
+        .tick = recorder->tick_count,
+        .offset = recorder->file_offset
+    };
+
+    U8 marker = REPLAY_KEYFRAME;
+    U32 size = (U32)state_size;
+    _recorder_write(recorder, &marker, sizeof(marker));
+    _recorder_write(recorder, &recorder->tick_count, sizeof(recorder->tick_count));
+    _recorder_write(recorder, &size, sizeof(size));
+    _recorder_write(recorder, &encoded_size, sizeof(encoded_size));
+    _recorder_write(recorder, encoded, encoded_size);
+}
+
+bool replay_recorder_begin(ReplayRecorder* recorder, const Game* game, const char* map_file_name) {
+    replay_recorder_end(recorder, game);
+
+    ReplayHeader header = {
+        .settings = game->settings,
+        .seed = game->random_state,
+    };
+    snprintf(header.map_file_name, sizeof(header.map_file_name), "%s", map_file_name);
+
+    char map_path[128];
+    snprintf(map_path, sizeof(map_path), "assets/%s", map_file_name);
+    size_t map_size = 0;
+    U8* map_data = ReadMapFile(map_path, &map_size);
+    if (map_data == NULL) {
+        fprintf(stderr, "Failed to read map file %s for replay\n", map_path);
+        return false;
+    }
+    header.map_hash = HashMapData(map_data, map_size);
+    free(map_data);
+
+    for (S32 s = 0; s < MAX_SNAKE_COUNT; s++) {
+        const Snake* snake = game->snakes + s;
+        ReplaySnakeSpawn* spawn = header.spawns + s;
+        spawn->direction = (U8)snake->direction;
+        spawn->color = (U8)snake->color;
+        spawn->alive = snake->life_state == SNAKE_LIFE_STATE_ALIVE && snake->length > 0;
+        if (spawn->alive) {
+            spawn->x = snake->segments[0].x;
+            spawn->y = snake->segments[0].y;
+        }
+    }
+
+#if defined(PLATFORM_WINDOWS)
+    _mkdir(REPLAY_DIRECTORY);
+#else
+    mkdir(REPLAY_DIRECTORY, 0755);
+#endif
+
+    char time_string[32];
+    time_t now = time(NULL);
+    strftime(time_string, sizeof(time_string), "%Y%m%d-%H%M%S", localtime(&now));
+    snprintf(recorder->path,
+             sizeof(recorder->path),
+             REPLAY_DIRECTORY "/%s-%d.tqreplay",
+             time_string,
+             _replay_file_count++);
+
+    recorder->file = fopen(recorder->path, "wb");
+    if (recorder->file == NULL) {
+        fprintf(stderr, "Failed to create replay file %s\n", recorder->path);
+        return false;
+    }
+
+    if (!_write_header(recorder->file, &header)) {
+        fprintf(stderr, "Failed to write replay file %s\n", recorder->path);
+        fclose(recorder->file);
+        recorder->file = NULL;
+        return false;
+    }
+
+    recorder->tick_count = 0;
+    recorder->file_offset = (U32)ftell(recorder->file);
+    recorder->keyframe_count = 0;
+    recorder->keyframe_state_size = 0;
+    return true;
+}
+
+void replay_recorder_add_tick(ReplayRecorder* recorder,
+                              const Game* game,
+                              const SnakeAction* snake_actions) {
+    if (recorder->file == NULL) {
+        return;
+    }
+
+    if (recorder->tick_count % REPLAY_KEYFRAME_INTERVAL_TICKS == 0) {
+        _recorder_write_keyframe(recorder, game);
+    }
+
+    // Most ticks nobody presses anything, so only the actions that were set are written.
+    U8 tick[1 + MAX_SNAKE_COUNT];
+    U8 count = 1;
+    tick[0] = 0;
+    for (S32 s = 0; s < MAX_SNAKE_COUNT; s++) {
+        if (snake_actions[s] != SNAKE_ACTION_NONE) {
+            tick[0] |= (U8)(1 << s);
+            tick[count++] = snake_actions[s];
+        }
+    }
+
+    _recorder_write(recorder, tick, count);
+    recorder->tick_count++;
+}
+
+void replay_recorder_end(ReplayRecorder* recorder, const Game* game) {
+    if (recorder->file == NULL) {
+        return;
+    }
+
+    U8 end_of_ticks = REPLAY_END_OF_TICKS;
+    _recorder_write(recorder, &end_of_ticks, sizeof(end_of_ticks));
+    for (U32 k = 0; k < recorder->keyframe_count; k++) {
+        _recorder_write(recorder, &recorder->keyframes[k].tick, sizeof(recorder->keyframes[k].tick));
+        _recorder_write(recorder, &recorder->keyframes[k].offset, sizeof(recorder->keyframes[k].offset));
+    }
+
+    ReplayTrailer trailer = {
+        .keyframe_count = recorder->keyframe_count,
+        .keyframe_interval_ticks = REPLAY_KEYFRAME_INTERVAL_TICKS,
+        .tick_count = recorder->tick_count,
+        .final_hash = game_hash(game)
+    };
+    _recorder_write(recorder, &trailer.keyframe_count, sizeof(trailer.keyframe_count));
+    _recorder_write(recorder, &trailer.keyframe_interval_ticks, sizeof(trailer.keyframe_interval_ticks));
+    _recorder_write(recorder, &trailer.tick_count, sizeof(trailer.tick_count));
+    _recorder_write(recorder, &trailer.final_hash, sizeof(trailer.final_hash));
+
+    if (fclose(recorder->file) != 0) {
+        fprintf(stderr, "Failed to write replay file %s\n", recorder->path);
+    } else {
+        printf("recorded %u ticks, %u keyframes, %u bytes to %s\n",
+               recorder->tick_count,
+               recorder->keyframe_count,
+               recorder->file_offset,
+               recorder->path);
+    }
+    recorder->file = NULL;
+
+    free(recorder->keyframe_state);
+    free(recorder->scratch);
+    free(recorder->keyframes);
+    recorder->keyframe_state = NULL;
+    recorder->keyframe_state_capacity = 0;
+    recorder->scratch = NULL;
+    recorder->scratch_capacity = 0;
+    recorder->keyframes = NULL;
+    recorder->keyframe_capacity = 0;
+}
+
+bool replay_load(Replay* replay, const char* path) {
+    replay_destroy(replay);
+
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Failed to open replay file %s\n", path);
+        return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    replay->data = malloc(size > 0 ? size : 1);
+    if (replay->data == NULL || fread(replay->data, 1, size, file) != (size_t)size) {
+        fprintf(stderr, "Failed to read replay file %s\n", path);
+        fclose(file);
+        replay_destroy(replay);
+        return false;
+    }
+    fclose(file);
+    replay->size = (size_t)size;
+
+    const U8* ptr = replay->data;
+    const U8* end = replay->data + replay->size;
+    if (!_read_header(&ptr, end, &replay->header)) {
+        replay_destroy(replay);
+        return false;
+    }
+    replay->first_tick_offset = ptr - replay->data;
+    replay->offset = replay->first_tick_offset;
+
+    // Look for the trailer at the end, then check the index before it ends where the ticks do and
+    // points at keyframes, in case the file was cut off somewhere that looks like a trailer.
+    ReplayTrailer trailer = {0};
+    size_t trailer_size = sizeof(trailer.keyframe_count) +
+                          sizeof(trailer.keyframe_interval_ticks) +
+                          sizeof(trailer.tick_count) +
+                          sizeof(trailer.final_hash);
+    if (replay->size < replay->offset + trailer_size + 1) {
+        return true;
+    }
+
+    const U8* trailer_ptr = end - trailer_size;
+    _read(&trailer_ptr, end, &trailer.keyframe_count, sizeof(trailer.keyframe_count));
+    _read(&trailer_ptr, end, &trailer.keyframe_interval_ticks, sizeof(trailer.keyframe_interval_ticks));
+    _read(&trailer_ptr, end, &trailer.tick_count, sizeof(trailer.tick_count));
+    _read(&trailer_ptr, end, &trailer.final_hash, sizeof(trailer.final_hash));
+
+    // Seeking finds keyframes by dividing by the interval, so they have to be exactly where the
+    // recorder puts them.
+    U32 expected_keyframe_count = (trailer.tick_count + REPLAY_KEYFRAME_INTERVAL_TICKS - 1) /
+                                  REPLAY_KEYFRAME_INTERVAL_TICKS;
+    if (trailer.keyframe_interval_ticks != REPLAY_KEYFRAME_INTERVAL_TICKS ||
+        trailer.keyframe_count != expected_keyframe_count) {
+        return true;
+    }
+
+    size_t index_size = (size_t)trailer.keyframe_count * 2 * sizeof(U32);
+    if (index_size > replay->size - replay->offset - trailer_size - 1) {
+        return true;
+    }
+
+    size_t index_offset = replay->size - trailer_size - index_size;
+    if (replay->data[index_offset - 1] != REPLAY_END_OF_TICKS) {
+        return true;
+    }
+
+    for (U32 k = 0; k < trailer.keyframe_count; k++) {
+        U32 keyframe_tick = 0;
+        U32 keyframe_offset = 0;
+        memcpy(&keyframe_tick, replay->data + index_offset + k * 2 * sizeof(U32), sizeof(U32));
+        memcpy(&keyframe_offset, replay->data + index_offset + k * 2 * sizeof(U32) + sizeof(U32), sizeof(U32));
+        if (keyframe_tick != k * REPLAY_KEYFRAME_INTERVAL_TICKS ||
+            keyframe_offset < replay->first_tick_offset ||
+            keyframe_offset >= index_offset ||
+            replay->data[keyframe_offset] != REPLAY_KEYFRAME) {
+            return true;
+        }
+    }
+
+    replay->trailer = trailer;
+    replay->keyframe_index_offset = index_offset;
+    replay->has_footer = true;
+    return true;
+}
+
+static ReplayKeyframeEntry _replay_keyframe_entry(const Replay* replay, U32 index) {
+    ReplayKeyframeEntry entry = {0};
+    const U8* ptr = replay->data + replay->keyframe_index_offset + index * 2 * sizeof(U32);
+    memcpy(&entry.tick, ptr, sizeof(entry.tick));
+    memcpy(&entry.offset, ptr + sizeof(entry.tick), sizeof(entry.offset));
+    return entry;
+}
+
+// Reads a keyframe's header, leaving ptr at its encoded state.
+static bool _replay_read_keyframe_header(const U8** ptr,
+                                         const U8* end,
+                                         U32* tick,
+                                         U32* state_size,
+                                         U32* encoded_size) {
+    U8 marker = 0;
+    return _read(ptr, end, &marker, sizeof(marker)) &&
+           marker == REPLAY_KEYFRAME &&
+           _read(ptr, end, tick, sizeof(*tick)) &&
+           _read(ptr, end, state_size, sizeof(*state_size)) &&
+           _read(ptr, end, encoded_size, sizeof(*encoded_size)) &&
+           (size_t)(end - *ptr) >= *encoded_size;
+}
+
+// Decodes the keyframe at index into replay->keyframe_state, starting from the full keyframe before
+// it. Returns the size of the state or 0 on failure.
+static size_t _replay_decode_keyframe(Replay* replay, U32 index) {
+    const U8* end = replay->data + replay->size;
+    size_t previous_size = 0;
+    U32 state_size = 0;
+
+    for (U32 k = index - index % REPLAY_KEYFRAMES_PER_FULL; k <= index; k++) {
+        const U8* ptr = replay->data + _replay_keyframe_entry(replay, k).offset;
+        U32 tick = 0;
+        U32 encoded_size = 0;
+        if (!_replay_read_keyframe_header(&ptr, end, &tick, &state_size, &encoded_size) ||
+            !_reserve(&replay->keyframe_state, &replay->keyframe_state_capacity, state_size)) {
+            fprintf(stderr, "Replay keyframe %u is corrupt\n", k);
+            return 0;
+        }
+
+        // Full keyframes are encoded against nothing, and anything past the end of the previous
+        // state counts as zeros.
+        if (k % REPLAY_KEYFRAMES_PER_FULL == 0) {
+            memset(replay->keyframe_state, 0, replay->keyframe_state_capacity);
+        } else if (previous_size > state_size) {
+            memset(replay->keyframe_state + state_size, 0, previous_size - state_size);
+        }
+
+        if (!replay_delta_decode(ptr, encoded_size, replay->keyframe_state, state_size)) {
+            fprintf(stderr, "Replay keyframe %u is corrupt\n", k);
+            return 0;
+        }
+        previous_size = state_size;
+    }
+
+    return state_size;
+}
+
+// Puts game in the state of keyframe index with the replay ready to play the tick after it.
+static bool _replay_restore_keyframe(Replay* replay, Game* game, U32 index) {
+    ReplayKeyframeEntry entry = _replay_keyframe_entry(replay, index);
+    size_t state_size = _replay_decode_keyframe(replay, index);
+    if (state_size == 0 || !_game_state_read(replay->keyframe_state, state_size, game)) {
+        return false;
+    }
+
+    replay->offset = entry.offset;
+    replay->ticks_played = entry.tick;
+    return true;
+}
+
+void replay_destroy(Replay* replay) {
+    free(replay->data);
+    free(replay->keyframe_state);
+    memset(replay, 0, sizeof(*replay));
+}
+
+bool replay_start_game(Replay* replay, Game* game) {
+    const ReplayHeader* header = &replay->header;
+
+    FreeMap(&game->map);
+    if (!map_cache_find(header->map_hash, header->map_file_name, &game->map)) {
+        fprintf(stderr, "Replay map %s (%016" PRIx64 ") isn't in the cache or assets\n",
+                header->map_file_name, header->map_hash);
+        return false;
+    }
+
+    game_destroy(game);
+    if (!game_init_loaded_map(game)) {
+        return false;
+    }
+
+    game->settings = header->settings;
+    game_seed_random(game, header->seed);
+
+    for (S32 s = 0; s < MAX_SNAKE_COUNT; s++) {
+        const ReplaySnakeSpawn* spawn = header->spawns + s;
+        Snake* snake = game->snakes + s;
+        snake->length = 0;
+        snake->life_state = SNAKE_LIFE_STATE_DEAD;
+        snake->color = spawn->color;
+        if (spawn->alive) {
+            snake_spawn(snake,
+                        spawn->x,
+                        spawn->y,
+                        spawn->direction,
+                        game->settings.starting_length,
+                        (S8)(game->settings.segment_health));
+        }
+    }
+
+    game->state = GAME_STATE_PLAYING;
+    replay->offset = replay->first_tick_offset;
+    replay->ticks_played = 0;
+    return true;
+}
+
+bool replay_next_tick(Replay* replay, SnakeAction* snake_actions) {
+    if (replay->has_footer && replay->ticks_played >= replay->trailer.tick_count) {
+        return false;
+    }
+
+    const U8* ptr = replay->data + replay->offset;
+    const U8* end = replay->data + replay->size;
+
+    // Keyframes are only needed for seeking, step over them.
+    if (ptr < end && *ptr == REPLAY_KEYFRAME) {
+        U32 tick = 0;
+        U32 state_size = 0;
+        U32 encoded_size = 0;
+        if (!_replay_read_keyframe_header(&ptr, end, &tick, &state_size, &encoded_size)) {
+            return false;
+        }
+        ptr += encoded_size;
+    }
+
+    U8 mask = 0;
+    if (!_read(&ptr, end, &mask, sizeof(mask)) || mask == REPLAY_END_OF_TICKS) {
+        return false;
+    }
+
+    for (S32 s = 0; s < MAX_SNAKE_COUNT; s++) {
+        snake_actions[s] = SNAKE_ACTION_NONE;
+        if ((mask & (1 << s)) && !_read(&ptr, end, snake_actions + s, sizeof(snake_actions[s]))) {
+            return false;
+        }
+    }
+
+    replay->offset = ptr - replay->data;
+    replay->ticks_played++;
+    return true;
+}
+
+bool replay_seek(Replay* replay, Game* game, U32 tick) {
+    // Carry on from where we are if that's no further than from a keyframe.
+    bool simulate_from_here = tick >= replay->ticks_played &&
+                              tick - replay->ticks_played < REPLAY_KEYFRAME_INTERVAL_TICKS;
+
+    if (!simulate_from_here && replay->has_footer && replay->trailer.keyframe_count > 0) {
+        U32 index = tick / replay->trailer.keyframe_interval_ticks;
+        if (index >= replay->trailer.keyframe_count) {
+            index = replay->trailer.keyframe_count - 1;
+        }
+
+        if (!_replay_restore_keyframe(replay, game, index)) {
+            return false;
+        }
+    } else if (!simulate_from_here) {
+        // Without keyframes the only way back is from the start.
+        if (tick < replay->ticks_played && !replay_start_game(replay, game)) {
+            return false;
+        }
+    }
+
+    SnakeAction snake_actions[MAX_SNAKE_COUNT];
+    while (replay->ticks_played < tick && replay_next_tick(replay, snake_actions)) {
+        game_update(game, snake_actions);
+    }
+    return true;
+}
+
+bool replay_verify(const char* path) {
+    Replay replay = {0};
+    Game game = {0};
+    if (!replay_load(&replay, path) || !replay_start_game(&replay, &game)) {
+        replay_destroy(&replay);
+        return false;
+    }
+
+    clock_t start = clock();
+
+    // Check the simulation against each keyframe on the way, to narrow down where it went wrong.
+    U32 next_keyframe = 0;
+    U32 diverged_keyframe = 0;
+    bool diverged = false;
+    U8* state = NULL;
+    size_t state_capacity = 0;
+    U64* keyframe_hashes = NULL;
+    if (replay.has_footer && replay.trailer.keyframe_count > 0) {
+        keyframe_hashes = calloc(replay.trailer.keyframe_count, sizeof(*keyframe_hashes));
+    }
+
+    SnakeAction snake_actions[MAX_SNAKE_COUNT];
+    do {
+        if (!diverged && replay.has_footer && next_keyframe < replay.trailer.keyframe_count &&
+            _replay_keyframe_entry(&replay, next_keyframe).tick == replay.ticks_played) {
+            size_t keyframe_size = _replay_decode_keyframe(&replay, next_keyframe);
+            size_t state_size = _game_state_size(&game);
+            if (keyframe_hashes == NULL || !_reserve(&state, &state_capacity, state_size)) {
+                break;
+            }
+            _game_state_write(&game, state, state_size);
+            if (keyframe_size != state_size || memcmp(state, replay.keyframe_state, state_size) != 0) {
+                diverged = true;
+                diverged_keyframe = next_keyframe;
+            }
+            keyframe_hashes[next_keyframe] = game_hash(&game);
+            next_keyframe++;
+        }
+    } while (replay_next_tick(&replay, snake_actions) && (game_update(&game, snake_actions), true));
+    free(state);
+
+    double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    printf("played %u ticks in %.3f s (%.0f ticks/s)\n",
+           replay.ticks_played,
+           seconds,
+           seconds > 0.0 ? replay.ticks_played / seconds : 0.0);
+
+    bool result = true;
+    if (!replay.has_footer) {
+        puts("replay has no footer, it was cut off before the game ended so can't be verified");
+        result = false;
+    } else if (replay.ticks_played != replay.trailer.tick_count) {
+        printf("FAILED: played %u of %u ticks\n", replay.ticks_played, replay.trailer.tick_count);
+        result = false;
+    } else if (diverged) {
+        printf("FAILED: state doesn't match keyframe %u at tick %u\n",
+               diverged_keyframe,
+               _replay_keyframe_entry(&replay, diverged_keyframe).tick);
+        result = false;
+    } else if (game_hash(&game) != replay.trailer.final_hash) {
+        printf("FAILED: final state %016" PRIx64 " doesn't match the recorded %016" PRIx64 "\n",
+               game_hash(&game), replay.trailer.final_hash);
+        result = false;
+    }
+
+    // Then play from each keyframe to the next the way seeking does, which only matches if keyframes
+    // store everything the simulation reads. Backwards, so nothing the keyframe left out is carried
+    // over from having just played up to it.
+    if (result && replay.trailer.keyframe_count > 0) {
+        Game seek_game = {0};
+        result = replay_start_game(&replay, &seek_game);
+        for (U32 k = replay.trailer.keyframe_count; k-- > 0 && result;) {
+            bool last = k + 1 == replay.trailer.keyframe_count;
+            U32 end_tick = last ? replay.trailer.tick_count : _replay_keyframe_entry(&replay, k + 1).tick;
+            U64 expected_hash = last ? replay.trailer.final_hash : keyframe_hashes[k + 1];
+
+            result = _replay_restore_keyframe(&replay, &seek_game, k);
+            while (result && replay.ticks_played < end_tick && replay_next_tick(&replay, snake_actions)) {
+                game_update(&seek_game, snake_actions);
+            }
+
+            if (result && game_hash(&seek_game) != expected_hash) {
+                printf("FAILED: playing from keyframe %u doesn't reach the same state at tick %u\n",
+                       k,
+                       end_tick);
+                result = false;
+            }
+        }
+        game_destroy(&seek_game);
+        FreeMap(&seek_game.map);
+    }
+
+    if (result) {
+        printf("PASSED: final state %016" PRIx64 " matches\n", replay.trailer.final_hash);
+    }
+
+    free(keyframe_hashes);
+    game_destroy(&game);
+    FreeMap(&game.map);
+    replay_destroy(&replay);
+    return result;
+}
@@ -0,0 +1,123 @@
+#ifndef replay_h
+#define replay_h
+
+#include "game.h"
+
+#include <stdio.h>
+
+#define REPLAY_MAGIC "TQRP"
+#define REPLAY_VERSION 3
+#define REPLAY_DIRECTORY "replays"
+#define REPLAY_MAP_FILE_NAME_LEN 64
+
+// A keyframe of the whole game state is stored every this many ticks, so seeking only has to
+// simulate from the one before.
+#define REPLAY_KEYFRAME_INTERVAL_TICKS 256
+
+// Keyframes are stored as the difference from the one before, except every nth which stands on its
+// own, so getting at any keyframe decodes at most this many.
+#define REPLAY_KEYFRAMES_PER_FULL 8
+
+// How the game looked on its first tick, before any actions were applied.
+typedef struct {
+    S16 x;
+    S16 y;
+    U8 direction;
+    U8 color;
+    U8 alive;
+} ReplaySnakeSpawn;
+
+// A replay file is the header, then for every tick a byte with a bit set for each snake that had an
+// action followed by those actions. Before every REPLAY_KEYFRAME_INTERVAL_TICKS'th tick there is a
+// REPLAY_KEYFRAME byte and a keyframe: the tick, the size of the game state, and the state XORed
+// with the previous keyframe's with the runs of zeros in it run length encoded.
+//
+// The file ends with REPLAY_END_OF_TICKS, the tick and file offset of each keyframe, then
+// ReplayTrailer. A file cut off before the end still plays back, it just can't be verified or
+// seeked in quickly.
+typedef struct {
+    U64 map_hash;
+    char map_file_name[REPLAY_MAP_FILE_NAME_LEN];
+    GameSettings settings;
+    U32 seed;
+    ReplaySnakeSpawn spawns[MAX_SNAKE_COUNT];
+} ReplayHeader;
+
+#define REPLAY_END_OF_TICKS 0x80
+#define REPLAY_KEYFRAME 0x40
+
+typedef struct {
+    U32 tick;
+    U32 offset;
+} ReplayKeyframeEntry;
+
+typedef struct {
+    U32 keyframe_count;
+    U32 keyframe_interval_ticks;
+    U32 tick_count;
+    U64 final_hash; // game_hash() of the state the game ended on.
+} ReplayTrailer;
+
+typedef struct {
+    FILE* file;
+    char path[128];
+    U32 tick_count;
+    U32 file_offset;
+    U8* keyframe_state; // The last keyframe written, to encode the next against.
+    size_t keyframe_state_size;
+    size_t keyframe_state_capacity;
+    U8* scratch;
+    size_t scratch_capacity;
+    ReplayKeyframeEntry* keyframes;
+    U32 keyframe_count;
+    U32 keyframe_capacity;
+} ReplayRecorder;
+
+typedef struct {
+    ReplayHeader header;
+    U8* data;
+    size_t size;
+    size_t first_tick_offset;
+    size_t offset; // Where the next tick starts in data.
+    U32 ticks_played;
+    bool has_footer;
+    ReplayTrailer trailer;
+    size_t keyframe_index_offset;
+    U8* keyframe_state; // Scratch space for decoding keyframes.
+    size_t keyframe_state_capacity;
+} Replay;
+
+// Starts recording a game that has just been reset, into a new file in REPLAY_DIRECTORY.
+bool replay_recorder_begin(ReplayRecorder* recorder, const Game* game, const char* map_file_name);
+// The actions exactly as they were passed to game_update, along with the game they were applied to.
+void replay_recorder_add_tick(ReplayRecorder* recorder,
+                              const Game* game,
+                              const SnakeAction* snake_actions);
+// Writes the footer and closes the file, does nothing if not recording.
+void replay_recorder_end(ReplayRecorder* recorder, const Game* game);
+
+bool replay_load(Replay* replay, const char* path);
+void replay_destroy(Replay* replay);
+
+// Sets up game as it was when the replay started, finding the map in the cache or assets by hash.
+bool replay_start_game(Replay* replay, Game* game);
+// Fills in the next tick's actions, returns false once every tick has been played.
+bool replay_next_tick(Replay* replay, SnakeAction* snake_actions);
+// Puts game in the state it was at tick, from the nearest keyframe before it. game must have been
+// set up with replay_start_game. Seeking past the end stops on the last tick.
+bool replay_seek(Replay* replay, Game* game, U32 tick);
+
+// XORs state with previous, which must be zero past its own size, and run length encodes the result
+// as pairs of a U16 count of zeros and a U16 count of the bytes that follow them. out must have room
+// for replay_delta_encode_bound(size) bytes. Returns the encoded size.
+size_t replay_delta_encode(const U8* state, const U8* previous, size_t size, U8* out);
+size_t replay_delta_encode_bound(size_t size);
+// Applies the delta to state, which holds the previous keyframe. Returns false if the delta is
+// corrupt or doesn't cover exactly size bytes.
+bool replay_delta_decode(const U8* encoded, size_t encoded_size, U8* state, size_t size);
+
+// Plays the whole replay as fast as possible and checks the game matches every keyframe and ends on
+// the recorded hash, then that playing on from each keyframe reaches the same state as well.
+bool replay_verify(const char* path);
+
+#endif /* replay_h */
@@ -48,89 +48,189 @@ void snake_turn(Snake* snake, Direction direction) {
     snake->direction = direction;
 }
 
-void snake_draw(SDL_Renderer* renderer,
-                SDL_Texture* texture,
+// Tail and middle segments only, the head's sprite follows the snake's direction rather than where
+// its segments are.
+static SnakeSegmentSprite _snake_segment_sprite(Snake* snake, S32 segment_index) {
+    SnakeSegmentSprite sprite = {0};
+    SnakeSegment* segment = snake->segments + segment_index;
+
+    if (segment_index == snake->length - 1) {
+        SnakeSegment* last_segment = segment - 1;
+        if (segment->y == last_segment->y && segment->x == (last_segment->x - 1)) {
+            sprite.quarter_turns = 1; // east
+        } else if (segment->y == (last_segment->y - 1) && segment->x == last_segment->x) {
+            sprite.quarter_turns = 2; // south
+        } else if (segment->y == last_segment->y && segment->x == (last_segment->x + 1)) {
+            sprite.quarter_turns = 3; // west
+        }
+        return sprite;
+    }
+
+    SnakeSegmentShape shape = snake_segment_shape(snake, segment_index);
+    sprite.row = shape.flipped ? 0 : 1;
+
+    switch(shape.type) {
+    case SNAKE_SEGMENT_SHAPE_TYPE_VERTICAL:
+        sprite.column = 2;
+        sprite.quarter_turns = 1;
+        break;
+    case SNAKE_SEGMENT_SHAPE_TYPE_HORIZONTAL:
+        sprite.column = 2;
+        break;
+    case SNAKE_SEGMENT_SHAPE_TYPE_NORTH_EAST_CORNER:
+        sprite.column = 1;
+        break;
+    case SNAKE_SEGMENT_SHAPE_TYPE_SOUTH_EAST_CORNER:
+        sprite.column = 1;
+        sprite.quarter_turns = 1;
+        break;
+    case SNAKE_SEGMENT_SHAPE_TYPE_SOUTH_WEST_CORNER:
+        sprite.column = 1;
+        sprite.quarter_turns = 2;
+        break;
+    case SNAKE_SEGMENT_SHAPE_TYPE_NORTH_WEST_CORNER:
+        sprite.column = 1;
+        sprite.quarter_turns = 3;
+        break;
+    default:
+        break;
+    }
+
+    return sprite;
+}
+
+static bool _snake_segment_moved(const SnakeSpriteCache* sprite_cache, Snake* snake, S32 segment_index) {
+    if (segment_index < 0 || segment_index >= snake->length) {
+        return false;
+    }
+    if (segment_index >= sprite_cache->length) {
+        return true;
+    }
+    return sprite_cache->segments[segment_index].x != snake->segments[segment_index].x ||
+           sprite_cache->segments[segment_index].y != snake->segments[segment_index].y;
+}
+
+// Works out the sprites of any segments that have changed shape since last time.
+static bool _snake_sprite_cache_update(SnakeSpriteCache* sprite_cache, Snake* snake) {
+    if (sprite_cache->capacity < snake->length) {
+        SnakeSegment* segments = realloc(sprite_cache->segments,
+                                         (size_t)(snake->length) * sizeof(*segments));
+        if (segments == NULL) {
+            return false;
+        }
+        sprite_cache->segments = segments;
+
+        SnakeSegmentSprite* sprites = realloc(sprite_cache->sprites,
+                                              (size_t)(snake->length) * sizeof(*sprites));
+        if (sprites == NULL) {
+            return false;
+        }
+        sprite_cache->sprites = sprites;
+        sprite_cache->capacity = snake->length;
+    }
+
+    S32 tail_index = snake->length - 1;
+    for (S32 i = 1; i < snake->length; i++) {
+        // A segment's shape depends on the segments either side of it, and the old tail was drawn as
+        // a tail rather than by its shape.
+        if (i == tail_index ||
+            i >= sprite_cache->length - 1 ||
+            _snake_segment_moved(sprite_cache, snake, i - 1) ||
+            _snake_segment_moved(sprite_cache, snake, i) ||
+            _snake_segment_moved(sprite_cache, snake, i + 1)) {
+            sprite_cache->sprites[i] = _snake_segment_sprite(snake, i);
+        }
+    }
+
+    for (S32 i = 0; i < snake->length; i++) {
+        sprite_cache->segments[i] = snake->segments[i];
+    }
+    sprite_cache->length = snake->length;
+    return true;
+}
+
+void snake_draw(SpriteBatch* batch,
                 Snake* snake,
+                Snake* prev_snake,
+                float interpolation,
                 S32 cell_size,
                 S32 camera_offset_x,
                 S32 camera_offset_y,
-                S32 max_segment_health) {
-    int tail_index = snake->length - 1;
+                const SpatialRect* visible_cells,
+                S32 max_segment_health,
+                SnakeSpriteCache* sprite_cache) {
+    if (sprite_cache != NULL && !_snake_sprite_cache_update(sprite_cache, snake)) {
+        fprintf(stderr, "Failed to allocate sprite cache for %d segments\n", snake->length);
+        sprite_cache = NULL;
+    }
+
+    float hue = snake->chomp_cooldown ? (128.0f / 255.0f) : 1.0f;
+    SDL_FColor color = {0.0f, 0.0f, 0.0f, 1.0f};
+
+    switch (snake->color) {
+    case SNAKE_COLOR_RED:
+        color.r = hue;
+        break;
+    case SNAKE_COLOR_YELLOW:
+        color.r = hue;
+        color.g = hue;
+        break;
+    case SNAKE_COLOR_GREEN:
+        color.g = hue;
+        break;
+    case SNAKE_COLOR_CYAN:
+        color.g = hue;
+        color.b = hue;
+        break;
+    case SNAKE_COLOR_BLUE:
+        color.b = hue;
+        break;
+    case SNAKE_COLOR_PURPLE:
+        color.r = hue;
+        color.b = hue;
+        break;
+    default:
+        color = (SDL_FColor){1.0f, 1.0f, 1.0f, 1.0f};
+        break;
+    }
+
     for (int i = 0; i < snake->length; i++) {
+        if (visible_cells != NULL &&
+            !spatial_rect_contains(*visible_cells, snake->segments[i].x, snake->segments[i].y)) {
+            continue;
+        }
+
+        float segment_x = (float)(snake->segments[i].x);
+        float segment_y = (float)(snake->segments[i].y);
+
+        // Slide each segment from where it was in the previous state. Segments that were just
+        // grown come out of the previous tail, and anything that moved further than a single
+        // cell (spawning, being pushed around) snaps into place.
+        if (prev_snake != NULL && prev_snake->length > 0 && interpolation < 1.0f) {
+            S32 prev_index = (i < prev_snake->length) ? i : prev_snake->length - 1;
+            SnakeSegment* prev_segment = prev_snake->segments + prev_index;
+            S32 dx = snake->segments[i].x - prev_segment->x;
+            S32 dy = snake->segments[i].y - prev_segment->y;
+            if ((dx == 0 || dy == 0) && abs(dx + dy) <= 1) {
+                segment_x = (float)(prev_segment->x) + (float)(dx) * interpolation;
+                segment_y = (float)(prev_segment->y) + (float)(dy) * interpolation;
+            }
+        }
+
         SDL_FRect dest_rect = {
-            .x = (float)(camera_offset_x + snake->segments[i].x * cell_size),
-            .y = (float)(camera_offset_y + snake->segments[i].y * cell_size),
+            .x = (float)(camera_offset_x) + segment_x * (float)(cell_size),
+            .y = (float)(camera_offset_y) + segment_y * (float)(cell_size),
             .w = (float)(cell_size),
             .h = (float)(cell_size)
         };
 
-        double angle = 0.0;
-
-        SDL_FRect source_rect = {0};
-
-        source_rect.w = 16;
-        source_rect.h = 16;
-
+        SnakeSegmentSprite sprite;
         if (i == 0) {
-            source_rect.x = 48.0f;
-            source_rect.y = 0.0f;
-            angle = 90.0 * snake->direction;
+            sprite = (SnakeSegmentSprite){ .column = 3, .row = 0, .quarter_turns = (U8)(snake->direction) };
+        } else if (sprite_cache != NULL) {
+            sprite = sprite_cache->sprites[i];
         } else {
-            // detect straight vs corner vs tail
-            if (i == tail_index) {
-                // tail
-                source_rect.x = 0.0f;
-                source_rect.y = 0.0f;
-
-                int last_segment_x = snake->segments[i - 1].x;
-                int last_segment_y = snake->segments[i - 1].y;
-
-                if (snake->segments[i].y == last_segment_y &&
-                    snake->segments[i].x == (last_segment_x - 1)) {
-                    // east
-                    angle = 90.0;
-                } else if (snake->segments[i].y == (last_segment_y - 1) &&
-                           snake->segments[i].x == last_segment_x) {
-                    // south
-                    angle = 180.0;
-                } else if (snake->segments[i].y == last_segment_y &&
-                           snake->segments[i].x == (last_segment_x + 1)) {
-                    // west
-                    angle = 270.0;
-                }
-            } else {
-                SnakeSegmentShape shape = snake_segment_shape(snake, i);
-
-                source_rect.y = shape.flipped ? 0.0f : 16.0f;
-
-                switch(shape.type) {
-                case SNAKE_SEGMENT_SHAPE_TYPE_VERTICAL:
-                    source_rect.x = 32.0f;
-                    angle = 90.0;
-                    break;
-                case SNAKE_SEGMENT_SHAPE_TYPE_HORIZONTAL:
-                    source_rect.x = 32.0f;
-                    break;
-                case SNAKE_SEGMENT_SHAPE_TYPE_NORTH_EAST_CORNER:
-                    source_rect.x = 16.0f;
-                    break;
-                case SNAKE_SEGMENT_SHAPE_TYPE_SOUTH_EAST_CORNER:
-                    source_rect.x = 16.0f;
-                    angle = 90.0;
-                    break;
-                case SNAKE_SEGMENT_SHAPE_TYPE_SOUTH_WEST_CORNER:
-                    source_rect.x = 16.0f;
-                    angle = 180.0;
-                    break;
-                case SNAKE_SEGMENT_SHAPE_TYPE_NORTH_WEST_CORNER:
-                    // corner top left
-                    source_rect.x = 16.0f;
-                    angle = 270.0;
-                    break;
-                default:
-                    break;
-                }
-            }
+            sprite = _snake_segment_sprite(snake, i);
         }
 
         S32 health_frame = 0;
@@ -138,47 +238,25 @@ void snake_draw(SDL_Renderer* renderer,
             health_frame = 2 - (S32)(((float)(snake->segments[i].health) / (float)(max_segment_health)) * 2.0);
         }
 
-        source_rect.y += (float)(2 * health_frame * source_rect.h);
-
-        U8 hue = snake->chomp_cooldown ? 128 : 255;
-
-        switch (snake->color) {
-        case SNAKE_COLOR_RED:
-            SDL_SetTextureColorMod(texture, hue, 0, 0);
-            break;
-        case SNAKE_COLOR_YELLOW:
-            SDL_SetTextureColorMod(texture, hue, hue, 0);
-            break;
-        case SNAKE_COLOR_GREEN:
-            SDL_SetTextureColorMod(texture, 0, hue, 0);
-            break;
-        case SNAKE_COLOR_CYAN:
-            SDL_SetTextureColorMod(texture, 0, hue, hue);
-            break;
-        case SNAKE_COLOR_BLUE:
-            SDL_SetTextureColorMod(texture, 0, 0, hue);
-            break;
-        case SNAKE_COLOR_PURPLE:
-            SDL_SetTextureColorMod(texture, hue, 0, hue);
-            break;
-        default:
-            break;
-        }
+        SDL_FRect source_rect = {
+            .x = (float)(sprite.column * 16),
+            .y = (float)((sprite.row + 2 * health_frame) * 16),
+            .w = 16.0f,
+            .h = 16.0f
+        };
 
-        bool result = SDL_RenderTextureRotated(renderer,
-                                          texture,
-                                          &source_rect,
-                                          &dest_rect,
-                                          angle,
-                                          NULL,
-                                          SDL_FLIP_NONE);
-        if (!result) {
-            fprintf(stderr, "Tom F was wrong: %s\n", SDL_GetError());
+        if (!sprite_batch_add(batch, &source_rect, &dest_rect, sprite.quarter_turns, color)) {
             return;
         }
     }
 }
 
+void snake_sprite_cache_destroy(SnakeSpriteCache* sprite_cache) {
+    free(sprite_cache->segments);
+    free(sprite_cache->sprites);
+    *sprite_cache = (SnakeSpriteCache){0};
+}
+
 void snake_destroy(Snake* snake) {
     if (snake->segments != NULL) {
         free(snake->segments);
@@ -186,17 +264,21 @@ void snake_destroy(Snake* snake) {
     }
 }
 
-size_t snake_serialize(const Snake* snake, void* buffer, size_t buffer_size) {
-    // Segments plus the direction as a single byte.
-    size_t segments_size = (snake->length * sizeof(*snake->segments));
-
+size_t snake_serialized_size(S32 length) {
     // Total size of snake buffer as sent over network.
     size_t total_size = 0;
-    total_size += sizeof(snake->length);
-    total_size += segments_size;
+    total_size += sizeof(length);
+    total_size += length * sizeof(SnakeSegment);
     total_size += sizeof(U8); // direction
     total_size += sizeof(U8); // chomp cooldown
     total_size += sizeof(SnakeColor);
+    return total_size;
+}
+
+size_t snake_serialize(const Snake* snake, void* buffer, size_t buffer_size) {
+    // Segments plus the direction as a single byte.
+    size_t segments_size = (snake->length * sizeof(*snake->segments));
+    size_t total_size = snake_serialized_size(snake->length);
 
     assert(total_size <= buffer_size && "buffer too small!");
 
@@ -436,6 +518,86 @@ SnakeAction action_buffer_remove(ActionBuffer * buf) {
     return action;
 }
 
+size_t ticked_snake_action_serialize(const TickedSnakeAction* ticked_action, void* buffer, size_t buffer_size) {
+    size_t total_size = sizeof(ticked_action->tick) + sizeof(ticked_action->action);
+    assert(total_size <= buffer_size && "buffer too small!");
+
+    U8 * ptr = buffer;
+
+    memcpy(ptr, &ticked_action->tick, sizeof(ticked_action->tick));
+    ptr += sizeof(ticked_action->tick);
+
+    *ptr = ticked_action->action;
+    ptr += sizeof(ticked_action->action);
+
+    return total_size;
+}
+
+size_t ticked_snake_action_deserialize(void* buffer, size_t size, TickedSnakeAction* out) {
+    size_t total_size = sizeof(out->tick) + sizeof(out->action);
+    if (size < total_size) {
+        return 0;
+    }
+
+    U8 * ptr = buffer;
+
+    memcpy(&out->tick, ptr, sizeof(out->tick));
+    ptr += sizeof(out->tick);
+
+    out->action = *ptr;
+    ptr += sizeof(out->action);
+
+    return total_size;
+}
+
+void input_timeline_reset(InputTimeline* timeline, U32 tick) {
+    memset(timeline, 0, sizeof(*timeline));
+    timeline->next_tick = tick;
+}
+
+InputArrival input_timeline_add(InputTimeline* timeline, U32 target_tick, SnakeAction action) {
+    InputArrival arrival = INPUT_ARRIVAL_ON_TIME;
+    timeline->stats.last_lead_ticks = (S32)(target_tick - timeline->next_tick);
+
+    if (timeline->stats.last_lead_ticks < 0) {
+        // Missed the tick it was meant for, apply it as soon as possible rather than dropping it.
+        target_tick = timeline->next_tick;
+        arrival = INPUT_ARRIVAL_LATE;
+        timeline->stats.late_count++;
+    } else if (timeline->stats.last_lead_ticks >= INPUT_TIMELINE_TICKS) {
+        target_tick = timeline->next_tick + INPUT_TIMELINE_TICKS - 1;
+        arrival = INPUT_ARRIVAL_EARLY;
+        timeline->stats.early_count++;
+    } else {
+        timeline->stats.on_time_count++;
+    }
+
+    action_buffer_add(timeline->slots + (target_tick % INPUT_TIMELINE_TICKS), action);
+    return arrival;
+}
+
+SnakeAction input_timeline_remove(InputTimeline* timeline) {
+    ActionBuffer* slot = timeline->slots + (timeline->next_tick % INPUT_TIMELINE_TICKS);
+    SnakeAction action = action_buffer_remove(slot);
+
+    // Anything left over is carried into the next tick, the same way an ActionBuffer holds a
+    // queued turn for the following tick. It was meant for an earlier tick than what is already
+    // queued there, so it goes first.
+    timeline->next_tick++;
+    ActionBuffer* next_slot = timeline->slots + (timeline->next_tick % INPUT_TIMELINE_TICKS);
+    ActionBuffer merged = {0};
+    for (S32 i = 0; i < slot->count; i++) {
+        action_buffer_add(&merged, slot->actions[i]);
+    }
+    for (S32 i = 0; i < next_slot->count; i++) {
+        action_buffer_add(&merged, next_slot->actions[i]);
+    }
+    *next_slot = merged;
+    slot->count = 0;
+
+    return action;
+}
+
 SnakeSegmentShape snake_segment_shape(Snake* snake, S32 segment_index) {
     SnakeSegmentShape result = {0};
     if (segment_index >= snake->length) {
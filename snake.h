@@ -3,12 +3,15 @@
 
 #include "ints.h"
 #include "direction.h"
+#include "spatial.h"
+#include "sprite_batch.h"
 
 #include <SDL3/SDL_render.h>
 #include <stdbool.h>
 
 #define INITIAL_SNAKE_LEN 5
 #define ACTION_BUF_SIZE 2
+#define INPUT_TIMELINE_TICKS 32
 #define SNAKE_KILL_DAMAGE_COOLDOWN 4
 #define CHOMP_POINT_CHECK_COUNT 3
 
@@ -58,6 +61,23 @@ typedef struct {
     S8 health;
 } SnakeSegment;
 
+// Where a segment's sprite is on the sprite sheet in 16 pixel tiles, before picking the frame for its
+// health, and how many quarter turns clockwise it is drawn at.
+typedef struct {
+    U8 column;
+    U8 row;
+    U8 quarter_turns;
+} SnakeSegmentSprite;
+
+// The sprites worked out for a snake's segments on earlier frames, so each is only worked out again
+// once it or a segment next to it has moved.
+typedef struct {
+    SnakeSegment* segments; // Where each segment was when its sprite was worked out.
+    SnakeSegmentSprite* sprites;
+    S32 length;
+    S32 capacity;
+} SnakeSpriteCache;
+
 typedef enum {
     SNAKE_CONSTRICT_STATE_NONE,
     SNAKE_CONSTRICT_STATE_LEFT,
@@ -96,6 +116,34 @@ typedef struct {
     SnakeAction actions[ACTION_BUF_SIZE];
 } ActionBuffer;
 
+// A snake action stamped with the tick it should be applied on, as sent from client to server.
+typedef struct {
+    U32 tick;
+    SnakeAction action;
+} TickedSnakeAction;
+
+typedef enum {
+    INPUT_ARRIVAL_ON_TIME,
+    INPUT_ARRIVAL_LATE,  // The target tick was already simulated, applied on the next tick instead.
+    INPUT_ARRIVAL_EARLY, // The target tick is past the end of the timeline, clamped to the last slot.
+} InputArrival;
+
+typedef struct {
+    S32 on_time_count;
+    S32 late_count;
+    S32 early_count;
+    // How many ticks ahead of the server the most recent input was targeted, negative when late.
+    S32 last_lead_ticks;
+} InputTimelineStats;
+
+// Per player ring of action buffers indexed by tick, so that network input is applied on the tick
+// the client intended regardless of when it arrives.
+typedef struct {
+    ActionBuffer slots[INPUT_TIMELINE_TICKS];
+    U32 next_tick; // The next tick that will be removed from the timeline.
+    InputTimelineStats stats;
+} InputTimeline;
+
 bool snake_init(Snake* snake, S32 capacity);
 void snake_destroy(Snake* snake);
 
@@ -106,14 +154,25 @@ void snake_spawn(Snake* snake,
                  S32 length,
                  S8 segment_health);
 void snake_turn(Snake* snake, Direction direction);
-void snake_draw(SDL_Renderer* renderer,
-                SDL_Texture* texture,
+// Adds the snake's segments to batch, which should be using the snake sprite sheet.
+// prev_snake is the same snake in the previous state, or NULL, and interpolation is how far between
+// that state and this one to draw it, where 1.0 draws the snake exactly where it is. sprite_cache
+// can be NULL for a snake that is only drawn once. Segments in cells outside visible_cells are
+// skipped, pass NULL to draw them all.
+void snake_draw(SpriteBatch* batch,
                 Snake* snake,
+                Snake* prev_snake,
+                float interpolation,
                 S32 cell_size,
                 S32 camera_offset_x,
                 S32 camera_offset_y,
-                S32 max_segment_health);
+                const SpatialRect* visible_cells,
+                S32 max_segment_health,
+                SnakeSpriteCache* sprite_cache);
+void snake_sprite_cache_destroy(SnakeSpriteCache* sprite_cache);
 
+// How many bytes snake_serialize writes for a snake this long.
+size_t snake_serialized_size(S32 length);
 size_t snake_serialize(const Snake* snake, void * buffer, size_t buffer_size);
 size_t snake_deserialize(void * buffer, size_t size, Snake* out);
 
@@ -131,6 +190,13 @@ const char* snake_color_string(SnakeColor color);
 void action_buffer_add(ActionBuffer * buf, SnakeAction action);
 SnakeAction action_buffer_remove(ActionBuffer * buf);
 
+size_t ticked_snake_action_serialize(const TickedSnakeAction* ticked_action, void* buffer, size_t buffer_size);
+size_t ticked_snake_action_deserialize(void* buffer, size_t size, TickedSnakeAction* out);
+
+void input_timeline_reset(InputTimeline* timeline, U32 tick);
+InputArrival input_timeline_add(InputTimeline* timeline, U32 target_tick, SnakeAction action);
+SnakeAction input_timeline_remove(InputTimeline* timeline);
+
 SnakeSegmentShape snake_segment_shape(Snake* snake, S32 segment_index);
 Direction snake_segment_direction_to_head(Snake* snake, S32 segment_index);
 Direction snake_segment_direction_to_tail(Snake* snake, S32 segment_index);
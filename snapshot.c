@@ -0,0 +1,117 @@
+#include "snapshot.h"
+
+#include <string.h>
+
+static Snapshot* _snapshot_buffer_at(SnapshotBuffer* buffer, S32 index) {
+    return buffer->snapshots + ((buffer->first + index) % SNAPSHOT_BUFFER_CAPACITY);
+}
+
+void snapshot_buffer_push(SnapshotBuffer* buffer, Game* game, S64 tick_us, S64 now_us) {
+    if (buffer->count > 0) {
+        Snapshot* newest = _snapshot_buffer_at(buffer, buffer->count - 1);
+        if (game->tick < newest->game.tick) {
+            // A new game has started, the old states are no use anymore.
+            snapshot_buffer_clear(buffer);
+        } else if (game->tick == newest->game.tick) {
+            // The server keeps sending state while waiting to start without ticking, so just
+            // refresh the newest state rather than filling the buffer with copies.
+            game_clone(game, &newest->game);
+            return;
+        }
+    }
+
+    S64 server_time_us = (S64)game->tick * tick_us;
+    bool tick_advanced = buffer->count > 0;
+
+    // Track the offset between our clock and the server tick clock along with how much it varies.
+    // The tick stands still while waiting to start, so the first state after it moves on arrives
+    // late by however long the wait was. Anchor the clock again once the tick starts advancing and
+    // whenever the game state changes, instead of taking all of that as jitter.
+    S64 offset_us = now_us - server_time_us;
+    if (!buffer->has_clock || !buffer->clock_ticking || buffer->clock_game_state != game->state) {
+        buffer->has_clock = true;
+        buffer->clock_ticking = tick_advanced;
+        buffer->clock_game_state = game->state;
+        buffer->clock_offset_us = offset_us;
+        buffer->jitter_us = 0;
+        buffer->delay_us = tick_us;
+    } else {
+        S64 deviation_us = offset_us - buffer->clock_offset_us;
+        buffer->clock_offset_us += deviation_us / 8;
+        if (deviation_us < 0) {
+            deviation_us = -deviation_us;
+        }
+        buffer->jitter_us += (deviation_us - buffer->jitter_us) / 8;
+    }
+
+    // Render at least a tick behind so there is usually a newer state to interpolate towards, plus
+    // enough to absorb late arrivals. Ease towards the target so the render time doesn't jump.
+    S64 target_delay_us = tick_us + SNAPSHOT_JITTER_SCALE * buffer->jitter_us;
+    S64 max_delay_us = (SNAPSHOT_BUFFER_CAPACITY - 2) * tick_us;
+    if (target_delay_us > max_delay_us) {
+        target_delay_us = max_delay_us;
+    }
+    buffer->delay_us += (target_delay_us - buffer->delay_us) / 16;
+
+    // Overwrite the oldest state when full.
+    if (buffer->count == SNAPSHOT_BUFFER_CAPACITY) {
+        buffer->first = (buffer->first + 1) % SNAPSHOT_BUFFER_CAPACITY;
+        buffer->count--;
+    }
+
+    Snapshot* snapshot = _snapshot_buffer_at(buffer, buffer->count);
+    game_clone(game, &snapshot->game);
+    snapshot->server_time_us = server_time_us;
+    buffer->count++;
+}
+
+bool snapshot_buffer_sample(SnapshotBuffer* buffer,
+                            S64 now_us,
+                            Game** from,
+                            Game** to,
+                            float* interpolation) {
+    if (buffer->count == 0) {
+        return false;
+    }
+
+    *from = NULL;
+    *interpolation = 1.0f;
+
+    S64 render_time_us = now_us - buffer->clock_offset_us - buffer->delay_us;
+
+    Snapshot* oldest = _snapshot_buffer_at(buffer, 0);
+    if (render_time_us <= oldest->server_time_us) {
+        *to = &oldest->game;
+        return true;
+    }
+
+    for (S32 i = 1; i < buffer->count; i++) {
+        Snapshot* next = _snapshot_buffer_at(buffer, i);
+        if (render_time_us < next->server_time_us) {
+            Snapshot* prev = _snapshot_buffer_at(buffer, i - 1);
+            *from = &prev->game;
+            *to = &next->game;
+            *interpolation = (float)(render_time_us - prev->server_time_us) /
+                             (float)(next->server_time_us - prev->server_time_us);
+            return true;
+        }
+    }
+
+    // Ran out of states, hold the newest until another arrives.
+    *to = &_snapshot_buffer_at(buffer, buffer->count - 1)->game;
+    return true;
+}
+
+void snapshot_buffer_clear(SnapshotBuffer* buffer) {
+    // Keep the cloned games around so their allocations are reused.
+    buffer->first = 0;
+    buffer->count = 0;
+    buffer->has_clock = false;
+}
+
+void snapshot_buffer_destroy(SnapshotBuffer* buffer) {
+    for (S32 i = 0; i < SNAPSHOT_BUFFER_CAPACITY; i++) {
+        game_destroy(&buffer->snapshots[i].game);
+    }
+    memset(buffer, 0, sizeof(*buffer));
+}
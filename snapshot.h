@@ -0,0 +1,44 @@
+#ifndef snapshot_h
+#define snapshot_h
+
+#include "game.h"
+
+#define SNAPSHOT_BUFFER_CAPACITY 8
+
+// How many times the measured arrival jitter is added on top of one tick of render delay.
+#define SNAPSHOT_JITTER_SCALE 2
+
+typedef struct {
+    Game game;
+    S64 server_time_us; // The game tick converted to time, so snapshots are evenly spaced.
+} Snapshot;
+
+// Keeps the most recent game states received from the server so the client can render slightly
+// in the past, interpolating between the two states either side of the render time. The render
+// delay adapts to how much the arrival times of the states vary.
+typedef struct {
+    Snapshot snapshots[SNAPSHOT_BUFFER_CAPACITY];
+    S32 first; // Index of the oldest snapshot.
+    S32 count;
+    bool has_clock;
+    bool clock_ticking;        // The clock was anchored on a state that followed an earlier tick.
+    GameState clock_game_state; // The game state the clock was anchored in.
+    S64 clock_offset_us; // Smoothed local arrival time minus server time.
+    S64 jitter_us;       // Smoothed deviation of arrivals from the clock offset.
+    S64 delay_us;        // How far behind the expected newest state we render.
+} SnapshotBuffer;
+
+void snapshot_buffer_push(SnapshotBuffer* buffer, Game* game, S64 tick_us, S64 now_us);
+
+// Finds the states to render at now_us. from is NULL when there is nothing to interpolate from, in
+// which case to should be rendered as is. Returns false if the buffer is empty.
+bool snapshot_buffer_sample(SnapshotBuffer* buffer,
+                            S64 now_us,
+                            Game** from,
+                            Game** to,
+                            float* interpolation);
+
+void snapshot_buffer_clear(SnapshotBuffer* buffer);
+void snapshot_buffer_destroy(SnapshotBuffer* buffer);
+
+#endif /* snapshot_h */
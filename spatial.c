@@ -0,0 +1,198 @@
+#include "spatial.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static SpatialBucket* _bucket_at(const SpatialGrid* grid, S32 x, S32 y) {
+    if (x < 0 || y < 0) {
+        return NULL;
+    }
+
+    S32 bucket_x = x / SPATIAL_BUCKET_SIZE;
+    S32 bucket_y = y / SPATIAL_BUCKET_SIZE;
+    if (bucket_x >= grid->width || bucket_y >= grid->height) {
+        return NULL;
+    }
+
+    return grid->buckets + (bucket_y * grid->width + bucket_x);
+}
+
+static void _add_point(SpatialPoint point, SpatialPoint* out, S32 max_count, S32* count) {
+    if (*count < max_count) {
+        out[*count] = point;
+    }
+    (*count)++;
+}
+
+bool spatial_grid_init(SpatialGrid* grid, S32 cell_width, S32 cell_height) {
+    memset(grid, 0, sizeof(*grid));
+
+    S32 width = (cell_width + SPATIAL_BUCKET_SIZE - 1) / SPATIAL_BUCKET_SIZE;
+    S32 height = (cell_height + SPATIAL_BUCKET_SIZE - 1) / SPATIAL_BUCKET_SIZE;
+    S32 bucket_count = width * height;
+    if (bucket_count <= 0) {
+        return true;
+    }
+
+    grid->buckets = calloc(bucket_count, sizeof(*grid->buckets));
+    grid->occupied = malloc(bucket_count * sizeof(*grid->occupied));
+    if (grid->buckets == NULL || grid->occupied == NULL) {
+        fprintf(stderr, "Failed to allocate %d spatial grid buckets\n", bucket_count);
+        spatial_grid_destroy(grid);
+        return false;
+    }
+
+    for (S32 b = 0; b < bucket_count; b++) {
+        grid->buckets[b].occupied_index = -1;
+    }
+
+    grid->width = width;
+    grid->height = height;
+    return true;
+}
+
+void spatial_grid_destroy(SpatialGrid* grid) {
+    for (S32 b = 0; b < grid->width * grid->height; b++) {
+        free(grid->buckets[b].points);
+    }
+    free(grid->buckets);
+    free(grid->occupied);
+    memset(grid, 0, sizeof(*grid));
+}
+
+void spatial_grid_clear(SpatialGrid* grid) {
+    for (S32 o = 0; o < grid->occupied_count; o++) {
+        SpatialBucket* bucket = grid->buckets + grid->occupied[o];
+        bucket->count = 0;
+        bucket->occupied_index = -1;
+    }
+    grid->occupied_count = 0;
+    grid->point_count = 0;
+}
+
+bool spatial_grid_insert(SpatialGrid* grid, S32 x, S32 y) {
+    SpatialBucket* bucket = _bucket_at(grid, x, y);
+    if (bucket == NULL) {
+        return false;
+    }
+
+    if (bucket->count == bucket->capacity) {
+        S32 capacity = bucket->capacity ? bucket->capacity * 2 : 4;
+        SpatialPoint* points = realloc(bucket->points, capacity * sizeof(*points));
+        if (points == NULL) {
+            fprintf(stderr, "Failed to grow spatial grid bucket to %d points\n", capacity);
+            return false;
+        }
+        bucket->points = points;
+        bucket->capacity = capacity;
+    }
+
+    if (bucket->count == 0) {
+        bucket->occupied_index = grid->occupied_count;
+        grid->occupied[grid->occupied_count++] = (S32)(bucket - grid->buckets);
+    }
+
+    bucket->points[bucket->count++] = (SpatialPoint){ .x = (S16)x, .y = (S16)y };
+    grid->point_count++;
+    return true;
+}
+
+bool spatial_grid_remove(SpatialGrid* grid, S32 x, S32 y) {
+    SpatialBucket* bucket = _bucket_at(grid, x, y);
+    if (bucket == NULL) {
+        return false;
+    }
+
+    for (S32 p = 0; p < bucket->count; p++) {
+        if (bucket->points[p].x != x || bucket->points[p].y != y) {
+            continue;
+        }
+
+        bucket->points[p] = bucket->points[--bucket->count];
+        grid->point_count--;
+
+        if (bucket->count == 0) {
+            // Swap the last occupied bucket into this one's place.
+            S32 last = grid->occupied[--grid->occupied_count];
+            grid->occupied[bucket->occupied_index] = last;
+            grid->buckets[last].occupied_index = bucket->occupied_index;
+            bucket->occupied_index = -1;
+        }
+        return true;
+    }
+
+    return false;
+}
+
+SpatialRect spatial_grid_bucket_rect(const SpatialGrid* grid, SpatialRect rect) {
+    SpatialRect buckets = { 0, 0, -1, -1 };
+    if (rect.max_x < 0 || rect.max_y < 0 || rect.max_x < rect.min_x || rect.max_y < rect.min_y) {
+        return buckets;
+    }
+
+    buckets.min_x = rect.min_x < 0 ? 0 : rect.min_x / SPATIAL_BUCKET_SIZE;
+    buckets.min_y = rect.min_y < 0 ? 0 : rect.min_y / SPATIAL_BUCKET_SIZE;
+    buckets.max_x = rect.max_x / SPATIAL_BUCKET_SIZE;
+    buckets.max_y = rect.max_y / SPATIAL_BUCKET_SIZE;
+    if (buckets.max_x >= grid->width) {
+        buckets.max_x = grid->width - 1;
+    }
+    if (buckets.max_y >= grid->height) {
+        buckets.max_y = grid->height - 1;
+    }
+    return buckets;
+}
+
+S32 spatial_grid_query_rect(const SpatialGrid* grid,
+                            SpatialRect rect,
+                            SpatialPoint* out,
+                            S32 max_count) {
+    S32 count = 0;
+    SpatialRect buckets = spatial_grid_bucket_rect(grid, rect);
+    for (S32 by = buckets.min_y; by <= buckets.max_y; by++) {
+        for (S32 bx = buckets.min_x; bx <= buckets.max_x; bx++) {
+            const SpatialBucket* bucket = grid->buckets + (by * grid->width + bx);
+            for (S32 p = 0; p < bucket->count; p++) {
+                if (spatial_rect_contains(rect, bucket->points[p].x, bucket->points[p].y)) {
+                    _add_point(bucket->points[p], out, max_count, &count);
+                }
+            }
+        }
+    }
+
+    return count;
+}
+
+S32 spatial_grid_query_outside_rect(const SpatialGrid* grid,
+                                    SpatialRect rect,
+                                    SpatialPoint* out,
+                                    S32 max_count) {
+    S32 count = 0;
+    for (S32 o = 0; o < grid->occupied_count; o++) {
+        S32 b = grid->occupied[o];
+        S32 bucket_min_x = (b % grid->width) * SPATIAL_BUCKET_SIZE;
+        S32 bucket_min_y = (b / grid->width) * SPATIAL_BUCKET_SIZE;
+
+        // Buckets entirely inside the rect have nothing to add.
+        if (spatial_rect_contains(rect, bucket_min_x, bucket_min_y) &&
+            spatial_rect_contains(rect,
+                                  bucket_min_x + SPATIAL_BUCKET_SIZE - 1,
+                                  bucket_min_y + SPATIAL_BUCKET_SIZE - 1)) {
+            continue;
+        }
+
+        const SpatialBucket* bucket = grid->buckets + b;
+        for (S32 p = 0; p < bucket->count; p++) {
+            if (!spatial_rect_contains(rect, bucket->points[p].x, bucket->points[p].y)) {
+                _add_point(bucket->points[p], out, max_count, &count);
+            }
+        }
+    }
+
+    return count;
+}
+
+bool spatial_rect_contains(SpatialRect rect, S32 x, S32 y) {
+    return x >= rect.min_x && x <= rect.max_x && y >= rect.min_y && y <= rect.max_y;
+}
@@ -0,0 +1,68 @@
+#ifndef spatial_h
+#define spatial_h
+
+#include "ints.h"
+
+#include <stdbool.h>
+
+// Width and height in cells of the square each bucket covers.
+#define SPATIAL_BUCKET_SIZE 16
+
+typedef struct {
+    S16 x;
+    S16 y;
+} SpatialPoint;
+
+// Inclusive cell bounds.
+typedef struct {
+    S32 min_x;
+    S32 min_y;
+    S32 max_x;
+    S32 max_y;
+} SpatialRect;
+
+typedef struct {
+    SpatialPoint* points;
+    S32 count;
+    S32 capacity;
+    S32 occupied_index; // Where this bucket is in the grid's occupied list, -1 when empty.
+} SpatialBucket;
+
+// Points on a cell grid sorted into fixed size buckets, so finding the points in an area only
+// looks at the buckets that overlap it. The non-empty buckets are also kept in a list, so going over
+// every point costs the same however big and empty the grid is.
+typedef struct {
+    SpatialBucket* buckets;
+    S32* occupied;
+    S32 occupied_count;
+    S32 width;  // In buckets.
+    S32 height; // In buckets.
+    S32 point_count;
+} SpatialGrid;
+
+bool spatial_grid_init(SpatialGrid* grid, S32 cell_width, S32 cell_height);
+void spatial_grid_destroy(SpatialGrid* grid);
+void spatial_grid_clear(SpatialGrid* grid);
+
+// A cell is expected to be inserted at most once.
+bool spatial_grid_insert(SpatialGrid* grid, S32 x, S32 y);
+bool spatial_grid_remove(SpatialGrid* grid, S32 x, S32 y);
+
+// The buckets overlapping rect, in bucket coordinates and clamped to the grid, for walking the
+// points in an area without copying them out. max is less than min when there are none.
+SpatialRect spatial_grid_bucket_rect(const SpatialGrid* grid, SpatialRect rect);
+
+// Copies up to max_count points inside or outside rect into out, returns how many were found, which
+// can be more than max_count.
+S32 spatial_grid_query_rect(const SpatialGrid* grid,
+                            SpatialRect rect,
+                            SpatialPoint* out,
+                            S32 max_count);
+S32 spatial_grid_query_outside_rect(const SpatialGrid* grid,
+                                    SpatialRect rect,
+                                    SpatialPoint* out,
+                                    S32 max_count);
+
+bool spatial_rect_contains(SpatialRect rect, S32 x, S32 y);
+
+#endif /* spatial_h */
@@ -0,0 +1,147 @@
+#include "spectator.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static void _spectator_remove(SpectatorList* list, S32 index) {
+    Spectator* spectator = list->spectators + index;
+    net_destroy_socket(spectator->socket);
+    packet_send_queue_destroy(&spectator->send_queue);
+    packet_transmission_state_destroy(&spectator->receive_state);
+
+    // Order doesn't matter, fill the gap with the last one.
+    list->count--;
+    if (index != list->count) {
+        *spectator = list->spectators[list->count];
+    }
+    memset(list->spectators + list->count, 0, sizeof(*spectator));
+}
+
+bool spectator_list_add(SpectatorList* list, NetSocket* socket, PacketSendQueue* send_queue) {
+    if (list->count == MAX_SPECTATOR_COUNT) {
+        return false;
+    }
+
+    Spectator* spectator = list->spectators + list->count++;
+    memset(spectator, 0, sizeof(*spectator));
+    spectator->socket = socket;
+    spectator->needs_keyframe = true;
+    spectator->send_interval_ticks = 1;
+
+    if (send_queue != NULL) {
+        spectator->send_queue = *send_queue;
+        memset(send_queue, 0, sizeof(*send_queue));
+    }
+    spectator->send_queue.byte_limit = SPECTATOR_SEND_QUEUE_BYTE_LIMIT;
+
+    return true;
+}
+
+bool spectator_list_needs_keyframe(const SpectatorList* list) {
+    for (S32 i = 0; i < list->count; i++) {
+        if (list->spectators[i].needs_keyframe) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void spectator_list_send_state(SpectatorList* list, PacketBuffer* join_buffer, PacketBuffer* state_buffer) {
+    if (state_buffer == NULL) {
+        return;
+    }
+
+    for (S32 i = 0; i < list->count; i++) {
+        Spectator* spectator = list->spectators + i;
+
+        // The first states must arrive, later ones can be dropped in favour of newer ones.
+        if (spectator->needs_keyframe) {
+            if (join_buffer != NULL) {
+                packet_send_queue_push_buffer(&spectator->send_queue, join_buffer, false);
+            }
+            packet_send_queue_push_buffer(&spectator->send_queue, state_buffer, false);
+            spectator->needs_keyframe = false;
+            spectator->ticks_since_send = 0;
+            continue;
+        }
+
+        spectator->ticks_since_send++;
+        if (spectator->ticks_since_send < spectator->send_interval_ticks) {
+            continue;
+        }
+
+        // Back off while a whole state is still waiting to go out, and speed back up once the
+        // queue has emptied.
+        if (spectator->send_queue.queued_bytes >= state_buffer->size) {
+            spectator->send_interval_ticks *= 2;
+            if (spectator->send_interval_ticks > SPECTATOR_MAX_SEND_INTERVAL_TICKS) {
+                spectator->send_interval_ticks = SPECTATOR_MAX_SEND_INTERVAL_TICKS;
+            }
+        } else if (spectator->send_queue.count == 0 && spectator->send_interval_ticks > 1) {
+            spectator->send_interval_ticks /= 2;
+        }
+
+        packet_send_queue_push_buffer(&spectator->send_queue, state_buffer, true);
+        spectator->ticks_since_send = 0;
+    }
+}
+
+void spectator_list_update(SpectatorList* list,
+                           const MapFile* map_file,
+                           void* scratch_buffer,
+                           size_t scratch_buffer_size,
+                           U16* sequence) {
+    for (S32 i = 0; i < list->count; i++) {
+        Spectator* spectator = list->spectators + i;
+        bool failed = false;
+
+        // Spectators only ever ask for the map, anything else is ignored.
+        Packet packet = {0};
+        packet_receive(spectator->socket, &packet, &spectator->receive_state);
+        if (spectator->receive_state.stage == PACKET_PROGRESS_STAGE_COMPLETE) {
+            U64 requested_hash = 0;
+            if (packet.header.type == PACKET_TYPE_MAP_REQUEST && packet.size >= sizeof(requested_hash)) {
+                memcpy(&requested_hash, packet.payload, sizeof(requested_hash));
+            }
+            if (requested_hash != 0 && requested_hash == map_file->hash) {
+                spectator->map_upload.active = true;
+                spectator->map_upload.hash = requested_hash;
+                spectator->map_upload.offset = 0;
+            }
+            packet_transmission_state_reset(&spectator->receive_state);
+        } else if (spectator->receive_state.stage == PACKET_PROGRESS_STAGE_ERROR) {
+            failed = true;
+        }
+
+        MapChunk chunk = {0};
+        while (!failed &&
+               spectator->send_queue.queued_bytes < MAP_CHUNKS_PER_FRAME * MAP_CHUNK_SIZE &&
+               map_upload_next_chunk(&spectator->map_upload, map_file, &chunk)) {
+            Packet chunk_packet = {
+                .header = {
+                    .type = PACKET_TYPE_MAP_CHUNK,
+                    .sequence = (*sequence)++
+                },
+                .size = (U32)(map_chunk_serialize(&chunk, scratch_buffer, scratch_buffer_size)),
+                .payload = (U8*)scratch_buffer
+            };
+            packet_send_queue_push(&spectator->send_queue, &chunk_packet, false);
+        }
+
+        if (!failed && !packet_send_queue_flush(&spectator->send_queue, spectator->socket)) {
+            failed = true;
+        }
+
+        if (failed) {
+            printf("spectator %d disconnected: %s", i, net_get_error());
+            _spectator_remove(list, i);
+            i--;
+        }
+    }
+}
+
+void spectator_list_destroy(SpectatorList* list) {
+    while (list->count > 0) {
+        _spectator_remove(list, list->count - 1);
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef spectator_h
+#define spectator_h
+
+#include "map_cache.h"
+#include "network.h"
+#include "packet.h"
+
+#define MAX_SPECTATOR_COUNT 256
+
+// Spectators slow down to at most one state every this many ticks when they can't keep up.
+#define SPECTATOR_MAX_SEND_INTERVAL_TICKS 8
+
+// Spectators drop states sooner than players, so a slow one never holds much memory.
+#define SPECTATOR_SEND_QUEUE_BYTE_LIMIT (64 * 1024)
+
+// A read-only connection that gets the state stream but doesn't take a player slot.
+typedef struct {
+    NetSocket* socket;
+    PacketSendQueue send_queue;
+    PacketTransmissionState receive_state;
+    MapUpload map_upload;
+    bool needs_keyframe;     // Just joined, send everything needed to show the current state.
+    S32 send_interval_ticks; // Only every nth state is sent, raised while the socket is backed up.
+    S32 ticks_since_send;
+} Spectator;
+
+typedef struct {
+    Spectator spectators[MAX_SPECTATOR_COUNT];
+    S32 count;
+} SpectatorList;
+
+// Takes ownership of the socket. A send queue with packets already partly sent on the socket can be
+// handed over so the stream isn't cut off mid-packet, it is left empty. Returns false if full.
+bool spectator_list_add(SpectatorList* list, NetSocket* socket, PacketSendQueue* send_queue);
+
+bool spectator_list_needs_keyframe(const SpectatorList* list);
+
+// Queues the tick's state for spectators that are due one. Spectators that just joined get
+// join_buffer first if there is one, e.g. the lobby state with the map and settings for a game that
+// is already running.
+void spectator_list_send_state(SpectatorList* list, PacketBuffer* join_buffer, PacketBuffer* state_buffer);
+
+// Reads map requests, streams map chunks and flushes each spectator's queue, dropping spectators
+// whose socket has failed.
+void spectator_list_update(SpectatorList* list,
+                           const MapFile* map_file,
+                           void* scratch_buffer,
+                           size_t scratch_buffer_size,
+                           U16* sequence);
+
+void spectator_list_destroy(SpectatorList* list);
+
+#endif /* spectator_h */
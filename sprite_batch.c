@@ -0,0 +1,113 @@
+#include "sprite_batch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Corners go clockwise from the top left. Turning a sprite clockwise by a quarter moves what was in
+// each corner to the next one, so the texture coordinates at dest corner c come from the source
+// corner in this table, rather than rotating any positions.
+static const S32 _rotated_corner[4][4] = {
+    {0, 1, 2, 3},
+    {3, 0, 1, 2},
+    {2, 3, 0, 1},
+    {1, 2, 3, 0},
+};
+
+void sprite_batch_begin(SpriteBatch* batch, SDL_Texture* texture) {
+    batch->texture = texture;
+    batch->sprite_count = 0;
+}
+
+static bool _sprite_batch_grow(SpriteBatch* batch) {
+    S32 capacity = (batch->sprite_capacity > 0) ? batch->sprite_capacity * 2 : 256;
+
+    SDL_Vertex* vertices = realloc(batch->vertices, (size_t)(capacity) * 4 * sizeof(*vertices));
+    if (vertices == NULL) {
+        fprintf(stderr, "sprite_batch: failed to allocate %d sprites\n", capacity);
+        return false;
+    }
+    batch->vertices = vertices;
+
+    int* indices = realloc(batch->indices, (size_t)(capacity) * 6 * sizeof(*indices));
+    if (indices == NULL) {
+        fprintf(stderr, "sprite_batch: failed to allocate %d sprites\n", capacity);
+        return false;
+    }
+    batch->indices = indices;
+
+    // Every sprite is two triangles over its own 4 vertices, so the indices never change.
+    for (S32 i = batch->sprite_capacity; i < capacity; i++) {
+        int first_vertex = i * 4;
+        int* sprite_indices = indices + (i * 6);
+        sprite_indices[0] = first_vertex;
+        sprite_indices[1] = first_vertex + 1;
+        sprite_indices[2] = first_vertex + 2;
+        sprite_indices[3] = first_vertex;
+        sprite_indices[4] = first_vertex + 2;
+        sprite_indices[5] = first_vertex + 3;
+    }
+
+    batch->sprite_capacity = capacity;
+    return true;
+}
+
+bool sprite_batch_add(SpriteBatch* batch,
+                      const SDL_FRect* source,
+                      const SDL_FRect* dest,
+                      S32 quarter_turns,
+                      SDL_FColor color) {
+    if (batch->sprite_count >= batch->sprite_capacity && !_sprite_batch_grow(batch)) {
+        return false;
+    }
+
+    float texture_width = (float)(batch->texture->w);
+    float texture_height = (float)(batch->texture->h);
+    float u0 = source->x / texture_width;
+    float v0 = source->y / texture_height;
+    float u1 = (source->x + source->w) / texture_width;
+    float v1 = (source->y + source->h) / texture_height;
+    SDL_FPoint source_corners[4] = {{u0, v0}, {u1, v0}, {u1, v1}, {u0, v1}};
+
+    SDL_FPoint dest_corners[4] = {
+        {dest->x, dest->y},
+        {dest->x + dest->w, dest->y},
+        {dest->x + dest->w, dest->y + dest->h},
+        {dest->x, dest->y + dest->h},
+    };
+
+    const S32* corners = _rotated_corner[quarter_turns & 3];
+    SDL_Vertex* vertices = batch->vertices + (batch->sprite_count * 4);
+    for (S32 c = 0; c < 4; c++) {
+        vertices[c].position = dest_corners[c];
+        vertices[c].color = color;
+        vertices[c].tex_coord = source_corners[corners[c]];
+    }
+
+    batch->sprite_count++;
+    return true;
+}
+
+bool sprite_batch_draw(SpriteBatch* batch, SDL_Renderer* renderer) {
+    if (batch->sprite_count == 0) {
+        return true;
+    }
+
+    bool result = SDL_RenderGeometry(renderer,
+                                     batch->texture,
+                                     batch->vertices,
+                                     batch->sprite_count * 4,
+                                     batch->indices,
+                                     batch->sprite_count * 6);
+    if (!result) {
+        fprintf(stderr, "sprite_batch: failed to draw %d sprites: %s\n",
+                batch->sprite_count,
+                SDL_GetError());
+    }
+    return result;
+}
+
+void sprite_batch_destroy(SpriteBatch* batch) {
+    free(batch->vertices);
+    free(batch->indices);
+    *batch = (SpriteBatch){0};
+}
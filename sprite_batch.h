@@ -0,0 +1,32 @@
+#ifndef sprite_batch_h
+#define sprite_batch_h
+
+#include "ints.h"
+
+#include <SDL3/SDL_render.h>
+#include <stdbool.h>
+
+// Sprites from one texture collected into a single vertex and index buffer, so a whole frame's worth
+// is drawn with one SDL_RenderGeometry call. The buffers are kept between frames and only grow.
+typedef struct {
+    SDL_Texture* texture;
+    SDL_Vertex* vertices;
+    int* indices;
+    S32 sprite_count;
+    S32 sprite_capacity;
+} SpriteBatch;
+
+// Empties the batch to start collecting sprites from texture.
+void sprite_batch_begin(SpriteBatch* batch, SDL_Texture* texture);
+// Adds source from the texture drawn at dest, turned clockwise by quarter_turns * 90 degrees around
+// its center, with its color multiplied by color.
+bool sprite_batch_add(SpriteBatch* batch,
+                      const SDL_FRect* source,
+                      const SDL_FRect* dest,
+                      S32 quarter_turns,
+                      SDL_FColor color);
+// Draws everything added since sprite_batch_begin in the order it was added.
+bool sprite_batch_draw(SpriteBatch* batch, SDL_Renderer* renderer);
+void sprite_batch_destroy(SpriteBatch* batch);
+
+#endif /* sprite_batch_h */
@@ -0,0 +1,421 @@
+#include "../game.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RUN_COUNT 15
+#define TICKS_PER_RUN 200
+#define SAMPLE_COUNT (RUN_COUNT * TICKS_PER_RUN)
+
+// The first ticks of each config aren't sampled, while the caches and allocator settle.
+#define WARMUP_TICKS 10
+
+// Configs slow enough to run over this stop early once they have MIN_SAMPLE_COUNT ticks, so the
+// whole suite finishes in a few minutes however slow game_update gets.
+#define CONFIG_BUDGET_NS 1000000000ULL
+#define MIN_SAMPLE_COUNT 10
+
+// Snakes turn every this many ticks in the scripted stream, so they go round in squares.
+#define SCRIPTED_TURN_TICKS 6
+
+typedef struct {
+    const char* name;
+    const char* path; // NULL for a generated map.
+    S32 width;
+    S32 height;
+} BenchMap;
+
+typedef enum {
+    ACTION_STREAM_RANDOM,
+    ACTION_STREAM_SCRIPTED,
+} ActionStream;
+
+typedef struct {
+    const BenchMap* map;
+    S32 snake_count;
+    S32 length;
+    bool enable_chomping;
+    bool enable_constricting;
+    ActionStream stream;
+} BenchConfig;
+
+typedef struct {
+    U64 min_ns;
+    U64 median_ns;
+    U64 p99_ns;
+} BenchStats;
+
+static const BenchMap bench_maps[] = {
+    { "small_map_1", "../assets/small_map_1.temap", 0, 0 },
+    { "medium_map_1", "../assets/medium_map_1.temap", 0, 0 },
+    { "generated_64", NULL, 64, 64 },
+    { "generated_128", NULL, 128, 128 },
+    { "generated_256", NULL, 256, 256 },
+};
+
+static const S32 bench_snake_counts[] = { 2, 4 };
+static const S32 bench_lengths[] = { 8, 256 };
+
+// One sample per tick across every run, for each phase and then the whole tick.
+static U64 g_samples[GAME_PHASE_COUNT + 1][SAMPLE_COUNT];
+
+static U32 _random(U32* state) {
+    U32 x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static bool _cell_is_open(Game* game, S32 x, S32 y) {
+    return IsValidPosition(&game->map, x, y) &&
+           GetMapTile(&game->map, x, y, MAP_GROUND_LAYER) != 0 &&
+           GetMapTile(&game->map, x, y, MAP_SOLID_LAYER) == 0;
+}
+
+// An open field with a wall round the edge and pillars scattered over 2% of it.
+static bool _generate_map(Map* map, S32 width, S32 height) {
+    memset(map, 0, sizeof(*map));
+    map->width = (Uint16)width;
+    map->height = (Uint16)height;
+    map->num_layers = 2;
+    for (S32 l = 0; l < map->num_layers; l++) {
+        map->tiles[l] = calloc(width * height, sizeof(*map->tiles[l]));
+        if (map->tiles[l] == NULL) {
+            fprintf(stderr, "Failed to allocate a %d x %d map\n", width, height);
+            return false;
+        }
+    }
+
+    U32 random_state = 4321;
+    for (S32 y = 0; y < height; y++) {
+        for (S32 x = 0; x < width; x++) {
+            SetMapTile(map, x, y, MAP_GROUND_LAYER, 1);
+            bool edge = x == 0 || y == 0 || x == width - 1 || y == height - 1;
+            if (edge || _random(&random_state) % 50 == 0) {
+                SetMapTile(map, x, y, MAP_SOLID_LAYER, 1);
+            }
+        }
+    }
+    return true;
+}
+
+static bool _cell_has_snake(Game* game, S32 snake_count, SnakeSegment* path, S32 path_length, S32 x, S32 y) {
+    for (S32 e = 0; e < path_length; e++) {
+        if (path[e].x == x && path[e].y == y) {
+            return true;
+        }
+    }
+    for (S32 s = 0; s < snake_count; s++) {
+        for (S32 e = 0; e < game->snakes[s].length; e++) {
+            if (game->snakes[s].segments[e].x == x && game->snakes[s].segments[e].y == y) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Lays the snake tail first from the corner of its quarter of the map, going straight until it runs
+// into a wall or a snake and then turning clockwise, so long snakes end up coiled. Stops early if it
+// gets boxed in.
+static void _lay_snake(Game* game, S32 snake_index, S32 length, S32 segment_health) {
+    S32 quarter_width = game->map.width / 2;
+    S32 quarter_height = game->map.height / 2;
+    S32 min_x = (snake_index % 2) * quarter_width;
+    S32 min_y = (snake_index / 2) * quarter_height;
+
+    Snake* snake = game->snakes + snake_index;
+    SnakeSegment* path = malloc(length * sizeof(*path));
+    S32 path_length = 0;
+    for (S32 i = 0; i < quarter_width * quarter_height && path_length == 0; i++) {
+        S32 x = min_x + i % quarter_width;
+        S32 y = min_y + i / quarter_width;
+        if (_cell_is_open(game, x, y) && !_cell_has_snake(game, snake_index, path, 0, x, y)) {
+            path[path_length++] = (SnakeSegment){ .x = (S16)x, .y = (S16)y, .health = (S8)segment_health };
+        }
+    }
+
+    Direction direction = DIRECTION_EAST;
+    while (path_length > 0 && path_length < length) {
+        bool stepped = false;
+        for (S32 turn = 0; turn < DIRECTION_COUNT && !stepped; turn++) {
+            S32 x = path[path_length - 1].x;
+            S32 y = path[path_length - 1].y;
+            adjacent_cell(direction, &x, &y);
+            bool in_quarter = x >= min_x && x < min_x + quarter_width &&
+                              y >= min_y && y < min_y + quarter_height;
+            if (in_quarter &&
+                _cell_is_open(game, x, y) &&
+                !_cell_has_snake(game, snake_index, path, path_length, x, y)) {
+                path[path_length++] = (SnakeSegment){ .x = (S16)x, .y = (S16)y, .health = (S8)segment_health };
+                stepped = true;
+            } else {
+                direction = rotate_clockwise(direction);
+            }
+        }
+        if (!stepped) {
+            break;
+        }
+    }
+
+    if (path_length == 0) {
+        snake->length = 0;
+        snake->life_state = SNAKE_LIFE_STATE_DEAD;
+        free(path);
+        return;
+    }
+
+    snake_spawn(snake, path[0].x, path[0].y, direction, path_length, (S8)segment_health);
+    for (S32 e = 0; e < path_length; e++) {
+        snake->segments[e] = path[path_length - 1 - e];
+    }
+    free(path);
+}
+
+static void _reset_game(Game* game, const BenchConfig* config, U32 seed) {
+    for (S32 y = 0; y < game->items.height; y++) {
+        for (S32 x = 0; x < game->items.width; x++) {
+            items_set_cell(&game->items, x, y, ITEM_TYPE_EMPTY);
+        }
+    }
+
+    game->settings = (GameSettings){
+        .enable_chomping = config->enable_chomping,
+        .enable_constricting = config->enable_constricting,
+        .segment_health = 3,
+        .starting_length = config->length,
+        .taco_count = (game->map.width * game->map.height) / 64,
+        .chomp_cooldown_ticks = 10,
+        .tick_ms = 175,
+    };
+
+    for (S32 s = 0; s < MAX_SNAKE_COUNT; s++) {
+        game->snakes[s].length = 0;
+        game->snakes[s].life_state = SNAKE_LIFE_STATE_DEAD;
+        if (s < config->snake_count) {
+            _lay_snake(game, s, config->length, game->settings.segment_health);
+        }
+    }
+
+    game_seed_random(game, seed);
+    for (S32 t = 0; t < game->settings.taco_count; t++) {
+        game_spawn_taco(game);
+    }
+
+    game->tick = 0;
+    game->state = GAME_STATE_PLAYING;
+}
+
+static void _make_actions(Game* game,
+                          const BenchConfig* config,
+                          U32* random_state,
+                          SnakeAction* snake_actions) {
+    for (S32 s = 0; s < MAX_SNAKE_COUNT; s++) {
+        SnakeAction action = SNAKE_ACTION_NONE;
+        if (config->stream == ACTION_STREAM_RANDOM) {
+            if (_random(random_state) % 4 == 0) {
+                action |= (SnakeAction)(1 << (_random(random_state) % DIRECTION_COUNT));
+            }
+            if (_random(random_state) % 8 == 0) {
+                action |= SNAKE_ACTION_CHOMP;
+            }
+            if (_random(random_state) % 16 == 0) {
+                action |= _random(random_state) % 2 ? SNAKE_ACTION_CONSTRICT_LEFT : SNAKE_ACTION_CONSTRICT_RIGHT;
+            }
+        } else {
+            U32 tick = game->tick + s;
+            if (tick % SCRIPTED_TURN_TICKS == 0) {
+                action |= (SnakeAction)(1 << rotate_clockwise(game->snakes[s].direction));
+            }
+            if (tick % (SCRIPTED_TURN_TICKS * 2) == 1) {
+                action |= SNAKE_ACTION_CHOMP;
+            }
+            if (tick % (SCRIPTED_TURN_TICKS * 4) == 2) {
+                action |= (tick / (SCRIPTED_TURN_TICKS * 4)) % 2 ? SNAKE_ACTION_CONSTRICT_LEFT : SNAKE_ACTION_CONSTRICT_RIGHT;
+            }
+        }
+
+        // The server strips the actions for disabled rules before they reach game_update.
+        if (!config->enable_chomping) {
+            action &= ~SNAKE_ACTION_CHOMP;
+        }
+        if (!config->enable_constricting) {
+            action &= ~(SNAKE_ACTION_CONSTRICT_LEFT | SNAKE_ACTION_CONSTRICT_RIGHT);
+        }
+        snake_actions[s] = action;
+    }
+}
+
+static int _compare_u64(const void* a, const void* b) {
+    U64 x = *(const U64*)a;
+    U64 y = *(const U64*)b;
+    return (x > y) - (x < y);
+}
+
+static BenchStats _stats(U64* samples, S32 count) {
+    qsort(samples, count, sizeof(*samples), _compare_u64);
+    S32 p99_index = (count * 99 + 99) / 100 - 1;
+    return (BenchStats){
+        .min_ns = samples[0],
+        .median_ns = samples[count / 2],
+        .p99_ns = samples[p99_index],
+    };
+}
+
+// Runs the config up to RUN_COUNT times from the same start, with a different seed each run.
+// Returns the number of ticks sampled.
+static S32 _run_config(Game* game, const BenchConfig* config, S32* average_length) {
+    S32 sample_count = 0;
+    S32 total_length = 0;
+    S32 runs = 0;
+    GamePhaseTimes phase_times;
+    game->phase_times = &phase_times;
+
+    U64 config_start_ns = SDL_GetTicksNS();
+    bool over_budget = false;
+    for (S32 r = 0; r < RUN_COUNT && !over_budget; r++) {
+        runs++;
+
+        U32 seed = 1000 + r;
+        U32 random_state = seed;
+        _reset_game(game, config, seed);
+        for (S32 s = 0; s < config->snake_count; s++) {
+            total_length += game->snakes[s].length;
+        }
+
+        for (S32 t = 0; t < TICKS_PER_RUN && !over_budget; t++) {
+            SnakeAction snake_actions[MAX_SNAKE_COUNT];
+            _make_actions(game, config, &random_state, snake_actions);
+            memset(&phase_times, 0, sizeof(phase_times));
+
+            U64 start_ns = SDL_GetTicksNS();
+            game_update(game, snake_actions);
+            U64 tick_ns = SDL_GetTicksNS() - start_ns;
+
+            over_budget = SDL_GetTicksNS() - config_start_ns > CONFIG_BUDGET_NS &&
+                          sample_count >= MIN_SAMPLE_COUNT;
+            if (r == 0 && t < WARMUP_TICKS) {
+                continue;
+            }
+            for (S32 p = 0; p < GAME_PHASE_COUNT; p++) {
+                g_samples[p][sample_count] = phase_times.ns[p];
+            }
+            g_samples[GAME_PHASE_COUNT][sample_count] = tick_ns;
+            sample_count++;
+        }
+    }
+
+    game->phase_times = NULL;
+    *average_length = total_length / (runs * config->snake_count);
+    return sample_count;
+}
+
+static void _write_stats(FILE* file, const char* name, BenchStats stats, bool last) {
+    fprintf(file,
+            "        \"%s\": { \"min_ns\": %llu, \"median_ns\": %llu, \"p99_ns\": %llu }%s\n",
+            name,
+            (unsigned long long)stats.min_ns,
+            (unsigned long long)stats.median_ns,
+            (unsigned long long)stats.p99_ns,
+            last ? "" : ",");
+}
+
+int main(int argc, char** argv) {
+    const char* output_path = argc > 1 ? argv[1] : "game_bench.json";
+    FILE* output = fopen(output_path, "w");
+    if (output == NULL) {
+        fprintf(stderr, "Failed to open %s\n", output_path);
+        return EXIT_FAILURE;
+    }
+
+    fprintf(output, "{\n");
+    fprintf(output, "  \"max_runs\": %d,\n", RUN_COUNT);
+    fprintf(output, "  \"ticks_per_run\": %d,\n", TICKS_PER_RUN);
+    fprintf(output, "  \"results\": [");
+
+    printf("%-14s %6s %6s %5s %5s %8s %6s | median ns per tick (p99)\n",
+           "map", "snakes", "length", "chomp", "cnstr", "actions", "ticks");
+
+    bool first_result = true;
+    S32 map_count = (S32)(sizeof(bench_maps) / sizeof(bench_maps[0]));
+    for (S32 m = 0; m < map_count; m++) {
+        const BenchMap* bench_map = bench_maps + m;
+        Game game = {0};
+        bool loaded = bench_map->path != NULL
+            ? LoadMap(&game.map, bench_map->path)
+            : _generate_map(&game.map, bench_map->width, bench_map->height);
+        if (!loaded || !game_init_loaded_map(&game)) {
+            fprintf(stderr, "Failed to set up map %s\n", bench_map->name);
+            fclose(output);
+            return EXIT_FAILURE;
+        }
+
+        for (S32 c = 0; c < 2; c++) {
+            for (S32 l = 0; l < 2; l++) {
+                for (S32 rules = 0; rules < 4; rules++) {
+                    for (S32 stream = 0; stream < 2; stream++) {
+                        BenchConfig config = {
+                            .map = bench_map,
+                            .snake_count = bench_snake_counts[c],
+                            .length = bench_lengths[l],
+                            .enable_chomping = rules & 1,
+                            .enable_constricting = rules & 2,
+                            .stream = stream,
+                        };
+
+                        S32 average_length = 0;
+                        S32 sample_count = _run_config(&game, &config, &average_length);
+
+                        BenchStats stats[GAME_PHASE_COUNT + 1];
+                        for (S32 p = 0; p <= GAME_PHASE_COUNT; p++) {
+                            stats[p] = _stats(g_samples[p], sample_count);
+                        }
+
+                        const char* stream_name = config.stream == ACTION_STREAM_RANDOM ? "random" : "scripted";
+                        printf("%-14s %6d %6d %5s %5s %8s %6d | %8llu (%llu)\n",
+                               bench_map->name,
+                               config.snake_count,
+                               average_length,
+                               config.enable_chomping ? "on" : "off",
+                               config.enable_constricting ? "on" : "off",
+                               stream_name,
+                               sample_count,
+                               (unsigned long long)stats[GAME_PHASE_COUNT].median_ns,
+                               (unsigned long long)stats[GAME_PHASE_COUNT].p99_ns);
+                        fflush(stdout);
+
+                        fprintf(output, "%s\n    {\n", first_result ? "" : ",");
+                        fprintf(output, "      \"map\": \"%s\",\n", bench_map->name);
+                        fprintf(output, "      \"width\": %d,\n", game.map.width);
+                        fprintf(output, "      \"height\": %d,\n", game.map.height);
+                        fprintf(output, "      \"snakes\": %d,\n", config.snake_count);
+                        fprintf(output, "      \"length\": %d,\n", config.length);
+                        fprintf(output, "      \"average_spawned_length\": %d,\n", average_length);
+                        fprintf(output, "      \"enable_chomping\": %s,\n", config.enable_chomping ? "true" : "false");
+                        fprintf(output, "      \"enable_constricting\": %s,\n", config.enable_constricting ? "true" : "false");
+                        fprintf(output, "      \"actions\": \"%s\",\n", stream_name);
+                        fprintf(output, "      \"ticks_sampled\": %d,\n", sample_count);
+                        fprintf(output, "      \"phases\": {\n");
+                        for (S32 p = 0; p < GAME_PHASE_COUNT; p++) {
+                            _write_stats(output, game_phase_string(p), stats[p], false);
+                        }
+                        _write_stats(output, "total", stats[GAME_PHASE_COUNT], true);
+                        fprintf(output, "      }\n    }");
+                        first_result = false;
+                    }
+                }
+            }
+        }
+
+        game_destroy(&game);
+        FreeMap(&game.map);
+    }
+
+    fprintf(output, "\n  ]\n}\n");
+    fclose(output);
+    printf("wrote %s\n", output_path);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,393 @@
+#include "../game.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Each size is timed until it has run this long or this many times, whichever comes first, and at
+// least MIN_REPS times.
+#define SIZE_BUDGET_NS 200000000ULL
+#define MAX_REPS 25
+#define MIN_REPS 3
+
+// Sizes stop growing once the next one looks like it would take longer than this, judging by how
+// much longer the last one took than the one before, so the slowest scenarios still finish.
+#define SLOW_OP_NS 1000000000ULL
+
+// Timings under this are mostly timer noise and aren't used to work out the growth.
+#define NOISE_FLOOR_NS 20000.0
+
+// How much faster than expected a scenario may grow before it is flagged, as a power of the size.
+#define EXPONENT_TOLERANCE 0.5
+
+#define MAX_SIZE_COUNT 16
+
+typedef struct {
+    const char* name;
+    const char* description;
+    // How the time is expected to grow with the size, as a power of it.
+    double expected_exponent;
+    S32 min_size;
+    S32 max_size;
+    // Already known to grow faster than expected, so it is reported but doesn't fail the run.
+    bool known_slow;
+    bool (*build)(Game* game, S32 size);
+    void (*run)(Game* game);
+} StressScenario;
+
+static bool _make_board(Game* game, S32 width, S32 height) {
+    memset(game, 0, sizeof(*game));
+    Map* map = &game->map;
+    map->width = (Uint16)width;
+    map->height = (Uint16)height;
+    map->num_layers = 2;
+    for (S32 l = 0; l < map->num_layers; l++) {
+        map->tiles[l] = calloc(width * height, sizeof(*map->tiles[l]));
+        if (map->tiles[l] == NULL) {
+            fprintf(stderr, "Failed to allocate a %d x %d board\n", width, height);
+            return false;
+        }
+    }
+
+    // Open ground with a wall round the edge.
+    for (S32 y = 0; y < height; y++) {
+        for (S32 x = 0; x < width; x++) {
+            SetMapTile(map, x, y, MAP_GROUND_LAYER, 1);
+            if (x == 0 || y == 0 || x == width - 1 || y == height - 1) {
+                SetMapTile(map, x, y, MAP_SOLID_LAYER, 1);
+            }
+        }
+    }
+
+    if (!game_init_loaded_map(game)) {
+        return false;
+    }
+
+    game->settings = (GameSettings){
+        .enable_chomping = true,
+        .enable_constricting = true,
+        .segment_health = 3,
+        .chomp_cooldown_ticks = 10,
+        .tick_ms = 175,
+    };
+    for (S32 s = 0; s < MAX_SNAKE_COUNT; s++) {
+        game->snakes[s].length = 0;
+        game->snakes[s].life_state = SNAKE_LIFE_STATE_DEAD;
+    }
+    game->state = GAME_STATE_PLAYING;
+    return true;
+}
+
+static void _free_board(Game* game) {
+    game_destroy(game);
+    FreeMap(&game->map);
+}
+
+// Appends a segment to the snake, head first.
+static void _add_segment(Game* game, S32 snake_index, S32 x, S32 y) {
+    Snake* snake = game->snakes + snake_index;
+    snake->segments[snake->length++] = (SnakeSegment){
+        .x = (S16)x,
+        .y = (S16)y,
+        .health = (S8)game->settings.segment_health
+    };
+    snake->life_state = SNAKE_LIFE_STATE_ALIVE;
+    if (snake->length == 2) {
+        snake->direction = direction_between_cells(x, y, snake->segments[0].x, snake->segments[0].y);
+    }
+}
+
+static void _add_vertical_snake(Game* game, S32 snake_index, S32 x, S32 top_y, S32 length) {
+    for (S32 e = 0; e < length; e++) {
+        _add_segment(game, snake_index, x, top_y + e);
+    }
+}
+
+// Lays the snake back and forth along the rows between min_y and max_y.
+static void _add_serpentine_snake(Game* game, S32 snake_index, S32 min_x, S32 max_x, S32 min_y, S32 max_y) {
+    for (S32 y = min_y; y <= max_y; y++) {
+        for (S32 i = 0; i <= max_x - min_x; i++) {
+            S32 x = (y - min_y) % 2 == 0 ? min_x + i : max_x - i;
+            _add_segment(game, snake_index, x, y);
+        }
+    }
+}
+
+// Lays the snake clockwise round the rectangle inset from the edge of the board, stopping a cell
+// short of closing the loop.
+static void _add_ring_snake(Game* game, S32 snake_index, S32 inset) {
+    S32 min_x = inset;
+    S32 min_y = inset;
+    S32 max_x = game->map.width - 1 - inset;
+    S32 max_y = game->map.height - 1 - inset;
+    for (S32 x = min_x + 1; x <= max_x; x++) {
+        _add_segment(game, snake_index, x, min_y);
+    }
+    for (S32 y = min_y + 1; y <= max_y; y++) {
+        _add_segment(game, snake_index, max_x, y);
+    }
+    for (S32 x = max_x - 1; x >= min_x; x--) {
+        _add_segment(game, snake_index, x, max_y);
+    }
+    for (S32 y = max_y - 1; y > min_y; y--) {
+        _add_segment(game, snake_index, min_x, y);
+    }
+}
+
+static void _push_segment(Game* game, S32 original_snake_index, S32 snake_index, S32 segment_index, Direction direction) {
+    PushState push_state = {0};
+    init_push_state(game, &push_state);
+    push_state.original_snake_index = original_snake_index;
+    snake_segment_push(game, &push_state, snake_index, segment_index, direction);
+    free(push_state.cells);
+}
+
+//
+// Scenarios
+//
+
+// A corridor packed with tacos, with a snake across the start being pushed into them.
+static bool _build_taco_corridor(Game* game, S32 size) {
+    if (!_make_board(game, size + 6, 5)) {
+        return false;
+    }
+    _add_vertical_snake(game, 0, 2, 1, 3);
+    for (S32 x = 3; x < size + 3; x++) {
+        items_set_cell(&game->items, x, 2, ITEM_TYPE_TACO);
+    }
+    return true;
+}
+
+static void _run_taco_corridor(Game* game) {
+    _push_segment(game, -1, 0, 1, DIRECTION_EAST);
+}
+
+// The taco corridor with two more snakes lying across it, so the push goes through them too.
+static bool _build_snake_taco_chain(Game* game, S32 size) {
+    if (!_build_taco_corridor(game, size)) {
+        return false;
+    }
+    for (S32 s = 1; s <= 2; s++) {
+        S32 x = 3 + (size * s) / 3;
+        items_set_cell(&game->items, x, 2, ITEM_TYPE_EMPTY);
+        _add_vertical_snake(game, s, x, 1, 3);
+    }
+    return true;
+}
+
+// A snake folded back and forth over the board, pushed from the top row towards the bottom so
+// every fold has to move.
+static bool _build_serpentine_push(Game* game, S32 size) {
+    if (!_make_board(game, size + 2, size + 2)) {
+        return false;
+    }
+    _add_serpentine_snake(game, 1, 1, size, 1, size - 2);
+    return true;
+}
+
+static void _run_serpentine_push(Game* game) {
+    // The snake starts from its head in the top left, so this is the middle of the top row.
+    _push_segment(game, -1, 1, (game->map.width - 2) / 2, DIRECTION_SOUTH);
+}
+
+// A snake coiled round the edge of the board, another coiled inside it, and a third in the middle.
+static bool _build_nested_coils(Game* game, S32 size) {
+    if (!_make_board(game, size + 2, size + 2)) {
+        return false;
+    }
+    _add_ring_snake(game, 0, 1);
+    _add_ring_snake(game, 2, 3);
+    _add_vertical_snake(game, 1, game->map.width / 2, game->map.height / 2 - 1, 3);
+    // The outer snake's head points west along the top, so the inside of the coil is to its left.
+    game->snakes[0].constrict_state = SNAKE_CONSTRICT_STATE_LEFT;
+    return true;
+}
+
+// A snake folded back and forth over the whole board constricting.
+static bool _build_serpentine_constrict(Game* game, S32 size) {
+    if (!_make_board(game, size + 2, size + 2)) {
+        return false;
+    }
+    _add_serpentine_snake(game, 0, 1, size, 1, size);
+    game->snakes[0].constrict_state = SNAKE_CONSTRICT_STATE_LEFT;
+    return true;
+}
+
+static void _run_constrict(Game* game) {
+    snake_constrict(game, 0);
+}
+
+static const StressScenario scenarios[] = {
+    {
+        "taco_corridor",
+        "push through a corridor of size tacos",
+        1.0, 16, 4096, false,
+        _build_taco_corridor, _run_taco_corridor
+    },
+    {
+        "snake_taco_chain",
+        "push through size tacos and two snakes",
+        1.0, 16, 4096, false,
+        _build_snake_taco_chain, _run_taco_corridor
+    },
+    {
+        // Each of the size folds can drag the whole size * size snake.
+        "serpentine_push",
+        "push across every fold of a size x size serpentine snake",
+        3.0, 8, 256, true,
+        _build_serpentine_push, _run_serpentine_push
+    },
+    {
+        // The coils are 4 * size long, and the board they enclose is size * size.
+        "nested_coils",
+        "constrict a coil round a size x size board with two snakes inside",
+        2.0, 8, 256, true,
+        _build_nested_coils, _run_constrict
+    },
+    {
+        "serpentine_constrict",
+        "constrict a size x size serpentine snake",
+        2.0, 8, 256, true,
+        _build_serpentine_constrict, _run_constrict
+    },
+};
+
+static int _compare_u64(const void* a, const void* b) {
+    U64 x = *(const U64*)a;
+    U64 y = *(const U64*)b;
+    return (x > y) - (x < y);
+}
+
+// Builds a fresh board for every rep, and returns the median time of the operation alone.
+static bool _time_size(const StressScenario* scenario, S32 size, U64* median_ns) {
+    U64 times_ns[MAX_REPS];
+    S32 rep_count = 0;
+    U64 total_ns = 0;
+    while (rep_count < MAX_REPS && (rep_count < MIN_REPS || total_ns < SIZE_BUDGET_NS)) {
+        Game game;
+        if (!scenario->build(&game, size)) {
+            return false;
+        }
+
+        U64 start_ns = SDL_GetTicksNS();
+        scenario->run(&game);
+        U64 elapsed_ns = SDL_GetTicksNS() - start_ns;
+        _free_board(&game);
+
+        times_ns[rep_count++] = elapsed_ns;
+        total_ns += elapsed_ns;
+        if (elapsed_ns > SLOW_OP_NS) {
+            break;
+        }
+    }
+
+    qsort(times_ns, rep_count, sizeof(*times_ns), _compare_u64);
+    *median_ns = times_ns[rep_count / 2];
+    return true;
+}
+
+// Least squares fit of log(time) against log(size), over the timings above the noise floor.
+static bool _growth_exponent(const S32* sizes, const U64* times_ns, S32 count, double* exponent) {
+    double sum_x = 0.0;
+    double sum_y = 0.0;
+    double sum_xx = 0.0;
+    double sum_xy = 0.0;
+    S32 n = 0;
+    for (S32 i = 0; i < count; i++) {
+        if ((double)times_ns[i] < NOISE_FLOOR_NS) {
+            continue;
+        }
+        double x = log((double)sizes[i]);
+        double y = log((double)times_ns[i]);
+        sum_x += x;
+        sum_y += y;
+        sum_xx += x * x;
+        sum_xy += x * y;
+        n++;
+    }
+
+    if (n < 2) {
+        return false;
+    }
+
+    *exponent = (n * sum_xy - sum_x * sum_y) / (n * sum_xx - sum_x * sum_x);
+    return true;
+}
+
+int main(void) {
+    S32 flagged_count = 0;
+    S32 known_slow_count = 0;
+    S32 scenario_count = (S32)(sizeof(scenarios) / sizeof(scenarios[0]));
+    for (S32 i = 0; i < scenario_count; i++) {
+        const StressScenario* scenario = scenarios + i;
+        printf("%s: %s\n", scenario->name, scenario->description);
+
+        S32 sizes[MAX_SIZE_COUNT];
+        U64 times_ns[MAX_SIZE_COUNT];
+        S32 size_count = 0;
+        for (S32 size = scenario->min_size; size <= scenario->max_size && size_count < MAX_SIZE_COUNT; size *= 2) {
+            U64 median_ns = 0;
+            if (!_time_size(scenario, size, &median_ns)) {
+                fprintf(stderr, "Failed to build %s at size %d\n", scenario->name, size);
+                return EXIT_FAILURE;
+            }
+
+            printf("  size %5d: %12.1f us", size, median_ns / 1000.0);
+            if (size_count > 0 && times_ns[size_count - 1] > 0) {
+                printf("  (x%.1f)", (double)median_ns / times_ns[size_count - 1]);
+            }
+            printf("\n");
+            fflush(stdout);
+
+            sizes[size_count] = size;
+            times_ns[size_count] = median_ns;
+            size_count++;
+
+            double growth = 2.0;
+            if (size_count > 1 && times_ns[size_count - 2] > 0) {
+                growth = (double)times_ns[size_count - 1] / times_ns[size_count - 2];
+            }
+            if (median_ns * growth > SLOW_OP_NS) {
+                break;
+            }
+        }
+
+        double exponent = 0.0;
+        if (!_growth_exponent(sizes, times_ns, size_count, &exponent)) {
+            printf("  too fast to measure growth\n\n");
+            continue;
+        }
+
+        bool flagged = exponent > scenario->expected_exponent + EXPONENT_TOLERANCE;
+        const char* note = "";
+        if (flagged) {
+            note = scenario->known_slow ? " <- WORSE THAN EXPECTED (known)" : " <- WORSE THAN EXPECTED";
+        } else if (scenario->known_slow) {
+            note = " <- no longer slow, clear known_slow";
+        }
+        printf("  grows as size^%.2f, expected size^%.1f%s\n\n",
+               exponent,
+               scenario->expected_exponent,
+               note);
+        if (flagged) {
+            if (scenario->known_slow) {
+                known_slow_count++;
+            } else {
+                flagged_count++;
+            }
+        }
+    }
+
+    if (known_slow_count > 0) {
+        printf("%d known slow scenarios still scale worse than expected\n", known_slow_count);
+    }
+
+    if (flagged_count > 0) {
+        printf("FAILED: %d of %d scenarios scale worse than expected\n", flagged_count, scenario_count);
+        return EXIT_FAILURE;
+    }
+
+    puts("PASSED");
+    return EXIT_SUCCESS;
+}
@@ -1,7 +1,9 @@
 #include "../game.h"
 
-#include <stdio.h>
 #include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 bool g_failed = false;
 
@@ -19,62 +21,66 @@ char new_char_from_level_string(const char** string, S32 x, S32 y) {
     return *(string[y] + x);
 }
 
+// Segments read from a level string start with this much health.
+#define TEST_SEGMENT_HEALTH 3
+
 bool game_from_string(const char** strings, Game* game) {
     // Process string array to get width and height.
     S32 width = (S32)(strlen(strings[0]));
     S32 height = 0;
 
     for (S32 i = 0; strings[i] != NULL; i++) {
-        if (strlen(strings[i]) != width) {
+        if ((S32)strlen(strings[i]) != width) {
             printf("Level string mismatch. Good luck finding it. Use a debugger.\n");
             return false;
         }
         height++;
     }
 
-    // Build the level.
-    if (!game_init(game, width, height, 0)) {
-        return false;
+    // Build the map, with walls on the solid layer.
+    memset(game, 0, sizeof(*game));
+    Map* map = &game->map;
+    map->width = (Uint16)width;
+    map->height = (Uint16)height;
+    map->num_layers = 2;
+    for (S32 l = 0; l < map->num_layers; l++) {
+        map->tiles[l] = calloc(width * height, sizeof(*map->tiles[l]));
+        if (map->tiles[l] == NULL) {
+            return false;
+        }
     }
 
-    S32 snake_capacities[MAX_SNAKE_COUNT] = {0};
-
     for (S16 y = 0; y < height; y++) {
         for (S16 x = 0; x < width; x++) {
-            char ch = new_char_from_level_string(strings, x, y);
-            level_set_cell(&game->level, x, y, CELL_TYPE_EMPTY);
-
-            if (ch == 'W') {
-                level_set_cell(&game->level, x, y, CELL_TYPE_WALL);
-            } else if (ch == 'T') {
-                level_set_cell(&game->level, x, y, CELL_TYPE_TACO);
-            } else if (islower(ch)) {
-                snake_capacities[0]++;
-            } else if (isupper(ch)) {
-                snake_capacities[1]++;
-            } else if (isdigit(ch)) {
-                snake_capacities[2]++;
+            SetMapTile(map, x, y, MAP_GROUND_LAYER, 1);
+            if (new_char_from_level_string(strings, x, y) == 'W') {
+                SetMapTile(map, x, y, MAP_SOLID_LAYER, 1);
             }
         }
     }
 
-    for (S32 i = 0; i < MAX_SNAKE_COUNT; i++) {
-        if (snake_capacities[i] == 0) {
-            continue;
-        }
-        if (!snake_init(game->snakes + i, snake_capacities[i])) {
-            return false;
-        }
-        game->snakes[i].length = snake_capacities[i];
+    if (!game_init_loaded_map(game)) {
+        return false;
     }
 
+    game->settings.enable_chomping = true;
+    game->settings.enable_constricting = true;
+    game->settings.head_invincible = true;
+    game->settings.segment_health = TEST_SEGMENT_HEALTH;
+    game->state = GAME_STATE_PLAYING;
+
     for (S16 y = 0; y < height; y++) {
         for (S16 x = 0; x < width; x++) {
             char ch = new_char_from_level_string(strings, x, y);
             S32 snake_index = 0;
             S32 segment_index = 0;
 
-            if (islower(ch)) {
+            if (ch == 'W') {
+                continue;
+            } else if (ch == 'T') {
+                items_set_cell(&game->items, x, y, ITEM_TYPE_TACO);
+                continue;
+            } else if (islower(ch)) {
                 snake_index = 0;
                 segment_index = ch - 'a';
             } else if (isupper(ch)) {
@@ -87,55 +93,62 @@ bool game_from_string(const char** strings, Game* game) {
                 continue;
             }
 
-            game->snakes[snake_index].segments[segment_index].x = x;
-            game->snakes[snake_index].segments[segment_index].y = y;
-            game->snakes[snake_index].segments[segment_index].health = SNAKE_SEGMENT_MAX_HEALTH;
+            Snake* snake = game->snakes + snake_index;
+            if (segment_index >= snake->length) {
+                snake->length = segment_index + 1;
+            }
+            snake->segments[segment_index].x = x;
+            snake->segments[segment_index].y = y;
+            snake->segments[segment_index].health = TEST_SEGMENT_HEALTH;
         }
     }
+
+    for (S32 s = 0; s < MAX_SNAKE_COUNT; s++) {
+        game->snakes[s].life_state = game->snakes[s].length > 0 ? SNAKE_LIFE_STATE_ALIVE : SNAKE_LIFE_STATE_DEAD;
+    }
     return true;
 }
 
+void free_game(Game* game) {
+    game_destroy(game);
+    FreeMap(&game->map);
+}
+
 void print_game(Game* game) {
-    char** string = malloc(game->level.height * sizeof(char*));
-    S32 string_length = game->level.width + 1; // plus one for null terminator.
-    for (S32 i = 0; i < game->level.height; i++) {
+    char** string = malloc(game->map.height * sizeof(char*));
+    S32 string_length = game->map.width + 1; // plus one for null terminator.
+    for (S32 i = 0; i < game->map.height; i++) {
         string[i] = malloc(string_length);
         memset(string[i], 0, string_length);
     }
 
-    for (S32 y = 0; y < game->level.height; y++) {
-        for (S32 x = 0; x < game->level.width; x++) {
-            CellType cell = level_get_cell(&game->level, x, y);
-            switch(cell) {
-            case CELL_TYPE_EMPTY:
-                string[y][x] = '.';
-                break;
-            case CELL_TYPE_WALL:
+    for (S32 y = 0; y < game->map.height; y++) {
+        for (S32 x = 0; x < game->map.width; x++) {
+            if (GetMapTile(&game->map, x, y, MAP_SOLID_LAYER) != 0) {
                 string[y][x] = 'W';
-                break;
-            case CELL_TYPE_TACO:
+            } else if (items_get_cell(&game->items, x, y) == ITEM_TYPE_TACO) {
                 string[y][x] = 'T';
-                break;
-            default:
-                string[y][x] = ' ';
-                break;
+            } else {
+                string[y][x] = '.';
             }
         }
     }
 
-    char base_chars[MAX_SNAKE_COUNT] = {'a', 'A', '0'};
+    char base_chars[MAX_SNAKE_COUNT] = {'a', 'A', '0', ' '};
     for (S32 s = 0; s < MAX_SNAKE_COUNT; s++) {
         for (S32 e = 0; e < game->snakes[s].length; e++) {
             SnakeSegment* segment = game->snakes[s].segments + e;
-            string[segment->y][segment->x] = (char)(base_chars[s] + e);
+            if (IsValidPosition(&game->map, segment->x, segment->y)) {
+                string[segment->y][segment->x] = (char)(base_chars[s] + e);
+            }
         }
     }
 
-    for (S32 i = 0; i < game->level.height; i++) {
+    for (S32 i = 0; i < game->map.height; i++) {
         printf("%s\n", string[i]);
     }
 
-    for (S32 i = 0; i < game->level.height; i++) {
+    for (S32 i = 0; i < game->map.height; i++) {
         free(string[i]);
     }
     free(string);
@@ -149,20 +162,21 @@ void print_games(Game* a, Game* b) {
 }
 
 bool games_are_equal(Game* a, Game* b) {
-    if (a->level.width != b->level.width) {
-        printf("width mismatch: %d -> %d\n", a->level.width, b->level.width);
+    if (a->map.width != b->map.width) {
+        printf("width mismatch: %d -> %d\n", a->map.width, b->map.width);
         return false;
     }
-    if (a->level.height != b->level.height) {
-        printf("height mismatch: %d -> %d\n", a->level.height, b->level.height);
+    if (a->map.height != b->map.height) {
+        printf("height mismatch: %d -> %d\n", a->map.height, b->map.height);
         return false;
     }
 
-    for (S32 y = 0; y < a->level.height; y++) {
-        for (S32 x = 0; x < a->level.width; x++) {
-            CellType a_cell = level_get_cell(&a->level, x, y);
-            CellType b_cell = level_get_cell(&b->level, x, y);
-            if (a_cell != b_cell) {
+    for (S32 y = 0; y < a->map.height; y++) {
+        for (S32 x = 0; x < a->map.width; x++) {
+            bool a_wall = GetMapTile(&a->map, x, y, MAP_SOLID_LAYER) != 0;
+            bool b_wall = GetMapTile(&b->map, x, y, MAP_SOLID_LAYER) != 0;
+            if (a_wall != b_wall ||
+                items_get_cell(&a->items, x, y) != items_get_cell(&b->items, x, y)) {
                 printf("cell mismatch: %d, %d\n", x, y);
                 print_games(a, b);
                 return false;
@@ -223,8 +237,8 @@ bool snake_segment_constrict_test(const char** input_level,
     game_from_string(output_level, &output_game);
 
     bool result = games_are_equal(&input_game, &output_game);
-    game_destroy(&input_game);
-    game_destroy(&output_game);
+    free_game(&input_game);
+    free_game(&output_game);
     return result;
 }
 
@@ -248,8 +262,8 @@ bool snake_segment_push_by_snake_test(const char** input_level,
     game_from_string(output_level, &output_game);
 
     bool result = games_are_equal(&input_game, &output_game);
-    game_destroy(&input_game);
-    game_destroy(&output_game);
+    free_game(&input_game);
+    free_game(&output_game);
     return result;
 }
 
@@ -260,6 +274,19 @@ bool snake_segment_push_test(const char** input_level,
     return snake_segment_push_by_snake_test(input_level, output_level, segment_index, 0, direction);
 }
 
+// Constricting chomps every segment of the snakes inside once, so make that enough to kill them
+// like the expected levels show.
+void set_other_snakes_to_one_health(Game* game, S32 snake_index) {
+    for (S32 s = 0; s < MAX_SNAKE_COUNT; s++) {
+        if (s == snake_index) {
+            continue;
+        }
+        for (S32 e = 0; e < game->snakes[s].length; e++) {
+            game->snakes[s].segments[e].health = 1;
+        }
+    }
+}
+
 bool snake_constrict_and_update_test(const char** input_level,
                                      const char** output_level,
                                      S32 snake_index,
@@ -270,6 +297,9 @@ bool snake_constrict_and_update_test(const char** input_level,
     Snake* snake = input_game.snakes + snake_index;
     snake->constrict_state = snake_constrict_state;
 
+    input_game.settings.head_invincible = false;
+    set_other_snakes_to_one_health(&input_game, snake_index);
+
     snake_constrict(&input_game, snake_index);
 
     // We update the game because the unittests expect the snake to get killed by it takes 1 tick
@@ -280,10 +310,11 @@ bool snake_constrict_and_update_test(const char** input_level,
 
     Game output_game = {0};
     game_from_string(output_level, &output_game);
+    set_other_snakes_to_one_health(&output_game, snake_index);
 
     bool result = games_are_equal(&input_game, &output_game);
-    game_destroy(&input_game);
-    game_destroy(&output_game);
+    free_game(&input_game);
+    free_game(&output_game);
     return result;
 }
 
@@ -1411,8 +1442,8 @@ int main(int argc, char** argv) {
         game_from_string(input_level, &output_game);
 
         bool result = games_are_equal(&input_game, &output_game);
-        game_destroy(&input_game);
-        game_destroy(&output_game);
+        free_game(&input_game);
+        free_game(&output_game);
         EXPECT(result);
     }
 
@@ -1440,11 +1471,70 @@ int main(int argc, char** argv) {
         game_from_string(input_level, &output_game);
 
         bool result = games_are_equal(&input_game, &output_game);
-        game_destroy(&input_game);
-        game_destroy(&output_game);
+        free_game(&input_game);
+        free_game(&output_game);
         EXPECT(result);
     }
 
+    // Area of interest states replace the tacos the client had, and buffers that are too small or
+    // cut off are rejected.
+    {
+        const char* server_level[] = {
+            "T........T",
+            "....T.....",
+            "...abc..T.",
+            "..........",
+            "T....ABC..",
+            NULL
+        };
+
+        const char* client_level[] = {
+            "T........T",
+            ".T........",
+            "...abc..T.",
+            "..........",
+            "T....ABC.T",
+            NULL
+        };
+
+        Game server_game = {0};
+        game_from_string(server_level, &server_game);
+        // Far updates carry every taco.
+        server_game.tick = INTEREST_FAR_INTERVAL_TICKS;
+
+        Game client_game = {0};
+        game_from_string(client_level, &client_game);
+
+        U8 buffer[1024];
+        U8 small_buffer[1024];
+        size_t size = game_serialize_interest(&server_game, 0, 2, buffer, sizeof(buffer));
+        EXPECT(size > 0);
+        for (size_t s = 0; s < size; s++) {
+            EXPECT(game_serialize_interest(&server_game, 0, 2, small_buffer, s) == 0);
+            EXPECT(game_deserialize_interest(buffer, s, &client_game) == 0);
+        }
+
+        EXPECT(game_deserialize_interest(buffer, size, &client_game) == size);
+        EXPECT(memcmp(client_game.items.cells,
+                      server_game.items.cells,
+                      server_game.items.width * server_game.items.height * sizeof(*server_game.items.cells)) == 0);
+        EXPECT(client_game.items.tacos.point_count == server_game.items.tacos.point_count);
+
+        // A taco count bigger than the level.
+        S32 huge_count = 0x7FFFFFFF;
+        size_t tacos_offset = sizeof(server_game.tick) +
+                              sizeof(server_game.state) +
+                              sizeof(server_game.settings.wait_to_start_ms) +
+                              sizeof(server_game.items.width) +
+                              sizeof(server_game.items.height) +
+                              sizeof(SpatialRect);
+        memcpy(buffer + tacos_offset, &huge_count, sizeof(huge_count));
+        EXPECT(game_deserialize_interest(buffer, size, &client_game) == 0);
+
+        free_game(&server_game);
+        free_game(&client_game);
+    }
+
     if (g_failed) {
         printf("unittests failed\n");
         return 1;
@@ -20,11 +20,15 @@ cl ^
     /DPLATFORM_WINDOWS ^
     /I"..\external\include" ^
     ..\game.c ^
+    ..\zone.c ^
     ..\snake.c ^
-    ..\level.c ^
+    ..\sprite_batch.c ^
     ..\direction.c ^
+    ..\items.c ^
+    ..\spatial.c ^
+    ..\map.c ^
     game_test.c ^
-    "SDL2.lib" "SDL2main.lib" "shell32.lib" "Ws2_32.lib" ^
+    "SDL3.lib" "shell32.lib" ^
     /link ^
     "/OUT:game_test.exe" ^
     "/LIBPATH:..\external\lib" ^
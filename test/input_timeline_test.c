@@ -0,0 +1,65 @@
+#include "../snake.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+bool g_failed = false;
+
+#define EXPECT(condition)                               \
+    if (!(condition)) {                                 \
+        printf("%s:%d:0 failed\n", __FILE__, __LINE__); \
+        g_failed = true;                                \
+    }
+
+int main(void) {
+    InputTimeline timeline;
+
+    // Inputs come out on the tick they were stamped with.
+    input_timeline_reset(&timeline, 100);
+    EXPECT(input_timeline_add(&timeline, 102, SNAKE_ACTION_FACE_NORTH) == INPUT_ARRIVAL_ON_TIME);
+    EXPECT(input_timeline_remove(&timeline) == SNAKE_ACTION_NONE);
+    EXPECT(input_timeline_remove(&timeline) == SNAKE_ACTION_NONE);
+    EXPECT(input_timeline_remove(&timeline) == SNAKE_ACTION_FACE_NORTH);
+    EXPECT(timeline.stats.on_time_count == 1);
+
+    // Late inputs are applied on the next tick, early ones on the last slot.
+    EXPECT(input_timeline_add(&timeline, 90, SNAKE_ACTION_FACE_WEST) == INPUT_ARRIVAL_LATE);
+    EXPECT(input_timeline_add(&timeline, 103 + INPUT_TIMELINE_TICKS, SNAKE_ACTION_FACE_EAST) == INPUT_ARRIVAL_EARLY);
+    EXPECT(input_timeline_remove(&timeline) == SNAKE_ACTION_FACE_WEST);
+    for (S32 i = 1; i < INPUT_TIMELINE_TICKS - 1; i++) {
+        EXPECT(input_timeline_remove(&timeline) == SNAKE_ACTION_NONE);
+    }
+    EXPECT(input_timeline_remove(&timeline) == SNAKE_ACTION_FACE_EAST);
+    EXPECT(timeline.stats.late_count == 1);
+    EXPECT(timeline.stats.early_count == 1);
+
+    // Two actions for one tick and one for the next, the left over action from the first tick runs
+    // before the one queued for the second.
+    input_timeline_reset(&timeline, 0);
+    input_timeline_add(&timeline, 0, SNAKE_ACTION_FACE_NORTH);
+    input_timeline_add(&timeline, 0, SNAKE_ACTION_FACE_EAST);
+    input_timeline_add(&timeline, 1, SNAKE_ACTION_FACE_SOUTH);
+    EXPECT(input_timeline_remove(&timeline) == SNAKE_ACTION_FACE_NORTH);
+    EXPECT(input_timeline_remove(&timeline) == SNAKE_ACTION_FACE_EAST);
+    EXPECT(input_timeline_remove(&timeline) == SNAKE_ACTION_FACE_SOUTH);
+    EXPECT(input_timeline_remove(&timeline) == SNAKE_ACTION_NONE);
+
+    // Both slots full, the carried action still goes first and the newest one falls off the end.
+    input_timeline_reset(&timeline, 0);
+    input_timeline_add(&timeline, 0, SNAKE_ACTION_FACE_NORTH);
+    input_timeline_add(&timeline, 0, SNAKE_ACTION_FACE_EAST);
+    input_timeline_add(&timeline, 1, SNAKE_ACTION_FACE_SOUTH);
+    input_timeline_add(&timeline, 1, SNAKE_ACTION_FACE_WEST);
+    EXPECT(input_timeline_remove(&timeline) == SNAKE_ACTION_FACE_NORTH);
+    EXPECT(input_timeline_remove(&timeline) == SNAKE_ACTION_FACE_EAST);
+    EXPECT(input_timeline_remove(&timeline) == SNAKE_ACTION_FACE_SOUTH);
+    EXPECT(input_timeline_remove(&timeline) == SNAKE_ACTION_NONE);
+
+    if (g_failed) {
+        puts("FAILED");
+        return EXIT_FAILURE;
+    }
+
+    puts("PASSED");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,31 @@
+@echo off
+:: Turn off msft (c) message with /nologo
+:: Turn off C++ runtime type info with /GR-
+:: Turn off exception handling with /EHa-
+:: Enable intrinsics with /Oi
+:: Enable level 4 warnings with /W4
+:: Output debug symbols with /Zi
+:: Define the platform
+:: Include our external libraries
+cl ^
+    /D_AMD64_ ^
+    /nologo ^
+    /GR- ^
+    /EHa- ^
+    /Oi ^
+    /W4 ^
+    /WX ^
+    /Zi ^
+    /D_CRT_SECURE_NO_WARNINGS ^
+    /DPLATFORM_WINDOWS ^
+    /I"..\external\include" ^
+    ..\snake.c ^
+    ..\sprite_batch.c ^
+    ..\spatial.c ^
+    ..\direction.c ^
+    input_timeline_test.c ^
+    "SDL3.lib" ^
+    /link ^
+    "/OUT:input_timeline_test.exe" ^
+    "/LIBPATH:..\external\lib" ^
+    "/SUBSYSTEM:CONSOLE"
@@ -0,0 +1,435 @@
+#include "../game.h"
+#include "../lobby.h"
+#include "../network.h"
+#include "../packet.h"
+#include "../snake.h"
+#include "test_time.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(PLATFORM_WINDOWS)
+    #include <windows.h>
+#else
+    #include <unistd.h>
+#endif
+
+// Connects a crowd of headless clients to a running server, readies them up and plays, recording
+// when each game state arrives. Start the server with -a <count> so games start and restart on
+// their own, e.g.
+//   ./taco-quest -s 1234 -a 3
+//   ./load_test 127.0.0.1 1234 -n 3 -d 60
+
+#define MAX_LOAD_CLIENTS 64
+#define DEFAULT_TICK_MS 175
+#define JITTER_SMOOTHING 16
+
+typedef enum {
+    ACTION_MODE_RANDOM,
+    ACTION_MODE_CIRCLE, // Turn clockwise every few ticks, the same script for every client.
+} ActionMode;
+
+typedef struct {
+    S64 offset_us; // Arrival time minus the tick's time on the server clock.
+    S32 game;
+} LatencySample;
+
+typedef struct {
+    NetSocket* socket;
+    PacketSendQueue send_queue;
+    PacketTransmissionState receive_state;
+    AppStateLobby lobby_state;
+    U16 sequence;
+    bool sent_ready;
+    bool in_game;
+    bool has_tick;
+    U32 last_tick;
+    U64 last_arrival_us;
+    double jitter_us; // Smoothed variation in state inter-arrival times, like RFC 3550.
+    U32 state_count;
+    U32 action_count;
+    U64 received_bytes;
+} LoadClient;
+
+static LatencySample* samples;
+static S32 sample_count;
+static S32 sample_capacity;
+
+// Smallest offset seen per game. Ticks restart each game, so so does the baseline.
+static S64* game_min_offset_us;
+static S32 game_count;
+
+static void sleep_ms(S32 ms) {
+#if defined(PLATFORM_WINDOWS)
+    Sleep(ms);
+#else
+    usleep(ms * 1000);
+#endif
+}
+
+static bool record_sample(S64 offset_us, S32 game) {
+    if (sample_count == sample_capacity) {
+        S32 capacity = sample_capacity ? sample_capacity * 2 : 1024;
+        LatencySample* new_samples = realloc(samples, capacity * sizeof(*samples));
+        if (new_samples == NULL) {
+            return false;
+        }
+        samples = new_samples;
+        sample_capacity = capacity;
+    }
+
+    samples[sample_count++] = (LatencySample){ .offset_us = offset_us, .game = game };
+
+    if (game >= game_count) {
+        S64* new_mins = realloc(game_min_offset_us, (game + 1) * sizeof(*game_min_offset_us));
+        if (new_mins == NULL) {
+            return false;
+        }
+        game_min_offset_us = new_mins;
+        while (game_count <= game) {
+            game_min_offset_us[game_count++] = offset_us;
+        }
+    }
+
+    if (offset_us < game_min_offset_us[game]) {
+        game_min_offset_us[game] = offset_us;
+    }
+    return true;
+}
+
+static int compare_s64(const void* a, const void* b) {
+    S64 left = *(const S64*)a;
+    S64 right = *(const S64*)b;
+    return (left > right) - (left < right);
+}
+
+static void queue_packet(LoadClient* client, PacketType type, void* payload, U32 size) {
+    Packet packet = {
+        .header = {
+            .type = type,
+            .sequence = client->sequence++
+        },
+        .size = size,
+        .payload = payload
+    };
+    packet_send_queue_push(&client->send_queue, &packet, false);
+}
+
+static SnakeAction pick_action(ActionMode mode, S32 client_index, U32 tick) {
+    switch (mode) {
+    case ACTION_MODE_CIRCLE: {
+        static const SnakeAction turns[] = {
+            SNAKE_ACTION_FACE_NORTH,
+            SNAKE_ACTION_FACE_EAST,
+            SNAKE_ACTION_FACE_SOUTH,
+            SNAKE_ACTION_FACE_WEST
+        };
+        return turns[((tick / 4) + client_index) % 4];
+    }
+    case ACTION_MODE_RANDOM:
+    default: {
+        SnakeAction action = (SnakeAction)(1 << (rand() % DIRECTION_COUNT));
+        if (rand() % 8 == 0) {
+            action |= SNAKE_ACTION_CHOMP;
+        }
+        return action;
+    }
+    }
+}
+
+#if defined(PLATFORM_LINUX)
+// Returns the user plus system CPU time of another process in seconds, or -1.
+static double process_cpu_seconds(int pid) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        return -1.0;
+    }
+
+    unsigned long user_ticks = 0;
+    unsigned long system_ticks = 0;
+    int matched = fscanf(file,
+                         "%*d %*s %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+                         &user_ticks,
+                         &system_ticks);
+    fclose(file);
+
+    if (matched != 2) {
+        return -1.0;
+    }
+    return (double)(user_ticks + system_ticks) / sysconf(_SC_CLK_TCK);
+}
+#endif
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        printf("usage: %s <ip> <port> [-n clients] [-d seconds] [-t default tick_ms] [-m random|circle] "
+               "[-r actions per tick] [-p server pid]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const char* ip = argv[1];
+    const char* port = argv[2];
+    S32 client_count = 3;
+    S32 duration_s = 60;
+    S32 tick_ms = DEFAULT_TICK_MS;
+    ActionMode action_mode = ACTION_MODE_RANDOM;
+    double actions_per_tick = 0.5;
+    int server_pid = 0;
+
+    for (S32 i = 3; i < argc; i++) {
+        if (i + 1 >= argc) {
+            printf("Expected a value after %s\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+
+        if (strcmp(argv[i], "-n") == 0) {
+            client_count = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-d") == 0) {
+            duration_s = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-t") == 0) {
+            tick_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-m") == 0) {
+            i++;
+            action_mode = strcmp(argv[i], "circle") == 0 ? ACTION_MODE_CIRCLE : ACTION_MODE_RANDOM;
+        } else if (strcmp(argv[i], "-r") == 0) {
+            actions_per_tick = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-p") == 0) {
+            server_pid = atoi(argv[++i]);
+        } else {
+            printf("Unexpected argument %s\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (client_count < 1 || client_count > MAX_LOAD_CLIENTS || tick_ms <= 0) {
+        printf("Expected 1 to %d clients and a positive tick\n", MAX_LOAD_CLIENTS);
+        return EXIT_FAILURE;
+    }
+
+    if (!net_init(NULL, NULL)) {
+        fprintf(stderr, "%s\n", net_get_error());
+        return EXIT_FAILURE;
+    }
+
+    srand(1234);
+
+    static LoadClient clients[MAX_LOAD_CLIENTS];
+    for (S32 i = 0; i < client_count; i++) {
+        clients[i].socket = net_create_client(ip, port);
+        if (clients[i].socket == NULL) {
+            fprintf(stderr, "client %d: %s", i, net_get_error());
+            return EXIT_FAILURE;
+        }
+
+        char name[MAX_LOBBY_PLAYER_NAME_LEN];
+        S32 name_length = snprintf(name, sizeof(name), "load_%d", i);
+        queue_packet(clients + i, PACKET_TYPE_CLIENT_NAME, name, (U32)(name_length));
+    }
+
+#if defined(PLATFORM_LINUX)
+    double server_cpu_start_s = server_pid > 0 ? process_cpu_seconds(server_pid) : -1.0;
+#else
+    (void)server_pid;
+#endif
+
+    struct timespec start = {0};
+    timespec_get(&start, TIME_UTC);
+
+    S64 tick_us = (S64)tick_ms * 1000;
+    S32 current_game = 0;
+    U64 sent_bytes = 0;
+    U64 elapsed_us = 0;
+
+    while (elapsed_us < (U64)duration_s * 1000000) {
+        struct timespec now = {0};
+        timespec_get(&now, TIME_UTC);
+        elapsed_us = microseconds_between_timestamps(&start, &now);
+
+        for (S32 i = 0; i < client_count; i++) {
+            LoadClient* client = clients + i;
+            if (client->socket == NULL) {
+                continue;
+            }
+
+            while (true) {
+                Packet packet = {0};
+                packet_receive(client->socket, &packet, &client->receive_state);
+
+                if (client->receive_state.stage == PACKET_PROGRESS_STAGE_ERROR) {
+                    fprintf(stderr, "client %d disconnected: %s", i, net_get_error());
+                    net_destroy_socket(client->socket);
+                    client->socket = NULL;
+                    break;
+                }
+
+                if (client->receive_state.stage != PACKET_PROGRESS_STAGE_COMPLETE) {
+                    break;
+                }
+
+                client->received_bytes += packet.size;
+
+                if (packet.header.type == PACKET_TYPE_LOBBY_STATE) {
+                    GameSettings settings = {0};
+                    lobby_state_deserialize(packet.payload, packet.size, &client->lobby_state, &settings);
+                    if (settings.tick_ms > 0) {
+                        tick_us = (S64)settings.tick_ms * 1000;
+                    }
+
+                    if (!client->sent_ready) {
+                        LobbyAction action = LOBBY_ACTION_TOGGLE_READY;
+                        queue_packet(client, PACKET_TYPE_LOBBY_ACTION, &action, sizeof(action));
+                        client->sent_ready = true;
+                    }
+                    client->in_game = false;
+                } else if ((packet.header.type == PACKET_TYPE_LEVEL_STATE ||
+                            packet.header.type == PACKET_TYPE_INTEREST_STATE) &&
+                           packet.size >= sizeof(U32) + sizeof(GameState)) {
+                    // game_serialize() and game_serialize_interest() lead with the tick and game
+                    // state.
+                    U32 tick = 0;
+                    GameState game_state = GAME_STATE_WAITING;
+                    memcpy(&tick, packet.payload, sizeof(tick));
+                    memcpy(&game_state, packet.payload + sizeof(tick), sizeof(game_state));
+
+                    // Ready up again once the game is over and we're back in the lobby.
+                    client->sent_ready = false;
+
+                    if (!client->in_game || (client->has_tick && tick < client->last_tick)) {
+                        // Every client sees the new game around the same time, use the first
+                        // one to start a new latency baseline.
+                        if (client->has_tick && i == 0) {
+                            current_game++;
+                        }
+                        client->has_tick = false;
+                    }
+                    client->in_game = true;
+
+                    // The server sends the same tick repeatedly while waiting to start, only time
+                    // the first arrival of each new tick.
+                    if (game_state == GAME_STATE_PLAYING && (!client->has_tick || tick > client->last_tick)) {
+                        S64 arrival_us = (S64)(elapsed_us);
+                        record_sample(arrival_us - (S64)tick * tick_us, current_game);
+
+                        if (client->has_tick) {
+                            S64 transit_change_us = (arrival_us - (S64)client->last_arrival_us) -
+                                                    (S64)(tick - client->last_tick) * tick_us;
+                            if (transit_change_us < 0) {
+                                transit_change_us = -transit_change_us;
+                            }
+                            client->jitter_us += ((double)transit_change_us - client->jitter_us) / JITTER_SMOOTHING;
+                        }
+
+                        client->has_tick = true;
+                        client->last_tick = tick;
+                        client->last_arrival_us = (U64)(arrival_us);
+                        client->state_count++;
+
+                        if ((double)rand() / RAND_MAX < actions_per_tick) {
+                            TickedSnakeAction ticked_action = {
+                                .tick = tick + 1,
+                                .action = pick_action(action_mode, i, tick)
+                            };
+                            U8 buffer[sizeof(TickedSnakeAction)];
+                            size_t size = ticked_snake_action_serialize(&ticked_action, buffer, sizeof(buffer));
+                            queue_packet(client, PACKET_TYPE_SNAKE_ACTION, buffer, (U32)(size));
+                            client->action_count++;
+                        }
+                    }
+                }
+
+                packet_transmission_state_reset(&client->receive_state);
+            }
+
+            if (client->socket != NULL) {
+                size_t queued_bytes = client->send_queue.queued_bytes;
+                if (!packet_send_queue_flush(&client->send_queue, client->socket)) {
+                    fprintf(stderr, "client %d: %s", i, net_get_error());
+                    net_destroy_socket(client->socket);
+                    client->socket = NULL;
+                } else {
+                    sent_bytes += queued_bytes - client->send_queue.queued_bytes;
+                }
+            }
+        }
+
+        sleep_ms(1);
+    }
+
+    // Latency relative to the quickest state to arrive in each game, so it shows the spread from
+    // the network and server rather than the unknown offset between our clock and the server's.
+    S64* latencies = malloc((sample_count > 0 ? sample_count : 1) * sizeof(*latencies));
+    if (latencies == NULL) {
+        fprintf(stderr, "malloc failed\n");
+        return EXIT_FAILURE;
+    }
+    for (S32 s = 0; s < sample_count; s++) {
+        latencies[s] = samples[s].offset_us - game_min_offset_us[samples[s].game];
+    }
+    qsort(latencies, sample_count, sizeof(*latencies), compare_s64);
+
+    double elapsed_s = elapsed_us / 1000000.0;
+    U64 received_bytes = 0;
+    S32 silent_count = 0;
+
+    printf("\n%d clients for %.1f s, %d games\n", client_count, elapsed_s, sample_count > 0 ? current_game + 1 : 0);
+    for (S32 i = 0; i < client_count; i++) {
+        LoadClient* client = clients + i;
+        received_bytes += client->received_bytes;
+        if (client->received_bytes == 0) {
+            silent_count++;
+        }
+        printf("client %2d: %6u states, %6u actions, %8.1f KB/s in, jitter %6.2f ms%s\n",
+               i,
+               client->state_count,
+               client->action_count,
+               client->received_bytes / 1024.0 / elapsed_s,
+               client->jitter_us / 1000.0,
+               client->socket == NULL ? " (disconnected)" : "");
+    }
+
+    if (silent_count > 0) {
+        printf("%d clients never heard from the server, it may be full\n", silent_count);
+    }
+
+    if (sample_count > 0) {
+        printf("state latency over %d states: p50 %.2f ms, p99 %.2f ms, p999 %.2f ms, max %.2f ms\n",
+               sample_count,
+               latencies[sample_count / 2] / 1000.0,
+               latencies[(S32)((sample_count - 1) * 0.99)] / 1000.0,
+               latencies[(S32)((sample_count - 1) * 0.999)] / 1000.0,
+               latencies[sample_count - 1] / 1000.0);
+    } else {
+        printf("no game states received\n");
+    }
+
+    printf("throughput: %.1f KB/s received, %.1f KB/s sent\n",
+           received_bytes / 1024.0 / elapsed_s,
+           sent_bytes / 1024.0 / elapsed_s);
+
+#if defined(PLATFORM_LINUX)
+    if (server_cpu_start_s >= 0.0) {
+        double server_cpu_s = process_cpu_seconds(server_pid) - server_cpu_start_s;
+        printf("server cpu: %.2f s (%.1f%% of a core)\n", server_cpu_s, 100.0 * server_cpu_s / elapsed_s);
+    }
+#else
+    printf("server cpu: see the time the server prints at each game over\n");
+#endif
+
+    for (S32 i = 0; i < client_count; i++) {
+        if (clients[i].socket != NULL) {
+            net_destroy_socket(clients[i].socket);
+        }
+        packet_send_queue_destroy(&clients[i].send_queue);
+        packet_transmission_state_destroy(&clients[i].receive_state);
+        list_dir_destroy(&clients[i].lobby_state.map_list);
+    }
+    free(latencies);
+    free(samples);
+    free(game_min_offset_us);
+    net_shutdown();
+    return EXIT_SUCCESS;
+}
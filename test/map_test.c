@@ -0,0 +1,94 @@
+#include "../map.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAP_PATH "map_test.temap"
+#define MAP_WIDTH 64
+#define MAP_HEIGHT 48
+
+bool g_failed = false;
+
+#define EXPECT(condition)                               \
+    if (!(condition)) {                                 \
+        printf("%s:%d:0 failed\n", __FILE__, __LINE__); \
+        g_failed = true;                                \
+    }
+
+// Loads data with the size of one layer changed in its info table, as if it had been cut short.
+static bool load_with_layer_size(const Uint8* data, size_t size, int layer, Uint32 layer_size) {
+    Uint8* copy = malloc(size);
+    memcpy(copy, data, size);
+
+    LayerInfo info;
+    Uint8* info_ptr = copy + sizeof(MapHeader) + layer * sizeof(LayerInfo);
+    memcpy(&info, info_ptr, sizeof(info));
+    info.size = layer_size;
+    memcpy(info_ptr, &info, sizeof(info));
+
+    Map map = {0};
+    bool result = LoadMapFromMemory(&map, copy, size);
+    FreeMap(&map);
+    free(copy);
+    return result;
+}
+
+int main(void) {
+    // A layer with no runs to compress and one that is a single run.
+    Map map = {
+        .width = MAP_WIDTH,
+        .height = MAP_HEIGHT,
+        .num_layers = 2,
+    };
+    map.tiles[0] = malloc(MAP_WIDTH * MAP_HEIGHT * sizeof(GID));
+    map.tiles[1] = calloc(MAP_WIDTH * MAP_HEIGHT, sizeof(GID));
+    for (int i = 0; i < MAP_WIDTH * MAP_HEIGHT; i++) {
+        map.tiles[0][i] = (GID)((i * 7) % 13 + 1);
+    }
+
+    EXPECT(SaveMap(&map, MAP_PATH));
+
+    size_t size = 0;
+    Uint8* data = ReadMapFile(MAP_PATH, &size);
+    EXPECT(data != NULL);
+    if (data == NULL) {
+        puts("FAILED");
+        return EXIT_FAILURE;
+    }
+
+    // The whole file loads back as it was saved.
+    Map loaded = {0};
+    EXPECT(LoadMapFromMemory(&loaded, data, size));
+    EXPECT(loaded.width == MAP_WIDTH && loaded.height == MAP_HEIGHT && loaded.num_layers == 2);
+    if (loaded.num_layers == 2) {
+        EXPECT(memcmp(loaded.tiles[0], map.tiles[0], MAP_WIDTH * MAP_HEIGHT * sizeof(GID)) == 0);
+        EXPECT(memcmp(loaded.tiles[1], map.tiles[1], MAP_WIDTH * MAP_HEIGHT * sizeof(GID)) == 0);
+    }
+    FreeMap(&loaded);
+
+    LayerInfo info[2];
+    memcpy(info, data + sizeof(MapHeader), sizeof(info));
+
+    // Layers that decompress to fewer tiles than the map has are rejected.
+    EXPECT(!load_with_layer_size(data, size, 0, info[0].size - sizeof(GID)));
+    EXPECT(!load_with_layer_size(data, size, 0, info[0].size / 2));
+    EXPECT(!load_with_layer_size(data, size, 0, sizeof(Uint64)));
+    EXPECT(!load_with_layer_size(data, size, 1, info[1].size - 2 * sizeof(GID)));
+
+    // So is a file cut off part way through the last layer.
+    EXPECT(!LoadMapFromMemory(&loaded, data, size - sizeof(GID)));
+    FreeMap(&loaded);
+
+    free(data);
+    FreeMap(&map);
+    remove(MAP_PATH);
+
+    if (g_failed) {
+        puts("FAILED");
+        return EXIT_FAILURE;
+    }
+
+    puts("PASSED");
+    return EXIT_SUCCESS;
+}
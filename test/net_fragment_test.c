@@ -0,0 +1,234 @@
+#include "../network.h"
+#include "../packet.h"
+#include "test_time.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define TEST_PORT "27615"
+#define MAX_SEND_CHUNK_SIZE (32 * 1024)
+
+static U8 payload_byte(U32 message_index, U32 offset) {
+    return (U8)((offset * 31) + (offset >> 11) + message_index * 7);
+}
+
+int main(void) {
+    // Sizes either side of the single packet limit, an exact number of fragment chunks, and a few
+    // multi-megabyte states.
+    U32 message_sizes[] = {
+        0,
+        1,
+        1000,
+        PACKET_MAX_PAYLOAD_SIZE,
+        PACKET_MAX_PAYLOAD_SIZE + 1,
+        PACKET_FRAGMENT_CHUNK_SIZE * 4,
+        3 * 1024 * 1024,
+        8 * 1024 * 1024 + 7,
+        2 * 1024 * 1024,
+        8 * 1024 * 1024 + 7,
+    };
+    S32 message_count = sizeof(message_sizes) / sizeof(message_sizes[0]);
+
+    if (!net_init("net_fragment_test.log", NULL)) {
+        fprintf(stderr, "%s\n", net_get_error());
+        return EXIT_FAILURE;
+    }
+
+    NetSocket* server_socket = net_create_server(TEST_PORT);
+    if (server_socket == NULL) {
+        fprintf(stderr, "%s\n", net_get_error());
+        return EXIT_FAILURE;
+    }
+
+    NetSocket* client_socket = net_create_client("127.0.0.1", TEST_PORT);
+    if (client_socket == NULL) {
+        fprintf(stderr, "%s\n", net_get_error());
+        return EXIT_FAILURE;
+    }
+
+    NetSocket* server_client_socket = NULL;
+    while (server_client_socket == NULL) {
+        if (!net_accept(server_socket, &server_client_socket)) {
+            fprintf(stderr, "%s\n", net_get_error());
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Write every message back to back into one stream, the way the server sends states.
+    size_t wire_size = 0;
+    for (S32 m = 0; m < message_count; m++) {
+        wire_size += packet_wire_size(message_sizes[m]);
+    }
+
+    U8* wire = malloc(wire_size);
+    U8* payload = malloc(9 * 1024 * 1024);
+    if (wire == NULL || payload == NULL) {
+        fprintf(stderr, "malloc failed\n");
+        return EXIT_FAILURE;
+    }
+
+    size_t wire_offset = 0;
+    for (S32 m = 0; m < message_count; m++) {
+        for (U32 b = 0; b < message_sizes[m]; b++) {
+            payload[b] = payload_byte(m, b);
+        }
+
+        Packet packet = {
+            .header = {
+                .type = PACKET_TYPE_LEVEL_STATE,
+                .sequence = (U16)(m)
+            },
+            .size = message_sizes[m],
+            .payload = payload
+        };
+
+        size_t written = packet_write(&packet, wire + wire_offset, wire_size - wire_offset);
+        if (written != packet_wire_size(message_sizes[m])) {
+            fprintf(stderr, "message %d: wrote %zu bytes, expected %zu\n",
+                    m, written, packet_wire_size(message_sizes[m]));
+            return EXIT_FAILURE;
+        }
+        wire_offset += written;
+    }
+
+    // Interleave sending random sized pieces of the stream with receiving, so headers and chunks
+    // arrive split at arbitrary points.
+    srand(1234);
+
+    struct timespec start = {0};
+    timespec_get(&start, TIME_UTC);
+
+    Packet packet = {0};
+    PacketTransmissionState state = {0};
+    size_t total_sent = 0;
+    S32 received_count = 0;
+    U8* largest_buffer = NULL;
+    bool failed = false;
+
+    while (received_count < message_count && !failed) {
+        if (total_sent < wire_size) {
+            size_t chunk_size = (size_t)(rand() % MAX_SEND_CHUNK_SIZE) + 1;
+            if (chunk_size > wire_size - total_sent) {
+                chunk_size = wire_size - total_sent;
+            }
+
+            int bytes_sent = net_send(server_client_socket, wire + total_sent, (int)chunk_size);
+            if (bytes_sent == -1) {
+                fprintf(stderr, "%s\n", net_get_error());
+                return EXIT_FAILURE;
+            }
+            total_sent += bytes_sent;
+        }
+
+        packet_receive(client_socket, &packet, &state);
+
+        if (state.stage == PACKET_PROGRESS_STAGE_ERROR) {
+            fprintf(stderr, "message %d: receive error\n", received_count);
+            failed = true;
+        } else if (state.stage == PACKET_PROGRESS_STAGE_COMPLETE) {
+            S32 m = received_count;
+
+            if (packet.header.type != PACKET_TYPE_LEVEL_STATE ||
+                packet.header.sequence != (U16)(m) ||
+                packet.size != message_sizes[m]) {
+                fprintf(stderr, "message %d: got type %d seq %d size %u, expected size %u\n",
+                        m, packet.header.type, packet.header.sequence, packet.size, message_sizes[m]);
+                failed = true;
+            }
+
+            for (U32 b = 0; b < packet.size && !failed; b++) {
+                if (packet.payload[b] != payload_byte(m, b)) {
+                    fprintf(stderr, "message %d: mismatch at byte %u\n", m, b);
+                    failed = true;
+                }
+            }
+
+            // Once the buffer has grown to fit the largest message it should be reused.
+            if (message_sizes[m] == 8 * 1024 * 1024 + 7) {
+                if (largest_buffer != NULL && largest_buffer != packet.payload) {
+                    fprintf(stderr, "message %d: receive buffer was reallocated\n", m);
+                    failed = true;
+                }
+                largest_buffer = packet.payload;
+            }
+
+            printf("message %d: %u bytes ok\n", m, packet.size);
+            received_count++;
+            packet_transmission_state_reset(&state);
+            memset(&packet, 0, sizeof(packet));
+        }
+    }
+
+    struct timespec end = {0};
+    timespec_get(&end, TIME_UTC);
+    uint64_t elapsed_us = microseconds_between_timestamps(&start, &end);
+    if (elapsed_us > 0) {
+        printf("%zu wire bytes in %.1f ms (%.1f MB/s)\n",
+               wire_size,
+               elapsed_us / 1000.0,
+               (wire_size / (1024.0 * 1024.0)) / (elapsed_us / 1000000.0));
+    }
+
+    // A fragment claiming a message over the limit is an error rather than a huge allocation.
+    if (!failed) {
+        Packet packet = {
+            .header = { .type = PACKET_TYPE_LEVEL_STATE },
+            .size = PACKET_MAX_PAYLOAD_SIZE + 1,
+            .payload = payload
+        };
+        size_t written = packet_write(&packet, wire, wire_size);
+
+        // total_size follows the message id in the first fragment header.
+        U32 bad_total_size = 0xFFFFFFF0;
+        memcpy(wire + sizeof(PacketHeader) + sizeof(U32), &bad_total_size, sizeof(bad_total_size));
+
+        PacketTransmissionState bad_state = {0};
+        size_t bad_sent = 0;
+        while (bad_state.stage != PACKET_PROGRESS_STAGE_ERROR &&
+               bad_state.stage != PACKET_PROGRESS_STAGE_COMPLETE) {
+            if (bad_sent < written) {
+                int bytes_sent = net_send(server_client_socket, wire + bad_sent, (int)(written - bad_sent));
+                if (bytes_sent == -1) {
+                    fprintf(stderr, "%s\n", net_get_error());
+                    return EXIT_FAILURE;
+                }
+                bad_sent += bytes_sent;
+            }
+            packet_receive(client_socket, &packet, &bad_state);
+        }
+
+        if (bad_state.stage != PACKET_PROGRESS_STAGE_ERROR ||
+            bad_state.buffer_capacity > PACKET_MAX_MESSAGE_SIZE) {
+            fprintf(stderr, "oversized message: expected a receive error\n");
+            failed = true;
+        } else {
+            printf("oversized message rejected ok\n");
+        }
+        packet_transmission_state_destroy(&bad_state);
+
+        // Nothing over the limit gets written in the first place.
+        packet.size = PACKET_MAX_MESSAGE_SIZE + 1;
+        if (packet_write(&packet, wire, wire_size) != 0) {
+            fprintf(stderr, "oversized message: packet_write should refuse it\n");
+            failed = true;
+        }
+    }
+
+    packet_transmission_state_destroy(&state);
+    free(wire);
+    free(payload);
+    net_destroy_socket(server_client_socket);
+    net_destroy_socket(client_socket);
+    net_destroy_socket(server_socket);
+    net_shutdown();
+
+    if (failed) {
+        puts("FAILED");
+        return EXIT_FAILURE;
+    }
+
+    puts("PASSED");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,296 @@
+#include "../plat_memory/network_memory.h"
+#include "../packet.h"
+#include "test_time.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define TEST_PORT "27616"
+#define CLIENT_COUNT 4
+#define FRAME_US 4000
+#define TICK_US 50000
+#define SIMULATED_US (10ULL * 60 * 1000000) // Ten minutes of play.
+#define DRAIN_US (15ULL * 1000000)
+#define MAX_STATE_SIZE (200 * 1024)
+
+// Mostly small states with the odd one big enough to be fragmented.
+static U32 state_size(U16 sequence) {
+    if (sequence % 97 == 0) {
+        return MAX_STATE_SIZE - sequence % 1000;
+    }
+    return 200 + (sequence * 37) % 3000;
+}
+
+static U8 payload_byte(U16 sequence, U32 offset) {
+    return (U8)((offset * 31) + (offset >> 11) + sequence * 7);
+}
+
+typedef struct {
+    NetSocket* socket;
+    PacketSendQueue send_queue;
+    PacketTransmissionState receive_state;
+    S32 last_sequence;
+    U32 received_count;
+    U64 received_bytes;
+    U16 action_sequence;
+} TestClient;
+
+typedef struct {
+    NetSocket* socket;
+    PacketSendQueue send_queue;
+    PacketTransmissionState receive_state;
+    S32 last_action_sequence;
+    U32 action_count;
+} TestServerClient;
+
+// Receives every complete packet, the way the game's loops do each frame. Returns false on failure.
+static bool receive_states(TestClient* client, S32 index) {
+    while (true) {
+        Packet packet = {0};
+        packet_receive(client->socket, &packet, &client->receive_state);
+
+        if (client->receive_state.stage == PACKET_PROGRESS_STAGE_ERROR) {
+            fprintf(stderr, "client %d: %s", index, net_get_error());
+            return false;
+        }
+
+        if (client->receive_state.stage != PACKET_PROGRESS_STAGE_COMPLETE) {
+            return true;
+        }
+
+        U16 sequence = packet.header.sequence;
+        if ((S32)(sequence) <= client->last_sequence) {
+            fprintf(stderr, "client %d: state %d arrived after %d\n", index, sequence, client->last_sequence);
+            return false;
+        }
+
+        if (packet.header.type != PACKET_TYPE_LEVEL_STATE || packet.size != state_size(sequence)) {
+            fprintf(stderr, "client %d: state %d has type %d size %u\n", index, sequence, packet.header.type, packet.size);
+            return false;
+        }
+
+        for (U32 b = 0; b < packet.size; b++) {
+            if (packet.payload[b] != payload_byte(sequence, b)) {
+                fprintf(stderr, "client %d: state %d mismatch at byte %u\n", index, sequence, b);
+                return false;
+            }
+        }
+
+        client->last_sequence = sequence;
+        client->received_count++;
+        client->received_bytes += packet.size;
+        packet_transmission_state_reset(&client->receive_state);
+    }
+}
+
+static bool receive_actions(TestServerClient* server_client, S32 index) {
+    while (true) {
+        Packet packet = {0};
+        packet_receive(server_client->socket, &packet, &server_client->receive_state);
+
+        if (server_client->receive_state.stage == PACKET_PROGRESS_STAGE_ERROR) {
+            fprintf(stderr, "server client %d: %s", index, net_get_error());
+            return false;
+        }
+
+        if (server_client->receive_state.stage != PACKET_PROGRESS_STAGE_COMPLETE) {
+            return true;
+        }
+
+        // Actions are never dropped, so every one should arrive in order.
+        if (packet.header.type != PACKET_TYPE_SNAKE_ACTION ||
+            packet.header.sequence != server_client->last_action_sequence + 1 ||
+            packet.size != 1 ||
+            packet.payload[0] != (U8)(packet.header.sequence)) {
+            fprintf(stderr, "server client %d: bad action %d after %d\n",
+                    index, packet.header.sequence, server_client->last_action_sequence);
+            return false;
+        }
+
+        server_client->last_action_sequence = packet.header.sequence;
+        server_client->action_count++;
+        packet_transmission_state_reset(&server_client->receive_state);
+    }
+}
+
+int main(void) {
+    if (!net_init(NULL, NULL)) {
+        fprintf(stderr, "%s\n", net_get_error());
+        return EXIT_FAILURE;
+    }
+
+    net_memory_seed(1234);
+
+    NetSocket* server_socket = net_create_server(TEST_PORT);
+    if (server_socket == NULL) {
+        fprintf(stderr, "%s\n", net_get_error());
+        return EXIT_FAILURE;
+    }
+
+    // A spread of connections, the last one too slow to keep up with the big states.
+    NetMemoryLinkSettings links[CLIENT_COUNT] = {
+        { .latency_us = 1000 },
+        { .latency_us = 40000, .jitter_us = 15000, .bytes_per_second = 4 * 1024 * 1024, .max_receive_size = 1400 },
+        { .latency_us = 120000, .jitter_us = 60000, .bytes_per_second = 1024 * 1024, .max_send_size = 4096 },
+        { .latency_us = 80000, .jitter_us = 20000, .bytes_per_second = 48 * 1024, .max_receive_size = 512 },
+    };
+
+    TestClient clients[CLIENT_COUNT] = {0};
+    TestServerClient server_clients[CLIENT_COUNT] = {0};
+
+    for (S32 i = 0; i < CLIENT_COUNT; i++) {
+        net_memory_set_link_settings(&links[i]);
+        clients[i].socket = net_create_client("127.0.0.1", TEST_PORT);
+        if (clients[i].socket == NULL || !net_accept(server_socket, &server_clients[i].socket) ||
+            server_clients[i].socket == NULL) {
+            fprintf(stderr, "client %d failed to connect: %s\n", i, net_get_error());
+            return EXIT_FAILURE;
+        }
+        clients[i].last_sequence = -1;
+        server_clients[i].last_action_sequence = -1;
+    }
+
+    U8* payload = malloc(MAX_STATE_SIZE);
+    if (payload == NULL) {
+        fprintf(stderr, "malloc failed\n");
+        return EXIT_FAILURE;
+    }
+
+    struct timespec start = {0};
+    timespec_get(&start, TIME_UTC);
+
+    U16 server_sequence = 0;
+    U32 sent_count = 0;
+    U64 time_since_tick_us = 0;
+    bool failed = false;
+
+    while (!failed && net_memory_time_us() < SIMULATED_US + DRAIN_US) {
+        net_memory_advance_time(FRAME_US);
+        time_since_tick_us += FRAME_US;
+
+        bool should_tick = time_since_tick_us >= TICK_US && net_memory_time_us() < SIMULATED_US;
+        if (should_tick) {
+            time_since_tick_us -= TICK_US;
+        }
+
+        // Server: read actions, then send every client the new state.
+        for (S32 i = 0; i < CLIENT_COUNT && !failed; i++) {
+            failed = !receive_actions(&server_clients[i], i);
+        }
+
+        if (should_tick) {
+            U16 sequence = server_sequence++;
+            Packet packet = {
+                .header = {
+                    .type = PACKET_TYPE_LEVEL_STATE,
+                    .sequence = sequence
+                },
+                .size = state_size(sequence),
+                .payload = payload
+            };
+            for (U32 b = 0; b < packet.size; b++) {
+                payload[b] = payload_byte(sequence, b);
+            }
+
+            // Written once and shared by every client, like the server's broadcast.
+            PacketBuffer* buffer = packet_buffer_create(&packet);
+            if (buffer == NULL) {
+                failed = true;
+                break;
+            }
+            for (S32 i = 0; i < CLIENT_COUNT; i++) {
+                packet_send_queue_push_buffer(&server_clients[i].send_queue, buffer, true);
+            }
+            packet_buffer_release(buffer);
+            sent_count++;
+        }
+
+        for (S32 i = 0; i < CLIENT_COUNT && !failed; i++) {
+            if (!packet_send_queue_flush(&server_clients[i].send_queue, server_clients[i].socket)) {
+                fprintf(stderr, "server client %d: %s", i, net_get_error());
+                failed = true;
+            }
+        }
+
+        // Clients: read states, then send an action each tick.
+        for (S32 i = 0; i < CLIENT_COUNT && !failed; i++) {
+            failed = !receive_states(&clients[i], i);
+
+            if (should_tick) {
+                U8 action = (U8)(clients[i].action_sequence);
+                Packet packet = {
+                    .header = {
+                        .type = PACKET_TYPE_SNAKE_ACTION,
+                        .sequence = clients[i].action_sequence++
+                    },
+                    .size = 1,
+                    .payload = &action
+                };
+                packet_send_queue_push(&clients[i].send_queue, &packet, false);
+            }
+
+            if (!failed && !packet_send_queue_flush(&clients[i].send_queue, clients[i].socket)) {
+                fprintf(stderr, "client %d: %s", i, net_get_error());
+                failed = true;
+            }
+        }
+    }
+
+    struct timespec end = {0};
+    timespec_get(&end, TIME_UTC);
+    uint64_t elapsed_us = microseconds_between_timestamps(&start, &end);
+
+    U64 total_bytes = 0;
+    for (S32 i = 0; i < CLIENT_COUNT; i++) {
+        TestClient* client = clients + i;
+        TestServerClient* server_client = server_clients + i;
+        total_bytes += client->received_bytes;
+
+        printf("client %d: %u of %u states received, %u dropped, %u actions\n",
+               i, client->received_count, sent_count, server_client->send_queue.dropped_count,
+               server_client->action_count);
+
+        // Once drained, every state was either delivered or knowingly dropped.
+        if (client->received_count + server_client->send_queue.dropped_count != sent_count ||
+            server_client->send_queue.count != 0) {
+            fprintf(stderr, "client %d: states went missing\n", i);
+            failed = true;
+        }
+
+        if (server_client->action_count != client->action_sequence) {
+            fprintf(stderr, "client %d: sent %d actions\n", i, client->action_sequence);
+            failed = true;
+        }
+    }
+
+    if (elapsed_us > 0) {
+        printf("%.0f s simulated in %.1f ms (%.0fx real time), %.1f MB delivered (%.1f MB/s)\n",
+               net_memory_time_us() / 1000000.0,
+               elapsed_us / 1000.0,
+               (double)net_memory_time_us() / elapsed_us,
+               total_bytes / (1024.0 * 1024.0),
+               (total_bytes / (1024.0 * 1024.0)) / (elapsed_us / 1000000.0));
+    }
+
+    for (S32 i = 0; i < CLIENT_COUNT; i++) {
+        packet_send_queue_destroy(&clients[i].send_queue);
+        packet_send_queue_destroy(&server_clients[i].send_queue);
+        packet_transmission_state_destroy(&clients[i].receive_state);
+        packet_transmission_state_destroy(&server_clients[i].receive_state);
+        net_destroy_socket(clients[i].socket);
+        net_destroy_socket(server_clients[i].socket);
+    }
+    free(payload);
+    net_destroy_socket(server_socket);
+    net_shutdown();
+
+    if (failed) {
+        puts("FAILED");
+        return EXIT_FAILURE;
+    }
+
+    puts("PASSED");
+    return EXIT_SUCCESS;
+}
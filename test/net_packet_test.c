@@ -1,4 +1,5 @@
 #include "../network.h"
+#include "test_time.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -62,11 +63,6 @@ typedef struct {
     S8* level_tiles;
 } PayloadTwo;
 
-uint64_t microseconds_between_timestamps(struct timespec* previous, struct timespec* current) {
-    return (current->tv_sec - previous->tv_sec) * 1000000LL +
-           ((current->tv_nsec - previous->tv_nsec)) / 1000;
-}
-
 // LIBRARY BEGIN
 // TODO: Should we consider combining Packet and PacketTransmissionState.
 const char* packet_type_description(PacketType type) {
@@ -224,7 +220,7 @@ int main(int argc, char** argv) {
     const char* net_log_file_name = session_type == SESSION_TYPE_SERVER ?
         "net_server.log" : "net_client.log";
 
-    if (!net_init(net_log_file_name)) {
+    if (!net_init(net_log_file_name, NULL)) {
         fprintf(stderr, "%s\n", net_get_error());
         return EXIT_FAILURE;
     }
@@ -0,0 +1,88 @@
+#include "../network.h"
+#include "test_time.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Roughly what a busy server logs over a few frames, well under the trace ring capacity.
+#define BURST_RECORD_COUNT 1024
+#define BURST_COUNT 200
+#define BURST_GAP_US 20000
+
+static uint64_t nanoseconds_between_timestamps(struct timespec* previous, struct timespec* current) {
+    return (current->tv_sec - previous->tv_sec) * 1000000000LL +
+           (current->tv_nsec - previous->tv_nsec);
+}
+
+// The text logging packet.c used to do for every send and receive.
+static char* get_timestamp(void) {
+    struct timespec ts = {0};
+    timespec_get(&ts, TIME_UTC);
+    static char buff[100];
+    size_t length = strftime(buff, sizeof(buff), "%T", gmtime(&ts.tv_sec));
+    long ms = ts.tv_nsec / 1000000;
+    snprintf(buff + length, sizeof(buff) - length, ".%03ld", ms);
+    return buff;
+}
+
+static void net_action_log(const char* timestamp_str,
+                           const char* type,
+                           size_t bytes_to_send,
+                           size_t bytes_sent,
+                           int seq,
+                           const char* desc) {
+    net_log("%s [tk %5d] %s: %4zu of %4zu bytes | ", timestamp_str, 0, type, bytes_to_send, bytes_sent);
+    if ( seq != -1 ) {
+        net_log(" seq %3d (%s)\n", seq, desc);
+    } else {
+        net_log("         (%s)\n", desc);
+    }
+}
+
+// Gives the trace flush thread time to drain between bursts, like the gap between frames.
+static void wait_us(uint64_t us) {
+    struct timespec start = {0};
+    struct timespec now = {0};
+    timespec_get(&start, TIME_UTC);
+    do {
+        timespec_get(&now, TIME_UTC);
+    } while (microseconds_between_timestamps(&start, &now) < us);
+}
+
+int main(void) {
+    if (!net_init("net_trace_bench.log", "net_trace_bench.trace")) {
+        fprintf(stderr, "%s\n", net_get_error());
+        return EXIT_FAILURE;
+    }
+
+    uint64_t text_ns = 0;
+    uint64_t trace_ns = 0;
+    struct timespec start = {0};
+    struct timespec end = {0};
+
+    for (S32 b = 0; b < BURST_COUNT; b++) {
+        timespec_get(&start, TIME_UTC);
+        for (S32 r = 0; r < BURST_RECORD_COUNT; r++) {
+            net_action_log(get_timestamp(), "SEND", 1200, 1200, r, "level state");
+        }
+        timespec_get(&end, TIME_UTC);
+        text_ns += nanoseconds_between_timestamps(&start, &end);
+
+        timespec_get(&start, TIME_UTC);
+        for (S32 r = 0; r < BURST_RECORD_COUNT; r++) {
+            net_trace(NET_TRACE_SEND, 1200, 1200, r, 2);
+        }
+        timespec_get(&end, TIME_UTC);
+        trace_ns += nanoseconds_between_timestamps(&start, &end);
+
+        wait_us(BURST_GAP_US);
+    }
+
+    net_shutdown();
+
+    S32 record_count = BURST_RECORD_COUNT * BURST_COUNT;
+    printf("text log:     %8.1f ns per record\n", (double)text_ns / record_count);
+    printf("binary trace: %8.1f ns per record\n", (double)trace_ns / record_count);
+    return EXIT_SUCCESS;
+}
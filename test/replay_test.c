@@ -0,0 +1,487 @@
+#include "../replay.h"
+
+#if defined(PLATFORM_WINDOWS)
+    #include <direct.h>
+    #define chdir _chdir
+#else
+    #include <unistd.h>
+#endif
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+bool g_failed = false;
+
+#define EXPECT(condition)                               \
+    if (!(condition)) {                                 \
+        printf("%s:%d:0 failed\n", __FILE__, __LINE__); \
+        g_failed = true;                                \
+    }
+
+#define TEST_MAP_FILE_NAME "small_map_1.temap"
+
+// Long enough for a full keyframe after the first run of deltas, and for snakes to die partway.
+#define TEST_TICK_COUNT 3000
+
+static U32 _test_random(U32* state) {
+    // xorshift32, so the actions are the same everywhere.
+    U32 x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static SnakeAction _test_random_action(U32* state) {
+    U32 r = _test_random(state) % 16;
+    if (r < 6) {
+        return SNAKE_ACTION_NONE;
+    } else if (r < 10) {
+        return (SnakeAction)(1 << (r - 6));
+    } else if (r < 13) {
+        return SNAKE_ACTION_CHOMP;
+    } else if (r < 15) {
+        return SNAKE_ACTION_CONSTRICT_LEFT;
+    }
+    return SNAKE_ACTION_CONSTRICT_RIGHT;
+}
+
+static bool _test_find_spawn(Game* game, S16 start_x, S16 start_y, S16 step_x, S16 step_y, S16* x, S16* y) {
+    for (S16 j = 0; j < game->map.height; j++) {
+        for (S16 i = 0; i < game->map.width; i++) {
+            S16 cx = (S16)(start_x + i * step_x);
+            S16 cy = (S16)(start_y + j * step_y);
+            if (!IsValidPosition(&game->map, cx, cy) ||
+                GetMapTile(&game->map, cx, cy, MAP_GROUND_LAYER) == 0 ||
+                GetMapTile(&game->map, cx, cy, MAP_SOLID_LAYER) != 0) {
+                continue;
+            }
+            *x = cx;
+            *y = cy;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool _test_start_game(Game* game) {
+    memset(game, 0, sizeof(*game));
+    if (!game_init(game, "assets/" TEST_MAP_FILE_NAME)) {
+        return false;
+    }
+
+    game->settings.enable_chomping = true;
+    game->settings.enable_constricting = true;
+    game->settings.head_invincible = true;
+    game->settings.zero_tacos_respawn = false;
+    game->settings.segment_health = 3;
+    game->settings.starting_length = 5;
+    game->settings.taco_count = 5;
+    game->settings.tick_ms = 175;
+    game->settings.chomp_cooldown_ticks = 10;
+
+    // One snake from each corner.
+    S16 last_x = (S16)(game->map.width - 1);
+    S16 last_y = (S16)(game->map.height - 1);
+    S16 corners[MAX_SNAKE_COUNT][4] = {
+        {0, 0, 1, 1},
+        {last_x, 0, -1, 1},
+        {last_x, last_y, -1, -1},
+        {0, last_y, 1, -1},
+    };
+    Direction directions[MAX_SNAKE_COUNT] = {DIRECTION_EAST, DIRECTION_SOUTH, DIRECTION_WEST, DIRECTION_NORTH};
+    for (S32 s = 0; s < MAX_SNAKE_COUNT; s++) {
+        S16 x = 0;
+        S16 y = 0;
+        if (!_test_find_spawn(game, corners[s][0], corners[s][1], corners[s][2], corners[s][3], &x, &y)) {
+            return false;
+        }
+        snake_spawn(game->snakes + s,
+                    x,
+                    y,
+                    directions[s],
+                    game->settings.starting_length,
+                    (S8)(game->settings.segment_health));
+        game->snakes[s].color = (SnakeColor)s;
+    }
+
+    game->state = GAME_STATE_PLAYING;
+    game_seed_random(game, 1234);
+    return true;
+}
+
+static void _test_destroy_game(Game* game) {
+    game_destroy(game);
+    FreeMap(&game->map);
+}
+
+// Records TEST_TICK_COUNT ticks of random actions, keeping the hash of the game after every tick.
+static bool _test_record(U32 seed, char* path, size_t path_size, U64* hashes) {
+    Game game;
+    if (!_test_start_game(&game)) {
+        printf("failed to start the game\n");
+        return false;
+    }
+
+    ReplayRecorder recorder = {0};
+    if (!replay_recorder_begin(&recorder, &game, TEST_MAP_FILE_NAME)) {
+        _test_destroy_game(&game);
+        return false;
+    }
+    snprintf(path, path_size, "%s", recorder.path);
+
+    U32 random_state = seed;
+    hashes[0] = game_hash(&game);
+    for (U32 t = 0; t < TEST_TICK_COUNT; t++) {
+        SnakeAction snake_actions[MAX_SNAKE_COUNT];
+        for (S32 s = 0; s < MAX_SNAKE_COUNT; s++) {
+            snake_actions[s] = _test_random_action(&random_state);
+        }
+        replay_recorder_add_tick(&recorder, &game, snake_actions);
+        game_update(&game, snake_actions);
+        hashes[t + 1] = game_hash(&game);
+    }
+
+    replay_recorder_end(&recorder, &game);
+    _test_destroy_game(&game);
+    return true;
+}
+
+static U8* _test_read_file(const char* path, size_t* size) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long file_size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    U8* data = malloc(file_size > 0 ? file_size : 1);
+    if (data != NULL && fread(data, 1, file_size, file) != (size_t)file_size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    *size = (size_t)file_size;
+    return data;
+}
+
+static bool _test_write_file(const char* path, const U8* data, size_t size) {
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        return false;
+    }
+    bool result = fwrite(data, 1, size, file) == size;
+    return fclose(file) == 0 && result;
+}
+
+static void test_record_and_verify(void) {
+    static U64 hashes[TEST_TICK_COUNT + 1];
+    char path[128];
+    bool recorded = _test_record(1, path, sizeof(path), hashes);
+    EXPECT(recorded);
+    if (!recorded) {
+        return;
+    }
+
+    Replay replay = {0};
+    Game game = {0};
+    EXPECT(replay_load(&replay, path));
+    EXPECT(replay.has_footer);
+    EXPECT(replay.trailer.tick_count == TEST_TICK_COUNT);
+    EXPECT(replay.trailer.final_hash == hashes[TEST_TICK_COUNT]);
+    EXPECT(replay_start_game(&replay, &game));
+
+    // Playing it back goes through exactly the same states.
+    EXPECT(game_hash(&game) == hashes[0]);
+    SnakeAction snake_actions[MAX_SNAKE_COUNT];
+    U32 mismatched_ticks = 0;
+    while (replay_next_tick(&replay, snake_actions)) {
+        game_update(&game, snake_actions);
+        if (game_hash(&game) != hashes[replay.ticks_played]) {
+            mismatched_ticks++;
+        }
+    }
+    EXPECT(replay.ticks_played == TEST_TICK_COUNT);
+    EXPECT(mismatched_ticks == 0);
+    EXPECT(game_hash(&game) == hashes[TEST_TICK_COUNT]);
+
+    _test_destroy_game(&game);
+    replay_destroy(&replay);
+
+    EXPECT(replay_verify(path));
+    remove(path);
+}
+
+static void test_flipped_action_fails_verify(void) {
+    static U64 hashes[TEST_TICK_COUNT + 1];
+    char path[128];
+    bool recorded = _test_record(2, path, sizeof(path), hashes);
+    EXPECT(recorded);
+    if (!recorded) {
+        return;
+    }
+
+    // Find the tick before a keyframe where a snake turned or chomped, it's the last action of the
+    // tick. Constricting instead always changes the snake's state, so the keyframe won't match.
+    Replay replay = {0};
+    Game game = {0};
+    EXPECT(replay_load(&replay, path));
+    EXPECT(replay_start_game(&replay, &game));
+    size_t action_offset = 0;
+    SnakeAction snake_actions[MAX_SNAKE_COUNT];
+    while (action_offset == 0 && replay_next_tick(&replay, snake_actions)) {
+        if (replay.ticks_played % REPLAY_KEYFRAME_INTERVAL_TICKS != 0) {
+            continue;
+        }
+        for (S32 s = MAX_SNAKE_COUNT - 1; s >= 0; s--) {
+            if (snake_actions[s] == SNAKE_ACTION_NONE) {
+                continue;
+            }
+            if (!(snake_actions[s] & (SNAKE_ACTION_CONSTRICT_LEFT | SNAKE_ACTION_CONSTRICT_RIGHT))) {
+                action_offset = replay.offset - 1;
+            }
+            break;
+        }
+    }
+    EXPECT(action_offset != 0);
+    _test_destroy_game(&game);
+    replay_destroy(&replay);
+
+    size_t size = 0;
+    U8* data = _test_read_file(path, &size);
+    EXPECT(data != NULL);
+    if (data != NULL && action_offset != 0) {
+        data[action_offset] = SNAKE_ACTION_CONSTRICT_LEFT;
+        char flipped_path[160];
+        snprintf(flipped_path, sizeof(flipped_path), "%s.flipped", path);
+        EXPECT(_test_write_file(flipped_path, data, size));
+        EXPECT(!replay_verify(flipped_path));
+        remove(flipped_path);
+    }
+
+    free(data);
+    remove(path);
+}
+
+static void test_seek_matches_linear_simulation(void) {
+    static U64 hashes[TEST_TICK_COUNT + 1];
+    char path[128];
+    bool recorded = _test_record(42, path, sizeof(path), hashes);
+    EXPECT(recorded);
+    if (!recorded) {
+        return;
+    }
+
+    EXPECT(replay_verify(path));
+
+    Replay replay = {0};
+    Game game = {0};
+    EXPECT(replay_load(&replay, path));
+    EXPECT(replay.has_footer);
+    EXPECT(replay_start_game(&replay, &game));
+
+    // None of these are on a keyframe, and going back has to start from one.
+    U32 ticks[] = {1000, 1100, 37, 2999, 300, 2100, 1500, 513, 2000, 2047, 2049};
+    for (size_t i = 0; i < sizeof(ticks) / sizeof(ticks[0]); i++) {
+        EXPECT(replay_seek(&replay, &game, ticks[i]));
+        EXPECT(replay.ticks_played == ticks[i]);
+        if (game_hash(&game) != hashes[ticks[i]]) {
+            printf("seeking to tick %u got %016" PRIx64 ", expected %016" PRIx64 "\n",
+                   ticks[i], game_hash(&game), hashes[ticks[i]]);
+            g_failed = true;
+        }
+    }
+
+    _test_destroy_game(&game);
+    replay_destroy(&replay);
+    remove(path);
+}
+
+// Encodes state against previous, checks it decodes back, and returns the encoded size.
+static size_t _test_delta_round_trip(const U8* state, const U8* previous, size_t size) {
+    U8* encoded = malloc(replay_delta_encode_bound(size));
+    U8* decoded = malloc(size > 0 ? size : 1);
+    EXPECT(encoded != NULL && decoded != NULL);
+    if (encoded == NULL || decoded == NULL) {
+        free(encoded);
+        free(decoded);
+        return 0;
+    }
+
+    size_t encoded_size = replay_delta_encode(state, previous, size, encoded);
+    EXPECT(encoded_size <= replay_delta_encode_bound(size));
+
+    memcpy(decoded, previous, size);
+    EXPECT(replay_delta_decode(encoded, encoded_size, decoded, size));
+    EXPECT(memcmp(decoded, state, size) == 0);
+
+    // Cutting off the last pair or part of one has to be noticed.
+    if (encoded_size > 0) {
+        memcpy(decoded, previous, size);
+        EXPECT(!replay_delta_decode(encoded, encoded_size - 1, decoded, size));
+        EXPECT(!replay_delta_decode(encoded, encoded_size, decoded, size - 1));
+    }
+
+    free(encoded);
+    free(decoded);
+    return encoded_size;
+}
+
+static void test_delta_codec(void) {
+    size_t size = 0x20000;
+    U8* previous = malloc(size);
+    U8* state = malloc(size);
+    U8* zeros = calloc(size, 1);
+    EXPECT(previous != NULL && state != NULL && zeros != NULL);
+    if (previous == NULL || state == NULL || zeros == NULL) {
+        free(previous);
+        free(state);
+        free(zeros);
+        return;
+    }
+
+    U32 random_state = 7;
+    for (size_t i = 0; i < size; i++) {
+        previous[i] = (U8)_test_random(&random_state);
+    }
+
+    // A keyframe that changed in a few places against the one before.
+    memcpy(state, previous, size);
+    state[0] ^= 1;
+    state[1000] ^= 0xFF;
+    state[1001] ^= 0x10;
+    state[5000] ^= 3;
+    EXPECT(_test_delta_round_trip(state, previous, size) < 64);
+
+    // A full keyframe, against nothing.
+    EXPECT(_test_delta_round_trip(previous, zeros, size) > size);
+
+    // Exactly a full run of zeros and then one more, either side of a change.
+    memcpy(state, previous, size);
+    state[0xFFFF] ^= 1;
+    state[2 * 0xFFFF + 1] ^= 1;
+    EXPECT(_test_delta_round_trip(state, previous, size) < 64);
+
+    // Runs that end at the end of the buffer, of zeros and of changes.
+    EXPECT(_test_delta_round_trip(previous, previous, size) < 64);
+    memcpy(state, previous, size);
+    state[size - 1] ^= 0x80;
+    EXPECT(_test_delta_round_trip(state, previous, size) < 64);
+    memcpy(state, previous, size);
+    for (size_t i = size - 300; i < size; i++) {
+        state[i] ^= 0x55;
+    }
+    EXPECT(_test_delta_round_trip(state, previous, size) < 400);
+
+    // Worst case, every other byte changed.
+    memcpy(state, previous, size);
+    for (size_t i = 0; i < size; i += 2) {
+        state[i] ^= 1;
+    }
+    _test_delta_round_trip(state, previous, size);
+
+    // A run claiming more than there is.
+    U8 corrupt[] = {0xFF, 0xFF, 0x02, 0x00, 0x01, 0x01};
+    EXPECT(!replay_delta_decode(corrupt, sizeof(corrupt), state, 100));
+
+    free(previous);
+    free(state);
+    free(zeros);
+}
+
+// Writes data with size bytes and one byte at offset changed to path, and checks the replay loads
+// without a footer and can't be verified.
+static void _test_expect_no_footer(const char* path, U8* data, size_t size, size_t offset, U8 value) {
+    U8 old_value = data[offset];
+    data[offset] = value;
+    EXPECT(_test_write_file(path, data, size));
+    data[offset] = old_value;
+
+    Replay replay = {0};
+    EXPECT(replay_load(&replay, path));
+    EXPECT(!replay.has_footer);
+    replay_destroy(&replay);
+    EXPECT(!replay_verify(path));
+}
+
+static void test_corrupt_trailer(void) {
+    static U64 hashes[TEST_TICK_COUNT + 1];
+    char path[128];
+    bool recorded = _test_record(3, path, sizeof(path), hashes);
+    EXPECT(recorded);
+    if (!recorded) {
+        return;
+    }
+
+    size_t size = 0;
+    U8* data = _test_read_file(path, &size);
+    EXPECT(data != NULL);
+    if (data == NULL) {
+        remove(path);
+        return;
+    }
+
+    char corrupt_path[160];
+    snprintf(corrupt_path, sizeof(corrupt_path), "%s.corrupt", path);
+
+    // The trailer is the keyframe count, the interval, the tick count, then the final hash.
+    size_t trailer_size = 3 * sizeof(U32) + sizeof(U64);
+    size_t trailer_offset = size - trailer_size;
+
+    // Cut off partway through the trailer and partway through the index.
+    _test_expect_no_footer(corrupt_path, data, size - 3, 0, data[0]);
+    _test_expect_no_footer(corrupt_path, data, size - trailer_size - 5, 0, data[0]);
+
+    // A keyframe count, interval and tick count that don't go together.
+    _test_expect_no_footer(corrupt_path, data, size, trailer_offset, (U8)(data[trailer_offset] + 1));
+    _test_expect_no_footer(corrupt_path, data, size, trailer_offset + sizeof(U32) + 1, 0);
+    _test_expect_no_footer(corrupt_path, data, size, trailer_offset + 2 * sizeof(U32) + 1, 0xFF);
+
+    // An index entry pointing somewhere that isn't a keyframe, and one with the wrong tick.
+    U32 keyframe_count = 0;
+    memcpy(&keyframe_count, data + trailer_offset, sizeof(keyframe_count));
+    EXPECT(keyframe_count > 1);
+    size_t index_offset = trailer_offset - keyframe_count * 2 * sizeof(U32);
+    _test_expect_no_footer(corrupt_path, data, size, index_offset + 2 * sizeof(U32) + sizeof(U32), 1);
+    _test_expect_no_footer(corrupt_path, data, size, index_offset + 2 * sizeof(U32), 1);
+
+    // A keyframe that doesn't decode makes verifying fail even though the footer is fine.
+    U32 second_keyframe_offset = 0;
+    memcpy(&second_keyframe_offset, data + index_offset + 2 * sizeof(U32) + sizeof(U32), sizeof(U32));
+    size_t encoded_size_offset = second_keyframe_offset + 1 + 2 * sizeof(U32);
+    data[encoded_size_offset] ^= 0x01;
+    EXPECT(_test_write_file(corrupt_path, data, size));
+    EXPECT(!replay_verify(corrupt_path));
+
+    free(data);
+    remove(corrupt_path);
+    remove(path);
+}
+
+int main(int argc, char** argv) {
+    (void)(argc);
+    (void)(argv);
+
+    // Replays find their maps in assets and are written to replays, both from the repo root.
+    if (chdir("..") != 0) {
+        printf("FAILED: couldn't change to the repo root\n");
+        return 1;
+    }
+
+    test_record_and_verify();
+    test_flipped_action_fails_verify();
+    test_seek_matches_linear_simulation();
+    test_delta_codec();
+    test_corrupt_trailer();
+
+    if (g_failed) {
+        printf("FAILED\n");
+        return 1;
+    }
+
+    printf("PASSED\n");
+    return 0;
+}
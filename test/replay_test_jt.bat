@@ -0,0 +1,37 @@
+@echo off
+:: Turn off msft (c) message with /nologo
+:: Turn off C++ runtime type info with /GR-
+:: Turn off exception handling with /EHa-
+:: Enable intrinsics with /Oi
+:: Enable level 4 warnings with /W4
+:: Output debug symbols with /Zi
+:: Define the platform
+:: Include our external libraries
+cl ^
+    /D_AMD64_ ^
+    /nologo ^
+    /GR- ^
+    /EHa- ^
+    /Oi ^
+    /W4 ^
+    /WX ^
+    /Zi ^
+    /D_CRT_SECURE_NO_WARNINGS ^
+    /DPLATFORM_WINDOWS ^
+    /I"..\external\include" ^
+    ..\replay.c ^
+    ..\map_cache.c ^
+    ..\game.c ^
+    ..\zone.c ^
+    ..\snake.c ^
+    ..\sprite_batch.c ^
+    ..\direction.c ^
+    ..\items.c ^
+    ..\spatial.c ^
+    ..\map.c ^
+    replay_test.c ^
+    "SDL3.lib" "shell32.lib" ^
+    /link ^
+    "/OUT:replay_test.exe" ^
+    "/LIBPATH:..\external\lib" ^
+    "/SUBSYSTEM:CONSOLE"
@@ -0,0 +1,87 @@
+#include "../snapshot.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TICK_US 175000
+#define WAIT_US 3000000
+#define LATENCY_US 40000
+#define PLAYING_TICKS 40
+
+bool g_failed = false;
+
+#define EXPECT(condition)                               \
+    if (!(condition)) {                                 \
+        printf("%s:%d:0 failed\n", __FILE__, __LINE__); \
+        g_failed = true;                                \
+    }
+
+int main(void) {
+    SnapshotBuffer buffer = {0};
+    Game game = {0};
+
+    // The server sends the same tick over and over while counting down to the start.
+    game.state = GAME_STATE_WAITING;
+    S64 now_us = LATENCY_US;
+    for (; now_us < WAIT_US; now_us += TICK_US) {
+        snapshot_buffer_push(&buffer, &game, TICK_US, now_us);
+    }
+    EXPECT(buffer.count == 1);
+
+    game.state = GAME_STATE_PLAYING;
+    snapshot_buffer_push(&buffer, &game, TICK_US, now_us);
+
+    // Then ticks arrive evenly, so there is no jitter and the delay should be the one tick minimum.
+    for (S32 i = 0; i < PLAYING_TICKS; i++) {
+        game.tick++;
+        snapshot_buffer_push(&buffer, &game, TICK_US, WAIT_US + LATENCY_US + (S64)game.tick * TICK_US);
+    }
+    EXPECT(buffer.jitter_us == 0);
+    EXPECT(buffer.delay_us == TICK_US);
+    EXPECT(buffer.clock_offset_us == WAIT_US + LATENCY_US);
+
+    // Rendering now lands a tick behind the newest state.
+    Game* from = NULL;
+    Game* to = NULL;
+    float interpolation = 0.0f;
+    now_us = WAIT_US + LATENCY_US + (S64)game.tick * TICK_US + TICK_US / 2;
+    EXPECT(snapshot_buffer_sample(&buffer, now_us, &from, &to, &interpolation));
+    EXPECT(from != NULL && from->tick == game.tick - 1);
+    EXPECT(to != NULL && to->tick == game.tick);
+    EXPECT(interpolation > 0.49f && interpolation < 0.51f);
+
+    // Arrivals that vary raise the delay, and it comes back down once they're even again.
+    for (S32 i = 0; i < PLAYING_TICKS; i++) {
+        game.tick++;
+        S64 wobble_us = (i % 2) ? TICK_US / 4 : 0;
+        snapshot_buffer_push(&buffer, &game, TICK_US, WAIT_US + LATENCY_US + (S64)game.tick * TICK_US + wobble_us);
+    }
+    EXPECT(buffer.jitter_us > 0);
+    EXPECT(buffer.delay_us > TICK_US);
+
+    // A new game starts the clock over, including its own wait to start.
+    game.tick = 0;
+    game.state = GAME_STATE_WAITING;
+    S64 restart_us = now_us + 10 * TICK_US;
+    for (now_us = restart_us; now_us < restart_us + WAIT_US; now_us += TICK_US) {
+        snapshot_buffer_push(&buffer, &game, TICK_US, now_us);
+    }
+    game.state = GAME_STATE_PLAYING;
+    for (S32 i = 0; i < PLAYING_TICKS; i++) {
+        game.tick++;
+        snapshot_buffer_push(&buffer, &game, TICK_US, restart_us + WAIT_US + (S64)game.tick * TICK_US);
+    }
+    EXPECT(buffer.jitter_us == 0);
+    EXPECT(buffer.clock_offset_us == restart_us + WAIT_US);
+
+    snapshot_buffer_destroy(&buffer);
+    game_destroy(&game);
+
+    if (g_failed) {
+        puts("FAILED");
+        return EXIT_FAILURE;
+    }
+
+    puts("PASSED");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,129 @@
+#include "../items.h"
+#include "../spatial.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAP_WIDTH 1000
+#define MAP_HEIGHT 600
+#define TACO_CHANGES 200000
+#define QUERY_COUNT 200
+#define MAX_POINTS (MAP_WIDTH * MAP_HEIGHT)
+
+bool g_failed = false;
+
+#define EXPECT(condition)                               \
+    if (!(condition)) {                                 \
+        printf("%s:%d:0 failed\n", __FILE__, __LINE__); \
+        g_failed = true;                                \
+    }
+
+static S32 count_tacos_by_scan(Items* items, SpatialRect rect, bool inside) {
+    S32 count = 0;
+    for (S32 y = 0; y < items->height; y++) {
+        for (S32 x = 0; x < items->width; x++) {
+            if (items_get_cell(items, x, y) == ITEM_TYPE_TACO &&
+                spatial_rect_contains(rect, x, y) == inside) {
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+static bool points_are_tacos(Items* items, SpatialPoint* points, S32 count, SpatialRect rect, bool inside) {
+    for (S32 i = 0; i < count; i++) {
+        if (items_get_cell(items, points[i].x, points[i].y) != ITEM_TYPE_TACO ||
+            spatial_rect_contains(rect, points[i].x, points[i].y) != inside) {
+            printf("point %d, %d is not a taco %s the rect\n",
+                   points[i].x, points[i].y, inside ? "inside" : "outside");
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(void) {
+    Items items = {0};
+    if (!items_init(&items, MAP_WIDTH, MAP_HEIGHT)) {
+        fprintf(stderr, "items_init failed\n");
+        return EXIT_FAILURE;
+    }
+
+    SpatialPoint* points = malloc(MAX_POINTS * sizeof(*points));
+    if (points == NULL) {
+        fprintf(stderr, "malloc failed\n");
+        return EXIT_FAILURE;
+    }
+
+    // Place and eat tacos at random, including setting cells that are already tacos or empty.
+    srand(1234);
+    for (S32 i = 0; i < TACO_CHANGES; i++) {
+        S32 x = rand() % MAP_WIDTH;
+        S32 y = rand() % MAP_HEIGHT;
+        items_set_cell(&items, x, y, (rand() % 3) == 0 ? ITEM_TYPE_TACO : ITEM_TYPE_EMPTY);
+    }
+
+    SpatialRect everything = { 0, 0, MAP_WIDTH - 1, MAP_HEIGHT - 1 };
+    EXPECT(items.tacos.point_count == count_tacos_by_scan(&items, everything, true));
+
+    for (S32 q = 0; q < QUERY_COUNT && !g_failed; q++) {
+        // Rects hanging off every edge of the map as well as inside it.
+        S32 radius = rand() % 40;
+        S32 center_x = (rand() % (MAP_WIDTH + 40)) - 20;
+        S32 center_y = (rand() % (MAP_HEIGHT + 40)) - 20;
+        SpatialRect rect = {
+            center_x - radius,
+            center_y - radius,
+            center_x + radius,
+            center_y + radius
+        };
+
+        S32 inside_count = spatial_grid_query_rect(&items.tacos, rect, points, MAX_POINTS);
+        EXPECT(inside_count == count_tacos_by_scan(&items, rect, true));
+        EXPECT(points_are_tacos(&items, points, inside_count, rect, true));
+
+        S32 outside_count = spatial_grid_query_outside_rect(&items.tacos, rect, points, MAX_POINTS);
+        EXPECT(outside_count == count_tacos_by_scan(&items, rect, false));
+        EXPECT(points_are_tacos(&items, points, outside_count, rect, false));
+
+        EXPECT(inside_count + outside_count == items.tacos.point_count);
+
+        // Walking the buckets finds the same points as the query.
+        S32 walked_count = 0;
+        SpatialRect buckets = spatial_grid_bucket_rect(&items.tacos, rect);
+        for (S32 by = buckets.min_y; by <= buckets.max_y; by++) {
+            for (S32 bx = buckets.min_x; bx <= buckets.max_x; bx++) {
+                const SpatialBucket* bucket = items.tacos.buckets + (by * items.tacos.width + bx);
+                for (S32 p = 0; p < bucket->count; p++) {
+                    walked_count += spatial_rect_contains(rect, bucket->points[p].x, bucket->points[p].y);
+                }
+            }
+        }
+        EXPECT(walked_count == inside_count);
+    }
+
+    // Counts past max_count are still reported.
+    EXPECT(spatial_grid_query_rect(&items.tacos, everything, points, 1) == items.tacos.point_count);
+
+    // Emptying the grid leaves no occupied buckets behind.
+    for (S32 y = 0; y < MAP_HEIGHT; y++) {
+        for (S32 x = 0; x < MAP_WIDTH; x++) {
+            items_set_cell(&items, x, y, ITEM_TYPE_EMPTY);
+        }
+    }
+    EXPECT(items.tacos.point_count == 0);
+    EXPECT(items.tacos.occupied_count == 0);
+
+    free(points);
+    items_destroy(&items);
+
+    if (g_failed) {
+        puts("FAILED");
+        return EXIT_FAILURE;
+    }
+
+    puts("PASSED");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,13 @@
+#ifndef test_time_h
+#define test_time_h
+
+#include <stdint.h>
+#include <time.h>
+
+// Same as main.c's, for the tests that time themselves with timespec_get.
+static inline uint64_t microseconds_between_timestamps(struct timespec* previous, struct timespec* current) {
+    return (current->tv_sec - previous->tv_sec) * 1000000LL +
+           ((current->tv_nsec - previous->tv_nsec)) / 1000;
+}
+
+#endif /* test_time_h */
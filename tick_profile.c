@@ -0,0 +1,77 @@
+#include "tick_profile.h"
+
+static S32 _bucket_for(U64 ns) {
+    U64 us = ns / 1000;
+    S32 bucket = 0;
+    while (us > 0 && bucket < TICK_PROFILE_BUCKET_COUNT - 1) {
+        us >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+static void _histogram_replace(TickProfileHistogram* histogram, U32 index, U64 ns, U32 calls) {
+    // Drop whatever tick is falling out of the window.
+    if (histogram->window_calls[index] > 0) {
+        histogram->buckets[_bucket_for(histogram->window_ns[index])]--;
+        histogram->total_ns -= histogram->window_ns[index];
+        histogram->total_calls -= histogram->window_calls[index];
+        histogram->tick_count--;
+    }
+
+    histogram->window_ns[index] = ns;
+    histogram->window_calls[index] = calls;
+    if (calls > 0) {
+        histogram->buckets[_bucket_for(ns)]++;
+        histogram->total_ns += ns;
+        histogram->total_calls += calls;
+        histogram->tick_count++;
+    }
+}
+
+void tick_profile_add(TickProfile* profile, const GamePhaseTimes* phase_times, U64 tick_ns) {
+    for (S32 p = 0; p < GAME_PHASE_COUNT; p++) {
+        _histogram_replace(profile->histograms + p,
+                           profile->next,
+                           phase_times->ns[p],
+                           phase_times->calls[p]);
+    }
+    _histogram_replace(profile->histograms + TICK_PROFILE_TOTAL, profile->next, tick_ns, 1);
+
+    profile->next = (profile->next + 1) % TICK_PROFILE_WINDOW_TICKS;
+}
+
+U64 tick_profile_percentile_ns(const TickProfileHistogram* histogram, float fraction) {
+    if (histogram->tick_count == 0) {
+        return 0;
+    }
+
+    U32 target = (U32)(fraction * (float)histogram->tick_count);
+    if (target >= histogram->tick_count) {
+        target = histogram->tick_count - 1;
+    }
+
+    U64 upper_ns = (1ULL << (TICK_PROFILE_BUCKET_COUNT - 1)) * 1000;
+    U32 seen = 0;
+    for (S32 b = 0; b < TICK_PROFILE_BUCKET_COUNT; b++) {
+        seen += histogram->buckets[b];
+        if (seen > target) {
+            upper_ns = (1ULL << b) * 1000;
+            break;
+        }
+    }
+
+    // The top bucket's bound can be well past anything actually seen.
+    U64 max_ns = tick_profile_max_ns(histogram);
+    return (upper_ns < max_ns) ? upper_ns : max_ns;
+}
+
+U64 tick_profile_max_ns(const TickProfileHistogram* histogram) {
+    U64 max_ns = 0;
+    for (S32 i = 0; i < TICK_PROFILE_WINDOW_TICKS; i++) {
+        if (histogram->window_calls[i] > 0 && histogram->window_ns[i] > max_ns) {
+            max_ns = histogram->window_ns[i];
+        }
+    }
+    return max_ns;
+}
@@ -0,0 +1,38 @@
+#ifndef tick_profile_h
+#define tick_profile_h
+
+#include "game.h"
+
+// How many of the most recent ticks the histograms cover, about 45 seconds at the default tick rate.
+#define TICK_PROFILE_WINDOW_TICKS 256
+
+// Bucket 0 counts ticks under 1 us, and each bucket after covers twice the time of the one before,
+// so the last covers over half a minute.
+#define TICK_PROFILE_BUCKET_COUNT 26
+
+// The whole tick is profiled along with each phase, after them.
+#define TICK_PROFILE_TOTAL GAME_PHASE_COUNT
+
+// A rolling histogram of the time a phase took on the ticks it ran.
+typedef struct {
+    U32 buckets[TICK_PROFILE_BUCKET_COUNT];
+    U64 window_ns[TICK_PROFILE_WINDOW_TICKS];
+    U32 window_calls[TICK_PROFILE_WINDOW_TICKS];
+    U64 total_ns;    // Over the window.
+    U32 total_calls; // Over the window.
+    U32 tick_count;  // Ticks in the window that the phase ran on.
+} TickProfileHistogram;
+
+typedef struct {
+    TickProfileHistogram histograms[GAME_PHASE_COUNT + 1];
+    U32 next; // Where the next tick goes in the window.
+} TickProfile;
+
+void tick_profile_add(TickProfile* profile, const GamePhaseTimes* phase_times, U64 tick_ns);
+
+// The upper bound of the bucket the fraction of ticks falls in, capped at the max, 0 if the phase
+// hasn't run.
+U64 tick_profile_percentile_ns(const TickProfileHistogram* histogram, float fraction);
+U64 tick_profile_max_ns(const TickProfileHistogram* histogram);
+
+#endif /* tick_profile_h */
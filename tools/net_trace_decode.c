@@ -0,0 +1,62 @@
+#include "../network.h"
+#include "../packet.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Turns the binary trace written by the game into the text format net_action_log used to write.
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <net_server.trace>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    FILE* file = fopen(argv[1], "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Failed to open %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    NetTraceFileHeader header = {0};
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, NET_TRACE_MAGIC, sizeof(header.magic)) != 0) {
+        fprintf(stderr, "%s is not a net trace file\n", argv[1]);
+        fclose(file);
+        return EXIT_FAILURE;
+    }
+
+    if (header.version != NET_TRACE_VERSION) {
+        fprintf(stderr, "%s is version %u, expected %u\n", argv[1], header.version, NET_TRACE_VERSION);
+        fclose(file);
+        return EXIT_FAILURE;
+    }
+
+    const char* direction_names[] = { "SEND", "RECV", "DROP" };
+
+    NetTraceRecord record = {0};
+    while (fread(&record, sizeof(record), 1, file) == 1) {
+        U64 time_us = header.start_time_us + record.time_us;
+        time_t seconds = (time_t)(time_us / 1000000);
+
+        char timestamp[100];
+        size_t length = strftime(timestamp, sizeof(timestamp), "%T", gmtime(&seconds));
+        snprintf(timestamp + length, sizeof(timestamp) - length, ".%03d", (S32)((time_us / 1000) % 1000));
+
+        const char* direction = record.direction < sizeof(direction_names) / sizeof(direction_names[0]) ?
+            direction_names[record.direction] : "????";
+        const char* description = packet_type_description(record.packet_type);
+
+        printf("%s [tk %5u] %s: %4u of %4u bytes | ",
+               timestamp, record.tick, direction, record.bytes_expected, record.bytes_transferred);
+        if (record.sequence != -1) {
+            printf(" seq %3d (%s)\n", record.sequence, description);
+        } else {
+            printf("         (%s)\n", description);
+        }
+    }
+
+    fclose(file);
+    return EXIT_SUCCESS;
+}
@@ -33,6 +33,43 @@ S32 ui_dropdown_height(UIDropDown* drop_down, S32 option_count, S32 font_height)
     return result;
 }
 
+static UILayoutKey _ui_layout_key(UserInterface* ui,
+                                  S32 x,
+                                  S32 y,
+                                  U32 content_generation,
+                                  S32 content_size) {
+    PF_FontState font_state = PF_GetState(ui->font);
+    return (UILayoutKey){
+        .valid = true,
+        .x = x,
+        .y = y,
+        .char_width = font_state.char_width,
+        .char_height = font_state.char_height,
+        .letter_spacing = font_state.letter_spacing,
+        .scale = font_state.scale,
+        .content_generation = content_generation,
+        .content_size = content_size,
+    };
+}
+
+// Returns whether the layout measured with layout_key is still good for key. If it isn't, key is
+// remembered and the caller lays the widget out again.
+static bool _ui_layout_is_current(UILayoutKey* layout_key, UILayoutKey key) {
+    if (layout_key->valid &&
+        layout_key->x == key.x &&
+        layout_key->y == key.y &&
+        layout_key->char_width == key.char_width &&
+        layout_key->char_height == key.char_height &&
+        layout_key->letter_spacing == key.letter_spacing &&
+        layout_key->scale == key.scale &&
+        layout_key->content_generation == key.content_generation &&
+        layout_key->content_size == key.content_size) {
+        return true;
+    }
+    *layout_key = key;
+    return false;
+}
+
 void ui_create(UserInterface* ui, PF_Font* font) {
     ui->font = font;
 
@@ -62,6 +99,24 @@ void ui_checkbox(UserInterface* ui,
                  UIMouseState* mouse_state,
                  UICheckBox* checkbox,
                  bool* value) {
+    if (!_ui_layout_is_current(&checkbox->layout_key, _ui_layout_key(ui, checkbox->x, checkbox->y, 0, 0))) {
+        checkbox->outline_rect = (SDL_FRect){
+            (float)(checkbox->x),
+            (float)(checkbox->y),
+            (float)(UI_CHECKBOX_SIZE),
+            (float)(UI_CHECKBOX_SIZE)};
+        checkbox->background_rect = (SDL_FRect){
+            (float)(checkbox->outline_rect.x + UI_CHECKBOX_OUTLINE_SIZE),
+            (float)(checkbox->outline_rect.y + UI_CHECKBOX_OUTLINE_SIZE),
+            (float)(checkbox->outline_rect.w - (2 * UI_CHECKBOX_OUTLINE_SIZE)),
+            (float)(checkbox->outline_rect.h - (2 * UI_CHECKBOX_OUTLINE_SIZE))};
+        checkbox->checked_rect = (SDL_FRect){
+            (float)(checkbox->outline_rect.x + UI_CHECKBOX_FILL_GAP),
+            (float)(checkbox->outline_rect.y + UI_CHECKBOX_FILL_GAP),
+            (float)(checkbox->outline_rect.w - (2 * UI_CHECKBOX_FILL_GAP)),
+            (float)(checkbox->outline_rect.h - (2 * UI_CHECKBOX_FILL_GAP))};
+    }
+
     bool mouse_is_over = mouse_state->x >= checkbox->x &&
                          mouse_state->x <= (checkbox->x + UI_CHECKBOX_SIZE) &&
                          mouse_state->y >= checkbox->y &&
@@ -78,44 +133,29 @@ void ui_checkbox(UserInterface* ui,
     }
 
     // Outline
-    SDL_FRect outline_rect = {
-        (float)(checkbox->x),
-        (float)(checkbox->y),
-        (float)(UI_CHECKBOX_SIZE),
-        (float)(UI_CHECKBOX_SIZE)};
     SDL_SetRenderDrawColor(renderer,
                            ui->outline_color.red,
                            ui->outline_color.green,
                            ui->outline_color.blue,
                            ui->outline_color.alpha);
-    SDL_RenderFillRect(renderer, &outline_rect);
+    SDL_RenderFillRect(renderer, &checkbox->outline_rect);
 
     // Background
-    SDL_FRect background_rect = {
-        (float)(outline_rect.x + UI_CHECKBOX_OUTLINE_SIZE),
-        (float)(outline_rect.y + UI_CHECKBOX_OUTLINE_SIZE),
-        (float)(outline_rect.w - (2 * UI_CHECKBOX_OUTLINE_SIZE)),
-        (float)(outline_rect.h - (2 * UI_CHECKBOX_OUTLINE_SIZE))};
     SDL_SetRenderDrawColor(renderer,
                            active_background_color.red,
                            active_background_color.green,
                            active_background_color.blue,
                            active_background_color.alpha);
-    SDL_RenderFillRect(renderer, &background_rect);
+    SDL_RenderFillRect(renderer, &checkbox->background_rect);
 
     if (*value) {
         // Checkmark
-        SDL_FRect checked_rect = {
-            (float)(outline_rect.x + UI_CHECKBOX_FILL_GAP),
-            (float)(outline_rect.y + UI_CHECKBOX_FILL_GAP),
-            (float)(outline_rect.w - (2 * UI_CHECKBOX_FILL_GAP)),
-            (float)(outline_rect.h - (2 * UI_CHECKBOX_FILL_GAP))};
         SDL_SetRenderDrawColor(renderer,
                                ui->outline_color.red,
                                ui->outline_color.green,
                                ui->outline_color.blue,
                                ui->outline_color.alpha);
-        SDL_RenderFillRect(renderer, &checked_rect);
+        SDL_RenderFillRect(renderer, &checkbox->checked_rect);
     }
 }
 
@@ -124,23 +164,37 @@ void ui_slider(UserInterface* ui,
                UIMouseState* mouse_state,
                UISlider* slider,
                S32* value) {
-    PF_FontState font_state = PF_GetState(ui->font);
+    UILayoutKey layout_key = _ui_layout_key(ui, slider->x, slider->y, 0, slider->pixel_width);
+    if (!_ui_layout_is_current(&slider->layout_key, layout_key)) {
+        slider->width = ui_slider_width(slider);
+        slider->height = ui_slider_height(slider, layout_key.char_height);
+        slider->outline_rect = (SDL_FRect){
+            (float)(slider->x),
+            (float)(slider->y),
+            (float)(slider->width),
+            (float)(slider->height)};
+        slider->background_rect = (SDL_FRect){
+            (float)(slider->outline_rect.x + UI_SLIDER_OUTLINE_SIZE),
+            (float)(slider->outline_rect.y + UI_SLIDER_OUTLINE_SIZE),
+            (float)(slider->outline_rect.w - (2 * UI_SLIDER_OUTLINE_SIZE)),
+            (float)(slider->outline_rect.h - (2 * UI_SLIDER_OUTLINE_SIZE))};
+        slider->line_rect = (SDL_FRect){
+            (float)(slider->x + 2),
+            (float)(slider->y + (slider->height / 2)),
+            (float)(slider->width - 4),
+            (float)(1)};
+    }
 
-    S32 width = ui_slider_width(slider);
-    S32 height = ui_slider_height(slider, font_state.char_height);
+    S32 width = slider->width;
+    S32 height = slider->height;
 
     // Outline
-    SDL_FRect outline_rect = {
-        (float)(slider->x),
-        (float)(slider->y),
-        (float)(width),
-        (float)(height)};
     SDL_SetRenderDrawColor(renderer,
                            ui->outline_color.red,
                            ui->outline_color.green,
                            ui->outline_color.blue,
                            ui->outline_color.alpha);
-    SDL_RenderFillRect(renderer, &outline_rect);
+    SDL_RenderFillRect(renderer, &slider->outline_rect);
 
     // TODO: Compress this logic.
     bool mouse_is_over = mouse_state->x >= slider->x &&
@@ -154,30 +208,20 @@ void ui_slider(UserInterface* ui,
     }
 
     // Background
-    SDL_FRect background_rect = {
-        (float)(outline_rect.x + UI_SLIDER_OUTLINE_SIZE),
-        (float)(outline_rect.y + UI_SLIDER_OUTLINE_SIZE),
-        (float)(outline_rect.w - (2 * UI_SLIDER_OUTLINE_SIZE)),
-        (float)(outline_rect.h - (2 * UI_SLIDER_OUTLINE_SIZE))};
     SDL_SetRenderDrawColor(renderer,
                            active_background_color.red,
                            active_background_color.green,
                            active_background_color.blue,
                            active_background_color.alpha);
-    SDL_RenderFillRect(renderer, &background_rect);
+    SDL_RenderFillRect(renderer, &slider->background_rect);
 
     // Line
-    SDL_FRect line_rect = {
-        (float)(slider->x + 2),
-        (float)(slider->y + (height / 2)),
-        (float)(width - 4),
-        (float)(1)};
     SDL_SetRenderDrawColor(renderer,
                            ui->outline_color.red,
                            ui->outline_color.green,
                            ui->outline_color.blue,
                            ui->outline_color.alpha);
-    SDL_RenderFillRect(renderer, &line_rect);
+    SDL_RenderFillRect(renderer, &slider->line_rect);
 
     if (!mouse_state->prev_left_clicked && mouse_state->left_clicked && mouse_is_over) {
         slider->active = true;
@@ -225,17 +269,23 @@ void ui_dropdown(UserInterface* ui,
                  UIDropDown* drop_down,
                  char** options,
                  S32 option_count,
+                 U32 options_generation,
                  S32* selected) {
     assert(*selected >= 0 && *selected < option_count);
 
-    PF_FontState font_state = PF_GetState(ui->font);
-
-    S32 font_height = (S32)(font_state.char_height * font_state.scale);
+    UILayoutKey layout_key = _ui_layout_key(ui, drop_down->x, drop_down->y, options_generation, option_count);
+    if (!_ui_layout_is_current(&drop_down->layout_key, layout_key)) {
+        drop_down->font_height = (S32)(layout_key.char_height * layout_key.scale);
+        drop_down->width = ui_dropdown_width((const char**)(options),
+                                             option_count,
+                                             (S32)(layout_key.char_width * layout_key.scale),
+                                             layout_key.letter_spacing);
+        drop_down->option_x = 2 * (layout_key.char_width + layout_key.letter_spacing) +
+                              drop_down->x + UI_DROPDOWN_H_PADDING;
+    }
 
-    S32 width = ui_dropdown_width(options,
-                                  option_count,
-                                  (S32)(font_state.char_width * font_state.scale),
-                                  font_state.letter_spacing);
+    S32 font_height = drop_down->font_height;
+    S32 width = drop_down->width;
     S32 height = ui_dropdown_height(drop_down, option_count, font_height);
 
     // Outline
@@ -335,11 +385,25 @@ void ui_dropdown(UserInterface* ui,
                         drop_down->y + UI_DROPDOWN_V_PADDING,
                         "-");
 
-        // Draw all the text options.
-        for (S32 i = 0; i < option_count; i++) {
+        // Draw the text options, only the ones that land on screen, there can be a lot of them.
+        S32 first_option = 0;
+        S32 last_option = option_count - 1;
+        int output_width = 0;
+        int output_height = 0;
+        if (font_height > 0 && SDL_GetCurrentRenderOutputSize(renderer, &output_width, &output_height)) {
+            S32 options_y = drop_down->y + UI_DROPDOWN_V_PADDING;
+            if (options_y < 0) {
+                first_option = -options_y / font_height;
+            }
+            S32 last_visible = (output_height - options_y) / font_height;
+            if (last_visible < last_option) {
+                last_option = last_visible;
+            }
+        }
+        for (S32 i = first_option; i <= last_option; i++) {
             PF_RenderString(
                 ui->font,
-                2 * (font_state.char_width + font_state.letter_spacing) + drop_down->x + UI_DROPDOWN_H_PADDING,
+                drop_down->option_x,
                 drop_down->y + UI_DROPDOWN_V_PADDING + (i * font_height),
                 options[i]);
         }
@@ -347,7 +411,7 @@ void ui_dropdown(UserInterface* ui,
         // Draw the selected text.
         PF_RenderString(
             ui->font,
-            2 * (font_state.char_width + font_state.letter_spacing) + drop_down->x + UI_DROPDOWN_H_PADDING,
+            drop_down->option_x,
             drop_down->y + UI_DROPDOWN_V_PADDING,
             options[*selected]);
 
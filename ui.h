@@ -21,6 +21,21 @@ typedef struct {
     float y;
 } UIMouseState;
 
+// What a widget's layout was last measured with. Widgets keep their layout between frames and only
+// measure it again when one of these changes.
+typedef struct {
+    bool valid;
+    S32 x;
+    S32 y;
+    S32 char_width;
+    S32 char_height;
+    S32 letter_spacing;
+    float scale;
+    // Whatever else the layout depends on: the options for drop downs, the track width for sliders.
+    U32 content_generation;
+    S32 content_size;
+} UILayoutKey;
+
 #define UI_CHECKBOX_SIZE 20
 #define UI_CHECKBOX_OUTLINE_SIZE 2
 #define UI_CHECKBOX_FILL_GAP 5
@@ -28,6 +43,12 @@ typedef struct {
 typedef struct {
     S32 x;
     S32 y;
+
+    // Cached layout.
+    UILayoutKey layout_key;
+    SDL_FRect outline_rect;
+    SDL_FRect background_rect;
+    SDL_FRect checked_rect;
 } UICheckBox;
 
 #define UI_SLIDER_OUTLINE_SIZE 2
@@ -42,6 +63,14 @@ typedef struct  {
     S32 min;
     S32 max;
     bool active;
+
+    // Cached layout.
+    UILayoutKey layout_key;
+    S32 width;
+    S32 height;
+    SDL_FRect outline_rect;
+    SDL_FRect background_rect;
+    SDL_FRect line_rect;
 } UISlider;
 
 S32 ui_slider_width(UISlider* slider);
@@ -55,6 +84,12 @@ typedef struct {
     S32 y;
 
     bool dropped;
+
+    // Cached layout, measuring the width means looking at every option.
+    UILayoutKey layout_key;
+    S32 width;
+    S32 font_height;
+    S32 option_x;
 } UIDropDown;
 
 S32 ui_dropdown_width(const char** options,
@@ -90,10 +125,13 @@ void ui_slider(UserInterface* ui,
                UIMouseState* mouse_state,
                UISlider* slider,
                S32* value);
+// options_generation has to change whenever the options do, it's how the drop down knows to measure
+// them again.
 void ui_dropdown(UserInterface* ui,
                  SDL_Renderer* renderer,
                  UIMouseState* mouse_state,
                  UIDropDown* drop_down,
                  char** options,
                  S32 option_count,
+                 U32 options_generation,
                  S32* selected);
@@ -0,0 +1,200 @@
+#include "zone.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#if defined(PLATFORM_WINDOWS)
+#include <windows.h>
+#define ZONE_THREAD_LOCAL __declspec(thread)
+typedef volatile LONG ZoneAtomic;
+#else
+#define ZONE_THREAD_LOCAL _Thread_local
+typedef U32 ZoneAtomic;
+#endif
+
+typedef struct {
+    const char* name;
+    U64 start_ns;
+    U64 duration_ns;
+} ZoneEvent;
+
+typedef struct {
+    ZoneEvent events[ZONE_RING_CAPACITY];
+    ZoneAtomic event_count; // Every event ever recorded, the ring index is this modulo capacity.
+    const char* open_names[ZONE_MAX_DEPTH];
+    U64 open_start_ns[ZONE_MAX_DEPTH];
+    S32 depth; // Can go past ZONE_MAX_DEPTH, zones that deep just aren't recorded.
+} ZoneThread;
+
+bool zone_enabled;
+
+static ZoneThread* zone_threads[ZONE_MAX_THREADS];
+static ZoneAtomic zone_thread_count;
+static U64 zone_start_ns;
+
+// NULL until this thread's first zone, and stays NULL if every slot was already taken.
+static ZONE_THREAD_LOCAL ZoneThread* zone_thread;
+static ZONE_THREAD_LOCAL bool zone_thread_registered;
+
+#if defined(PLATFORM_WINDOWS)
+static LARGE_INTEGER zone_counter_frequency;
+
+static U64 _zone_now_ns(void) {
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    // Split up to avoid overflowing, the frequency is usually 10MHz.
+    U64 seconds = (U64)(counter.QuadPart / zone_counter_frequency.QuadPart);
+    U64 remainder = (U64)(counter.QuadPart % zone_counter_frequency.QuadPart);
+    return seconds * 1000000000ULL + (remainder * 1000000000ULL) / (U64)(zone_counter_frequency.QuadPart);
+}
+
+static U32 _zone_atomic_load(ZoneAtomic* atomic) {
+    return (U32)InterlockedCompareExchange(atomic, 0, 0);
+}
+
+static void _zone_atomic_store(ZoneAtomic* atomic, U32 value) {
+    InterlockedExchange(atomic, (LONG)value);
+}
+
+// Returns the value from before the increment.
+static U32 _zone_atomic_increment(ZoneAtomic* atomic) {
+    return (U32)InterlockedIncrement(atomic) - 1;
+}
+#else
+static U64 _zone_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (U64)ts.tv_sec * 1000000000ULL + (U64)ts.tv_nsec;
+}
+
+static U32 _zone_atomic_load(ZoneAtomic* atomic) {
+    return __atomic_load_n(atomic, __ATOMIC_ACQUIRE);
+}
+
+static void _zone_atomic_store(ZoneAtomic* atomic, U32 value) {
+    __atomic_store_n(atomic, value, __ATOMIC_RELEASE);
+}
+
+static U32 _zone_atomic_increment(ZoneAtomic* atomic) {
+    return __atomic_fetch_add(atomic, 1, __ATOMIC_ACQ_REL);
+}
+#endif
+
+bool zone_init(void) {
+#if defined(PLATFORM_WINDOWS)
+    QueryPerformanceFrequency(&zone_counter_frequency);
+#endif
+    zone_start_ns = _zone_now_ns();
+    zone_enabled = true;
+    return true;
+}
+
+static ZoneThread* _zone_get_thread(void) {
+    if (zone_thread_registered) {
+        return zone_thread;
+    }
+    zone_thread_registered = true;
+
+    U32 slot = _zone_atomic_increment(&zone_thread_count);
+    if (slot >= ZONE_MAX_THREADS) {
+        fprintf(stderr, "More than %d threads recording zones, ignoring the rest\n", ZONE_MAX_THREADS);
+        return NULL;
+    }
+
+    zone_thread = calloc(1, sizeof(*zone_thread));
+    if (zone_thread == NULL) {
+        fprintf(stderr, "Failed to allocate zone buffer\n");
+        return NULL;
+    }
+    zone_threads[slot] = zone_thread;
+    return zone_thread;
+}
+
+void zone_begin(const char* name) {
+    ZoneThread* thread = _zone_get_thread();
+    if (thread == NULL) {
+        return;
+    }
+
+    if (thread->depth < ZONE_MAX_DEPTH) {
+        thread->open_names[thread->depth] = name;
+        thread->open_start_ns[thread->depth] = _zone_now_ns();
+    }
+    thread->depth++;
+}
+
+void zone_end(void) {
+    ZoneThread* thread = zone_thread;
+    if (thread == NULL || thread->depth == 0) {
+        return;
+    }
+
+    thread->depth--;
+    if (thread->depth >= ZONE_MAX_DEPTH) {
+        return;
+    }
+
+    // Zones are recorded whole once they end, so a ring that has wrapped never leaves a begin
+    // without its end.
+    U32 count = _zone_atomic_load(&thread->event_count);
+    ZoneEvent* event = thread->events + (count & (ZONE_RING_CAPACITY - 1));
+    event->name = thread->open_names[thread->depth];
+    event->start_ns = thread->open_start_ns[thread->depth];
+    event->duration_ns = _zone_now_ns() - event->start_ns;
+    _zone_atomic_store(&thread->event_count, count + 1);
+}
+
+bool zone_write(const char* path) {
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Failed to open %s for writing zones\n", path);
+        return false;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    U32 thread_count = _zone_atomic_load(&zone_thread_count);
+    if (thread_count > ZONE_MAX_THREADS) {
+        thread_count = ZONE_MAX_THREADS;
+    }
+    for (U32 t = 0; t < thread_count; t++) {
+        ZoneThread* thread = zone_threads[t];
+        if (thread == NULL) {
+            continue;
+        }
+
+        U32 count = _zone_atomic_load(&thread->event_count);
+        U32 oldest = (count > ZONE_RING_CAPACITY) ? count - ZONE_RING_CAPACITY : 0;
+        for (U32 i = oldest; i != count; i++) {
+            const ZoneEvent* event = thread->events + (i & (ZONE_RING_CAPACITY - 1));
+            // Names are expected to be literals that don't need escaping.
+            fprintf(file,
+                    "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                    first ? "" : ",\n",
+                    event->name,
+                    t + 1,
+                    (double)(event->start_ns - zone_start_ns) / 1000.0,
+                    (double)(event->duration_ns) / 1000.0);
+            first = false;
+        }
+    }
+    fprintf(file, "\n]}\n");
+
+    bool success = ferror(file) == 0;
+    fclose(file);
+    if (!success) {
+        fprintf(stderr, "Failed to write zones to %s\n", path);
+    }
+    return success;
+}
+
+void zone_shutdown(void) {
+    zone_enabled = false;
+    for (S32 t = 0; t < ZONE_MAX_THREADS; t++) {
+        free(zone_threads[t]);
+        zone_threads[t] = NULL;
+    }
+    zone_thread_count = 0;
+    zone_thread = NULL;
+}
@@ -0,0 +1,40 @@
+#ifndef zone_h
+#define zone_h
+
+#include <stdbool.h>
+
+#include "ints.h"
+
+// Zones time named spans of the frame, nested inside each other, to view as a Chrome trace in
+// chrome://tracing or ui.perfetto.dev.
+//
+// Each thread records into its own ring buffer of the last ZONE_RING_CAPACITY zones it finished,
+// about half a minute of frames, so writing the trace straight after a hitch catches it.
+
+#define ZONE_RING_CAPACITY (1 << 16) // Must be a power of 2.
+#define ZONE_MAX_DEPTH 32
+#define ZONE_MAX_THREADS 8
+
+// Only set by zone_init(), so when tracing is off each zone costs a branch on this.
+extern bool zone_enabled;
+
+bool zone_init(void);
+// name must live until the trace is written, in practice always a string literal.
+void zone_begin(const char* name);
+void zone_end(void);
+// Writes every thread's zones as Chrome trace JSON. Other threads can keep recording while this
+// runs, though their oldest zones may be overwritten as they are written out.
+bool zone_write(const char* path);
+// Frees every thread's buffer, only once no other thread will record zones.
+void zone_shutdown(void);
+
+// Build with ZONES_DISABLED to compile zones out entirely.
+#if defined(ZONES_DISABLED)
+#define ZONE_BEGIN(name)
+#define ZONE_END()
+#else
+#define ZONE_BEGIN(name) do { if (zone_enabled) zone_begin(name); } while (0)
+#define ZONE_END() do { if (zone_enabled) zone_end(); } while (0)
+#endif
+
+#endif /* zone_h */